@@ -15,3 +15,7 @@
 #include "esp_agent_events.h"
 #include "esp_agent_tools.h"
 #include "esp_agent_messages.h"
+#include "esp_agent_usage.h"
+#include "esp_agent_capture.h"
+#include "esp_agent_bench.h"
+#include "esp_agent_soak.h"
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief ESP Agent message microbenchmarks
+ *
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Run the agent message microbenchmarks.
+ *
+ * Times message parsing and dispatch (esp_agent_messages_parse_process) over a corpus of realistic
+ * server messages, and each outgoing message builder, on a private agent handle that is never
+ * connected. Results are printed to stdout as one JSON object per line:
+ *
+ *     {"suite":"esp_agent","bench":"parse.tool_request_16_params","iterations":500,"bytes":912,
+ *      "ns_per_msg":84210,"allocs_per_msg":71.00,"frees_per_msg":71.00,"peak_heap_bytes":6144}
+ *
+ * `allocs_per_msg` and `frees_per_msg` count the heap allocations and frees made by the benchmark task,
+ * cJSON trees and serialized strings included. `peak_heap_bytes` is the highest heap usage above the
+ * baseline while processing one message. They are taken with the heap hooks on a device, and a malloc
+ * wrapper on the host, so allocations of other tasks running at the same time are not counted.
+ *
+ * The benchmark runs in its own low priority task, so that the event loop and tool tasks spawned by
+ * dispatch run as soon as they are ready. Requires CONFIG_ESP_AGENT_BENCH.
+ *
+ * @param[in] iterations Iterations per benchmark, 0 for CONFIG_ESP_AGENT_BENCH_ITERATIONS
+ * @param[in] filter Only run benchmarks whose name contains this string (NULL for all)
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if benchmarks are disabled, error code otherwise
+ */
+esp_err_t esp_agent_bench_run(uint32_t iterations, const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file
+ * @brief ESP Agent session capture and replay API
+ *
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include "esp_agent_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Capture log format (little endian):
+ *
+ *     esp_agent_capture_header_t
+ *     esp_agent_capture_record_t, followed by `len` bytes of payload
+ *     esp_agent_capture_record_t, followed by `len` bytes of payload
+ *     ...
+ *
+ * Records are in the order they were captured. Once the capture buffer is full, the oldest
+ * records are overwritten.
+ */
+#define ESP_AGENT_CAPTURE_MAGIC     0x50434145  /* "EACP" */
+#define ESP_AGENT_CAPTURE_VERSION   1
+
+typedef enum {
+    ESP_AGENT_CAPTURE_DIR_RX = 0,   /**< WebSocket frame received from the server */
+    ESP_AGENT_CAPTURE_DIR_TX,       /**< WebSocket frame sent to the server */
+    ESP_AGENT_CAPTURE_DIR_EVENT,    /**< WebSocket client event, `op_code` holds the event ID */
+} esp_agent_capture_dir_t;
+
+#define ESP_AGENT_CAPTURE_FLAG_FIN      (1 << 0)    /**< Last frame of the message */
+#define ESP_AGENT_CAPTURE_FLAG_ERROR    (1 << 1)    /**< Frame could not be sent */
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             /**< ESP_AGENT_CAPTURE_MAGIC */
+    uint16_t version;           /**< ESP_AGENT_CAPTURE_VERSION */
+    uint16_t header_size;       /**< sizeof(esp_agent_capture_header_t) */
+    uint32_t records;           /**< Number of records in the log */
+    uint32_t dropped;           /**< Records overwritten or too large for the capture buffer */
+} esp_agent_capture_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp_us;      /**< Monotonic time since the capture started (wraps after ~71 minutes) */
+    uint32_t len;               /**< Payload length */
+    uint8_t direction;          /**< esp_agent_capture_dir_t */
+    uint8_t op_code;            /**< WebSocket opcode */
+    uint8_t flags;              /**< ESP_AGENT_CAPTURE_FLAG_* */
+    uint8_t reserved;
+} esp_agent_capture_record_t;
+
+/**
+ * @brief Start capturing the WebSocket traffic of the agent.
+ *
+ * Any previous capture is discarded. The capture buffer is allocated from PSRAM when available.
+ * Requires CONFIG_ESP_AGENT_CAPTURE.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @param[in] buffer_size Capture buffer size in bytes, 0 for CONFIG_ESP_AGENT_CAPTURE_BUFFER_SIZE
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if capture is disabled, error code otherwise
+ */
+esp_err_t esp_agent_capture_start(esp_agent_handle_t handle, size_t buffer_size);
+
+/**
+ * @brief Stop capturing. The captured log is kept until the next start or deinit.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t esp_agent_capture_stop(esp_agent_handle_t handle);
+
+/**
+ * @brief Get a copy of the captured log.
+ *
+ * The capture can keep running while the copy is taken.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @param[out] log Allocated log, to be freed by the caller
+ * @param[out] len Length of the log
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if nothing was captured, error code otherwise
+ */
+esp_err_t esp_agent_capture_get(esp_agent_handle_t handle, uint8_t **log, size_t *len);
+
+/**
+ * @brief Replay the received frames of a captured log into the agent.
+ *
+ * Frames are fed to the WebSocket event handler as if they were received from the server, so the
+ * same parsing, dispatch and playback paths run. Sent frames and client events are skipped.
+ * Blocks until the whole log is replayed, waiting for the message queue to drain rather than
+ * dropping messages. Capture must not be running.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @param[in] log Captured log
+ * @param[in] len Length of the log
+ * @param[in] speed_percent Replay speed: 100 for the original timing, 200 for twice as fast, 0 for no delays
+ * @return ESP_OK on success, ESP_FAIL if messages were still dropped, error code otherwise
+ */
+esp_err_t esp_agent_capture_replay(esp_agent_handle_t handle, const uint8_t *log, size_t len, uint32_t speed_percent);
+
+#ifdef __cplusplus
+}
+#endif
@@ -40,11 +40,13 @@ typedef enum {
 
 /**
  * @brief Audio configuration for the conversation.
+ *
+ * PCM is 16-bit mono little endian, sent in packets of any length. frame_duration only applies to Opus.
  */
 typedef struct {
     esp_agent_conversation_audio_format_t format;
-    uint16_t sample_rate;       /**< Sample rate in Hz (e.g., 8000, 16000) */
-    uint8_t frame_duration;     /**< Frame duration in ms (e.g., 20, 40, 60) */
+    uint16_t sample_rate;       /**< Sample rate in Hz (8000, 16000 or 24000) */
+    uint8_t frame_duration;     /**< Frame duration in ms (10, 20, 40 or 60) */
 } esp_agent_audio_config_t;
 
 /**
@@ -120,6 +122,19 @@ esp_err_t esp_agent_set_agent_id(esp_agent_handle_t handle, const char *agent_id
  */
 esp_err_t esp_agent_set_refresh_token(esp_agent_handle_t handle, const char *refresh_token);
 
+/**
+ * @brief Gets the audio configuration of the conversation.
+ *
+ * This is the configuration passed to esp_agent_init. A server selecting a different one in its
+ * handshake acknowledgement fails the session with ESP_AGENT_AUDIO_CONFIG_ERROR instead of a start.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @param[out] upload Upload (device to server) audio configuration, can be NULL
+ * @param[out] download Download (server to device) audio configuration, can be NULL
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t esp_agent_get_audio_config(esp_agent_handle_t handle, esp_agent_audio_config_t *upload, esp_agent_audio_config_t *download);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,7 @@
 #include <esp_event.h>
 
 #include "esp_agent_core.h"
+#include "esp_agent_usage.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,9 @@ typedef enum {
 
     ESP_AGENT_EVENT_SPEECH_START,
     ESP_AGENT_EVENT_SPEECH_END,
+    ESP_AGENT_EVENT_BARGE_IN,           /* The server detected the user interrupting the assistant */
+
+    ESP_AGENT_EVENT_USAGE,
 
     ESP_AGENT_EVENT_DATA_TYPE_TEXT,
     ESP_AGENT_EVENT_DATA_TYPE_THINKING,
@@ -48,6 +52,7 @@ typedef enum {
  */
 typedef enum {
     ESP_AGENT_AUDIO_CONVERSATION_ERROR,
+    ESP_AGENT_AUDIO_CONFIG_ERROR,
     ESP_AGENT_ERROR_MAX,
 } esp_agent_error_t;
 
@@ -95,6 +100,9 @@ typedef union {
     struct {
         esp_agent_error_t error;
     } error;
+
+    /* Posted on `transaction_end`, conversation totals are available through esp_agent_get_usage_stats() */
+    esp_agent_usage_info_t usage;
 } esp_agent_message_data_t;
 
 /**
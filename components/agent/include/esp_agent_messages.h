@@ -36,6 +36,17 @@ esp_err_t esp_agent_speech_conversation_start(esp_agent_handle_t handle);
  */
 esp_err_t esp_agent_speech_conversation_end(esp_agent_handle_t handle);
 
+/**
+ * @brief This tells the server the user interrupted the assistant's speech.
+ *
+ * The server stops the current response. Audio of that response still in flight is
+ * received as usual and should be dropped by the application.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t esp_agent_speech_barge_in(esp_agent_handle_t handle);
+
 /**
  * @brief This sends the speech data to the server
  *
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @brief ESP Agent soak harness
+ *
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include "esp_agent_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Read the next speech frame to upload.
+ *
+ * @param[in] user_data User data from the soak configuration
+ * @param[out] buf Buffer for the frame
+ * @param[in] buf_size Size of the buffer
+ * @param[out] len Length of the frame
+ * @return ESP_OK on success, error code to abort the soak
+ */
+typedef esp_err_t (*esp_agent_soak_read_frame_t)(void *user_data, uint8_t *buf, size_t buf_size, size_t *len);
+
+typedef struct {
+    esp_agent_handle_t handle;              /**< Agent to drive, must be a speech conversation */
+    uint32_t turns;                         /**< Number of turns to run */
+    uint32_t frames_per_turn;               /**< Speech frames uploaded per speech turn */
+    uint32_t frame_interval_ms;             /**< Delay between speech frames, 0 to send as fast as possible */
+    uint32_t text_every;                    /**< Every Nth turn is a text turn, 0 for none */
+    uint32_t tool_every;                    /**< Every Nth turn asks the stand-in server to call tool_name, 0 for none */
+    const char *tool_name;                  /**< Local tool called on tool turns */
+    uint32_t sample_every;                  /**< Sample the heap every N turns */
+    uint32_t turn_timeout_ms;               /**< Time to wait for the end of a turn */
+    esp_agent_soak_read_frame_t read_frame; /**< Speech frame source, NULL for Opus silence frames */
+    void *user_data;                        /**< User data for read_frame */
+} esp_agent_soak_config_t;
+
+#define ESP_AGENT_SOAK_DEFAULT_CONFIG() { \
+    .handle = NULL,                 \
+    .turns = 1000,                  \
+    .frames_per_turn = 25,          \
+    .frame_interval_ms = 60,        \
+    .text_every = 3,                \
+    .tool_every = 5,                \
+    .tool_name = NULL,              \
+    .sample_every = 20,             \
+    .turn_timeout_ms = 10000,       \
+    .read_frame = NULL,             \
+    .user_data = NULL,              \
+}
+
+/**
+ * @brief Run a soak test against a stand-in server (see tools/agent_stub_server).
+ *
+ * Drives the configured number of turns through the agent: speech turns (upload, echoed speech
+ * download), text turns and tool call turns, reconnecting whenever the server drops the connection.
+ * The heap is sampled every `sample_every` turns and printed as a JSON line:
+ *
+ *     {"soak":"sample","turn":200,"elapsed_ms":361250,"heap_used":...,"internal_free":...,
+ *      "internal_largest":...,"internal_frag":0.183,...}
+ *
+ * and a final report line holds the leak rate (least squares slope of the used heap) and the
+ * fragmentation index (1 - largest free block / free size) at the start and end of the run.
+ * Blocks until the run completes or esp_agent_soak_stop() is called. Requires CONFIG_ESP_AGENT_SOAK.
+ *
+ * @param[in] config Soak configuration
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the soak harness is disabled, error code otherwise
+ */
+esp_err_t esp_agent_soak_run(const esp_agent_soak_config_t *config);
+
+/**
+ * @brief Ask a running soak to stop after the current turn.
+ */
+void esp_agent_soak_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
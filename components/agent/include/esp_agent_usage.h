@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief ESP Agent usage telemetry API
+ *
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include "esp_agent_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Server-side usage of a single transaction (one conversation turn).
+ *
+ * Built from the `usage_info`, `tool_call_info` and `tool_result_info` messages,
+ * and closed by `transaction_end`.
+ */
+typedef struct {
+    uint32_t input_tokens;          /**< Input tokens reported by the server */
+    uint32_t output_tokens;         /**< Output tokens reported by the server */
+    uint32_t tool_calls;            /**< Number of server tool calls */
+    uint32_t tool_latency_ms;       /**< Sum of server tool latencies */
+    uint32_t duration_ms;           /**< Time from the first message of the turn to `transaction_end` */
+} esp_agent_usage_info_t;
+
+/**
+ * @brief Usage aggregated over the current conversation.
+ *
+ * Reset whenever the server acknowledges a different conversation ID.
+ */
+typedef struct {
+    uint32_t transactions;              /**< Number of completed transactions */
+    uint64_t input_tokens;              /**< Total input tokens */
+    uint64_t output_tokens;             /**< Total output tokens */
+    uint32_t tool_calls;                /**< Total server tool calls */
+    uint64_t tool_latency_total_ms;     /**< Sum of server tool latencies */
+    uint32_t tool_latency_max_ms;       /**< Slowest server tool call */
+    uint64_t transaction_total_ms;      /**< Sum of transaction durations */
+    uint32_t transaction_max_ms;        /**< Longest transaction */
+} esp_agent_usage_stats_t;
+
+/**
+ * @brief Get the usage aggregated over the current conversation.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @param[out] stats Pointer to the structure to fill
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t esp_agent_get_usage_stats(esp_agent_handle_t handle, esp_agent_usage_stats_t *stats);
+
+/**
+ * @brief Reset the usage aggregated over the current conversation.
+ *
+ * @param[in] handle Agent handle obtained from esp_agent_init
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t esp_agent_reset_usage_stats(esp_agent_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
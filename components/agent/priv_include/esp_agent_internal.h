@@ -11,13 +11,28 @@
 #include <esp_timer.h>
 #include <freertos/event_groups.h>
 
+#include <esp_agent_internal_usage.h>
+#include <esp_agent_internal_capture.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 ESP_EVENT_DECLARE_BASE(AGENT_EVENT);
 
+#ifdef CONFIG_ESP_AGENT_API_USE_TLS
 #define ESP_AGENT_API_USE_TLS 1
+#else
+#define ESP_AGENT_API_USE_TLS 0
+#endif
+
+/* The certificate bundle is not available on the linux target */
+#if ESP_AGENT_API_USE_TLS && !CONFIG_IDF_TARGET_LINUX
+#include <esp_crt_bundle.h>
+#define ESP_AGENT_CRT_BUNDLE_ATTACH esp_crt_bundle_attach
+#else
+#define ESP_AGENT_CRT_BUNDLE_ATTACH NULL
+#endif
 
 /* Event group bits for task stop signals */
 #define MESSAGE_TASK_STOP_BIT BIT0
@@ -54,11 +69,14 @@ typedef struct {
     esp_event_loop_handle_t event_loop;
     esp_websocket_client_handle_t ws_client;
     QueueHandle_t message_queue;
+    uint32_t messages_dropped;                    /* Received messages lost to a full queue or event loop */
     TaskHandle_t message_task_handle;
     QueueHandle_t send_queue;
     TaskHandle_t send_task_handle;
     EventGroupHandle_t event_group;               /* Event group for task stop signals */
     local_tool_node_t *local_tools;               /* Head of linked list of registered local tools */
+    esp_agent_usage_t usage;                      /* Server-side usage telemetry */
+    esp_agent_capture_t capture;                  /* WebSocket traffic capture */
 } esp_agent_t;
 
 /* This function will strip the https:// prefix from the menuconfig URL */
@@ -0,0 +1,61 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <esp_agent_capture.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Capture state, embedded in the agent handle. The buffer is a byte ring of records. */
+typedef struct {
+    volatile bool enabled;
+    SemaphoreHandle_t lock;
+    uint8_t *buf;
+    size_t capacity;
+    size_t head;                /* Offset of the oldest record */
+    size_t used;
+    uint32_t records;
+    uint32_t dropped;
+    int64_t start_us;
+} esp_agent_capture_t;
+
+#if CONFIG_ESP_AGENT_CAPTURE
+/**
+ * @brief Append a record to the capture, if capture is running
+ *
+ * @param capture Capture state
+ * @param direction esp_agent_capture_dir_t
+ * @param op_code WebSocket opcode, or event ID for ESP_AGENT_CAPTURE_DIR_EVENT
+ * @param flags ESP_AGENT_CAPTURE_FLAG_*
+ * @param data Payload (may be NULL if len is 0)
+ * @param len Payload length
+ */
+void esp_agent_capture_record(esp_agent_capture_t *capture, uint8_t direction, uint8_t op_code, uint8_t flags, const void *data, size_t len);
+
+/**
+ * @brief Free the capture buffer
+ *
+ * @param capture Capture state
+ */
+void esp_agent_capture_deinit(esp_agent_capture_t *capture);
+#else
+static inline void esp_agent_capture_record(esp_agent_capture_t *capture, uint8_t direction, uint8_t op_code, uint8_t flags, const void *data, size_t len) {}
+static inline void esp_agent_capture_deinit(esp_agent_capture_t *capture) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include <esp_agent_usage.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Server tool calls that may be in flight at the same time */
+#define ESP_AGENT_USAGE_MAX_PENDING_TOOLS 4
+
+typedef struct {
+    uint32_t id_hash;
+    int64_t start_us;
+} esp_agent_usage_pending_tool_t;
+
+/* Usage telemetry state, embedded in the agent handle */
+typedef struct {
+    portMUX_TYPE lock;
+    bool in_transaction;
+    int64_t transaction_start_us;
+    esp_agent_usage_info_t current;
+    esp_agent_usage_pending_tool_t pending_tools[ESP_AGENT_USAGE_MAX_PENDING_TOOLS];
+    esp_agent_usage_stats_t stats;
+} esp_agent_usage_t;
+
+/**
+ * @brief Initialize the usage telemetry state
+ *
+ * @param usage Usage state
+ */
+void esp_agent_usage_init(esp_agent_usage_t *usage);
+
+/**
+ * @brief Clear the current transaction and the aggregated statistics
+ *
+ * @param usage Usage state
+ */
+void esp_agent_usage_reset(esp_agent_usage_t *usage);
+
+/**
+ * @brief Mark the beginning of a transaction, if one is not already in progress
+ *
+ * @param usage Usage state
+ */
+void esp_agent_usage_transaction_begin(esp_agent_usage_t *usage);
+
+/**
+ * @brief Account the token usage reported by the server
+ *
+ * @param usage Usage state
+ * @param input_tokens Input tokens
+ * @param output_tokens Output tokens
+ */
+void esp_agent_usage_add_tokens(esp_agent_usage_t *usage, uint32_t input_tokens, uint32_t output_tokens);
+
+/**
+ * @brief Record the start of a server tool call
+ *
+ * @param usage Usage state
+ * @param id Tool call ID (may be NULL)
+ */
+void esp_agent_usage_tool_call(esp_agent_usage_t *usage, const char *id);
+
+/**
+ * @brief Record the result of a server tool call
+ *
+ * @param usage Usage state
+ * @param id Tool call ID (may be NULL)
+ * @param reported_latency_ms Latency reported by the server, or -1 to use the local measurement
+ */
+void esp_agent_usage_tool_result(esp_agent_usage_t *usage, const char *id, int32_t reported_latency_ms);
+
+/**
+ * @brief Close the current transaction and fold it into the aggregated statistics
+ *
+ * @param usage Usage state
+ * @param[out] info Usage of the closed transaction
+ */
+void esp_agent_usage_transaction_end(esp_agent_usage_t *usage, esp_agent_usage_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,7 +17,6 @@
 #include <esp_log.h>
 #include <esp_event.h>
 #include <esp_check.h>
-#include <esp_crt_bundle.h>
 
 #include <esp_agent.h>
 #include <esp_agent_internal.h>
@@ -100,14 +99,18 @@ esp_agent_handle_t esp_agent_init(const esp_agent_config_t *config)
         goto err;
     }
 
-    agent->upload_audio_config = *config->upload_audio_config;
-    agent->download_audio_config = *config->download_audio_config;
+    if (config->upload_audio_config) {
+        agent->upload_audio_config = *config->upload_audio_config;
+    }
+    if (config->download_audio_config) {
+        agent->download_audio_config = *config->download_audio_config;
+    }
 
     // Configure websocket client
     esp_websocket_client_config_t ws_cfg = {
         .buffer_size = 8*1024,
         .network_timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+        .crt_bundle_attach = ESP_AGENT_CRT_BUNDLE_ATTACH,
         .disable_auto_reconnect = true,
     };
 
@@ -156,6 +159,8 @@ esp_agent_handle_t esp_agent_init(const esp_agent_config_t *config)
     // Initialize local tools list
     agent->local_tools = NULL;
 
+    esp_agent_usage_init(&agent->usage);
+
     // Create event group for task stop signals
     agent->event_group = xEventGroupCreate();
     if (agent->event_group == NULL) {
@@ -242,6 +247,8 @@ void esp_agent_deinit(esp_agent_handle_t handle)
         esp_websocket_client_destroy(agent->ws_client);
     }
 
+    esp_agent_capture_deinit(&agent->capture);
+
     if (agent->message_queue) {
         /* Purge any remaining messages in received messages queue */
         char *message = NULL;
@@ -389,3 +396,19 @@ char *esp_agents_get_api_endpoint(void)
 
     return ESP_AGENT_API_ENDPOINT;
 }
+
+esp_err_t esp_agent_get_audio_config(esp_agent_handle_t handle, esp_agent_audio_config_t *upload, esp_agent_audio_config_t *download)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    if (upload) {
+        *upload = agent->upload_audio_config;
+    }
+    if (download) {
+        *download = agent->download_audio_config;
+    }
+    return ESP_OK;
+}
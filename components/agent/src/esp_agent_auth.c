@@ -9,7 +9,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include <esp_crt_bundle.h>
 #include <esp_http_client.h>
 
 #include <esp_agent_auth.h>
@@ -85,7 +84,7 @@ esp_err_t esp_agent_auth_get_access_token(const char *refresh_token, char **acce
         .url = refresh_url,
         .method = HTTP_METHOD_POST,
         .timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+        .crt_bundle_attach = ESP_AGENT_CRT_BUNDLE_ATTACH,
         .buffer_size = 3072,
     };
 
@@ -0,0 +1,572 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <cJSON.h>
+
+#include <esp_log.h>
+#include <esp_check.h>
+#include <esp_timer.h>
+
+#include <esp_agent.h>
+#include <esp_agent_bench.h>
+
+static const char *TAG = "esp_agent_bench";
+
+#if CONFIG_ESP_AGENT_BENCH
+
+#include <esp_idf_version.h>
+#include <esp_agent_internal.h>
+#include <esp_agent_internal_messages.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include <esp_heap_caps.h>
+#endif
+
+#define BENCH_TOOL_NAME         "bench_tool"
+#define BENCH_TASK_STACK_SIZE   6144
+#define BENCH_TASK_PRIORITY     1
+#define BENCH_SETTLE_MS         20
+
+/* Components whose logs would otherwise dominate the measurements */
+static const char *s_quiet_tags[] = {
+    "esp_agent_messages", "esp_agent_message_handlers", "esp_agent_tools", "esp_agent_ws", "esp_agent_events",
+};
+
+typedef struct {
+    const char *name;
+    const char *message;
+} bench_message_t;
+
+static const bench_message_t s_parse_corpus[] = {
+    {"handshake_ack", "{\"type\":\"handshake_ack\",\"content_type\":\"json\",\"content\":{\"conversationId\":\"6f1c2a4e-8a3b-4f0e-9d57-2b1e0c7a9d13\"}}"},
+    {"transcript_user", "{\"type\":\"user\",\"content_type\":\"text\",\"content\":\"What is the weather like in Pune today?\",\"metadata\":{\"role\":\"user\"}}"},
+    {"transcript_speculative", "{\"type\":\"assistant\",\"content_type\":\"text\",\"content\":\"It is sunny in Pune, with a high of\",\"metadata\":{\"role\":\"assistant\",\"generation_stage\":\"speculative\"}}"},
+    {"thinking", "{\"type\":\"thinking\",\"content_type\":\"text\",\"content\":\"The user wants the weather, I should call the weather tool with the city name.\"}"},
+    {"tool_request_1_param", "{\"type\":\"tool_request\",\"content_type\":\"json\",\"content\":{\"request_id\":\"req-7c1d6f0a\",\"tool_name\":\"" BENCH_TOOL_NAME "\",\"input\":{\"volume\":60}}}"},
+    {"error_json", "{\"type\":\"error\",\"content_type\":\"text\",\"content\":\"{\\\"code\\\":\\\"INTERNAL_ERROR\\\",\\\"message\\\":\\\"The model did not respond in time, please retry\\\"}\"}"},
+    {"usage_info", "{\"type\":\"usage_info\",\"content_type\":\"json\",\"content\":{\"input_tokens\":1532,\"output_tokens\":87}}"},
+    {"tool_call_info", "{\"type\":\"tool_call_info\",\"content_type\":\"json\",\"content\":{\"tool_call_id\":\"call-51e2\",\"tool_name\":\"get_weather\"}}"},
+    {"transaction_end", "{\"type\":\"transaction_end\",\"content_type\":\"json\",\"content\":{}}"},
+    {"audio_stream_start", "{\"type\":\"audio_stream_start\",\"content_type\":\"json\",\"content\":{}}"},
+    {"unknown_type", "{\"type\":\"future_message\",\"content_type\":\"json\",\"content\":{\"value\":1}}"},
+};
+
+typedef struct {
+    uint32_t iterations;
+    const char *filter;
+    esp_agent_handle_t handle;
+    TaskHandle_t caller;
+    esp_err_t result;
+} bench_ctx_t;
+
+/*
+ * Counters updated by the heap hooks for allocations made by the bench task. cJSON keeps its default
+ * allocator, replacing it would also disable the realloc() fast path of cJSON_Print*().
+ */
+static volatile bool s_counting;
+static TaskHandle_t s_bench_task;
+static uint32_t s_allocs;
+static uint32_t s_frees;
+static int32_t s_heap_used;
+static int32_t s_heap_peak;
+
+static inline bool bench_counted(void)
+{
+    return s_counting && xTaskGetCurrentTaskHandle() == s_bench_task;
+}
+
+static void bench_count_alloc(size_t size)
+{
+    s_allocs++;
+    s_heap_used += size;
+    if (s_heap_used > s_heap_peak) {
+        s_heap_peak = s_heap_used;
+    }
+}
+
+static void bench_count_free(size_t size)
+{
+    s_frees++;
+    s_heap_used -= size;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+/* Linked with -Wl,--wrap for the allocator entry points, see the component CMakeLists.txt */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    if (ptr && bench_counted()) {
+        bench_count_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *ptr = __real_calloc(n, size);
+    if (ptr && bench_counted()) {
+        bench_count_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old_size = (ptr && bench_counted()) ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr && bench_counted()) {
+        if (old_size) {
+            bench_count_free(old_size);
+        }
+        bench_count_alloc(malloc_usable_size(new_ptr));
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr && bench_counted()) {
+        bench_count_free(malloc_usable_size(ptr));
+    }
+    __real_free(ptr);
+}
+#else
+/*
+ * The free hook runs once the block is back in the heap, its size can no longer be read. The size of each
+ * live allocation of the bench task is kept in an open addressing table instead, only touched by that task.
+ */
+#define BENCH_LIVE_SLOTS        512     /* Power of two */
+
+typedef struct {
+    void *ptr;
+    size_t size;
+} bench_live_t;
+
+static bench_live_t s_live[BENCH_LIVE_SLOTS];
+static uint32_t s_live_count;
+
+static inline uint32_t bench_live_home(const void *ptr)
+{
+    return ((uintptr_t)ptr >> 3) & (BENCH_LIVE_SLOTS - 1);
+}
+
+static void bench_live_reset(void)
+{
+    memset(s_live, 0, sizeof(s_live));
+    s_live_count = 0;
+}
+
+static void bench_live_add(void *ptr, size_t size)
+{
+    /* Keep a free slot so lookups end, a block not kept is just never subtracted */
+    if (s_live_count >= BENCH_LIVE_SLOTS - 1) {
+        return;
+    }
+    uint32_t i = bench_live_home(ptr);
+    while (s_live[i].ptr) {
+        i = (i + 1) & (BENCH_LIVE_SLOTS - 1);
+    }
+    s_live[i] = (bench_live_t) { .ptr = ptr, .size = size };
+    s_live_count++;
+}
+
+/* Returns the size the block was allocated with, 0 if it was not allocated while counting */
+static size_t bench_live_remove(void *ptr)
+{
+    uint32_t i = bench_live_home(ptr);
+    while (s_live[i].ptr != ptr) {
+        if (s_live[i].ptr == NULL) {
+            return 0;
+        }
+        i = (i + 1) & (BENCH_LIVE_SLOTS - 1);
+    }
+    size_t size = s_live[i].size;
+    s_live_count--;
+
+    /* Move back the entries of the probe run that would no longer be found past the hole */
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & (BENCH_LIVE_SLOTS - 1);
+        if (s_live[j].ptr == NULL) {
+            break;
+        }
+        uint32_t home = bench_live_home(s_live[j].ptr);
+        if (((j - home) & (BENCH_LIVE_SLOTS - 1)) >= ((j - i) & (BENCH_LIVE_SLOTS - 1))) {
+            s_live[i] = s_live[j];
+            i = j;
+        }
+    }
+    s_live[i].ptr = NULL;
+    return size;
+}
+
+/* Called by the heap component for every allocation, CONFIG_HEAP_USE_HOOKS is selected by CONFIG_ESP_AGENT_BENCH */
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (bench_counted()) {
+        /* A realloc in place reports the same block again */
+        s_heap_used -= bench_live_remove(ptr);
+        size_t allocated = heap_caps_get_allocated_size(ptr);
+        bench_live_add(ptr, allocated);
+        bench_count_alloc(allocated);
+    }
+}
+
+void esp_heap_trace_free_hook(void *ptr)
+{
+    if (bench_counted()) {
+        bench_count_free(bench_live_remove(ptr));
+    }
+}
+#endif
+
+static void bench_count_start(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    bench_live_reset();
+#endif
+    s_allocs = 0;
+    s_frees = 0;
+    s_heap_used = 0;
+    s_heap_peak = 0;
+    s_counting = true;
+}
+
+static void bench_count_stop(void)
+{
+    s_counting = false;
+}
+
+static esp_err_t bench_tool_handler(esp_agent_handle_t handle, const char *tool_name, esp_agent_tool_param_t params[], size_t num_params, void *user_data, char **result)
+{
+    *result = strdup("ok");
+    return ESP_OK;
+}
+
+static bool bench_selected(const bench_ctx_t *ctx, const char *name)
+{
+    return ctx->filter == NULL || ctx->filter[0] == '\0' || strstr(name, ctx->filter) != NULL;
+}
+
+static void bench_report(const char *name, uint32_t iterations, size_t bytes, int64_t elapsed_us, uint32_t allocs, uint32_t frees, int32_t peak_heap)
+{
+    printf("{\"suite\":\"esp_agent\",\"bench\":\"%s\",\"iterations\":%" PRIu32 ",\"bytes\":%zu,"
+           "\"ns_per_msg\":%" PRId64 ",\"allocs_per_msg\":%.2f,\"frees_per_msg\":%.2f,\"peak_heap_bytes\":%" PRId32 "}\n",
+           name, iterations, bytes, elapsed_us * 1000 / iterations,
+           (double)allocs / iterations, (double)frees / iterations, peak_heap);
+}
+
+/* Let the event loop and the tool tasks spawned by dispatch finish */
+static void bench_settle(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(BENCH_SETTLE_MS));
+}
+
+static int32_t bench_parse_peak(bench_ctx_t *ctx, char *message)
+{
+    bench_settle();
+    bench_count_start();
+    esp_agent_messages_parse_process(ctx->handle, message);
+    bench_count_stop();
+    return s_heap_peak;
+}
+
+static void bench_parse(bench_ctx_t *ctx, const char *name, const char *message)
+{
+    char full_name[64];
+    snprintf(full_name, sizeof(full_name), "parse.%s", name);
+    if (!bench_selected(ctx, full_name)) {
+        return;
+    }
+
+    /* esp_agent_messages_parse_process() takes a mutable buffer, like the one from the receive queue */
+    char *buf = strdup(message);
+    if (buf == NULL) {
+        ctx->result = ESP_ERR_NO_MEM;
+        return;
+    }
+
+    /* Warm up */
+    esp_agent_messages_parse_process(ctx->handle, buf);
+    bench_settle();
+
+    bench_count_start();
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+        esp_agent_messages_parse_process(ctx->handle, buf);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    bench_count_stop();
+    uint32_t allocs = s_allocs;
+    uint32_t frees = s_frees;
+
+    bench_report(full_name, ctx->iterations, strlen(buf), elapsed_us, allocs, frees, bench_parse_peak(ctx, buf));
+    free(buf);
+}
+
+typedef enum {
+    BENCH_BUILD_HANDSHAKE,
+    BENCH_BUILD_TEXT,
+    BENCH_BUILD_TEXT_LARGE,
+    BENCH_BUILD_TOOL_RESPONSE,
+    BENCH_BUILD_SPEECH_START,
+    BENCH_BUILD_SPEECH_END,
+    BENCH_BUILD_MAX,
+} bench_builder_t;
+
+static const char *s_builder_names[BENCH_BUILD_MAX] = {
+    [BENCH_BUILD_HANDSHAKE] = "build.handshake",
+    [BENCH_BUILD_TEXT] = "build.text",
+    [BENCH_BUILD_TEXT_LARGE] = "build.text_2k",
+    [BENCH_BUILD_TOOL_RESPONSE] = "build.tool_response",
+    [BENCH_BUILD_SPEECH_START] = "build.speech_conversation_start",
+    [BENCH_BUILD_SPEECH_END] = "build.speech_conversation_end",
+};
+
+static char *bench_build_one(bench_ctx_t *ctx, bench_builder_t builder, char *large_text)
+{
+    switch (builder) {
+        case BENCH_BUILD_HANDSHAKE:
+            return esp_agent_messages_get_handshake(ctx->handle);
+        case BENCH_BUILD_TEXT:
+            return esp_agent_messages_prepare_text(ctx->handle, "Turn off the living room lights");
+        case BENCH_BUILD_TEXT_LARGE:
+            return esp_agent_messages_prepare_text(ctx->handle, large_text);
+        case BENCH_BUILD_TOOL_RESPONSE:
+            return esp_agent_messages_prepare_tool_response(ctx->handle, "req-7c1d6f0a", ESP_OK, "{\"temperature\":31,\"condition\":\"sunny\"}");
+        case BENCH_BUILD_SPEECH_START:
+            return esp_agent_messages_prepare_speech_conversation_start(ctx->handle);
+        case BENCH_BUILD_SPEECH_END:
+            return esp_agent_messages_prepare_speech_conversation_end(ctx->handle);
+        default:
+            return NULL;
+    }
+}
+
+static void bench_build(bench_ctx_t *ctx, bench_builder_t builder, char *large_text)
+{
+    const char *name = s_builder_names[builder];
+    if (!bench_selected(ctx, name)) {
+        return;
+    }
+
+    char *out = bench_build_one(ctx, builder, large_text);
+    if (out == NULL) {
+        ESP_LOGE(TAG, "%s failed", name);
+        ctx->result = ESP_FAIL;
+        return;
+    }
+    size_t bytes = strlen(out);
+    free(out);
+
+    bench_count_start();
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+        free(bench_build_one(ctx, builder, large_text));
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    bench_count_stop();
+    uint32_t allocs = s_allocs;
+    uint32_t frees = s_frees;
+
+    bench_count_start();
+    free(bench_build_one(ctx, builder, large_text));
+    bench_count_stop();
+
+    bench_report(name, ctx->iterations, bytes, elapsed_us, allocs, frees, s_heap_peak);
+}
+
+/* Build the corpus entries that are too large to keep as literals */
+static char *bench_make_large_transcript(size_t text_len)
+{
+    static const char words[] = "The quick brown fox jumps over the lazy dog, and then it naps in the warm afternoon sun. ";
+    char *text = malloc(text_len + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < text_len; i++) {
+        text[i] = words[i % (sizeof(words) - 1)];
+    }
+    text[text_len] = '\0';
+    return text;
+}
+
+static char *bench_make_transcript_message(const char *text)
+{
+    cJSON *json = cJSON_CreateObject();
+    cJSON *metadata = cJSON_CreateObject();
+    char *message = NULL;
+
+    if (json && metadata) {
+        cJSON_AddStringToObject(json, "type", "assistant");
+        cJSON_AddStringToObject(json, "content_type", "text");
+        cJSON_AddStringToObject(json, "content", text);
+        cJSON_AddStringToObject(metadata, "role", "assistant");
+        cJSON_AddStringToObject(metadata, "generation_stage", "final");
+        cJSON_AddItemToObject(json, "metadata", metadata);
+        metadata = NULL;
+        message = cJSON_PrintUnformatted(json);
+    }
+    cJSON_Delete(metadata);
+    cJSON_Delete(json);
+    return message;
+}
+
+static char *bench_make_tool_request_message(int num_params)
+{
+    cJSON *json = cJSON_CreateObject();
+    cJSON *content = cJSON_CreateObject();
+    cJSON *input = cJSON_CreateObject();
+    char *message = NULL;
+    char name[16];
+    char value[32];
+
+    if (json && content && input) {
+        for (int i = 0; i < num_params; i++) {
+            snprintf(name, sizeof(name), "param_%d", i);
+            switch (i % 3) {
+                case 0:
+                    snprintf(value, sizeof(value), "value number %d", i);
+                    cJSON_AddStringToObject(input, name, value);
+                    break;
+                case 1:
+                    cJSON_AddNumberToObject(input, name, i * 10);
+                    break;
+                default:
+                    cJSON_AddBoolToObject(input, name, i & 1);
+                    break;
+            }
+        }
+        cJSON_AddStringToObject(json, "type", "tool_request");
+        cJSON_AddStringToObject(json, "content_type", "json");
+        cJSON_AddStringToObject(content, "request_id", "req-3b9e41d2");
+        cJSON_AddStringToObject(content, "tool_name", BENCH_TOOL_NAME);
+        cJSON_AddItemToObject(content, "input", input);
+        cJSON_AddItemToObject(json, "content", content);
+        input = NULL;
+        content = NULL;
+        message = cJSON_PrintUnformatted(json);
+    }
+    cJSON_Delete(input);
+    cJSON_Delete(content);
+    cJSON_Delete(json);
+    return message;
+}
+
+static void bench_task(void *arg)
+{
+    bench_ctx_t *ctx = (bench_ctx_t *)arg;
+    char *large_text = bench_make_large_transcript(4096);
+    char *transcript_large = large_text ? bench_make_transcript_message(large_text) : NULL;
+    char *tool_request_16 = bench_make_tool_request_message(16);
+
+    if (large_text == NULL || transcript_large == NULL || tool_request_16 == NULL) {
+        ctx->result = ESP_ERR_NO_MEM;
+        goto end;
+    }
+    /* The 2k text builder uses the first half of the transcript text */
+    large_text[2048] = '\0';
+
+    printf("{\"suite\":\"esp_agent\",\"target\":\"%s\",\"idf\":\"%s\",\"iterations\":%" PRIu32 "}\n",
+           CONFIG_IDF_TARGET, esp_get_idf_version(), ctx->iterations);
+
+    s_bench_task = xTaskGetCurrentTaskHandle();
+
+    for (size_t i = 0; i < sizeof(s_parse_corpus) / sizeof(s_parse_corpus[0]); i++) {
+        bench_parse(ctx, s_parse_corpus[i].name, s_parse_corpus[i].message);
+    }
+    bench_parse(ctx, "transcript_4k", transcript_large);
+    bench_parse(ctx, "tool_request_16_params", tool_request_16);
+
+    for (int i = 0; i < BENCH_BUILD_MAX; i++) {
+        bench_build(ctx, i, large_text);
+    }
+
+    bench_settle();
+
+end:
+    free(large_text);
+    free(transcript_large);
+    free(tool_request_16);
+    xTaskNotifyGive(ctx->caller);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_agent_bench_run(uint32_t iterations, const char *filter)
+{
+    esp_err_t ret = ESP_OK;
+    esp_log_level_t levels[sizeof(s_quiet_tags) / sizeof(s_quiet_tags[0])];
+
+    esp_agent_audio_config_t audio_config = {
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
+        .sample_rate = 16000,
+        .frame_duration = 60,
+    };
+    esp_agent_config_t config = {
+        .agent_id = "bench",
+        .refresh_token = "bench",
+        .conversation_type = ESP_AGENT_CONVERSATION_SPEECH,
+        .upload_audio_config = &audio_config,
+        .download_audio_config = &audio_config,
+    };
+
+    bench_ctx_t ctx = {
+        .iterations = iterations ? iterations : CONFIG_ESP_AGENT_BENCH_ITERATIONS,
+        .filter = filter,
+        .caller = xTaskGetCurrentTaskHandle(),
+        .result = ESP_OK,
+    };
+
+    ctx.handle = esp_agent_init(&config);
+    ESP_RETURN_ON_FALSE(ctx.handle, ESP_FAIL, TAG, "Failed to create bench agent");
+    ESP_GOTO_ON_ERROR(esp_agent_register_local_tool(ctx.handle, BENCH_TOOL_NAME, bench_tool_handler, NULL), end, TAG, "Failed to register bench tool");
+
+    for (size_t i = 0; i < sizeof(s_quiet_tags) / sizeof(s_quiet_tags[0]); i++) {
+        levels[i] = esp_log_level_get(s_quiet_tags[i]);
+        esp_log_level_set(s_quiet_tags[i], ESP_LOG_NONE);
+    }
+
+    if (xTaskCreate(bench_task, "agent_bench", BENCH_TASK_STACK_SIZE, &ctx, BENCH_TASK_PRIORITY, NULL) == pdPASS) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ret = ctx.result;
+    } else {
+        ESP_LOGE(TAG, "Failed to create bench task");
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < sizeof(s_quiet_tags) / sizeof(s_quiet_tags[0]); i++) {
+        esp_log_level_set(s_quiet_tags[i], levels[i]);
+    }
+
+end:
+    esp_agent_deinit(ctx.handle);
+    return ret;
+}
+
+#else /* CONFIG_ESP_AGENT_BENCH */
+
+esp_err_t esp_agent_bench_run(uint32_t iterations, const char *filter)
+{
+    ESP_LOGE(TAG, "Benchmarks are disabled, enable CONFIG_ESP_AGENT_BENCH");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_ESP_AGENT_BENCH */
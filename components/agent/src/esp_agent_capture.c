@@ -0,0 +1,301 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <esp_log.h>
+#include <esp_check.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_websocket_client.h>
+
+#include <esp_agent.h>
+#include <esp_agent_internal.h>
+#include <esp_agent_websocket.h>
+
+static const char *TAG = "esp_agent_capture";
+
+#if CONFIG_ESP_AGENT_CAPTURE
+
+static void *capture_alloc(size_t size)
+{
+#if CONFIG_SPIRAM
+    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ptr) {
+        return ptr;
+    }
+#endif
+    return malloc(size);
+}
+
+static void ring_write(esp_agent_capture_t *capture, const void *src, size_t len)
+{
+    size_t pos = (capture->head + capture->used) % capture->capacity;
+    size_t first = capture->capacity - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(capture->buf + pos, src, first);
+    memcpy(capture->buf, (const uint8_t *)src + first, len - first);
+    capture->used += len;
+}
+
+static void ring_read(const esp_agent_capture_t *capture, size_t offset, void *dst, size_t len)
+{
+    size_t pos = (capture->head + offset) % capture->capacity;
+    size_t first = capture->capacity - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, capture->buf + pos, first);
+    memcpy((uint8_t *)dst + first, capture->buf, len - first);
+}
+
+static void ring_drop_oldest(esp_agent_capture_t *capture)
+{
+    esp_agent_capture_record_t record;
+    ring_read(capture, 0, &record, sizeof(record));
+
+    size_t size = sizeof(record) + record.len;
+    capture->head = (capture->head + size) % capture->capacity;
+    capture->used -= size;
+    capture->records--;
+    capture->dropped++;
+}
+
+void esp_agent_capture_record(esp_agent_capture_t *capture, uint8_t direction, uint8_t op_code, uint8_t flags, const void *data, size_t len)
+{
+    if (!capture->enabled) {
+        return;
+    }
+
+    esp_agent_capture_record_t record = {
+        .timestamp_us = (uint32_t)(esp_timer_get_time() - capture->start_us),
+        .len = len,
+        .direction = direction,
+        .op_code = op_code,
+        .flags = flags,
+    };
+
+    xSemaphoreTake(capture->lock, portMAX_DELAY);
+    if (sizeof(record) + len > capture->capacity) {
+        capture->dropped++;
+        goto end;
+    }
+    while (capture->used + sizeof(record) + len > capture->capacity) {
+        ring_drop_oldest(capture);
+    }
+    ring_write(capture, &record, sizeof(record));
+    if (len) {
+        ring_write(capture, data, len);
+    }
+    capture->records++;
+
+end:
+    xSemaphoreGive(capture->lock);
+}
+
+void esp_agent_capture_deinit(esp_agent_capture_t *capture)
+{
+    capture->enabled = false;
+    if (capture->buf) {
+        free(capture->buf);
+        capture->buf = NULL;
+    }
+    if (capture->lock) {
+        vSemaphoreDelete(capture->lock);
+        capture->lock = NULL;
+    }
+}
+
+esp_err_t esp_agent_capture_start(esp_agent_handle_t handle, size_t buffer_size)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "Invalid handle");
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    esp_agent_capture_t *capture = &agent->capture;
+
+    if (buffer_size == 0) {
+        buffer_size = CONFIG_ESP_AGENT_CAPTURE_BUFFER_SIZE;
+    }
+    ESP_RETURN_ON_FALSE(buffer_size > sizeof(esp_agent_capture_record_t), ESP_ERR_INVALID_SIZE, TAG, "Capture buffer too small");
+
+    if (capture->lock == NULL) {
+        capture->lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(capture->lock, ESP_ERR_NO_MEM, TAG, "Failed to create capture lock");
+    }
+
+    capture->enabled = false;
+    xSemaphoreTake(capture->lock, portMAX_DELAY);
+    if (capture->buf && capture->capacity != buffer_size) {
+        free(capture->buf);
+        capture->buf = NULL;
+    }
+    if (capture->buf == NULL) {
+        capture->buf = capture_alloc(buffer_size);
+    }
+    capture->capacity = capture->buf ? buffer_size : 0;
+    capture->head = 0;
+    capture->used = 0;
+    capture->records = 0;
+    capture->dropped = 0;
+    capture->start_us = esp_timer_get_time();
+    xSemaphoreGive(capture->lock);
+
+    ESP_RETURN_ON_FALSE(capture->buf, ESP_ERR_NO_MEM, TAG, "Failed to allocate %zu bytes for capture", buffer_size);
+
+    capture->enabled = true;
+    ESP_LOGI(TAG, "Capture started (%zu bytes)", buffer_size);
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_capture_stop(esp_agent_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "Invalid handle");
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    agent->capture.enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_capture_get(esp_agent_handle_t handle, uint8_t **log, size_t *len)
+{
+    ESP_RETURN_ON_FALSE(handle && log && len, ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    esp_agent_capture_t *capture = &agent->capture;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(capture->lock && capture->buf, ESP_ERR_INVALID_STATE, TAG, "Nothing captured");
+
+    xSemaphoreTake(capture->lock, portMAX_DELAY);
+    size_t total = sizeof(esp_agent_capture_header_t) + capture->used;
+    uint8_t *out = capture_alloc(total);
+    ESP_GOTO_ON_FALSE(out, ESP_ERR_NO_MEM, end, TAG, "Failed to allocate %zu bytes for capture log", total);
+
+    esp_agent_capture_header_t header = {
+        .magic = ESP_AGENT_CAPTURE_MAGIC,
+        .version = ESP_AGENT_CAPTURE_VERSION,
+        .header_size = sizeof(esp_agent_capture_header_t),
+        .records = capture->records,
+        .dropped = capture->dropped,
+    };
+    memcpy(out, &header, sizeof(header));
+    ring_read(capture, 0, out + sizeof(header), capture->used);
+
+    *log = out;
+    *len = total;
+
+end:
+    xSemaphoreGive(capture->lock);
+    return ret;
+}
+
+esp_err_t esp_agent_capture_replay(esp_agent_handle_t handle, const uint8_t *log, size_t len, uint32_t speed_percent)
+{
+    ESP_RETURN_ON_FALSE(handle && log, ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    ESP_RETURN_ON_FALSE(!agent->capture.enabled, ESP_ERR_INVALID_STATE, TAG, "Stop the capture before replaying");
+
+    esp_agent_capture_header_t header;
+    ESP_RETURN_ON_FALSE(len >= sizeof(header), ESP_ERR_INVALID_SIZE, TAG, "Capture log too short");
+    memcpy(&header, log, sizeof(header));
+    ESP_RETURN_ON_FALSE(header.magic == ESP_AGENT_CAPTURE_MAGIC && header.version == ESP_AGENT_CAPTURE_VERSION,
+                        ESP_ERR_INVALID_ARG, TAG, "Not a capture log");
+
+    size_t offset = header.header_size;
+    uint32_t replayed = 0;
+    bool first = true;
+    uint32_t first_timestamp_us = 0;
+    uint32_t dropped_before = agent->messages_dropped;
+    int64_t replay_start_us = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < header.records; i++) {
+        esp_agent_capture_record_t record;
+        ESP_RETURN_ON_FALSE(offset + sizeof(record) <= len, ESP_ERR_INVALID_SIZE, TAG, "Truncated record %" PRIu32, i);
+        memcpy(&record, log + offset, sizeof(record));
+        offset += sizeof(record);
+        ESP_RETURN_ON_FALSE(offset + record.len <= len, ESP_ERR_INVALID_SIZE, TAG, "Truncated payload %" PRIu32, i);
+        const uint8_t *payload = log + offset;
+        offset += record.len;
+
+        if (record.direction != ESP_AGENT_CAPTURE_DIR_RX) {
+            continue;
+        }
+
+        if (first) {
+            first_timestamp_us = record.timestamp_us;
+            first = false;
+        }
+
+        if (speed_percent) {
+            int64_t due_us = replay_start_us + (int64_t)(uint32_t)(record.timestamp_us - first_timestamp_us) * 100 / speed_percent;
+            int64_t wait_us = due_us - esp_timer_get_time();
+            if (wait_us >= 1000) {
+                vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+            }
+        }
+
+        /* Without pacing the log outruns the message task, wait for room rather than drop a message */
+        if (record.op_code != WS_TRANSPORT_OPCODES_BINARY) {
+            while (uxQueueSpacesAvailable(agent->message_queue) == 0) {
+                vTaskDelay(1);
+            }
+        }
+
+        esp_websocket_event_data_t data = {
+            .data_ptr = (const char *)payload,
+            .data_len = record.len,
+            .op_code = record.op_code,
+            .fin = record.flags & ESP_AGENT_CAPTURE_FLAG_FIN,
+            .payload_len = record.len,
+            .payload_offset = 0,
+        };
+        esp_agent_websocket_event_handler(agent, WEBSOCKET_EVENTS, WEBSOCKET_EVENT_DATA, &data);
+        replayed++;
+    }
+
+    uint32_t dropped = agent->messages_dropped - dropped_before;
+    ESP_LOGI(TAG, "Replayed %" PRIu32 " frames in %" PRId64 " ms", replayed, (esp_timer_get_time() - replay_start_us) / 1000);
+    if (dropped) {
+        ESP_LOGW(TAG, "%" PRIu32 " messages were dropped during replay", dropped);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+#else /* CONFIG_ESP_AGENT_CAPTURE */
+
+esp_err_t esp_agent_capture_start(esp_agent_handle_t handle, size_t buffer_size)
+{
+    ESP_LOGE(TAG, "Capture is disabled, enable CONFIG_ESP_AGENT_CAPTURE");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_agent_capture_stop(esp_agent_handle_t handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_agent_capture_get(esp_agent_handle_t handle, uint8_t **log, size_t *len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_agent_capture_replay(esp_agent_handle_t handle, const uint8_t *log, size_t len, uint32_t speed_percent)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_ESP_AGENT_CAPTURE */
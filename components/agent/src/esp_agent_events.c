@@ -30,7 +30,7 @@ void esp_agent_internal_event_handler(void *handler_args, esp_event_base_t base,
             break;
         case ESP_AGENT_EVENT_DATA_TYPE_SPEECH:
             if (data->speech.data) {
-                ESP_LOGV(TAG, "Freeing speech data buffer: %d bytes", data->speech.len);
+                ESP_LOGV(TAG, "Freeing speech data buffer: %zu bytes", data->speech.len);
                 free((void *)data->speech.data);
             }
             break;
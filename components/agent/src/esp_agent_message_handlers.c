@@ -4,6 +4,9 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <inttypes.h>
+#include <string.h>
+
 #include <esp_log.h>
 #include <cJSON.h>
 
@@ -15,13 +18,17 @@
 static const char *TAG = "esp_agent_message_handlers";
 
 esp_err_t esp_agent_message_handshake_ack_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
-esp_err_t esp_agent_message_dummy_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_transcript_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_error_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_audio_stream_start_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_audio_stream_end_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_tool_request_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 esp_err_t esp_agent_message_thinking_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
+esp_err_t esp_agent_message_usage_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
+esp_err_t esp_agent_message_tool_call_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
+esp_err_t esp_agent_message_tool_result_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
+esp_err_t esp_agent_message_transaction_end_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
+esp_err_t esp_agent_message_barge_in_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata);
 
 const esp_agent_message_handler_info_t esp_agent_message_handlers[] = {
     {.type = ESP_AGENT_MESSAGE_TYPE_HANDSHAKE_ACK, .handler = esp_agent_message_handshake_ack_handler},
@@ -31,15 +38,49 @@ const esp_agent_message_handler_info_t esp_agent_message_handlers[] = {
     {.type = ESP_AGENT_MESSAGE_TYPE_ERROR, .handler = esp_agent_message_error_handler},
     {.type = ESP_AGENT_MESSAGE_TYPE_AUDIO_STREAM_START, .handler = esp_agent_message_audio_stream_start_handler},
     {.type = ESP_AGENT_MESSAGE_TYPE_AUDIO_STREAM_END, .handler = esp_agent_message_audio_stream_end_handler},
-    {.type = ESP_AGENT_MESSAGE_TYPE_USAGE_INFO, .handler = esp_agent_message_dummy_handler},
-    {.type = ESP_AGENT_MESSAGE_TYPE_TOOL_CALL_INFO, .handler = esp_agent_message_dummy_handler},
+    {.type = ESP_AGENT_MESSAGE_TYPE_USAGE_INFO, .handler = esp_agent_message_usage_info_handler},
+    {.type = ESP_AGENT_MESSAGE_TYPE_TOOL_CALL_INFO, .handler = esp_agent_message_tool_call_info_handler},
     {.type = ESP_AGENT_MESSAGE_TYPE_TOOL_REQUEST, .handler = esp_agent_message_tool_request_handler},
-    {.type = ESP_AGENT_MESSAGE_TYPE_TOOL_RESULT_INFO, .handler = esp_agent_message_dummy_handler},
-    {.type = ESP_AGENT_MESSAGE_TYPE_TRANSACTION_END, .handler = esp_agent_message_dummy_handler},
-    {.type = ESP_AGENT_MESSAGE_TYPE_BARGE_IN, .handler = esp_agent_message_dummy_handler}
+    {.type = ESP_AGENT_MESSAGE_TYPE_TOOL_RESULT_INFO, .handler = esp_agent_message_tool_result_info_handler},
+    {.type = ESP_AGENT_MESSAGE_TYPE_TRANSACTION_END, .handler = esp_agent_message_transaction_end_handler},
+    {.type = ESP_AGENT_MESSAGE_TYPE_BARGE_IN, .handler = esp_agent_message_barge_in_handler}
 };
 const size_t esp_agent_message_handlers_count = sizeof(esp_agent_message_handlers) / sizeof(esp_agent_message_handler_info_t);
 
+/* The pipelines are built from the offered configuration, so the server has to select it as is */
+static bool esp_agent_message_check_audio_config(const char *direction, cJSON *json, const esp_agent_audio_config_t *config)
+{
+    if (!cJSON_IsObject(json)) {
+        return true;
+    }
+
+    esp_agent_audio_config_t selected = *config;
+    char *format = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "format"));
+    cJSON *sample_rate = cJSON_GetObjectItemCaseSensitive(json, "sampleRate");
+    cJSON *frame_duration = cJSON_GetObjectItemCaseSensitive(json, "frameDurationMs");
+
+    if (format && strcmp(format, "audio/opus") == 0) {
+        selected.format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS;
+    } else if (format && strcmp(format, "audio/pcm") == 0) {
+        selected.format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_PCM;
+    }
+    if (cJSON_IsNumber(sample_rate)) {
+        selected.sample_rate = sample_rate->valueint;
+    }
+    if (cJSON_IsNumber(frame_duration)) {
+        selected.frame_duration = frame_duration->valueint;
+    }
+
+    if (selected.format != config->format || selected.sample_rate != config->sample_rate ||
+            selected.frame_duration != config->frame_duration) {
+        ESP_LOGE(TAG, "Server selected %s audio %s, %d Hz, %d ms, offered %d Hz, %d ms", direction,
+                 format ? format : "(unchanged)", selected.sample_rate, selected.frame_duration,
+                 config->sample_rate, config->frame_duration);
+        return false;
+    }
+    return true;
+}
+
 esp_err_t esp_agent_message_handshake_ack_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
 {
     if (handle == NULL || content == NULL) {
@@ -60,12 +101,27 @@ esp_err_t esp_agent_message_handshake_ack_handler(esp_agent_handle_t handle, cJS
 
     ESP_LOGD(TAG, "Conversation: %s", conv_id);
 
+    cJSON *audio_configuration = cJSON_GetObjectItemCaseSensitive(content, "audioConfiguration");
+    if (audio_configuration) {
+        bool input_ok = esp_agent_message_check_audio_config("input", cJSON_GetObjectItemCaseSensitive(audio_configuration, "input"), &agent->upload_audio_config);
+        bool output_ok = esp_agent_message_check_audio_config("output", cJSON_GetObjectItemCaseSensitive(audio_configuration, "output"), &agent->download_audio_config);
+        if (!input_ok || !output_ok) {
+            esp_agent_message_data_t event_data;
+            event_data.error.error = ESP_AGENT_AUDIO_CONFIG_ERROR;
+            esp_agent_post_event(handle, ESP_AGENT_EVENT_ERROR, &event_data);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
     if (agent->conversation_id != NULL) {
         if (strcmp(agent->conversation_id, conv_id) != 0) {
             ESP_LOGW(TAG, "Received different conversation ID. Expected: %s, Got: %s",
                      agent->conversation_id, conv_id);
+            esp_agent_usage_reset(&agent->usage);
         }
         free(agent->conversation_id);
+    } else {
+        esp_agent_usage_reset(&agent->usage);
     }
 
     agent->conversation_id = strdup(conv_id);
@@ -86,12 +142,6 @@ esp_err_t esp_agent_message_handshake_ack_handler(esp_agent_handle_t handle, cJS
     return err;
 }
 
-esp_err_t esp_agent_message_dummy_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
-{
-    // NO-OP
-    return ESP_OK;
-}
-
 esp_err_t esp_agent_message_transcript_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
 {
     if (handle == NULL || content == NULL) {
@@ -122,6 +172,8 @@ esp_err_t esp_agent_message_transcript_handler(esp_agent_handle_t handle, cJSON
 
     if (strcmp(role_str, "user") == 0) {
         event_data.text.role = ESP_AGENT_MESSAGE_ROLE_USER;
+        /* The user transcript opens a new turn, if the device didn't already */
+        esp_agent_usage_transaction_begin(&((esp_agent_t *)handle)->usage);
     } else if (strcmp(role_str, "assistant") == 0) {
         event_data.text.role = ESP_AGENT_MESSAGE_ROLE_ASSISTANT;
 
@@ -227,6 +279,17 @@ esp_err_t esp_agent_message_audio_stream_end_handler(esp_agent_handle_t handle,
     return ESP_OK;
 }
 
+esp_err_t esp_agent_message_barge_in_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
+{
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Invalid handle for processing barge in");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_post_event(handle, ESP_AGENT_EVENT_BARGE_IN, NULL);
+    return ESP_OK;
+}
+
 esp_err_t esp_agent_message_tool_request_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
 {
     if (handle == NULL || content == NULL) {
@@ -308,3 +371,137 @@ err:
     }
     return ESP_FAIL;
 }
+
+/* Telemetry content may either be a JSON object or a JSON string holding one */
+static cJSON *usage_get_content_object(cJSON *content, cJSON **parsed)
+{
+    *parsed = NULL;
+    if (cJSON_IsObject(content)) {
+        return content;
+    }
+    if (cJSON_IsString(content)) {
+        *parsed = cJSON_Parse(cJSON_GetStringValue(content));
+        if (cJSON_IsObject(*parsed)) {
+            return *parsed;
+        }
+    }
+    return NULL;
+}
+
+static cJSON *usage_get_item(cJSON *object, const char *snake_case, const char *camel_case)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, snake_case);
+    if (item == NULL) {
+        item = cJSON_GetObjectItemCaseSensitive(object, camel_case);
+    }
+    return item;
+}
+
+static int32_t usage_get_number(cJSON *object, const char *snake_case, const char *camel_case, int32_t default_value)
+{
+    cJSON *item = usage_get_item(object, snake_case, camel_case);
+    if (!cJSON_IsNumber(item) || cJSON_GetNumberValue(item) < 0) {
+        return default_value;
+    }
+    return (int32_t)cJSON_GetNumberValue(item);
+}
+
+static const char *usage_get_tool_id(cJSON *object)
+{
+    const char *id = cJSON_GetStringValue(usage_get_item(object, "tool_call_id", "toolCallId"));
+    if (id == NULL) {
+        id = cJSON_GetStringValue(usage_get_item(object, "request_id", "requestId"));
+    }
+    return id;
+}
+
+esp_err_t esp_agent_message_usage_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
+{
+    if (handle == NULL || content == NULL) {
+        ESP_LOGE(TAG, "Invalid handle or content for processing usage info");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    cJSON *parsed = NULL;
+    cJSON *usage = usage_get_content_object(content, &parsed);
+    if (usage == NULL) {
+        ESP_LOGW(TAG, "Unexpected usage info content");
+        cJSON_Delete(parsed);
+        return ESP_OK;
+    }
+
+    /* Some servers nest the counters inside a "usage" object */
+    cJSON *nested = cJSON_GetObjectItemCaseSensitive(usage, "usage");
+    if (cJSON_IsObject(nested)) {
+        usage = nested;
+    }
+
+    int32_t input_tokens = usage_get_number(usage, "input_tokens", "inputTokens", 0);
+    int32_t output_tokens = usage_get_number(usage, "output_tokens", "outputTokens", 0);
+    ESP_LOGD(TAG, "Usage: input tokens: %" PRId32 ", output tokens: %" PRId32, input_tokens, output_tokens);
+
+    esp_agent_usage_add_tokens(&agent->usage, input_tokens, output_tokens);
+
+    cJSON_Delete(parsed);
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_message_tool_call_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
+{
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Invalid handle for processing tool call info");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    cJSON *parsed = NULL;
+    cJSON *info = usage_get_content_object(content, &parsed);
+
+    esp_agent_usage_tool_call(&agent->usage, info ? usage_get_tool_id(info) : NULL);
+
+    cJSON_Delete(parsed);
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_message_tool_result_info_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
+{
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Invalid handle for processing tool result info");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    cJSON *parsed = NULL;
+    cJSON *info = usage_get_content_object(content, &parsed);
+    const char *id = NULL;
+    int32_t latency_ms = -1;
+
+    if (info) {
+        id = usage_get_tool_id(info);
+        latency_ms = usage_get_number(info, "duration_ms", "durationMs", -1);
+    }
+
+    esp_agent_usage_tool_result(&agent->usage, id, latency_ms);
+
+    cJSON_Delete(parsed);
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_message_transaction_end_handler(esp_agent_handle_t handle, cJSON *content, cJSON *metadata)
+{
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Invalid handle for processing transaction end");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    esp_agent_message_data_t event_data;
+
+    esp_agent_usage_transaction_end(&agent->usage, &event_data.usage);
+    ESP_LOGD(TAG, "Transaction end: %" PRIu32 " ms, tokens in/out: %" PRIu32 "/%" PRIu32 ", tool calls: %" PRIu32,
+             event_data.usage.duration_ms, event_data.usage.input_tokens, event_data.usage.output_tokens,
+             event_data.usage.tool_calls);
+
+    return esp_agent_post_event(handle, ESP_AGENT_EVENT_USAGE, &event_data);
+}
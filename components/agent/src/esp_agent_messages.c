@@ -259,14 +259,12 @@ char *esp_agent_messages_prepare_tool_response(esp_agent_handle_t handle, char *
     cJSON_AddItemToObject(content, "result", result);
     cJSON_AddItemToObject(tool_response_json, "content", content);
 
-    return cJSON_PrintUnformatted(tool_response_json);
-
-    /* To prevent unused variable warning */
-    if (0) {
-        printf("%d", ret);
-    }
+    char *tool_response_json_str = cJSON_PrintUnformatted(tool_response_json);
+    cJSON_Delete(tool_response_json);
+    return tool_response_json_str;
 
 err:
+    ESP_LOGE(TAG, "Failed to prepare tool response for %s: %s", request_id, esp_err_to_name(ret));
     if (tool_response_json) {
         cJSON_Delete(tool_response_json);
     }
@@ -363,6 +361,51 @@ only_delete_final_json:
     return ret_json_str;
 }
 
+char *esp_agent_messages_prepare_barge_in(esp_agent_handle_t handle)
+{
+    esp_err_t ret = ESP_OK;
+    cJSON *final_json = cJSON_CreateObject();
+    cJSON *metadata = cJSON_CreateObject();
+    cJSON *content = cJSON_CreateObject();
+
+    char *ret_json_str = NULL;
+
+    /* GOTO to delete_content_n_metadata if any of the JSON objects are not created */
+    ESP_GOTO_ON_FALSE(final_json, ESP_ERR_NO_MEM, delete_all_json_objects, TAG, "Failed to create final JSON");
+    ESP_GOTO_ON_FALSE(metadata, ESP_ERR_NO_MEM, delete_all_json_objects, TAG, "Failed to create metadata JSON");
+    ESP_GOTO_ON_FALSE(content, ESP_ERR_NO_MEM, delete_all_json_objects, TAG, "Failed to create content JSON");
+
+    cJSON_AddStringToObject(metadata, "role", "user");
+
+    cJSON_AddStringToObject(final_json, "type", ESP_AGENT_MESSAGE_TYPE_BARGE_IN);
+    cJSON_AddStringToObject(final_json, "content_type", "json");
+    cJSON_AddItemToObject(final_json, "metadata", metadata);
+    cJSON_AddItemToObject(final_json, "content", content);
+
+    ret_json_str = cJSON_PrintUnformatted(final_json);
+
+    /* For keping the compiler happy about not using variable ret */
+    /* Will be optimized away */
+    if (ret) {}
+
+    /* final_json has ownership of content and metadata*/
+    goto only_delete_final_json;
+
+delete_all_json_objects:
+    if (metadata) {
+        cJSON_Delete(metadata);
+    }
+    if (content) {
+        cJSON_Delete(content);
+    }
+only_delete_final_json:
+    if (final_json) {
+        cJSON_Delete(final_json);
+    }
+
+    return ret_json_str;
+}
+
 esp_err_t esp_agent_speech_conversation_start(esp_agent_handle_t handle)
 {
     if (handle == NULL) {
@@ -387,6 +430,8 @@ esp_err_t esp_agent_speech_conversation_start(esp_agent_handle_t handle)
     err = esp_agent_websocket_queue_message(agent, WS_SEND_MSG_TYPE_TEXT, speech_conversation_start_json_str, strlen(speech_conversation_start_json_str), pdMS_TO_TICKS(100));
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to queue speech conversation start: %d", err);
+    } else {
+        esp_agent_usage_transaction_begin(&agent->usage);
     }
 
     if (ret) {}
@@ -434,6 +479,34 @@ end:
     return err;
 }
 
+esp_err_t esp_agent_speech_barge_in(esp_agent_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    if (agent->conversation_type != ESP_AGENT_CONVERSATION_SPEECH) {
+        ESP_LOGE(TAG, "Conversation type is not speech");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char *barge_in_json_str = esp_agent_messages_prepare_barge_in(agent);
+    if (barge_in_json_str == NULL) {
+        ESP_LOGE(TAG, "Failed to prepare barge in");
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGD(TAG, "Barge in: %s", barge_in_json_str);
+
+    esp_err_t err = esp_agent_websocket_queue_message(agent, WS_SEND_MSG_TYPE_TEXT, barge_in_json_str, strlen(barge_in_json_str), pdMS_TO_TICKS(100));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue barge in: %d", err);
+    }
+
+    free(barge_in_json_str);
+    return err;
+}
+
 /* Send speech data */
 esp_err_t esp_agent_send_speech(esp_agent_handle_t handle, const uint8_t *data, size_t len, TickType_t timeout)
 {
@@ -472,6 +545,8 @@ esp_err_t esp_agent_send_text(esp_agent_handle_t handle, const char *text, TickT
     esp_err_t err = esp_agent_websocket_queue_message(agent, WS_SEND_MSG_TYPE_TEXT, text_json_str, strlen(text_json_str), timeout);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to queue text data: %d", err);
+    } else {
+        esp_agent_usage_transaction_begin(&agent->usage);
     }
 
     if (text_json_str) {
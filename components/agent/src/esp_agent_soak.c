@@ -0,0 +1,365 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_check.h>
+#include <esp_timer.h>
+
+#include <esp_agent.h>
+#include <esp_agent_soak.h>
+
+static const char *TAG = "esp_agent_soak";
+
+#if CONFIG_ESP_AGENT_SOAK
+
+#include <esp_agent_internal.h>
+#include <esp_agent_internal_messages.h>
+#include <esp_agent_internal_usage.h>
+#include <esp_agent_websocket.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include <esp_heap_caps.h>
+#endif
+
+#define SOAK_STARTED_BIT        BIT0
+#define SOAK_TURN_DONE_BIT      BIT1
+#define SOAK_DISCONNECTED_BIT   BIT2
+
+#define SOAK_START_TIMEOUT_MS   10000
+#define SOAK_MAX_FRAME_SIZE     1500
+#define SOAK_QUEUE_TIMEOUT_MS   500
+
+/* Samples taken before this turn are left out of the leak rate, so that buffers allocated lazily
+ * by the first turns (connection, codec, playback) are not counted as a leak. */
+#define SOAK_WARMUP_TURNS       20
+
+/* Opus packet (TOC 0xF8: CELT fullband 20 ms, mono, one frame) that decodes to silence */
+static const uint8_t s_opus_silence[] = {0xF8, 0xFF, 0xFE};
+
+typedef struct {
+    size_t free;
+    size_t largest;
+    size_t min_free;
+} soak_heap_caps_t;
+
+typedef struct {
+    size_t used;
+#if !CONFIG_IDF_TARGET_LINUX
+    soak_heap_caps_t internal;
+    soak_heap_caps_t spiram;
+    soak_heap_caps_t dma;
+#endif
+} soak_heap_sample_t;
+
+typedef struct {
+    EventGroupHandle_t event_group;
+    uint32_t disconnects;
+    uint32_t reconnects;
+    uint32_t speech_frames_rx;
+    uint32_t turns_ok;
+    uint32_t turns_failed;
+    /* Least squares fit of the used heap over the turn number */
+    uint32_t fit_n;
+    double fit_x;
+    double fit_y;
+    double fit_xx;
+    double fit_xy;
+} soak_ctx_t;
+
+static volatile bool s_stop;
+static volatile bool s_running;
+
+static void soak_heap_sample(soak_heap_sample_t *sample)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    sample->used = mallinfo2().uordblks;
+#else
+    static const uint32_t caps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM, MALLOC_CAP_DMA};
+    soak_heap_caps_t *stats[] = {&sample->internal, &sample->spiram, &sample->dma};
+
+    for (size_t i = 0; i < sizeof(caps) / sizeof(caps[0]); i++) {
+        stats[i]->free = heap_caps_get_free_size(caps[i]);
+        stats[i]->largest = heap_caps_get_largest_free_block(caps[i]);
+        stats[i]->min_free = heap_caps_get_minimum_free_size(caps[i]);
+    }
+    sample->used = heap_caps_get_total_size(MALLOC_CAP_DEFAULT) - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+#endif
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/* 0 when all the free memory is in one block, close to 1 when it is split into many small ones */
+static double soak_fragmentation(const soak_heap_caps_t *stats)
+{
+    return stats->free ? 1.0 - (double)stats->largest / (double)stats->free : 0.0;
+}
+#endif
+
+static void soak_print_sample(const char *kind, uint32_t turn, int64_t elapsed_us, const soak_heap_sample_t *sample)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    printf("{\"soak\":\"%s\",\"turn\":%" PRIu32 ",\"elapsed_ms\":%" PRId64 ",\"heap_used\":%zu}\n",
+           kind, turn, elapsed_us / 1000, sample->used);
+#else
+    printf("{\"soak\":\"%s\",\"turn\":%" PRIu32 ",\"elapsed_ms\":%" PRId64 ",\"heap_used\":%zu,"
+           "\"internal_free\":%zu,\"internal_largest\":%zu,\"internal_min_free\":%zu,\"internal_frag\":%.3f,"
+           "\"spiram_free\":%zu,\"spiram_largest\":%zu,\"spiram_min_free\":%zu,\"spiram_frag\":%.3f,"
+           "\"dma_free\":%zu,\"dma_largest\":%zu,\"dma_frag\":%.3f}\n",
+           kind, turn, elapsed_us / 1000, sample->used,
+           sample->internal.free, sample->internal.largest, sample->internal.min_free, soak_fragmentation(&sample->internal),
+           sample->spiram.free, sample->spiram.largest, sample->spiram.min_free, soak_fragmentation(&sample->spiram),
+           sample->dma.free, sample->dma.largest, soak_fragmentation(&sample->dma));
+#endif
+    fflush(stdout);
+}
+
+static void soak_fit_add(soak_ctx_t *ctx, uint32_t turn, size_t used)
+{
+    double x = turn;
+    double y = used;
+
+    ctx->fit_n++;
+    ctx->fit_x += x;
+    ctx->fit_y += y;
+    ctx->fit_xx += x * x;
+    ctx->fit_xy += x * y;
+}
+
+/* Bytes per turn, 0 if there are not enough samples */
+static double soak_fit_slope(const soak_ctx_t *ctx)
+{
+    double n = ctx->fit_n;
+    double denom = n * ctx->fit_xx - ctx->fit_x * ctx->fit_x;
+
+    if (ctx->fit_n < 2 || denom == 0.0) {
+        return 0.0;
+    }
+    return (n * ctx->fit_xy - ctx->fit_x * ctx->fit_y) / denom;
+}
+
+static void soak_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    soak_ctx_t *ctx = (soak_ctx_t *)arg;
+
+    switch (event_id) {
+        case ESP_AGENT_EVENT_START:
+            xEventGroupSetBits(ctx->event_group, SOAK_STARTED_BIT);
+            break;
+        case ESP_AGENT_EVENT_DISCONNECTED:
+            ctx->disconnects++;
+            xEventGroupClearBits(ctx->event_group, SOAK_STARTED_BIT);
+            xEventGroupSetBits(ctx->event_group, SOAK_DISCONNECTED_BIT);
+            break;
+        case ESP_AGENT_EVENT_DATA_TYPE_SPEECH:
+            ctx->speech_frames_rx++;
+            break;
+        case ESP_AGENT_EVENT_USAGE:
+            xEventGroupSetBits(ctx->event_group, SOAK_TURN_DONE_BIT);
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_err_t soak_connect(esp_agent_handle_t handle, soak_ctx_t *ctx)
+{
+    xEventGroupClearBits(ctx->event_group, SOAK_STARTED_BIT | SOAK_DISCONNECTED_BIT);
+
+    ESP_RETURN_ON_ERROR(esp_agent_start(handle, NULL), TAG, "Failed to start agent");
+
+    EventBits_t bits = xEventGroupWaitBits(ctx->event_group, SOAK_STARTED_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(SOAK_START_TIMEOUT_MS));
+    return (bits & SOAK_STARTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/* Text turns go through the message builder directly, so that they can be mixed with speech turns
+ * on the same conversation (esp_agent_send_text() only accepts text conversations). */
+static esp_err_t soak_send_text(esp_agent_t *agent, const char *text)
+{
+    char *json_str = esp_agent_messages_prepare_text(agent, text);
+    ESP_RETURN_ON_FALSE(json_str, ESP_ERR_NO_MEM, TAG, "Failed to prepare text message");
+
+    esp_err_t err = esp_agent_websocket_queue_message(agent, WS_SEND_MSG_TYPE_TEXT, json_str, strlen(json_str), pdMS_TO_TICKS(SOAK_QUEUE_TIMEOUT_MS));
+    if (err == ESP_OK) {
+        esp_agent_usage_transaction_begin(&agent->usage);
+    }
+    free(json_str);
+    return err;
+}
+
+static esp_err_t soak_send_speech(esp_agent_handle_t handle, const esp_agent_soak_config_t *config, uint8_t *frame)
+{
+    ESP_RETURN_ON_ERROR(esp_agent_speech_conversation_start(handle), TAG, "Failed to start speech");
+
+    for (uint32_t i = 0; i < config->frames_per_turn; i++) {
+        size_t len = sizeof(s_opus_silence);
+        if (config->read_frame) {
+            ESP_RETURN_ON_ERROR(config->read_frame(config->user_data, frame, SOAK_MAX_FRAME_SIZE, &len), TAG, "Failed to read speech frame");
+        } else {
+            memcpy(frame, s_opus_silence, len);
+        }
+        ESP_RETURN_ON_ERROR(esp_agent_send_speech(handle, frame, len, pdMS_TO_TICKS(SOAK_QUEUE_TIMEOUT_MS)), TAG, "Failed to send speech");
+        if (config->frame_interval_ms) {
+            vTaskDelay(pdMS_TO_TICKS(config->frame_interval_ms));
+        }
+    }
+
+    return esp_agent_speech_conversation_end(handle);
+}
+
+static esp_err_t soak_turn(const esp_agent_soak_config_t *config, soak_ctx_t *ctx, uint32_t turn, uint8_t *frame)
+{
+    esp_agent_t *agent = (esp_agent_t *)config->handle;
+    char text[64];
+    esp_err_t err;
+
+    if (!(xEventGroupGetBits(ctx->event_group) & SOAK_STARTED_BIT)) {
+        ctx->reconnects++;
+        ESP_RETURN_ON_ERROR(soak_connect(config->handle, ctx), TAG, "Turn %" PRIu32 ": reconnect failed", turn);
+    }
+
+    xEventGroupClearBits(ctx->event_group, SOAK_TURN_DONE_BIT);
+
+    if (config->tool_every && config->tool_name && turn % config->tool_every == 0) {
+        snprintf(text, sizeof(text), "tool:%s {}", config->tool_name);
+        err = soak_send_text(agent, text);
+    } else if (config->text_every && turn % config->text_every == 0) {
+        snprintf(text, sizeof(text), "soak turn %" PRIu32, turn);
+        err = soak_send_text(agent, text);
+    } else {
+        err = soak_send_speech(config->handle, config, frame);
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "Turn %" PRIu32 ": failed to send", turn);
+
+    EventBits_t bits = xEventGroupWaitBits(ctx->event_group, SOAK_TURN_DONE_BIT | SOAK_DISCONNECTED_BIT,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(config->turn_timeout_ms));
+    if (bits & SOAK_TURN_DONE_BIT) {
+        return ESP_OK;
+    }
+    if (!(bits & SOAK_DISCONNECTED_BIT)) {
+        ESP_LOGW(TAG, "Turn %" PRIu32 " timed out, reconnecting", turn);
+        esp_agent_stop(config->handle);
+        xEventGroupClearBits(ctx->event_group, SOAK_STARTED_BIT);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_agent_soak_run(const esp_agent_soak_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->handle && config->turns, ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
+    ESP_RETURN_ON_FALSE(((esp_agent_t *)config->handle)->conversation_type == ESP_AGENT_CONVERSATION_SPEECH,
+                        ESP_ERR_INVALID_ARG, TAG, "Soak needs a speech conversation");
+    ESP_RETURN_ON_FALSE(!s_running, ESP_ERR_INVALID_STATE, TAG, "Soak already running");
+
+    esp_err_t ret = ESP_OK;
+    esp_event_handler_instance_t handler_instance = NULL;
+    soak_ctx_t ctx = {0};
+    soak_heap_sample_t first = {0};
+    soak_heap_sample_t sample = {0};
+    uint32_t sample_every = config->sample_every ? config->sample_every : 1;
+    uint32_t turn = 0;
+
+    uint8_t *frame = malloc(SOAK_MAX_FRAME_SIZE);
+    ctx.event_group = xEventGroupCreate();
+    ESP_GOTO_ON_FALSE(frame && ctx.event_group, ESP_ERR_NO_MEM, cleanup, TAG, "Failed to allocate soak context");
+
+    s_running = true;
+    s_stop = false;
+
+    ESP_GOTO_ON_ERROR(esp_agent_register_event_handler(config->handle, ESP_EVENT_ANY_ID, soak_event_handler, &ctx, &handler_instance),
+                      cleanup, TAG, "Failed to register event handler");
+
+    ESP_LOGI(TAG, "Soak: %" PRIu32 " turns, %" PRIu32 " frames per speech turn, text every %" PRIu32 ", tool every %" PRIu32,
+             config->turns, config->frames_per_turn, config->text_every, config->tool_name ? config->tool_every : 0);
+
+    int64_t start_us = esp_timer_get_time();
+    soak_heap_sample(&first);
+    soak_print_sample("sample", 0, 0, &first);
+
+    for (turn = 1; turn <= config->turns && !s_stop; turn++) {
+        if (soak_turn(config, &ctx, turn, frame) == ESP_OK) {
+            ctx.turns_ok++;
+        } else {
+            ctx.turns_failed++;
+        }
+
+        if (turn % sample_every == 0 || turn == config->turns) {
+            soak_heap_sample(&sample);
+            soak_print_sample("sample", turn, esp_timer_get_time() - start_us, &sample);
+            if (turn >= SOAK_WARMUP_TURNS) {
+                soak_fit_add(&ctx, turn, sample.used);
+            }
+        }
+    }
+    turn--;
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    double leak_per_turn = soak_fit_slope(&ctx);
+    double leak_per_hour = elapsed_us > 0 ? leak_per_turn * turn * 3600e6 / (double)elapsed_us : 0.0;
+
+    soak_heap_sample(&sample);
+    printf("{\"soak\":\"report\",\"turns\":%" PRIu32 ",\"turns_ok\":%" PRIu32 ",\"turns_failed\":%" PRIu32 ","
+           "\"disconnects\":%" PRIu32 ",\"reconnects\":%" PRIu32 ",\"speech_frames_rx\":%" PRIu32 ",\"elapsed_ms\":%" PRId64 ","
+           "\"heap_used_start\":%zu,\"heap_used_end\":%zu,\"leak_bytes_per_turn\":%.2f,\"leak_bytes_per_hour\":%.0f"
+#if !CONFIG_IDF_TARGET_LINUX
+           ",\"internal_frag_start\":%.3f,\"internal_frag_end\":%.3f,\"internal_min_free\":%zu"
+           ",\"spiram_frag_start\":%.3f,\"spiram_frag_end\":%.3f"
+#endif
+           "}\n",
+           turn, ctx.turns_ok, ctx.turns_failed, ctx.disconnects, ctx.reconnects, ctx.speech_frames_rx, elapsed_us / 1000,
+           first.used, sample.used, leak_per_turn, leak_per_hour
+#if !CONFIG_IDF_TARGET_LINUX
+           , soak_fragmentation(&first.internal), soak_fragmentation(&sample.internal), sample.internal.min_free
+           , soak_fragmentation(&first.spiram), soak_fragmentation(&sample.spiram)
+#endif
+          );
+    fflush(stdout);
+
+    if (ctx.fit_n < 2) {
+        ESP_LOGW(TAG, "Not enough samples after the first %d turns for a leak rate", SOAK_WARMUP_TURNS);
+    }
+    ret = ctx.turns_failed ? ESP_FAIL : ESP_OK;
+
+cleanup:
+    if (handler_instance) {
+        esp_agent_unregister_event_handler(config->handle, &handler_instance, ESP_EVENT_ANY_ID);
+    }
+    if (ctx.event_group) {
+        vEventGroupDelete(ctx.event_group);
+    }
+    free(frame);
+    s_running = false;
+    return ret;
+}
+
+void esp_agent_soak_stop(void)
+{
+    s_stop = true;
+}
+
+#else /* CONFIG_ESP_AGENT_SOAK */
+
+esp_err_t esp_agent_soak_run(const esp_agent_soak_config_t *config)
+{
+    ESP_LOGE(TAG, "Soak harness is disabled, enable CONFIG_ESP_AGENT_SOAK");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void esp_agent_soak_stop(void)
+{
+}
+
+#endif /* CONFIG_ESP_AGENT_SOAK */
@@ -0,0 +1,198 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <esp_agent.h>
+#include <esp_agent_internal.h>
+#include <esp_agent_internal_usage.h>
+
+static const char *TAG = "esp_agent_usage";
+
+/* FNV-1a, only used to match tool_result_info with its tool_call_info */
+static uint32_t usage_hash_id(const char *id)
+{
+    uint32_t hash = 2166136261u;
+    if (id == NULL) {
+        return 0;
+    }
+    while (*id) {
+        hash ^= (uint8_t)*id++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline uint32_t usage_elapsed_ms(int64_t start_us, int64_t now_us)
+{
+    return (now_us > start_us) ? (uint32_t)((now_us - start_us) / 1000) : 0;
+}
+
+/* Must be called with the lock held */
+static void usage_transaction_begin_locked(esp_agent_usage_t *usage, int64_t now_us)
+{
+    if (!usage->in_transaction) {
+        usage->in_transaction = true;
+        usage->transaction_start_us = now_us;
+        memset(&usage->current, 0, sizeof(usage->current));
+    }
+}
+
+void esp_agent_usage_init(esp_agent_usage_t *usage)
+{
+    memset(usage, 0, sizeof(*usage));
+    portMUX_INITIALIZE(&usage->lock);
+}
+
+void esp_agent_usage_reset(esp_agent_usage_t *usage)
+{
+    taskENTER_CRITICAL(&usage->lock);
+    usage->in_transaction = false;
+    memset(&usage->current, 0, sizeof(usage->current));
+    memset(usage->pending_tools, 0, sizeof(usage->pending_tools));
+    memset(&usage->stats, 0, sizeof(usage->stats));
+    taskEXIT_CRITICAL(&usage->lock);
+}
+
+void esp_agent_usage_transaction_begin(esp_agent_usage_t *usage)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&usage->lock);
+    usage_transaction_begin_locked(usage, now_us);
+    taskEXIT_CRITICAL(&usage->lock);
+}
+
+void esp_agent_usage_add_tokens(esp_agent_usage_t *usage, uint32_t input_tokens, uint32_t output_tokens)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&usage->lock);
+    usage_transaction_begin_locked(usage, now_us);
+    usage->current.input_tokens += input_tokens;
+    usage->current.output_tokens += output_tokens;
+    taskEXIT_CRITICAL(&usage->lock);
+}
+
+void esp_agent_usage_tool_call(esp_agent_usage_t *usage, const char *id)
+{
+    int64_t now_us = esp_timer_get_time();
+    uint32_t id_hash = usage_hash_id(id);
+
+    taskENTER_CRITICAL(&usage->lock);
+    usage_transaction_begin_locked(usage, now_us);
+    usage->current.tool_calls++;
+
+    /* Reuse a free slot, or the oldest one if all are in use */
+    esp_agent_usage_pending_tool_t *slot = &usage->pending_tools[0];
+    for (size_t i = 0; i < ESP_AGENT_USAGE_MAX_PENDING_TOOLS; i++) {
+        esp_agent_usage_pending_tool_t *curr = &usage->pending_tools[i];
+        if (curr->start_us == 0) {
+            slot = curr;
+            break;
+        }
+        if (curr->start_us < slot->start_us) {
+            slot = curr;
+        }
+    }
+    slot->id_hash = id_hash;
+    slot->start_us = now_us;
+    taskEXIT_CRITICAL(&usage->lock);
+}
+
+void esp_agent_usage_tool_result(esp_agent_usage_t *usage, const char *id, int32_t reported_latency_ms)
+{
+    int64_t now_us = esp_timer_get_time();
+    uint32_t id_hash = usage_hash_id(id);
+    uint32_t latency_ms = 0;
+    bool found = false;
+
+    taskENTER_CRITICAL(&usage->lock);
+    for (size_t i = 0; i < ESP_AGENT_USAGE_MAX_PENDING_TOOLS; i++) {
+        esp_agent_usage_pending_tool_t *curr = &usage->pending_tools[i];
+        if (curr->start_us != 0 && curr->id_hash == id_hash) {
+            latency_ms = usage_elapsed_ms(curr->start_us, now_us);
+            curr->start_us = 0;
+            found = true;
+            break;
+        }
+    }
+
+    if (reported_latency_ms >= 0) {
+        latency_ms = (uint32_t)reported_latency_ms;
+        found = true;
+    }
+
+    if (found) {
+        usage->current.tool_latency_ms += latency_ms;
+        if (latency_ms > usage->stats.tool_latency_max_ms) {
+            usage->stats.tool_latency_max_ms = latency_ms;
+        }
+    }
+    taskEXIT_CRITICAL(&usage->lock);
+
+    if (!found) {
+        ESP_LOGD(TAG, "Tool result without matching tool call");
+    }
+}
+
+void esp_agent_usage_transaction_end(esp_agent_usage_t *usage, esp_agent_usage_info_t *info)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&usage->lock);
+    usage_transaction_begin_locked(usage, now_us);
+    usage->current.duration_ms = usage_elapsed_ms(usage->transaction_start_us, now_us);
+
+    usage->stats.transactions++;
+    usage->stats.input_tokens += usage->current.input_tokens;
+    usage->stats.output_tokens += usage->current.output_tokens;
+    usage->stats.tool_calls += usage->current.tool_calls;
+    usage->stats.tool_latency_total_ms += usage->current.tool_latency_ms;
+    usage->stats.transaction_total_ms += usage->current.duration_ms;
+    if (usage->current.duration_ms > usage->stats.transaction_max_ms) {
+        usage->stats.transaction_max_ms = usage->current.duration_ms;
+    }
+
+    if (info) {
+        *info = usage->current;
+    }
+    usage->in_transaction = false;
+    memset(usage->pending_tools, 0, sizeof(usage->pending_tools));
+    taskEXIT_CRITICAL(&usage->lock);
+}
+
+esp_err_t esp_agent_get_usage_stats(esp_agent_handle_t handle, esp_agent_usage_stats_t *stats)
+{
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+
+    taskENTER_CRITICAL(&agent->usage.lock);
+    *stats = agent->usage.stats;
+    taskEXIT_CRITICAL(&agent->usage.lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_agent_reset_usage_stats(esp_agent_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_agent_t *agent = (esp_agent_t *)handle;
+    esp_agent_usage_reset(&agent->usage);
+
+    return ESP_OK;
+}
@@ -9,6 +9,7 @@
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
 
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -75,6 +76,8 @@ void esp_agent_websocket_send_task(void *pvParameters)
             if (ws_ret < 0) {
                 ESP_LOGE(TAG, "Failed to send message: %d", ws_ret);
             }
+            esp_agent_capture_record(&agent->capture, ESP_AGENT_CAPTURE_DIR_TX, send_opcode,
+                                     ESP_AGENT_CAPTURE_FLAG_FIN | (ws_ret < 0 ? ESP_AGENT_CAPTURE_FLAG_ERROR : 0), msg->payload, msg->len);
 
         deallocate_message:
             if (msg->payload) {
@@ -122,7 +125,7 @@ esp_err_t esp_agent_websocket_queue_message(esp_agent_handle_t handle, ws_send_m
 
     ESP_GOTO_ON_FALSE(xQueueSend(agent->send_queue, &msg, timeout), ESP_ERR_TIMEOUT, error, TAG, "Failed to queue message (queue full), dropping");
 
-    ESP_LOGV(TAG, "Queued %s message: %d bytes", type == WS_SEND_MSG_TYPE_TEXT ? "text" : "binary", len);
+    ESP_LOGV(TAG, "Queued %s message: %zu bytes", type == WS_SEND_MSG_TYPE_TEXT ? "text" : "binary", len);
     return ret;
 
 error:
@@ -180,7 +183,7 @@ esp_err_t esp_agent_websocket_start(esp_agent_handle_t handle)
         agent->access_token_timestamp = esp_timer_get_time();
         ESP_LOGD(TAG, "Access token: %s", agent->access_token);
     } else {
-        ESP_LOGI(TAG, "Using existing access token, will expire in %lld seconds", (ACCESS_TOKEN_EXPIRATION_SECONDS - (esp_timer_get_time() - agent->access_token_timestamp) / 1000000));
+        ESP_LOGI(TAG, "Using existing access token, will expire in %" PRId64 " seconds", (ACCESS_TOKEN_EXPIRATION_SECONDS - (esp_timer_get_time() - agent->access_token_timestamp) / 1000000));
     }
 
     ESP_GOTO_ON_ERROR(build_ws_uri(agent->agent_id, agent->access_token, &ws_uri, &ws_uri_len), end, TAG, "Failed to build websocket URI");
@@ -331,10 +334,19 @@ void esp_agent_websocket_event_handler(void *handler_args, esp_event_base_t base
     static char *message_buffer = NULL;
     static size_t message_buffer_size = 0;
     static size_t message_buffer_capacity = 0;
+    /* Opcode of the message being received, continuation frames carry WS_TRANSPORT_OPCODES_CONT */
+    static uint8_t message_op_code = WS_TRANSPORT_OPCODES_TEXT;
 
     esp_agent_t *agent = (esp_agent_t *)handler_args;
     esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
 
+    if (event_id == WEBSOCKET_EVENT_DATA) {
+        esp_agent_capture_record(&agent->capture, ESP_AGENT_CAPTURE_DIR_RX, data->op_code,
+                                 data->fin ? ESP_AGENT_CAPTURE_FLAG_FIN : 0, data->data_ptr, data->data_len);
+    } else {
+        esp_agent_capture_record(&agent->capture, ESP_AGENT_CAPTURE_DIR_EVENT, event_id, 0, NULL, 0);
+    }
+
     switch (event_id) {
         case WEBSOCKET_EVENT_CONNECTED:
             ESP_LOGI(TAG, "WebSocket connected");
@@ -346,7 +358,13 @@ void esp_agent_websocket_event_handler(void *handler_args, esp_event_base_t base
             break;
 
         case WEBSOCKET_EVENT_DATA:
-            if (data->op_code == WS_TRANSPORT_OPCODES_TEXT) {
+            if (data->op_code == WS_TRANSPORT_OPCODES_TEXT || data->op_code == WS_TRANSPORT_OPCODES_BINARY) {
+                message_op_code = data->op_code;
+            } else if (data->op_code != WS_TRANSPORT_OPCODES_CONT) {
+                break;
+            }
+
+            if (message_op_code == WS_TRANSPORT_OPCODES_TEXT) {
                 ESP_LOGD(TAG, "Received text chunk: %.*s", data->data_len, (char *)data->data_ptr);
 
                 // Reallocate buffer if needed
@@ -380,6 +398,7 @@ void esp_agent_websocket_event_handler(void *handler_args, esp_event_base_t base
                         int err = xQueueSend(agent->message_queue, &complete_message, pdMS_TO_TICKS(10));
                         if (err != pdTRUE) {
                             ESP_LOGE(TAG, "Failed to send complete message to queue");
+                            agent->messages_dropped++;
                             free(complete_message);
                         }
                     }
@@ -401,7 +420,7 @@ void esp_agent_websocket_event_handler(void *handler_args, esp_event_base_t base
                         message_buffer[0] = '\0';
                 }
 
-            } else if (data->op_code == WS_TRANSPORT_OPCODES_BINARY) {
+            } else if (message_op_code == WS_TRANSPORT_OPCODES_BINARY) {
                 ESP_LOGV(TAG, "Received speech data: %d bytes", data->data_len);
                 uint8_t *audio_buf = malloc(data->data_len);
                 if (!audio_buf) {
@@ -416,7 +435,10 @@ void esp_agent_websocket_event_handler(void *handler_args, esp_event_base_t base
                         .len = data->data_len,
                     },
                 };
-                esp_agent_post_event(agent, ESP_AGENT_EVENT_DATA_TYPE_SPEECH, &message_data);
+                if (esp_agent_post_event(agent, ESP_AGENT_EVENT_DATA_TYPE_SPEECH, &message_data) != ESP_OK) {
+                    agent->messages_dropped++;
+                    free(audio_buf);
+                }
             }
             break;
 
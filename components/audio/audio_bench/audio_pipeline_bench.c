@@ -0,0 +1,407 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#include "audio_file_dev.h"
+#include "audio_playback.h"
+#include "audio_recorder.h"
+#include "audio_pipeline_bench.h"
+#include "audio_common.h"
+
+static const char *TAG = "audio_pipeline_bench";
+
+#if CONFIG_AUDIO_PIPELINE_BENCH
+
+#define BENCH_SAMPLE_RATE       16000
+#define BENCH_MIC_CHANNELS      4       /* RMNM: reference, microphone, unused, microphone */
+#define BENCH_SPEAKER_CHANNELS  2
+#define BENCH_FRAME_MS          20
+#define BENCH_OPUS_COMPLEXITY   5
+#define BENCH_PERIOD_MS         1000
+#define BENCH_CHIRP_MS          100
+#define BENCH_CHIRP_START_HZ    300.0
+#define BENCH_CHIRP_END_HZ      3000.0
+#define BENCH_CHIRP_AMPLITUDE   12000
+#define BENCH_MIC_THRESHOLD     4000
+#define BENCH_SPEAKER_THRESHOLD 2000    /* Lower, the AFE and the codec may attenuate the chirp */
+#define BENCH_START_TIMEOUT_MS  10000
+
+typedef struct {
+    const char *name;
+    audio_recorder_codec_t recorder_codec;
+    audio_playback_codec_t playback_codec;
+} bench_case_t;
+
+typedef struct {
+    uint32_t chirps;
+    uint32_t packets;
+    uint64_t packet_bytes;
+    uint64_t capture_sum_us;
+    uint64_t recorder_sum_us;
+    uint64_t playback_sum_us;
+    uint64_t end_to_end_sum_us;
+    uint32_t end_to_end_max_us;
+    uint32_t xruns;
+    uint64_t played_bytes;
+} bench_result_t;
+
+/* Progress of the chirp being timed */
+typedef struct {
+    int64_t mic_onset_us;
+    int64_t packet_us;          /* When the packet holding the onset was read from the recorder */
+} bench_chirp_t;
+
+typedef struct {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle[portNUM_PROCESSORS];
+    configRUN_TIME_COUNTER_TYPE total;
+#endif
+} bench_load_t;
+
+static const bench_case_t s_bench_cases[] = {
+    {"loopback.opus", AUDIO_RECORDER_CODEC_OPUS, AUDIO_PLAYBACK_CODEC_OPUS},
+    {"loopback.pcm", AUDIO_RECORDER_CODEC_PCM, AUDIO_PLAYBACK_CODEC_PCM},
+};
+
+static void bench_load_start(bench_load_t *load)
+{
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        load->idle[core] = ulTaskGetIdleRunTimeCounterForCore(core);
+    }
+    load->total = portGET_RUN_TIME_COUNTER_VALUE();
+#endif
+}
+
+static void bench_load_print(const bench_load_t *load)
+{
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE elapsed = portGET_RUN_TIME_COUNTER_VALUE() - load->total;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounterForCore(core) - load->idle[core];
+        printf(",\"core%d_pct\":%" PRIu32, core, elapsed ? (uint32_t)(100 - (uint64_t)idle * 100 / elapsed) : 0);
+    }
+#endif
+}
+
+/* One period of microphone frames: the chirp on both microphone slots, then silence */
+static int16_t *bench_chirp_create(size_t *len)
+{
+    size_t frames = BENCH_SAMPLE_RATE * BENCH_PERIOD_MS / 1000;
+    size_t chirp_frames = BENCH_SAMPLE_RATE * BENCH_CHIRP_MS / 1000;
+    double sweep = (BENCH_CHIRP_END_HZ - BENCH_CHIRP_START_HZ) / (2.0 * BENCH_CHIRP_MS / 1000);
+
+    *len = frames * BENCH_MIC_CHANNELS * sizeof(int16_t);
+    int16_t *frames_buf = heap_caps_calloc(1, *len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (frames_buf == NULL) {
+        frames_buf = calloc(1, *len);
+    }
+    if (frames_buf == NULL) {
+        return NULL;
+    }
+    for (size_t n = 0; n < chirp_frames; n++) {
+        double t = (double)n / BENCH_SAMPLE_RATE;
+        int16_t v = (int16_t)(BENCH_CHIRP_AMPLITUDE * sin(2 * M_PI * (BENCH_CHIRP_START_HZ * t + sweep * t * t)));
+        frames_buf[n * BENCH_MIC_CHANNELS + 1] = v;
+        frames_buf[n * BENCH_MIC_CHANNELS + 3] = v;
+    }
+    return frames_buf;
+}
+
+static bool bench_pcm_has_onset(const audio_recorder_packet_t *packet)
+{
+    const int16_t *samples = (const int16_t *)packet->data;
+    for (size_t n = 0; n < packet->len / sizeof(int16_t); n++) {
+        if (samples[n] >= BENCH_MIC_THRESHOLD / 2 || samples[n] <= -BENCH_MIC_THRESHOLD / 2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Time one packet and pass it on to the playback */
+static void bench_packet(const bench_case_t *bench, audio_file_dev_handle_t mic, const audio_recorder_packet_t *packet,
+                         bench_chirp_t *chirp, bench_result_t *result)
+{
+    int64_t now = esp_timer_get_time();
+
+    result->packets++;
+    result->packet_bytes += packet->len;
+    result->capture_sum_us += now - packet->capture_time_us;
+
+    if (chirp->mic_onset_us == 0) {
+        audio_file_dev_stats_t stats;
+        audio_file_dev_get_stats(mic, &stats);
+        chirp->mic_onset_us = stats.onset_us;
+    }
+    if (chirp->mic_onset_us && chirp->packet_us == 0) {
+        bool onset = false;
+        if (bench->recorder_codec == AUDIO_RECORDER_CODEC_PCM) {
+            onset = bench_pcm_has_onset(packet);
+        } else {
+            onset = packet->capture_time_us + packet->duration_ms * 1000 > chirp->mic_onset_us;
+        }
+        if (onset) {
+            chirp->packet_us = now;
+        }
+    }
+}
+
+/* Pass one packet from the recorder to the playback, timing it unless bench is NULL */
+static void bench_forward(audio_recorder_handle_t recorder, audio_playback_handle_t playback, const bench_case_t *bench,
+                          audio_file_dev_handle_t mic, bench_chirp_t *chirp, bench_result_t *result)
+{
+    audio_recorder_packet_t packet;
+    if (audio_recorder_acquire_read(recorder, &packet, pdMS_TO_TICKS(100)) != ESP_OK) {
+        return;
+    }
+    if (packet.len) {
+        if (bench) {
+            bench_packet(bench, mic, &packet, chirp, result);
+        }
+        audio_playback_write(playback, packet.data, packet.len);
+    }
+    audio_recorder_release_read(recorder);
+}
+
+/* Once the speaker played the chirp, or it got lost, take its times and look for the next one */
+static void bench_chirp_check(audio_file_dev_handle_t mic, audio_file_dev_handle_t speaker, bench_chirp_t *chirp,
+                              bench_result_t *result)
+{
+    int64_t now = esp_timer_get_time();
+    if (chirp->mic_onset_us == 0 || now - chirp->mic_onset_us < BENCH_PERIOD_MS * 1000 / 2) {
+        /* Rearm in the silence after the chirp, not in the middle of it */
+        return;
+    }
+
+    audio_file_dev_stats_t mic_stats;
+    audio_file_dev_stats_t speaker_stats;
+    audio_file_dev_get_stats(mic, &mic_stats);
+    audio_file_dev_get_stats(speaker, &speaker_stats);
+    if (speaker_stats.onset_us == 0 && now - chirp->mic_onset_us < BENCH_PERIOD_MS * 1000) {
+        return;
+    }
+
+    if (speaker_stats.onset_us > chirp->mic_onset_us && chirp->packet_us) {
+        uint32_t end_to_end_us = (uint32_t)(speaker_stats.onset_us - chirp->mic_onset_us);
+        result->chirps++;
+        result->recorder_sum_us += chirp->packet_us - chirp->mic_onset_us;
+        result->playback_sum_us += speaker_stats.onset_us - chirp->packet_us;
+        result->end_to_end_sum_us += end_to_end_us;
+        if (end_to_end_us > result->end_to_end_max_us) {
+            result->end_to_end_max_us = end_to_end_us;
+        }
+    } else {
+        ESP_LOGW(TAG, "Chirp not played back");
+    }
+    result->xruns += mic_stats.xruns + speaker_stats.xruns;
+    result->played_bytes += speaker_stats.bytes;
+    audio_file_dev_reset_stats(mic);
+    audio_file_dev_reset_stats(speaker);
+    *chirp = (bench_chirp_t) {0};
+}
+
+static esp_err_t bench_loopback(const bench_case_t *bench, uint32_t seconds, const uint8_t *chirp_data, size_t chirp_len)
+{
+    esp_err_t ret = ESP_OK;
+    audio_recorder_handle_t recorder = NULL;
+    audio_playback_handle_t playback = NULL;
+    bench_result_t result = {0};
+    bench_chirp_t chirp = {0};
+    bench_load_t load = {0};
+    audio_playback_stats_t playback_stats = {0};
+
+    audio_file_dev_config_t mic_config = {
+        .data = chirp_data,
+        .data_len = chirp_len,
+        .loop = true,
+        .realtime = true,
+        .onset_threshold = BENCH_MIC_THRESHOLD,
+    };
+    audio_file_dev_config_t speaker_config = {
+        .realtime = true,
+        .onset_threshold = BENCH_SPEAKER_THRESHOLD,
+    };
+    audio_file_dev_handle_t mic = audio_file_dev_create(ESP_CODEC_DEV_TYPE_IN, &mic_config);
+    audio_file_dev_handle_t speaker = audio_file_dev_create(ESP_CODEC_DEV_TYPE_OUT, &speaker_config);
+    if (mic == NULL || speaker == NULL) {
+        ret = ESP_ERR_NO_MEM;
+        goto end;
+    }
+
+    esp_codec_dev_sample_info_t mic_fs = {
+        .sample_rate = BENCH_SAMPLE_RATE,
+        .channel = BENCH_MIC_CHANNELS,
+        .bits_per_sample = 16,
+    };
+    esp_codec_dev_sample_info_t speaker_fs = {
+        .sample_rate = BENCH_SAMPLE_RATE,
+        .channel = BENCH_SPEAKER_CHANNELS,
+        .bits_per_sample = 16,
+    };
+    if (esp_codec_dev_open(audio_file_dev_get_codec_dev(mic), &mic_fs) != ESP_CODEC_DEV_OK
+        || esp_codec_dev_open(audio_file_dev_get_codec_dev(speaker), &speaker_fs) != ESP_CODEC_DEV_OK) {
+        ESP_LOGE(TAG, "Failed to open file devices");
+        ret = ESP_FAIL;
+        goto end;
+    }
+
+    audio_recorder_config_t recorder_config = {
+        .format = "RMNM",
+        .in_dev_handle = audio_file_dev_get_codec_dev(mic),
+        .codec = bench->recorder_codec,
+        .sample_rate = BENCH_SAMPLE_RATE,
+        .frame_duration_ms = BENCH_FRAME_MS,
+        .complexity = BENCH_OPUS_COMPLEXITY,
+    };
+    recorder = audio_recorder_init(&recorder_config);
+    if (recorder == NULL) {
+        ret = ESP_FAIL;
+        goto end;
+    }
+
+    audio_playback_config_t playback_config = {
+        .audio_in_info = {
+            .sample_rate = BENCH_SAMPLE_RATE,
+            .frame_duration_ms = BENCH_FRAME_MS,
+            .codec = bench->playback_codec,
+        },
+        .out_codec_info = speaker_fs,
+        .out_dev_handle = audio_file_dev_get_codec_dev(speaker),
+    };
+    playback = audio_playback_init(&playback_config);
+    if (playback == NULL) {
+        ret = ESP_FAIL;
+        goto end;
+    }
+
+    ret = audio_playback_start(playback);
+    if (ret == ESP_OK) {
+        ret = audio_recorder_start(recorder);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the pipelines: %s", esp_err_to_name(ret));
+        goto end;
+    }
+
+    /* Let the pipelines settle, then start timing in the silence between two chirps */
+    int64_t deadline = esp_timer_get_time() + BENCH_START_TIMEOUT_MS * 1000;
+    while (true) {
+        audio_file_dev_stats_t mic_stats;
+        audio_file_dev_get_stats(mic, &mic_stats);
+        if (mic_stats.calls && esp_timer_get_time() > mic_stats.first_us + BENCH_PERIOD_MS * 1500) {
+            break;
+        }
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGE(TAG, "The recorder did not read the microphone");
+            ret = ESP_ERR_TIMEOUT;
+            goto end;
+        }
+        bench_forward(recorder, playback, NULL, NULL, NULL, NULL);
+    }
+
+    audio_file_dev_reset_stats(mic);
+    audio_file_dev_reset_stats(speaker);
+    bench_load_start(&load);
+    int64_t start = esp_timer_get_time();
+    deadline = start + (int64_t)seconds * 1000000;
+    while (esp_timer_get_time() < deadline) {
+        bench_forward(recorder, playback, bench, mic, &chirp, &result);
+        bench_chirp_check(mic, speaker, &chirp, &result);
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    audio_file_dev_stats_t mic_stats;
+    audio_file_dev_stats_t speaker_stats;
+    audio_file_dev_get_stats(mic, &mic_stats);
+    audio_file_dev_get_stats(speaker, &speaker_stats);
+    audio_playback_get_stats(playback, &playback_stats);
+    result.xruns += mic_stats.xruns + speaker_stats.xruns;
+    result.played_bytes += speaker_stats.bytes;
+    uint32_t chirps = result.chirps ? result.chirps : 1;
+    uint32_t packets = result.packets ? result.packets : 1;
+    double played_us = result.played_bytes * 1000000.0 / (BENCH_SAMPLE_RATE * BENCH_SPEAKER_CHANNELS * sizeof(int16_t));
+
+    printf("{\"suite\":\"audio_pipeline\",\"bench\":\"%s\",\"seconds\":%" PRIu32 ",\"chirps\":%" PRIu32
+           ",\"capture_us\":%" PRIu64 ",\"recorder_us\":%" PRIu64 ",\"playback_us\":%" PRIu64
+           ",\"end_to_end_us\":%" PRIu64 ",\"end_to_end_max_us\":%" PRIu32
+           ",\"upload_kbps\":%.1f,\"realtime_pct\":%.1f,\"xruns\":%" PRIu32 ",\"restarts\":%" PRIu32,
+           bench->name, seconds, result.chirps, result.capture_sum_us / packets, result.recorder_sum_us / chirps,
+           result.playback_sum_us / chirps, result.end_to_end_sum_us / chirps, result.end_to_end_max_us,
+           result.packet_bytes * 8000.0 / elapsed_us, played_us * 100 / elapsed_us, result.xruns, playback_stats.restarts);
+    bench_load_print(&load);
+    printf("}\n");
+    if (result.chirps == 0) {
+        ESP_LOGW(TAG, "%s: no chirp made it through the pipelines", bench->name);
+    }
+
+end:
+    if (recorder) {
+        audio_recorder_deinit(recorder);
+    }
+    if (playback) {
+        audio_playback_deinit(playback);
+    }
+    audio_file_dev_destroy(mic);
+    audio_file_dev_destroy(speaker);
+    return ret;
+}
+
+esp_err_t audio_pipeline_bench_run(uint32_t seconds, const char *filter)
+{
+    esp_err_t ret = ESP_OK;
+    size_t chirp_len = 0;
+
+    /* The bench recorder needs the one AFE of the pool, swapping it under a live recorder would cut it off */
+    if (audio_pool_afe_in_use()) {
+        ESP_LOGE(TAG, "A recorder is running, the benchmark needs its AFE");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (seconds == 0) {
+        seconds = CONFIG_AUDIO_PIPELINE_BENCH_SECONDS;
+    }
+    int16_t *chirp = bench_chirp_create(&chirp_len);
+    if (chirp == NULL) {
+        ESP_LOGE(TAG, "No memory for the chirp");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < sizeof(s_bench_cases) / sizeof(s_bench_cases[0]); i++) {
+        const bench_case_t *bench = &s_bench_cases[i];
+        if (filter && filter[0] != '\0' && strstr(bench->name, filter) == NULL) {
+            continue;
+        }
+        esp_err_t err = bench_loopback(bench, seconds, (const uint8_t *)chirp, chirp_len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s failed: %s", bench->name, esp_err_to_name(err));
+            ret = err;
+        }
+    }
+
+    free(chirp);
+    return ret;
+}
+
+#else /* CONFIG_AUDIO_PIPELINE_BENCH */
+
+esp_err_t audio_pipeline_bench_run(uint32_t seconds, const char *filter)
+{
+    ESP_LOGE(TAG, "Benchmarks are disabled, enable CONFIG_AUDIO_PIPELINE_BENCH");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_AUDIO_PIPELINE_BENCH */
@@ -0,0 +1,56 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __AUDIO_PIPELINE_BENCH_H__
+#define __AUDIO_PIPELINE_BENCH_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Run the recorder and playback pipelines in loopback on file codec devices
+ *
+ * A recorder and a playback are created on audio_file_dev devices paced in real time: the microphone
+ * repeats a 100 ms chirp every second, and every packet the recorder produces is written to the playback,
+ * whose speaker only records when the chirp comes out. One benchmark runs per codec, "loopback.opus" and
+ * "loopback.pcm", each printing one JSON object per line:
+ *
+ *     {"suite":"audio_pipeline","bench":"loopback.opus","seconds":10,"chirps":9,"capture_us":21250,
+ *      "recorder_us":84512,"playback_us":61420,"end_to_end_us":145932,"end_to_end_max_us":151020,
+ *      "upload_kbps":24.1,"realtime_pct":99.8,"xruns":0,"restarts":0,"core0_pct":31,"core1_pct":58}
+ *
+ * - capture_us: average time from capture to packet, as audio_recorder_packet_t capture_time_us measures it
+ * - recorder_us: chirp onset on the microphone to the packet holding it read from the recorder. With Opus
+ *   the packet is found from its capture time, so AFE buffering is left to playback_us.
+ * - playback_us: that packet written to the playback to the chirp onset on the speaker
+ * - end_to_end_us, end_to_end_max_us: chirp onset on the microphone to onset on the speaker
+ * - upload_kbps: size of the recorded packets
+ * - realtime_pct: audio played over the run time, below 100 when the pipelines fall behind
+ * - xruns: microphone overflows and speaker underruns, see audio_file_dev_stats_t
+ * - restarts: playback pipeline restarts, see audio_playback_get_stats()
+ * - coreN_pct: load of each core over the run, the pipelines running outside the benchmark included.
+ *   Requires CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ *
+ * Needs the memory of a second recorder and playback. The recorder takes the one AFE of the shared pool, with
+ * the "RMNM" format, so the benchmark refuses to run while another recorder holds it: deinitialize that one
+ * first. Requires CONFIG_AUDIO_PIPELINE_BENCH.
+ *
+ * @param seconds Duration of each benchmark, 0 for CONFIG_AUDIO_PIPELINE_BENCH_SECONDS
+ * @param filter Only run benchmarks whose name contains this string (NULL for all)
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if benchmarks are disabled, error code otherwise
+ */
+esp_err_t audio_pipeline_bench_run(uint32_t seconds, const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_PIPELINE_BENCH_H__ */
@@ -7,6 +7,8 @@
 #include "esp_audio_dec_default.h"
 #include "esp_audio_enc_default.h"
 #include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
 #include <esp_log.h>
 #include <esp_gmf_pool.h>
 #include <esp_afe_sr_models.h>
@@ -26,6 +28,10 @@
 typedef struct {
     esp_gmf_pool_handle_t pool_handle;
     bool initialized;
+    /* The pool has no way to drop an element, so the ai_afe registered with the manager stays for good */
+    esp_gmf_afe_manager_handle_t afe_manager;
+    char afe_format[16];
+    uint8_t afe_users;
 } audio_common_data_t;
 
 static const char *TAG = "audio_common";
@@ -105,7 +111,7 @@ static esp_gmf_afe_manager_handle_t pool_setup_afe(const char *input_format, esp
     afe_cfg->aec_init = false;
 #endif
     afe_cfg->vad_init = true;
-    afe_cfg->vad_min_noise_ms = 1000;
+    afe_cfg->vad_min_noise_ms = CONFIG_AUDIO_VAD_HANGOVER_MS;
     afe_cfg->vad_min_speech_ms = 64;
     afe_cfg->vad_mode = VAD_MODE_3;
     afe_cfg->se_init = false;
@@ -132,6 +138,14 @@ static esp_gmf_afe_manager_handle_t pool_setup_afe(const char *input_format, esp
     esp_gmf_element_handle_t ai_afe = NULL;
     esp_gmf_afe_cfg_t ai_afe_cfg = DEFAULT_GMF_AFE_CFG(gmf_afe_manager, NULL, NULL, models);
     ai_afe_cfg.wakeup_end = 15 * 1000; // 15 seconds
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+    /* MultiNet is only loaded with this option, and only runs after the wake word */
+    ai_afe_cfg.vcmd_detect_en = true;
+    ai_afe_cfg.mn_language = CONFIG_AUDIO_RECORDER_COMMAND_LANGUAGE;
+    ai_afe_cfg.vcmd_timeout = CONFIG_AUDIO_RECORDER_COMMAND_TIMEOUT_MS;
+#else
+    ai_afe_cfg.vcmd_detect_en = false;
+#endif
 
     err = esp_gmf_afe_init(&ai_afe_cfg, &ai_afe);
     if (err != ESP_GMF_ERR_OK) {
@@ -191,6 +205,37 @@ void* audio_pool_register_afe(const char *input_format)
         ESP_LOGE(TAG, "Audio pool not initialized");
         return NULL;
     }
+    if (input_format == NULL) {
+        return NULL;
+    }
+
+    if (g_audio_common_data.afe_manager == NULL) {
+        g_audio_common_data.afe_manager = pool_setup_afe(input_format, g_audio_common_data.pool_handle);
+        if (g_audio_common_data.afe_manager == NULL) {
+            return NULL;
+        }
+        snprintf(g_audio_common_data.afe_format, sizeof(g_audio_common_data.afe_format), "%s", input_format);
+    } else if (g_audio_common_data.afe_users > 0) {
+        /* One manager feeds one pipeline, and a second ai_afe in the pool would never be found by name */
+        ESP_LOGE(TAG, "AFE already in use");
+        return NULL;
+    } else if (strcmp(g_audio_common_data.afe_format, input_format) != 0) {
+        ESP_LOGE(TAG, "AFE registered for %s, can't switch to %s", g_audio_common_data.afe_format, input_format);
+        return NULL;
+    }
 
-    return pool_setup_afe(input_format, g_audio_common_data.pool_handle);
+    g_audio_common_data.afe_users++;
+    return g_audio_common_data.afe_manager;
+}
+
+void audio_pool_release_afe(void)
+{
+    if (g_audio_common_data.afe_users > 0) {
+        g_audio_common_data.afe_users--;
+    }
+}
+
+bool audio_pool_afe_in_use(void)
+{
+    return g_audio_common_data.afe_users > 0;
 }
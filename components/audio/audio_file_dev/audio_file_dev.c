@@ -0,0 +1,482 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <audio_codec_data_if.h>
+
+#include "audio_file_dev.h"
+
+static const char *TAG = "audio_file_dev";
+
+#define WAV_HEADER_SIZE     44
+#define WAV_FORMAT_PCM      1
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef struct audio_file_dev {
+    audio_codec_data_if_t base;         /* First member: the data interface callbacks get the device from it */
+    esp_codec_dev_handle_t codec_dev;
+    esp_codec_dev_type_t type;
+    audio_file_dev_config_t config;
+    char *path;
+    FILE *file;
+    long data_start;                    /* Offset of the samples in the WAV file */
+    size_t data_size;                   /* Bytes of samples to read, or written */
+    size_t data_pos;                    /* Read position in the samples */
+    esp_codec_dev_sample_info_t fs;
+    uint32_t byte_rate;
+    bool opened;
+    int64_t clock_us;                   /* Realtime: when the first byte of the stream was captured or played */
+    uint64_t clock_bytes;               /* Bytes read or written since clock_us */
+    portMUX_TYPE stats_lock;
+    audio_file_dev_stats_t stats;
+} audio_file_dev_t;
+
+static uint16_t wav_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t wav_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void wav_put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void wav_put_le32(uint8_t *p, uint32_t v)
+{
+    wav_put_le16(p, v & 0xffff);
+    wav_put_le16(p + 2, v >> 16);
+}
+
+static void wav_write_header(FILE *file, const esp_codec_dev_sample_info_t *fs, uint32_t data_size)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+    uint16_t block_align = fs->channel * fs->bits_per_sample / 8;
+
+    memcpy(header, "RIFF", 4);
+    wav_put_le32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    wav_put_le32(header + 16, 16);
+    wav_put_le16(header + 20, WAV_FORMAT_PCM);
+    wav_put_le16(header + 22, fs->channel);
+    wav_put_le32(header + 24, fs->sample_rate);
+    wav_put_le32(header + 28, fs->sample_rate * block_align);
+    wav_put_le16(header + 32, block_align);
+    wav_put_le16(header + 34, fs->bits_per_sample);
+    memcpy(header + 36, "data", 4);
+    wav_put_le32(header + 40, data_size);
+    fwrite(header, 1, sizeof(header), file);
+}
+
+/* Find the samples of the WAV file and check they are in the format the device was opened with */
+static int wav_read_header(audio_file_dev_t *dev)
+{
+    uint8_t riff[12];
+    bool fmt_found = false;
+
+    if (fread(riff, 1, sizeof(riff), dev->file) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", dev->path);
+        return ESP_CODEC_DEV_NOT_SUPPORT;
+    }
+
+    while (true) {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, sizeof(chunk), dev->file) != sizeof(chunk)) {
+            ESP_LOGE(TAG, "No samples in %s", dev->path);
+            return ESP_CODEC_DEV_NOT_SUPPORT;
+        }
+        uint32_t len = wav_le32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (len < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), dev->file) != sizeof(fmt)) {
+                ESP_LOGE(TAG, "Invalid format chunk in %s", dev->path);
+                return ESP_CODEC_DEV_NOT_SUPPORT;
+            }
+            uint16_t format = wav_le16(fmt);
+            uint16_t channels = wav_le16(fmt + 2);
+            uint32_t sample_rate = wav_le32(fmt + 4);
+            uint16_t bits = wav_le16(fmt + 14);
+            if ((format != WAV_FORMAT_PCM && format != WAV_FORMAT_EXTENSIBLE) || channels != dev->fs.channel
+                || sample_rate != dev->fs.sample_rate || bits != dev->fs.bits_per_sample) {
+                ESP_LOGE(TAG, "%s is %" PRIu32 " Hz, %d bits, %d channels (format %d), the device %" PRIu32 " Hz, %d bits, %d channels",
+                         dev->path, sample_rate, bits, channels, format, (uint32_t)dev->fs.sample_rate,
+                         dev->fs.bits_per_sample, dev->fs.channel);
+                return ESP_CODEC_DEV_NOT_SUPPORT;
+            }
+            fmt_found = true;
+            fseek(dev->file, len - sizeof(fmt) + (len & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!fmt_found) {
+                ESP_LOGE(TAG, "No format chunk before the samples in %s", dev->path);
+                return ESP_CODEC_DEV_NOT_SUPPORT;
+            }
+            dev->data_start = ftell(dev->file);
+            dev->data_size = len;
+            return ESP_CODEC_DEV_OK;
+        } else {
+            fseek(dev->file, len + (len & 1), SEEK_CUR);
+        }
+    }
+}
+
+/* Write the final sizes into the header of a WAV file being written */
+static void wav_finish(audio_file_dev_t *dev)
+{
+    if (dev->type != ESP_CODEC_DEV_TYPE_OUT || dev->file == NULL) {
+        return;
+    }
+    fseek(dev->file, 0, SEEK_SET);
+    wav_write_header(dev->file, &dev->fs, dev->data_size);
+    fseek(dev->file, 0, SEEK_END);
+    fflush(dev->file);
+}
+
+static uint64_t file_dev_bytes_to_us(audio_file_dev_t *dev, uint64_t bytes)
+{
+    return bytes * 1000000 / dev->byte_rate;
+}
+
+static void file_dev_sleep_until(int64_t due_us)
+{
+    int64_t wait_us = due_us - esp_timer_get_time();
+    if (wait_us > 0) {
+        /* Rounded up to whole ticks, late by at most one tick like a DMA interrupt behind other work */
+        vTaskDelay((TickType_t)((wait_us * configTICK_RATE_HZ + 999999) / 1000000));
+    }
+}
+
+/* Offset in bytes of the first sample above the onset threshold, -1 if there is none */
+static int file_dev_find_onset(audio_file_dev_t *dev, const uint8_t *data, size_t size)
+{
+    int threshold = dev->config.onset_threshold;
+
+    if (dev->fs.bits_per_sample == 32) {
+        const int32_t *samples = (const int32_t *)data;
+        for (size_t n = 0; n < size / 4; n++) {
+            int v = samples[n] / 65536;
+            if (v >= threshold || v <= -threshold) {
+                return n * 4;
+            }
+        }
+    } else if (dev->fs.bits_per_sample == 16) {
+        const int16_t *samples = (const int16_t *)data;
+        for (size_t n = 0; n < size / 2; n++) {
+            if (samples[n] >= threshold || samples[n] <= -threshold) {
+                return n * 2;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Count a read or write of size bytes, its first byte captured or played at start_us */
+static void file_dev_account(audio_file_dev_t *dev, const uint8_t *data, size_t size, int64_t start_us, bool xrun)
+{
+    int onset = -1;
+    if (dev->config.onset_threshold > 0 && dev->stats.onset_us == 0) {
+        onset = file_dev_find_onset(dev, data, size);
+    }
+
+    portENTER_CRITICAL(&dev->stats_lock);
+    if (dev->stats.calls == 0) {
+        dev->stats.first_us = esp_timer_get_time();
+    }
+    dev->stats.calls++;
+    dev->stats.bytes += size;
+    if (xrun) {
+        dev->stats.xruns++;
+    }
+    if (onset >= 0) {
+        dev->stats.onset_us = start_us + file_dev_bytes_to_us(dev, onset);
+    }
+    portEXIT_CRITICAL(&dev->stats_lock);
+}
+
+/* Fill the buffer from the file or data, then silence */
+static void file_dev_fill(audio_file_dev_t *dev, uint8_t *data, size_t size)
+{
+    size_t filled = 0;
+
+    while (filled < size) {
+        size_t avail = dev->data_size - dev->data_pos;
+        if (avail == 0) {
+            if (!dev->config.loop || dev->data_size == 0) {
+                break;
+            }
+            dev->data_pos = 0;
+            if (dev->file) {
+                fseek(dev->file, dev->data_start, SEEK_SET);
+            }
+            continue;
+        }
+        size_t len = avail < size - filled ? avail : size - filled;
+        if (dev->file) {
+            len = fread(data + filled, 1, len, dev->file);
+            if (len == 0) {
+                /* Shorter than its header says */
+                dev->data_size = dev->data_pos;
+                continue;
+            }
+        } else {
+            memcpy(data + filled, dev->config.data + dev->data_pos, len);
+        }
+        dev->data_pos += len;
+        filled += len;
+    }
+    memset(data + filled, 0, size - filled);
+}
+
+static int file_dev_open(const audio_codec_data_if_t *h, void *data_cfg, int cfg_size)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+    dev->opened = true;
+    return ESP_CODEC_DEV_OK;
+}
+
+static bool file_dev_is_open(const audio_codec_data_if_t *h)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+    return dev->opened;
+}
+
+static int file_dev_enable(const audio_codec_data_if_t *h, esp_codec_dev_type_t dev_type, bool enable)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+
+    /* A new stream starts its clock on the first read or write */
+    dev->clock_us = 0;
+    dev->clock_bytes = 0;
+    if (!enable) {
+        wav_finish(dev);
+    }
+    return ESP_CODEC_DEV_OK;
+}
+
+static int file_dev_set_fmt(const audio_codec_data_if_t *h, esp_codec_dev_type_t dev_type, esp_codec_dev_sample_info_t *fs)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+
+    if (fs->sample_rate == 0 || fs->channel == 0 || (fs->bits_per_sample != 16 && fs->bits_per_sample != 32)) {
+        ESP_LOGE(TAG, "Unsupported format: %d bits, %d channels", fs->bits_per_sample, fs->channel);
+        return ESP_CODEC_DEV_NOT_SUPPORT;
+    }
+    if (dev->file && memcmp(fs, &dev->fs, sizeof(*fs)) != 0) {
+        ESP_LOGE(TAG, "Can't change the format of %s", dev->path);
+        return ESP_CODEC_DEV_NOT_SUPPORT;
+    }
+    dev->fs = *fs;
+    dev->byte_rate = fs->sample_rate * fs->channel * fs->bits_per_sample / 8;
+
+    if (dev->path == NULL || dev->file) {
+        return ESP_CODEC_DEV_OK;
+    }
+    dev->file = fopen(dev->path, dev->type == ESP_CODEC_DEV_TYPE_IN ? "rb" : "wb");
+    if (dev->file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", dev->path);
+        return ESP_CODEC_DEV_NOT_FOUND;
+    }
+    if (dev->type == ESP_CODEC_DEV_TYPE_OUT) {
+        wav_write_header(dev->file, &dev->fs, 0);
+        return ESP_CODEC_DEV_OK;
+    }
+    int ret = wav_read_header(dev);
+    if (ret != ESP_CODEC_DEV_OK) {
+        fclose(dev->file);
+        dev->file = NULL;
+    }
+    return ret;
+}
+
+static int file_dev_read(const audio_codec_data_if_t *h, uint8_t *data, int size)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+    if (dev->byte_rate == 0) {
+        return ESP_CODEC_DEV_WRONG_STATE;
+    }
+
+    file_dev_fill(dev, data, size);
+
+    int64_t now = esp_timer_get_time();
+    int64_t start_us = now;
+    bool xrun = false;
+    if (dev->config.realtime) {
+        if (dev->clock_us == 0) {
+            dev->clock_us = now;
+        }
+        int64_t due_us = dev->clock_us + file_dev_bytes_to_us(dev, dev->clock_bytes + size);
+        if (now - due_us > (int64_t)file_dev_bytes_to_us(dev, size)) {
+            /* The DMA buffers overflowed while nobody read them: this block is the latest audio */
+            xrun = dev->clock_bytes > 0;
+            dev->clock_us = now - file_dev_bytes_to_us(dev, dev->clock_bytes + size);
+            due_us = now;
+        }
+        file_dev_sleep_until(due_us);
+        dev->clock_bytes += size;
+        start_us = due_us - file_dev_bytes_to_us(dev, size);
+    }
+    file_dev_account(dev, data, size, start_us, xrun);
+    return ESP_CODEC_DEV_OK;
+}
+
+static int file_dev_write(const audio_codec_data_if_t *h, uint8_t *data, int size)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+    if (dev->byte_rate == 0) {
+        return ESP_CODEC_DEV_WRONG_STATE;
+    }
+
+    if (dev->file) {
+        if (fwrite(data, 1, size, dev->file) != (size_t)size) {
+            ESP_LOGE(TAG, "Failed to write %s", dev->path);
+            return ESP_CODEC_DEV_WRITE_FAIL;
+        }
+        dev->data_size += size;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t start_us = now;
+    bool xrun = false;
+    if (dev->config.realtime) {
+        if (dev->clock_us == 0) {
+            dev->clock_us = now;
+        }
+        start_us = dev->clock_us + file_dev_bytes_to_us(dev, dev->clock_bytes);
+        if (start_us < now) {
+            /* Everything written so far has played, the speaker was silent until now */
+            xrun = dev->clock_bytes > 0;
+            dev->clock_us = now - file_dev_bytes_to_us(dev, dev->clock_bytes);
+            start_us = now;
+        }
+        file_dev_sleep_until(start_us);
+        dev->clock_bytes += size;
+    }
+    file_dev_account(dev, data, size, start_us, xrun);
+    return ESP_CODEC_DEV_OK;
+}
+
+static int file_dev_close(const audio_codec_data_if_t *h)
+{
+    audio_file_dev_t *dev = (audio_file_dev_t *)h;
+
+    wav_finish(dev);
+    if (dev->file) {
+        fclose(dev->file);
+        dev->file = NULL;
+    }
+    dev->opened = false;
+    return ESP_CODEC_DEV_OK;
+}
+
+audio_file_dev_handle_t audio_file_dev_create(esp_codec_dev_type_t type, const audio_file_dev_config_t *config)
+{
+    if (config == NULL || (type != ESP_CODEC_DEV_TYPE_IN && type != ESP_CODEC_DEV_TYPE_OUT)) {
+        ESP_LOGE(TAG, "Invalid config for audio_file_dev");
+        return NULL;
+    }
+
+    audio_file_dev_t *dev = (audio_file_dev_t *)calloc(1, sizeof(audio_file_dev_t));
+    if (dev == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for file device");
+        return NULL;
+    }
+
+    dev->base.open = file_dev_open;
+    dev->base.is_open = file_dev_is_open;
+    dev->base.enable = file_dev_enable;
+    dev->base.set_fmt = file_dev_set_fmt;
+    dev->base.read = file_dev_read;
+    dev->base.write = file_dev_write;
+    dev->base.close = file_dev_close;
+    dev->type = type;
+    dev->config = *config;
+    portMUX_INITIALIZE(&dev->stats_lock);
+    if (config->path) {
+        dev->path = strdup(config->path);
+        if (dev->path == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for file device");
+            goto err;
+        }
+    } else if (type == ESP_CODEC_DEV_TYPE_IN && config->data) {
+        dev->data_size = config->data_len;
+    }
+    dev->config.path = dev->path;
+    file_dev_open(&dev->base, NULL, 0);
+
+    esp_codec_dev_cfg_t dev_cfg = {
+        .dev_type = type,
+        .data_if = &dev->base,
+    };
+    dev->codec_dev = esp_codec_dev_new(&dev_cfg);
+    if (dev->codec_dev == NULL) {
+        ESP_LOGE(TAG, "Failed to create codec device");
+        goto err;
+    }
+    return dev;
+
+err:
+    free(dev->path);
+    free(dev);
+    return NULL;
+}
+
+esp_codec_dev_handle_t audio_file_dev_get_codec_dev(audio_file_dev_handle_t dev)
+{
+    return dev ? dev->codec_dev : NULL;
+}
+
+esp_err_t audio_file_dev_get_stats(audio_file_dev_handle_t dev, audio_file_dev_stats_t *stats)
+{
+    if (dev == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&dev->stats_lock);
+    *stats = dev->stats;
+    portEXIT_CRITICAL(&dev->stats_lock);
+    return ESP_OK;
+}
+
+esp_err_t audio_file_dev_reset_stats(audio_file_dev_handle_t dev)
+{
+    if (dev == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&dev->stats_lock);
+    dev->stats = (audio_file_dev_stats_t) {0};
+    portEXIT_CRITICAL(&dev->stats_lock);
+    return ESP_OK;
+}
+
+void audio_file_dev_destroy(audio_file_dev_handle_t dev)
+{
+    if (dev == NULL) {
+        return;
+    }
+
+    if (dev->codec_dev) {
+        esp_codec_dev_close(dev->codec_dev);
+        esp_codec_dev_delete(dev->codec_dev);
+    }
+    file_dev_close(&dev->base);
+    free(dev->path);
+    free(dev);
+}
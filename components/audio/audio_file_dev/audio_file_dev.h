@@ -0,0 +1,103 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __AUDIO_FILE_DEV_H__
+#define __AUDIO_FILE_DEV_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_codec_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct audio_file_dev *audio_file_dev_handle_t;
+
+/**
+ * @brief File codec device configuration
+ *
+ * The device stands in for a microphone (ESP_CODEC_DEV_TYPE_IN) or a speaker (ESP_CODEC_DEV_TYPE_OUT) behind
+ * an esp_codec_dev handle, so the recorder and playback pipelines run unchanged on recorded or synthetic audio.
+ * Audio is in the format passed to esp_codec_dev_open(). A WAV file read by an input device must be in that
+ * format, a WAV file written by an output device gets it.
+ *
+ * @param path WAV file read by an input device or written by an output device, NULL for none. An input device
+ *        without a file or data returns silence, an output device without a file discards the audio.
+ * @param data Input device only: frames to return instead of a file, kept by the caller until the device is
+ *        destroyed
+ * @param data_len Length of data in bytes
+ * @param loop Input device only: start the file or data again at its end, instead of returning silence
+ * @param realtime Pace reads and writes to the sample rate, as an I2S DMA does: a read returns once its last
+ *        frame would have been captured, a write once the audio before it has played out. Otherwise calls
+ *        return immediately, to run the pipelines as fast as they can.
+ * @param onset_threshold Amplitude (16-bit scale) of the first sample counted as signal, see
+ *        audio_file_dev_stats_t, 0 to disable
+ */
+typedef struct {
+    const char *path;
+    const uint8_t *data;
+    size_t data_len;
+    bool loop;
+    bool realtime;
+    int16_t onset_threshold;
+} audio_file_dev_config_t;
+
+/**
+ * @brief Counters of a file codec device, since it was opened or audio_file_dev_reset_stats()
+ *
+ * @param bytes Bytes read or written
+ * @param calls Reads or writes
+ * @param xruns Realtime only: reads made more than one call late (the DMA would have overflowed), or writes
+ *        made after the previous audio had played out (the speaker went silent)
+ * @param first_us esp_timer time of the first read or write
+ * @param onset_us Estimated esp_timer time at which the first sample above onset_threshold was captured by
+ *        the microphone or played by the speaker, 0 if none yet
+ */
+typedef struct {
+    uint64_t bytes;
+    uint32_t calls;
+    uint32_t xruns;
+    int64_t first_us;
+    int64_t onset_us;
+} audio_file_dev_stats_t;
+
+/**
+ * @brief Create a file codec device
+ *
+ * @param type ESP_CODEC_DEV_TYPE_IN or ESP_CODEC_DEV_TYPE_OUT
+ * @param config The configuration
+ * @return The device, NULL on error
+ */
+audio_file_dev_handle_t audio_file_dev_create(esp_codec_dev_type_t type, const audio_file_dev_config_t *config);
+
+/**
+ * @brief The esp_codec_dev handle of the device, to open and pass to the pipelines
+ */
+esp_codec_dev_handle_t audio_file_dev_get_codec_dev(audio_file_dev_handle_t dev);
+
+esp_err_t audio_file_dev_get_stats(audio_file_dev_handle_t dev, audio_file_dev_stats_t *stats);
+
+/**
+ * @brief Clear the counters and look for a new onset
+ */
+esp_err_t audio_file_dev_reset_stats(audio_file_dev_handle_t dev);
+
+/**
+ * @brief Close the codec device and the file
+ *
+ * A WAV file written by the device is complete once it is closed.
+ */
+void audio_file_dev_destroy(audio_file_dev_handle_t dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_FILE_DEV_H__ */
@@ -0,0 +1,392 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "audio_mixer.h"
+
+static const char *TAG = "audio_mixer";
+
+#define AUDIO_MIXER_FRAME_MS          10      /* Mixing period */
+#define AUDIO_MIXER_DEFAULT_BUFFER_MS 40
+#define AUDIO_MIXER_Q15_ONE           (1 << 15)
+#define AUDIO_MIXER_MAX_GAIN_Q15      (4 << 15)
+
+typedef struct {
+    RingbufHandle_t rb;
+    size_t rb_size;
+    volatile int32_t gain_q15;              /* Set by audio_mixer_set_gain() */
+    int32_t applied_q15;                    /* Gain reached at the end of the last frame, mixer task only */
+    bool ducks_others;
+    volatile int64_t last_write_us;
+    portMUX_TYPE buffer_lock;
+    const uint8_t *buffer;                  /* Played in place after the ring, see audio_mixer_play_buffer() */
+    size_t buffer_len;
+    size_t buffer_pos;
+    audio_mixer_drained_cb_t drained_cb;    /* Armed by audio_mixer_notify_drained(), under buffer_lock */
+    void *drained_ctx;
+} audio_mixer_channel_t;
+
+typedef struct {
+    esp_codec_dev_handle_t out_dev_handle;
+    uint8_t sample_bytes;
+    size_t frame_samples;                   /* Samples of all codec channels in one mixing period */
+    size_t frame_bytes;
+    uint8_t channel_count;
+    audio_mixer_channel_t channels[AUDIO_MIXER_MAX_CHANNELS];
+    int32_t duck_q15;                       /* Gain of ducked channels once fully ducked */
+    int32_t duck_attack_step;               /* Per mixing period */
+    int32_t duck_release_step;
+    int32_t duck_gain_q15;                  /* Current ducking gain, mixer task only */
+    uint8_t *frame_buf;
+    int64_t *acc;
+    TaskHandle_t task;
+    SemaphoreHandle_t exited;
+    volatile bool running;
+} audio_mixer_t;
+
+static int32_t mixer_db_to_q15(float gain_db)
+{
+    float gain = powf(10.0f, gain_db / 20.0f) * AUDIO_MIXER_Q15_ONE;
+    return gain > AUDIO_MIXER_MAX_GAIN_Q15 ? AUDIO_MIXER_MAX_GAIN_Q15 : (int32_t)gain;
+}
+
+static int32_t mixer_ramp_step(int32_t range, uint16_t ramp_ms)
+{
+    int32_t frames = ramp_ms / AUDIO_MIXER_FRAME_MS;
+    return frames > 0 ? range / frames : range;
+}
+
+static size_t mixer_channel_available(audio_mixer_channel_t *ch)
+{
+    UBaseType_t waiting = 0;
+    vRingbufferGetInfo(ch->rb, NULL, NULL, NULL, NULL, &waiting);
+
+    portENTER_CRITICAL(&ch->buffer_lock);
+    size_t buffered = ch->buffer_len - ch->buffer_pos;
+    portEXIT_CRITICAL(&ch->buffer_lock);
+    return waiting + buffered;
+}
+
+/* The byte buffer hands out at most the contiguous part, so a read can take two receives */
+static size_t mixer_channel_read(audio_mixer_channel_t *ch, uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        size_t n = 0;
+        uint8_t *data = xRingbufferReceiveUpTo(ch->rb, &n, 0, len - got);
+        if (data == NULL) {
+            break;
+        }
+        memcpy(buf + got, data, n);
+        vRingbufferReturnItem(ch->rb, data);
+        got += n;
+    }
+
+    portENTER_CRITICAL(&ch->buffer_lock);
+    size_t n = ch->buffer_len - ch->buffer_pos;
+    if (n > len - got) {
+        n = len - got;
+    }
+    const uint8_t *data = ch->buffer + ch->buffer_pos;
+    ch->buffer_pos += n;
+    portEXIT_CRITICAL(&ch->buffer_lock);
+    if (n > 0) {
+        memcpy(buf + got, data, n);
+        got += n;
+    }
+    return got;
+}
+
+/* Add one channel's samples to the accumulator, ramping its gain from where the last frame ended */
+static void mixer_accumulate(audio_mixer_t *mixer, audio_mixer_channel_t *ch, size_t len, int32_t target_q15)
+{
+    size_t samples = len / mixer->sample_bytes;
+    int64_t gain = (int64_t)ch->applied_q15 << 16;
+    int64_t step = (((int64_t)target_q15 - ch->applied_q15) << 16) / (int64_t)mixer->frame_samples;
+
+    for (size_t i = 0; i < samples; i++) {
+        int64_t sample = mixer->sample_bytes == 2 ? ((int16_t *)mixer->frame_buf)[i] : ((int32_t *)mixer->frame_buf)[i];
+        mixer->acc[i] += (sample * (gain >> 16)) >> 15;
+        gain += step;
+    }
+    ch->applied_q15 = target_q15;
+}
+
+static void mixer_output(audio_mixer_t *mixer)
+{
+    for (size_t i = 0; i < mixer->frame_samples; i++) {
+        int64_t sample = mixer->acc[i];
+        if (mixer->sample_bytes == 2) {
+            sample = sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+            ((int16_t *)mixer->frame_buf)[i] = (int16_t)sample;
+        } else {
+            sample = sample > INT32_MAX ? INT32_MAX : (sample < INT32_MIN ? INT32_MIN : sample);
+            ((int32_t *)mixer->frame_buf)[i] = (int32_t)sample;
+        }
+    }
+    esp_codec_dev_write(mixer->out_dev_handle, mixer->frame_buf, mixer->frame_bytes);
+}
+
+/* Call the drained notifications of the channels left empty, once their last period went to the codec */
+static void mixer_notify_drained(audio_mixer_t *mixer)
+{
+    for (uint8_t i = 0; i < mixer->channel_count; i++) {
+        audio_mixer_channel_t *ch = &mixer->channels[i];
+        if (ch->drained_cb == NULL || mixer_channel_available(ch) > 0) {
+            continue;
+        }
+        portENTER_CRITICAL(&ch->buffer_lock);
+        audio_mixer_drained_cb_t cb = ch->drained_cb;
+        void *ctx = ch->drained_ctx;
+        ch->drained_cb = NULL;
+        portEXIT_CRITICAL(&ch->buffer_lock);
+        if (cb) {
+            cb(ctx);
+        }
+    }
+}
+
+/*
+ * Mixes one period at a time and writes it to the codec, which paces the loop. A channel takes part once
+ * it holds a full period, or whatever it holds if its writer has been quiet for a period (end of a
+ * stream), so a writer that is merely between two writes is not padded with silence.
+ */
+static void audio_mixer_task(void *arg)
+{
+    audio_mixer_t *mixer = (audio_mixer_t *)arg;
+    bool ready[AUDIO_MIXER_MAX_CHANNELS];
+
+    while (mixer->running) {
+        int64_t now = esp_timer_get_time();
+        bool any = false;
+        bool pending = false;
+        bool ducking = false;
+
+        for (uint8_t i = 0; i < mixer->channel_count; i++) {
+            audio_mixer_channel_t *ch = &mixer->channels[i];
+            size_t available = mixer_channel_available(ch);
+            ready[i] = available >= mixer->frame_bytes
+                       || (available > 0 && now - ch->last_write_us >= AUDIO_MIXER_FRAME_MS * 1000);
+            pending |= available > 0 && !ready[i];
+            any |= ready[i];
+            ducking |= ready[i] && ch->ducks_others;
+        }
+
+        if (!any) {
+            mixer_notify_drained(mixer);
+            /* Nothing to play: wait for a write, or for a partial period to go stale */
+            ulTaskNotifyTake(pdTRUE, pending ? pdMS_TO_TICKS(AUDIO_MIXER_FRAME_MS) + 1 : portMAX_DELAY);
+            continue;
+        }
+
+        if (ducking) {
+            mixer->duck_gain_q15 -= mixer->duck_attack_step;
+            if (mixer->duck_gain_q15 < mixer->duck_q15) {
+                mixer->duck_gain_q15 = mixer->duck_q15;
+            }
+        } else {
+            mixer->duck_gain_q15 += mixer->duck_release_step;
+            if (mixer->duck_gain_q15 > AUDIO_MIXER_Q15_ONE) {
+                mixer->duck_gain_q15 = AUDIO_MIXER_Q15_ONE;
+            }
+        }
+
+        memset(mixer->acc, 0, mixer->frame_samples * sizeof(int64_t));
+        for (uint8_t i = 0; i < mixer->channel_count; i++) {
+            audio_mixer_channel_t *ch = &mixer->channels[i];
+            int32_t target_q15 = ch->gain_q15;
+            if (!ch->ducks_others) {
+                target_q15 = (int32_t)(((int64_t)target_q15 * mixer->duck_gain_q15) >> 15);
+            }
+            if (!ready[i]) {
+                /* Silent, so the gain can jump */
+                ch->applied_q15 = target_q15;
+                continue;
+            }
+            size_t len = mixer_channel_read(ch, mixer->frame_buf, mixer->frame_bytes);
+            mixer_accumulate(mixer, ch, len, target_q15);
+        }
+        mixer_output(mixer);
+        mixer_notify_drained(mixer);
+    }
+
+    xSemaphoreGive(mixer->exited);
+    vTaskDelete(NULL);
+}
+
+audio_mixer_handle_t audio_mixer_init(const audio_mixer_config_t *config)
+{
+    if (config == NULL || config->out_dev_handle == NULL || config->channel_count == 0
+        || config->channel_count > AUDIO_MIXER_MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Invalid config for audio_mixer");
+        return NULL;
+    }
+    if (config->out_info.bits_per_sample != 16 && config->out_info.bits_per_sample != 32) {
+        ESP_LOGE(TAG, "Unsupported bits per sample: %d", config->out_info.bits_per_sample);
+        return NULL;
+    }
+
+    audio_mixer_t *mixer = (audio_mixer_t *)calloc(1, sizeof(audio_mixer_t));
+    if (mixer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for audio mixer");
+        return NULL;
+    }
+
+    mixer->out_dev_handle = config->out_dev_handle;
+    mixer->sample_bytes = config->out_info.bits_per_sample / 8;
+    mixer->frame_samples = config->out_info.sample_rate * AUDIO_MIXER_FRAME_MS / 1000 * config->out_info.channel;
+    mixer->frame_bytes = mixer->frame_samples * mixer->sample_bytes;
+    mixer->channel_count = config->channel_count;
+    mixer->duck_q15 = mixer_db_to_q15(-fabsf(config->duck_db));
+    mixer->duck_attack_step = mixer_ramp_step(AUDIO_MIXER_Q15_ONE - mixer->duck_q15, config->duck_attack_ms);
+    mixer->duck_release_step = mixer_ramp_step(AUDIO_MIXER_Q15_ONE - mixer->duck_q15, config->duck_release_ms);
+    mixer->duck_gain_q15 = AUDIO_MIXER_Q15_ONE;
+
+    uint16_t buffer_ms = config->buffer_ms ? config->buffer_ms : AUDIO_MIXER_DEFAULT_BUFFER_MS;
+    if (buffer_ms < 2 * AUDIO_MIXER_FRAME_MS) {
+        buffer_ms = 2 * AUDIO_MIXER_FRAME_MS;
+    }
+    for (uint8_t i = 0; i < mixer->channel_count; i++) {
+        audio_mixer_channel_t *ch = &mixer->channels[i];
+        ch->rb_size = mixer->frame_bytes * buffer_ms / AUDIO_MIXER_FRAME_MS;
+        ch->rb = xRingbufferCreate(ch->rb_size, RINGBUF_TYPE_BYTEBUF);
+        if (ch->rb == NULL) {
+            ESP_LOGE(TAG, "Failed to create channel %d buffer", i);
+            goto err;
+        }
+        ch->gain_q15 = mixer_db_to_q15(config->channels[i].gain_db);
+        ch->applied_q15 = ch->gain_q15;
+        ch->ducks_others = config->channels[i].ducks_others;
+        portMUX_INITIALIZE(&ch->buffer_lock);
+    }
+
+    mixer->frame_buf = malloc(mixer->frame_bytes);
+    mixer->acc = malloc(mixer->frame_samples * sizeof(int64_t));
+    mixer->exited = xSemaphoreCreateBinary();
+    if (mixer->frame_buf == NULL || mixer->acc == NULL || mixer->exited == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate mixing buffers");
+        goto err;
+    }
+
+    mixer->running = true;
+    if (xTaskCreatePinnedToCore(audio_mixer_task, "audio_mixer", 4 * 1024, mixer, config->task_prio, &mixer->task,
+                                config->task_core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create mixer task");
+        mixer->running = false;
+        goto err;
+    }
+
+    ESP_LOGI(TAG, "Mixing %d channels, %d ms buffered per channel", mixer->channel_count, buffer_ms);
+    return (audio_mixer_handle_t)mixer;
+
+err:
+    audio_mixer_deinit((audio_mixer_handle_t)mixer);
+    return NULL;
+}
+
+esp_err_t audio_mixer_deinit(audio_mixer_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_mixer_t *mixer = (audio_mixer_t *)handle;
+
+    if (mixer->running) {
+        mixer->running = false;
+        xTaskNotifyGive(mixer->task);
+        xSemaphoreTake(mixer->exited, portMAX_DELAY);
+    }
+
+    for (uint8_t i = 0; i < mixer->channel_count; i++) {
+        if (mixer->channels[i].rb) {
+            vRingbufferDelete(mixer->channels[i].rb);
+        }
+    }
+    if (mixer->exited) {
+        vSemaphoreDelete(mixer->exited);
+    }
+    free(mixer->frame_buf);
+    free(mixer->acc);
+    free(mixer);
+    return ESP_OK;
+}
+
+esp_err_t audio_mixer_write(audio_mixer_handle_t handle, uint8_t channel, const uint8_t *data, size_t len, TickType_t timeout)
+{
+    audio_mixer_t *mixer = (audio_mixer_t *)handle;
+    if (mixer == NULL || data == NULL || channel >= mixer->channel_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_mixer_channel_t *ch = &mixer->channels[channel];
+    /* A byte buffer only accepts writes that fit its free space, so feed it in pieces */
+    size_t piece = ch->rb_size / 2;
+    while (len > 0) {
+        size_t n = len < piece ? len : piece;
+        if (xRingbufferSend(ch->rb, data, n, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        ch->last_write_us = esp_timer_get_time();
+        xTaskNotifyGive(mixer->task);
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t audio_mixer_play_buffer(audio_mixer_handle_t handle, uint8_t channel, const uint8_t *data, size_t len)
+{
+    audio_mixer_t *mixer = (audio_mixer_t *)handle;
+    if (mixer == NULL || data == NULL || channel >= mixer->channel_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_mixer_channel_t *ch = &mixer->channels[channel];
+    portENTER_CRITICAL(&ch->buffer_lock);
+    ch->buffer = data;
+    ch->buffer_len = len;
+    ch->buffer_pos = 0;
+    portEXIT_CRITICAL(&ch->buffer_lock);
+    ch->last_write_us = esp_timer_get_time();
+    xTaskNotifyGive(mixer->task);
+    return ESP_OK;
+}
+
+esp_err_t audio_mixer_notify_drained(audio_mixer_handle_t handle, uint8_t channel, audio_mixer_drained_cb_t cb, void *ctx)
+{
+    audio_mixer_t *mixer = (audio_mixer_t *)handle;
+    if (mixer == NULL || channel >= mixer->channel_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_mixer_channel_t *ch = &mixer->channels[channel];
+    portENTER_CRITICAL(&ch->buffer_lock);
+    ch->drained_cb = cb;
+    ch->drained_ctx = ctx;
+    portEXIT_CRITICAL(&ch->buffer_lock);
+    xTaskNotifyGive(mixer->task);
+    return ESP_OK;
+}
+
+esp_err_t audio_mixer_set_gain(audio_mixer_handle_t handle, uint8_t channel, float gain_db)
+{
+    audio_mixer_t *mixer = (audio_mixer_t *)handle;
+    if (mixer == NULL || channel >= mixer->channel_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mixer->channels[channel].gain_q15 = mixer_db_to_q15(gain_db);
+    return ESP_OK;
+}
@@ -0,0 +1,139 @@
+/**
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __AUDIO_MIXER_H__
+#define __AUDIO_MIXER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_codec_dev.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void *audio_mixer_handle_t;
+
+/**
+ * @brief Called from the mixer task once an input channel has played out, see audio_mixer_notify_drained()
+ */
+typedef void (*audio_mixer_drained_cb_t)(void *ctx);
+
+#define AUDIO_MIXER_MAX_CHANNELS 4
+
+/**
+ * @brief Input channel configuration
+ *
+ * @param gain_db Gain applied to the channel, 0 for unity
+ * @param ducks_others While the channel has audio, the channels without ducks_others are attenuated by
+ *        the mixer duck_db (for notifications over speech)
+ */
+typedef struct {
+    float gain_db;
+    bool ducks_others;
+} audio_mixer_channel_config_t;
+
+/**
+ * @brief Mixer configuration
+ *
+ * Every input channel carries audio in the format of the codec device, out_info. The mixer task is the
+ * only writer to out_dev_handle, which must already be open.
+ *
+ * @param out_dev_handle Codec device written by the mixer
+ * @param out_info Format of the codec device and of every input: 16 or 32-bit interleaved samples
+ * @param channel_count Number of input channels, up to AUDIO_MIXER_MAX_CHANNELS
+ * @param channels Per channel configuration
+ * @param buffer_ms Audio buffered per input channel. Writers block once it is full, so this is also how far
+ *        ahead of the codec a writer runs.
+ * @param duck_db Attenuation of ducked channels, as a positive number of dB
+ * @param duck_attack_ms Time to ramp ducked channels down
+ * @param duck_release_ms Time to ramp ducked channels back up once the ducking channels are silent
+ * @param task_core Core of the mixer task
+ * @param task_prio Priority of the mixer task
+ */
+typedef struct {
+    esp_codec_dev_handle_t out_dev_handle;
+    esp_codec_dev_sample_info_t out_info;
+    uint8_t channel_count;
+    audio_mixer_channel_config_t channels[AUDIO_MIXER_MAX_CHANNELS];
+    uint16_t buffer_ms;
+    float duck_db;
+    uint16_t duck_attack_ms;
+    uint16_t duck_release_ms;
+    int task_core;
+    uint8_t task_prio;
+} audio_mixer_config_t;
+
+audio_mixer_handle_t audio_mixer_init(const audio_mixer_config_t *config);
+
+esp_err_t audio_mixer_deinit(audio_mixer_handle_t handle);
+
+/**
+ * @brief Queue audio on an input channel
+ *
+ * Blocks while the channel buffer is full, the mixer drains it at the codec rate.
+ *
+ * @param handle The mixer handle
+ * @param channel Input channel
+ * @param data Samples in the codec format
+ * @param len Length in bytes
+ * @param timeout Time to wait for buffer space
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the data could not all be queued, otherwise an error code
+ */
+esp_err_t audio_mixer_write(audio_mixer_handle_t handle, uint8_t channel, const uint8_t *data, size_t len, TickType_t timeout);
+
+/**
+ * @brief Play a buffer of samples on an input channel without copying it
+ *
+ * The mixer reads the buffer in place, after the audio already queued on the channel. It must stay
+ * valid until it has played, which suits decoded clips kept for the lifetime of the application.
+ * A buffer still playing on the channel is replaced. Returns immediately.
+ *
+ * @param handle The mixer handle
+ * @param channel Input channel
+ * @param data Samples in the codec format
+ * @param len Length in bytes
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_mixer_play_buffer(audio_mixer_handle_t handle, uint8_t channel, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get notified once an input channel has played out
+ *
+ * Arms a one-shot notification: cb is called from the mixer task once the channel buffer and the buffer
+ * played in place are empty, after the period that took their last samples has been written to the codec.
+ * When the channel is already empty it is called on the next mixing period. Arming again replaces the
+ * previous notification, a NULL cb cancels it.
+ *
+ * @param handle The mixer handle
+ * @param channel Input channel
+ * @param cb Callback, NULL to cancel
+ * @param ctx Passed to cb
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_mixer_notify_drained(audio_mixer_handle_t handle, uint8_t channel, audio_mixer_drained_cb_t cb, void *ctx);
+
+/**
+ * @brief Set the gain of an input channel
+ *
+ * The change is ramped over one mixing period.
+ *
+ * @param handle The mixer handle
+ * @param channel Input channel
+ * @param gain_db Gain, 0 for unity
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_mixer_set_gain(audio_mixer_handle_t handle, uint8_t channel, float gain_db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_MIXER_H__ */
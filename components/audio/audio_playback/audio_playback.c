@@ -5,9 +5,13 @@
  */
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include <string.h>
+#include <inttypes.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 
 #include <esp_gmf_pool.h>
 #include <esp_gmf_pipeline.h>
@@ -17,140 +21,543 @@
 #include <esp_audio_simple_player.h>
 #include <esp_audio_simple_player_advance.h>
 
-#include <esp_gmf_rate_cvt.h>
-#include <esp_gmf_bit_cvt.h>
 #include <esp_gmf_ch_cvt.h>
 #include <esp_gmf_audio_dec.h>
 #include <esp_opus_dec.h>
 
 #include "audio_common.h"
+#include "audio_convert.h"
 #include "audio_playback.h"
 
 static const char *TAG = "audio_playback";
 
 #define AUDIO_PLAYBACK_FIFO_BLOCK_COUNT 5
 #define AUDIO_PLAYBACK_FIFO_BLOCK_SIZE 512  // Block size for OPUS data
+#define AUDIO_PLAYBACK_MAX_PACKET_SIZE 4096 // Largest packet reassembled from several blocks
+#define AUDIO_PLAYBACK_MAX_CLIPS 4
+#define AUDIO_PLAYBACK_RESTART_BACKOFF_MS 100 // Delay before restarting a pipeline that failed again within this time
+#define AUDIO_PLAYBACK_RESTART_MAX_BACKOFF_MS 3200 // Longest delay between attempts to restart a pipeline that won't run
+
+/* Media decoded by audio_playback_cache_media(), in the codec format */
+typedef struct {
+    const uint8_t *src;
+    uint8_t *pcm;
+    size_t len;
+} audio_playback_clip_t;
+
+/* Written alongside each FIFO block: packets larger than a block span consecutive blocks of the same seq */
+typedef struct {
+    uint16_t seq;
+    bool more;
+    bool eos;       /* Empty block marking the end of a stream */
+} audio_playback_span_t;
 
 typedef struct audio_playback_s {
     esp_gmf_pipeline_handle_t pipeline_handle;
     esp_gmf_task_handle_t task_handle;
     esp_codec_dev_handle_t out_dev_handle;
+    audio_mixer_handle_t mixer;             /* Single writer to out_dev_handle when set */
+    uint8_t speech_channel;
+    uint8_t media_channel;
     esp_gmf_db_handle_t fifo;
+    audio_playback_span_t spans[AUDIO_PLAYBACK_FIFO_BLOCK_COUNT];
+    uint32_t span_wr;
+    uint32_t span_rd;
+    uint16_t write_seq;
+    bool write_more;
+    bool write_acquired;
+    esp_gmf_data_bus_block_t write_blk;     /* FIFO block lent to the writer */
+    esp_gmf_data_bus_block_t read_blk;      /* FIFO block lent to the decoder */
+    bool read_lent;
+    uint8_t *packet_buf;                    /* Reassembly buffer for packets spanning blocks */
+    size_t packet_buf_size;
     audio_playback_audio_info_t audio_in_info;
     esp_codec_dev_sample_info_t out_codec_info;
+    bool native_out;                        /* out_codec_info is the decoded format, nothing to convert */
+    audio_resampler_handle_t resampler;     /* Pipeline task only, as are the buffers below */
+    int16_t *resample_buf;
+    size_t resample_buf_size;
+    uint8_t *convert_buf;
+    size_t convert_buf_size;
+    audio_stretch_handle_t stretch;         /* Catch-up time-stretch, pipeline task only with its buffer */
+    int16_t *stretch_buf;
+    size_t stretch_buf_size;
+    uint16_t catch_up_target_ms;
+    uint16_t catch_up_speed_pct;
+    uint16_t block_ms;                      /* Audio duration of a FIFO block */
+    bool catching_up;
+    int64_t stream_start_us;                /* When the stream's first block was decoded, 0 between streams */
+    uint64_t stream_samples;                /* Samples of the stream decoded since then */
+    uint64_t stretch_in;                    /* Samples into and out of the time-stretch */
+    uint64_t stretch_out;
+    audio_playback_drained_cb_t drained_cb;
+    void *drained_ctx;
+    portMUX_TYPE flush_lock;
+    bool flushing;                          /* Blocks queued before flush_wr are dropped, output is muted */
+    bool fade_request;
+    uint32_t flush_wr;
+    int64_t flush_us;
+    uint32_t fade_frames;
+    uint32_t fade_left;                     /* Pipeline task only */
     const uint8_t *asp_embed_data;
     size_t asp_embed_data_len;
     esp_asp_handle_t asp_handle;
+    audio_playback_clip_t clips[AUDIO_PLAYBACK_MAX_CLIPS];
+    audio_playback_clip_t *capture;         /* Clip the simple player output goes to instead of the codec */
+    size_t capture_size;
+    int64_t media_request_us;               /* When the media being played was requested */
+    bool media_output_started;
     bool started;
+    TaskHandle_t supervisor;                /* Restarts the pipeline after an error */
+    SemaphoreHandle_t supervisor_exited;
+    volatile bool recovering;
+    volatile bool stopping;                 /* Deinit in progress, stops are expected */
+    int64_t failed_us;
+    portMUX_TYPE stats_lock;
+    audio_playback_stats_t stats;
 } audio_playback_t;
 
+/* Blocks written before the last audio_playback_flush() are released here without being returned */
+static esp_gmf_err_io_t playback_fifo_read(audio_playback_t *playback, audio_playback_span_t *span, int block_ticks)
+{
+    while (true) {
+        playback->read_blk = (esp_gmf_data_bus_block_t) {0};
+        esp_gmf_err_io_t err = esp_gmf_db_acquire_read(playback->fifo, &playback->read_blk, AUDIO_PLAYBACK_FIFO_BLOCK_SIZE, block_ticks);
+        if (err != ESP_GMF_IO_OK) {
+            return err;
+        }
+        uint32_t index = playback->span_rd++;
+        *span = playback->spans[index % AUDIO_PLAYBACK_FIFO_BLOCK_COUNT];
+
+        bool stale = false;
+        portENTER_CRITICAL(&playback->flush_lock);
+        if (playback->flushing) {
+            stale = (int32_t)(index - playback->flush_wr) < 0;
+            if (!stale) {
+                /* Everything decoded before the flush has been through the out port */
+                playback->flushing = false;
+                playback->fade_request = false;
+            }
+        }
+        portEXIT_CRITICAL(&playback->flush_lock);
+
+        if (!stale) {
+            return ESP_GMF_IO_OK;
+        }
+        err = esp_gmf_db_release_read(playback->fifo, &playback->read_blk, block_ticks);
+        if (err != ESP_GMF_IO_OK) {
+            ESP_LOGW(TAG, "Failed to release ESP-GMF data bus read: %x", err);
+        }
+    }
+}
+
+static void playback_fifo_release(audio_playback_t *playback, int block_ticks)
+{
+    esp_gmf_err_io_t err = esp_gmf_db_release_read(playback->fifo, &playback->read_blk, block_ticks);
+    if (err != ESP_GMF_IO_OK) {
+        ESP_LOGW(TAG, "Failed to release ESP-GMF data bus read: %x", err);
+    }
+}
+
+/* Copy the current block into the reassembly buffer at offset, returns the new packet length */
+static size_t playback_packet_append(audio_playback_t *playback, size_t offset)
+{
+    size_t len = playback->read_blk.valid_size;
+
+    if (offset + len > AUDIO_PLAYBACK_MAX_PACKET_SIZE) {
+        ESP_LOGW(TAG, "Packet larger than %d bytes, truncated", AUDIO_PLAYBACK_MAX_PACKET_SIZE);
+        len = AUDIO_PLAYBACK_MAX_PACKET_SIZE - offset;
+    }
+    if (offset + len > playback->packet_buf_size) {
+        uint8_t *buf = realloc(playback->packet_buf, AUDIO_PLAYBACK_MAX_PACKET_SIZE);
+        if (buf == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate packet buffer");
+            return offset;
+        }
+        playback->packet_buf = buf;
+        playback->packet_buf_size = AUDIO_PLAYBACK_MAX_PACKET_SIZE;
+    }
+    memcpy(playback->packet_buf + offset, playback->read_blk.buf, len);
+    return offset + len;
+}
+
+static void playback_catch_up_flush(audio_playback_t *playback);
+
+static void playback_drained(audio_playback_t *playback, int block_ticks)
+{
+    playback_fifo_release(playback, block_ticks);
+    playback_catch_up_flush(playback);
+    ESP_LOGD(TAG, "End of stream drained");
+    if (playback->drained_cb == NULL) {
+        return;
+    }
+    if (playback->mixer) {
+        /* The mixer still holds up to its channel buffer, it reports when that has gone to the codec */
+        audio_mixer_notify_drained(playback->mixer, playback->speech_channel, playback->drained_cb, playback->drained_ctx);
+    } else {
+        playback->drained_cb(playback->drained_ctx);
+    }
+}
+
+/* The in port is a block port: a packet that fits in one FIFO block is lent to the decoder as is,
+ * only packets spanning several blocks are gathered into the reassembly buffer. */
 static esp_gmf_err_io_t playback_inport_acquire_read(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
 {
-    esp_gmf_data_bus_block_t _blk = {0};
     audio_playback_t *playback = (audio_playback_t *)handle;
+    audio_playback_span_t span = {0};
 
-    esp_gmf_err_io_t err = esp_gmf_db_acquire_read(playback->fifo, &_blk, wanted_size, block_ticks);
-    if (err != ESP_GMF_IO_OK) {
-        blk->valid_size = 0;
+    blk->valid_size = 0;
+    if (playback_fifo_read(playback, &span, block_ticks) != ESP_GMF_IO_OK) {
         return ESP_GMF_IO_OK;
     }
 
-    memcpy(blk->buf, _blk.buf, _blk.valid_size);
-    blk->valid_size = _blk.valid_size;
-    blk->is_last = _blk.is_last;
+    /* The pipeline task runs every element once per packet, so by the time the decoder asks for the
+     * next packet the previous one has been written to the codec device by the out port. */
+    while (span.eos) {
+        playback_drained(playback, block_ticks);
+        if (playback_fifo_read(playback, &span, block_ticks) != ESP_GMF_IO_OK) {
+            return ESP_GMF_IO_OK;
+        }
+    }
 
-    err = esp_gmf_db_release_read(playback->fifo, &_blk, block_ticks);
-    if (err != ESP_GMF_IO_OK) {
-        ESP_LOGW(TAG, "Failed to release ESP-GMF data bus read: %x", err);
+    if (!span.more) {
+        blk->buf = playback->read_blk.buf;
+        blk->buf_length = playback->read_blk.buf_length;
+        blk->valid_size = playback->read_blk.valid_size;
+        blk->is_last = playback->read_blk.is_last;
+        playback->read_lent = true;
+        return ESP_GMF_IO_OK;
     }
 
+    size_t len = 0;
+    bool is_last = false;
+    while (true) {
+        len = playback_packet_append(playback, len);
+        is_last = playback->read_blk.is_last;
+        playback_fifo_release(playback, block_ticks);
+        if (!span.more) {
+            break;
+        }
+
+        uint16_t seq = span.seq;
+        if (playback_fifo_read(playback, &span, block_ticks) != ESP_GMF_IO_OK) {
+            ESP_LOGW(TAG, "Incomplete packet dropped");
+            return ESP_GMF_IO_OK;
+        }
+        if (span.eos) {
+            ESP_LOGW(TAG, "Incomplete packet dropped");
+            playback_drained(playback, block_ticks);
+            return ESP_GMF_IO_OK;
+        }
+        if (span.seq != seq) {
+            /* The writer gave up on the previous packet, this block starts a new one */
+            ESP_LOGW(TAG, "Incomplete packet dropped");
+            len = 0;
+        }
+    }
+
+    blk->buf = playback->packet_buf;
+    blk->buf_length = playback->packet_buf_size;
+    blk->valid_size = len;
+    blk->is_last = is_last;
     return ESP_GMF_IO_OK;
 }
 
 static esp_gmf_err_io_t playback_inport_release_read(void *handle, esp_gmf_data_bus_block_t *blk, int block_ticks)
 {
+    audio_playback_t *playback = (audio_playback_t *)handle;
+
+    if (playback->read_lent) {
+        playback->read_lent = false;
+        playback_fifo_release(playback, block_ticks);
+    }
     return ESP_GMF_IO_OK;
 }
 
+/* Write to the codec, through the mixer when there is one */
+static void playback_output(audio_playback_t *playback, uint8_t channel, uint8_t *data, size_t len)
+{
+    if (playback->mixer) {
+        audio_mixer_write(playback->mixer, channel, data, len, portMAX_DELAY);
+    } else {
+        esp_codec_dev_write(playback->out_dev_handle, data, len);
+    }
+}
+
 static esp_gmf_err_io_t playback_outport_acquire_write(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
 {
     return ESP_GMF_IO_OK;
 }
 
+/* The buffers are scratch, their content is not kept. 16-byte aligned for the PIE conversion kernels. */
+static bool playback_grow(void **buf, size_t *size, size_t wanted)
+{
+    if (wanted <= *size) {
+        return true;
+    }
+    void *grown = heap_caps_aligned_alloc(16, wanted, MALLOC_CAP_DEFAULT);
+    if (grown == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte conversion buffer", wanted);
+        return false;
+    }
+    free(*buf);
+    *buf = grown;
+    *size = wanted;
+    return true;
+}
+
+/* Decoded samples are played faster while the stream is more than the catch-up target behind its schedule,
+ * the wall time since its first block less the audio played since, which sheds the latency a network stall
+ * leaves behind. A stream the server sends faster than real time fills the FIFO without falling behind, and
+ * plays at its own speed. Returns the stretched bytes in *out. */
+static size_t playback_catch_up(audio_playback_t *playback, uint8_t *buf, size_t len, uint8_t **out)
+{
+    *out = buf;
+    if (playback->stretch == NULL) {
+        return len;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (playback->stream_start_us == 0) {
+        playback->stream_start_us = now;
+        playback->stream_samples = 0;
+    }
+    int64_t lag_ms = (now - playback->stream_start_us) / 1000
+                     - (int64_t)(playback->stream_samples * 1000 / playback->audio_in_info.sample_rate);
+    playback->stream_samples += len / sizeof(int16_t);
+
+    /* Nothing queued, nothing to play faster */
+    uint32_t queued_ms = (playback->span_wr - playback->span_rd) * playback->block_ms;
+    if (!playback->catching_up && lag_ms > playback->catch_up_target_ms + playback->block_ms && queued_ms > playback->block_ms) {
+        playback->catching_up = true;
+        audio_stretch_set_speed(playback->stretch, playback->catch_up_speed_pct);
+        ESP_LOGI(TAG, "Catching up: %" PRId64 " ms behind, playing at %d%%", lag_ms, playback->catch_up_speed_pct);
+    } else if (playback->catching_up && (lag_ms <= playback->catch_up_target_ms || queued_ms == 0)) {
+        playback->catching_up = false;
+        audio_stretch_set_speed(playback->stretch, 100);
+        ESP_LOGI(TAG, "Caught up: %" PRId64 " ms behind", lag_ms);
+    }
+
+    size_t count = len / sizeof(int16_t);
+    size_t max_out = audio_stretch_max_output(playback->stretch, count);
+    if (!playback_grow((void **)&playback->stretch_buf, &playback->stretch_buf_size, max_out * sizeof(int16_t))) {
+        return len;
+    }
+    size_t produced = audio_stretch_process(playback->stretch, (const int16_t *)buf, count, playback->stretch_buf);
+
+    portENTER_CRITICAL(&playback->stats_lock);
+    playback->stretch_in += count;
+    playback->stretch_out += produced;
+    portEXIT_CRITICAL(&playback->stats_lock);
+    *out = (uint8_t *)playback->stretch_buf;
+    return produced * sizeof(int16_t);
+}
+
+/* Convert decoded 16-bit mono samples to the codec format, returns the converted bytes in *out */
+static size_t playback_convert(audio_playback_t *playback, uint8_t *buf, size_t len, uint8_t **out)
+{
+    if (playback->native_out) {
+        *out = buf;
+        return len;
+    }
+
+    const int16_t *samples = (const int16_t *)buf;
+    size_t count = len / sizeof(int16_t);
+    if (playback->resampler) {
+        size_t max_out = audio_resampler_max_output(playback->resampler, count);
+        if (!playback_grow((void **)&playback->resample_buf, &playback->resample_buf_size, max_out * sizeof(int16_t))) {
+            return 0;
+        }
+        count = audio_resampler_process(playback->resampler, samples, count, playback->resample_buf);
+        samples = playback->resample_buf;
+    }
+
+    uint8_t bits = playback->out_codec_info.bits_per_sample;
+    uint8_t channels = playback->out_codec_info.channel;
+    size_t out_len = audio_convert_s16_mono_size(count, bits, channels);
+    if (bits == 16 && channels == 1) {
+        /* Only the rate differs */
+        *out = (uint8_t *)samples;
+        return out_len;
+    }
+    if (!playback_grow((void **)&playback->convert_buf, &playback->convert_buf_size, out_len)) {
+        return 0;
+    }
+    audio_convert_s16_mono_to(samples, playback->convert_buf, count, bits, channels);
+    *out = playback->convert_buf;
+    return out_len;
+}
+
+/* Ramp the start of buf down to silence over the remaining fade, returns the bytes left to play */
+static size_t playback_fade_out(audio_playback_t *playback, uint8_t *buf, size_t len)
+{
+    uint8_t channels = playback->out_codec_info.channel;
+    uint8_t bytes = playback->out_codec_info.bits_per_sample / 8;
+    size_t frames = len / (channels * bytes);
+
+    if (frames > playback->fade_left) {
+        frames = playback->fade_left;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        /* Q15 gain */
+        int32_t gain = (int32_t)(((uint64_t)(playback->fade_left - i) << 15) / playback->fade_frames);
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            size_t n = i * channels + ch;
+            if (bytes == 2) {
+                int16_t *sample = (int16_t *)buf + n;
+                *sample = (int16_t)(((int32_t)*sample * gain) >> 15);
+            } else if (bytes == 4) {
+                int32_t *sample = (int32_t *)buf + n;
+                *sample = (int32_t)(((int64_t)*sample * gain) >> 15);
+            }
+        }
+    }
+    playback->fade_left -= frames;
+    return frames * channels * bytes;
+}
+
+/* Play the samples the time-stretch holds back, at the end of a stream */
+static void playback_catch_up_flush(audio_playback_t *playback)
+{
+    if (playback->stretch == NULL) {
+        return;
+    }
+
+    playback->catching_up = false;
+    playback->stream_start_us = 0;
+    audio_stretch_set_speed(playback->stretch, 100);
+    if (!playback_grow((void **)&playback->stretch_buf, &playback->stretch_buf_size,
+                       audio_stretch_max_output(playback->stretch, 0) * sizeof(int16_t))) {
+        audio_stretch_reset(playback->stretch);
+        return;
+    }
+    size_t count = audio_stretch_flush(playback->stretch, playback->stretch_buf);
+    if (count == 0) {
+        return;
+    }
+    portENTER_CRITICAL(&playback->stats_lock);
+    playback->stretch_out += count;
+    portEXIT_CRITICAL(&playback->stats_lock);
+
+    uint8_t *buf = NULL;
+    size_t len = playback_convert(playback, (uint8_t *)playback->stretch_buf, count * sizeof(int16_t), &buf);
+    playback_output(playback, playback->speech_channel, buf, len);
+}
+
 static esp_gmf_err_io_t playback_outport_release_write(void *handle, esp_gmf_data_bus_block_t *blk, int block_ticks)
 {
     audio_playback_t *playback = (audio_playback_t *)handle;
+    uint8_t *buf = NULL;
 
-    ESP_LOGD(TAG, "Writing audio data to codec device: %d", blk->valid_size);
-    esp_codec_dev_write(playback->out_dev_handle, blk->buf, blk->valid_size);
+    portENTER_CRITICAL(&playback->flush_lock);
+    bool flushing = playback->flushing;
+    if (playback->fade_request) {
+        playback->fade_request = false;
+        playback->fade_left = playback->fade_frames;
+    }
+    portEXIT_CRITICAL(&playback->flush_lock);
 
+    if (flushing && playback->fade_left == 0) {
+        return ESP_GMF_IO_OK;
+    }
+
+    uint8_t *samples = NULL;
+    size_t len = playback_catch_up(playback, blk->buf, blk->valid_size, &samples);
+    len = playback_convert(playback, samples, len, &buf);
+    if (flushing) {
+        len = playback_fade_out(playback, buf, len);
+    }
+
+    ESP_LOGD(TAG, "Writing audio data to codec device: %d", len);
+    playback_output(playback, playback->speech_channel, buf, len);
+
+    if (flushing && playback->fade_left == 0) {
+        if (playback->resampler) {
+            /* The next stream starts from silence */
+            audio_resampler_reset(playback->resampler);
+        }
+        if (playback->stretch) {
+            audio_stretch_reset(playback->stretch);
+            audio_stretch_set_speed(playback->stretch, 100);
+            playback->catching_up = false;
+            playback->stream_start_us = 0;
+        }
+        ESP_LOGI(TAG, "Playback faded out %" PRId64 " ms after flush", (esp_timer_get_time() - playback->flush_us) / 1000);
+    }
     return ESP_GMF_IO_OK;
 }
 
-static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_handle, audio_playback_t *playback)
+static esp_gmf_err_t pipeline_setup_decoder(esp_gmf_pipeline_handle_t pipeline_handle, audio_playback_t *playback)
 {
-    esp_gmf_err_t err = ESP_GMF_ERR_OK;
     esp_gmf_element_handle_t ele = NULL;
 
-    err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_rate_cvt", &ele);
+    // Get the OPUS decoder element - it will automatically decode OPUS format
+    esp_gmf_err_t err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_dec", &ele);
     if (err != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to get rate cvt element: %x", err);
-    } else {
-        esp_gmf_rate_cvt_set_dest_rate(ele, playback->out_codec_info.sample_rate);
+        ESP_LOGE(TAG, "Failed to get audio decoder element: %x", err);
+        return ESP_GMF_ERR_OK;
     }
 
-    err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_bit_cvt", &ele);
-    if (err != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to get bit cvt element: %x", err);
+    esp_opus_dec_frame_duration_t frame_duration = ESP_OPUS_DEC_FRAME_DURATION_INVALID;
+    if (playback->audio_in_info.frame_duration_ms == 10) {
+        frame_duration = ESP_OPUS_DEC_FRAME_DURATION_10_MS;
+    } else if (playback->audio_in_info.frame_duration_ms == 20) {
+        frame_duration = ESP_OPUS_DEC_FRAME_DURATION_20_MS;
+    } else if (playback->audio_in_info.frame_duration_ms == 40) {
+        frame_duration = ESP_OPUS_DEC_FRAME_DURATION_40_MS;
+    } else if (playback->audio_in_info.frame_duration_ms == 60) {
+        frame_duration = ESP_OPUS_DEC_FRAME_DURATION_60_MS;
     } else {
-        esp_gmf_bit_cvt_set_dest_bits(ele, playback->out_codec_info.bits_per_sample);
+        ESP_LOGE(TAG, "Invalid frame duration: %d", playback->audio_in_info.frame_duration_ms);
+        return ESP_GMF_ERR_INVALID_ARG;
     }
-
-    err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_ch_cvt", &ele);
+    esp_opus_dec_cfg_t opus_dec_cfg = {
+        .channel = ESP_AUDIO_MONO,
+        .frame_duration = frame_duration,
+        .self_delimited = false,
+        .sample_rate = playback->audio_in_info.sample_rate,
+    };
+    esp_audio_simple_dec_cfg_t audio_dec_cfg = {
+        .dec_type = ESP_AUDIO_TYPE_OPUS,
+        .dec_cfg = &opus_dec_cfg,
+        .cfg_size = sizeof(opus_dec_cfg),
+    };
+    err = esp_gmf_audio_dec_reconfig(ele, &audio_dec_cfg);
     if (err != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to get ch cvt element: %x", err);
-    } else {
-        esp_gmf_ch_cvt_set_dest_channel(ele, playback->out_codec_info.channel);
+        ESP_LOGE(TAG, "Failed to configure OPUS decoder: %x", err);
     }
 
-    // Get the OPUS decoder element - it will automatically decode OPUS format
-    err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_dec", &ele);
-    if (err != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to get audio decoder element: %x", err);
-    } else {
-        esp_opus_dec_frame_duration_t frame_duration = ESP_OPUS_DEC_FRAME_DURATION_INVALID;
-        if (playback->audio_in_info.frame_duration_ms == 20) {
-            frame_duration = ESP_OPUS_DEC_FRAME_DURATION_20_MS;
-        } else if (playback->audio_in_info.frame_duration_ms == 60) {
-            frame_duration = ESP_OPUS_DEC_FRAME_DURATION_60_MS;
-        } else {
-            ESP_LOGE(TAG, "Invalid frame duration: %d", playback->audio_in_info.frame_duration_ms);
-            return ESP_GMF_ERR_INVALID_ARG;
-        }
-        esp_opus_dec_cfg_t opus_dec_cfg = {
-            .channel = ESP_AUDIO_MONO,
-            .frame_duration = frame_duration,
-            .self_delimited = false,
-            .sample_rate = playback->audio_in_info.sample_rate,
-        };
-        esp_audio_simple_dec_cfg_t audio_dec_cfg = {
-            .dec_type = ESP_AUDIO_TYPE_OPUS,
-            .dec_cfg = &opus_dec_cfg,
-            .cfg_size = sizeof(opus_dec_cfg),
-        };
-        err = esp_gmf_audio_dec_reconfig(ele, &audio_dec_cfg);
+    ESP_LOGI(TAG, "Configured OPUS decoder pipeline");
+    return ESP_GMF_ERR_OK;
+}
+
+static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_handle, audio_playback_t *playback)
+{
+    esp_gmf_err_t err = ESP_GMF_ERR_OK;
+    esp_gmf_element_handle_t ele = NULL;
+
+    if (playback->audio_in_info.codec == AUDIO_PLAYBACK_CODEC_PCM) {
+        /* Only there because a pipeline needs an element, the PCM is already mono */
+        err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_ch_cvt", &ele);
         if (err != ESP_GMF_ERR_OK) {
-            ESP_LOGE(TAG, "Failed to configure OPUS decoder: %x", err);
+            ESP_LOGE(TAG, "Failed to get ch cvt element: %x", err);
+        } else {
+            esp_gmf_ch_cvt_set_dest_channel(ele, 1);
         }
+    }
 
-        ESP_LOGI(TAG, "Configured OPUS decoder pipeline");
+    if (playback->audio_in_info.codec == AUDIO_PLAYBACK_CODEC_OPUS) {
+        err = pipeline_setup_decoder(pipeline_handle, playback);
+        if (err != ESP_GMF_ERR_OK) {
+            return err;
+        }
     }
 
     esp_gmf_info_sound_t in_info = {
         .sample_rates = playback->audio_in_info.sample_rate,
         .bits = 16,
         .channels = 1,
-        .format_id = ESP_AUDIO_TYPE_OPUS,
+        .format_id = playback->audio_in_info.codec == AUDIO_PLAYBACK_CODEC_PCM ? ESP_AUDIO_TYPE_PCM : ESP_AUDIO_TYPE_OPUS,
     };
     esp_gmf_pipeline_report_info(pipeline_handle, ESP_GMF_INFO_SOUND, &in_info, sizeof(in_info));
 
@@ -161,7 +568,7 @@ static esp_gmf_err_t pipeline_setup_ports(esp_gmf_pipeline_handle_t pipeline_han
 {
     esp_gmf_err_t err = ESP_GMF_ERR_OK;
 
-    esp_gmf_port_handle_t in_port = NEW_ESP_GMF_PORT_IN_BYTE(
+    esp_gmf_port_handle_t in_port = NEW_ESP_GMF_PORT_IN_BLOCK(
         playback_inport_acquire_read,
         playback_inport_release_read,
         NULL, playback, 2048, portMAX_DELAY);
@@ -189,13 +596,15 @@ static esp_gmf_err_t pipeline_setup_ports(esp_gmf_pipeline_handle_t pipeline_han
 static esp_gmf_pipeline_handle_t pipeline_init(esp_gmf_pool_handle_t pool, audio_playback_t *playback)
 {
     esp_gmf_pipeline_handle_t pipeline_handle = NULL;
-    const char *el_names[] = {
-        "aud_dec",
-        "aud_rate_cvt",
-        "aud_bit_cvt",
-        "aud_ch_cvt",
-    };
-    size_t num_el = sizeof(el_names) / sizeof(el_names[0]);
+    const char *el_names[1];
+    size_t num_el = 0;
+
+    /* The output is converted to the codec format by the out port, see playback_convert() */
+    if (playback->audio_in_info.codec == AUDIO_PLAYBACK_CODEC_OPUS) {
+        el_names[num_el++] = "aud_dec";
+    } else {
+        el_names[num_el++] = "aud_ch_cvt";
+    }
     esp_gmf_err_t err = esp_gmf_pool_new_pipeline(pool, NULL, el_names, num_el, NULL, &pipeline_handle);
 
     err = pipeline_setup_ports(pipeline_handle, el_names[0], el_names[num_el - 1], playback);
@@ -212,10 +621,46 @@ err:
     return NULL;
 }
 
+/* Append decoded media to the clip being cached, growing it in PSRAM */
+static int playback_capture(audio_playback_t *playback, const uint8_t *data, size_t len)
+{
+    audio_playback_clip_t *clip = playback->capture;
+    if (clip->len + len > playback->capture_size) {
+        size_t size = playback->capture_size ? playback->capture_size * 2 : 16 * 1024;
+        while (size < clip->len + len) {
+            size *= 2;
+        }
+        uint8_t *pcm = heap_caps_realloc(clip->pcm, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (pcm == NULL) {
+            ESP_LOGE(TAG, "Failed to grow media cache to %zu bytes", size);
+            return -1;
+        }
+        clip->pcm = pcm;
+        playback->capture_size = size;
+    }
+    memcpy(clip->pcm + clip->len, data, len);
+    clip->len += len;
+    return 0;
+}
+
+/* Time from the request to the first PCM reaching the mixer, logged the same way for decoded and cached media */
+static void playback_log_media_output_started(audio_playback_t *playback, const char *source)
+{
+    ESP_LOGI(TAG, "Media output started %" PRId64 " us after request (%s)", esp_timer_get_time() - playback->media_request_us, source);
+}
+
 static int out_data_callback(uint8_t *data, int data_size, void *ctx)
 {
-    esp_codec_dev_handle_t dev = (esp_codec_dev_handle_t)ctx;
-    esp_codec_dev_write(dev, data, data_size);
+    audio_playback_t *playback = (audio_playback_t *)ctx;
+    if (playback->capture) {
+        return playback_capture(playback, data, data_size);
+    }
+
+    if (!playback->media_output_started) {
+        playback->media_output_started = true;
+        playback_log_media_output_started(playback, "decoder");
+    }
+    playback_output(playback, playback->media_channel, data, data_size);
     return 0;
 }
 
@@ -248,7 +693,7 @@ static esp_err_t media_playback_init(audio_playback_t *playback)
         },
         .out = {
             .cb = out_data_callback,
-            .user_ctx = playback->out_dev_handle,
+            .user_ctx = playback,
         },
         .prev = embed_flash_io_set,
         .prev_ctx = playback,
@@ -305,16 +750,78 @@ err:
     return NULL;
 }
 
-void audio_playback_pipeline_restart(void *arg)
+/* Reset the pipeline element after an error and run the pipeline again. The FIFO belongs to the playback,
+ * not the pipeline, so the packets queued behind the failed one are decoded as soon as it runs. */
+static esp_err_t playback_recover(audio_playback_t *playback)
 {
-    audio_playback_t *playback = (audio_playback_t *)arg;
-    esp_err_t err = esp_gmf_pipeline_run(playback->pipeline_handle);
+    esp_gmf_pipeline_handle_t pipeline_handle = playback->pipeline_handle;
+
+    esp_gmf_pipeline_stop(pipeline_handle);
+    if (playback->read_lent) {
+        /* The packet the decoder failed on */
+        playback->read_lent = false;
+        playback_fifo_release(playback, 0);
+    }
+    /* The pipeline holds a single element, the decoder or the channel converter, so this resets only it */
+    esp_gmf_pipeline_reset(pipeline_handle);
+    esp_gmf_err_t err = pipeline_setup_elements(pipeline_handle, playback);
+    if (err == ESP_GMF_ERR_OK) {
+        err = esp_gmf_pipeline_run(pipeline_handle);
+    }
     if (err != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to restart pipeline task");
-    } else {
-        ESP_LOGI(TAG, "Pipeline task restarted successfully");
+        ESP_LOGE(TAG, "Failed to restart pipeline: %x", err);
+        return ESP_FAIL;
+    }
+
+    uint32_t recovery_us = (uint32_t)(esp_timer_get_time() - playback->failed_us);
+    portENTER_CRITICAL(&playback->stats_lock);
+    playback->stats.restarts++;
+    playback->stats.last_recovery_us = recovery_us;
+    if (recovery_us > playback->stats.max_recovery_us) {
+        playback->stats.max_recovery_us = recovery_us;
+    }
+    portEXIT_CRITICAL(&playback->stats_lock);
+    ESP_LOGW(TAG, "Pipeline restarted %" PRIu32 " us after error", recovery_us);
+    return ESP_OK;
+}
+
+/* Waits for the event handler to report a failure. The handler runs in the pipeline task, which can not
+ * stop and run its own pipeline. A restart that fails is retried, backing off up to
+ * AUDIO_PLAYBACK_RESTART_MAX_BACKOFF_MS. Deinit notifies the task and waits for it to exit, so it never
+ * goes away in the middle of a restart. */
+static void playback_supervisor_task(void *arg)
+{
+    audio_playback_t *playback = (audio_playback_t *)arg;
+    int64_t last_us = 0;
+
+    while (!playback->stopping) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (playback->stopping) {
+            break;
+        }
+        uint32_t backoff_ms = 0;
+        if (last_us && esp_timer_get_time() - last_us < AUDIO_PLAYBACK_RESTART_BACKOFF_MS * 1000) {
+            /* Failing again straight away, likely not a single bad packet: don't spin */
+            backoff_ms = AUDIO_PLAYBACK_RESTART_BACKOFF_MS;
+        }
+        while (true) {
+            if (backoff_ms) {
+                /* A notification from deinit ends the wait early */
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(backoff_ms));
+            }
+            if (playback->stopping || playback_recover(playback) == ESP_OK) {
+                break;
+            }
+            backoff_ms = backoff_ms ? backoff_ms * 2 : AUDIO_PLAYBACK_RESTART_BACKOFF_MS;
+            if (backoff_ms > AUDIO_PLAYBACK_RESTART_MAX_BACKOFF_MS) {
+                backoff_ms = AUDIO_PLAYBACK_RESTART_MAX_BACKOFF_MS;
+            }
+            ESP_LOGW(TAG, "Retrying the pipeline restart in %" PRIu32 " ms", backoff_ms);
+        }
+        last_us = esp_timer_get_time();
     }
 
+    xSemaphoreGive(playback->supervisor_exited);
     vTaskDelete(NULL);
 }
 
@@ -331,18 +838,17 @@ static esp_gmf_err_t audio_playback_event_handler(esp_gmf_event_pkt_t *pkt, void
         esp_gmf_event_state_t state = (esp_gmf_event_state_t)pkt->sub;
         ESP_LOGD(TAG, "Pipeline event: state change to %s", esp_gmf_event_get_state_str(state));
 
-        // Detect pipeline errors or stops and trigger restart
+        // Hand pipeline errors and unexpected stops to the supervisor
         if (state == ESP_GMF_EVENT_STATE_ERROR || state == ESP_GMF_EVENT_STATE_STOPPED) {
-            if (playback->started) {
-                playback->started = false;
-                ESP_LOGW(TAG, "Pipeline entered error/stopped state, triggering restart");
-
-                // Attempt to restart the pipeline immediately
-                xTaskCreate(audio_playback_pipeline_restart, "audio_playback_pipeline_restart", 1024 * 4, playback, 6, NULL);
+            if (playback->started && !playback->stopping && !playback->recovering && playback->supervisor) {
+                playback->recovering = true;
+                playback->failed_us = esp_timer_get_time();
+                ESP_LOGW(TAG, "Pipeline entered %s state, restarting", esp_gmf_event_get_state_str(state));
+                xTaskNotifyGive(playback->supervisor);
             }
         } else if (state == ESP_GMF_EVENT_STATE_RUNNING) {
             ESP_LOGI(TAG, "Playback pipeline running successfully");
-            playback->started = true;
+            playback->recovering = false;
         }
     }
 
@@ -356,6 +862,12 @@ audio_playback_handle_t audio_playback_init(const audio_playback_config_t *confi
         return NULL;
     }
 
+    uint16_t sample_rate = config->audio_in_info.sample_rate;
+    if (sample_rate != 8000 && sample_rate != 16000 && sample_rate != 24000) {
+        ESP_LOGE(TAG, "Unsupported sample rate: %d", sample_rate);
+        return NULL;
+    }
+
     audio_playback_t *playback = (audio_playback_t *)calloc(1, sizeof(audio_playback_t));
     if (playback == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for audio playback");
@@ -363,10 +875,53 @@ audio_playback_handle_t audio_playback_init(const audio_playback_config_t *confi
     }
 
     playback->out_dev_handle = config->out_dev_handle;
+    playback->mixer = config->mixer;
+    playback->speech_channel = config->speech_channel;
+    playback->media_channel = config->media_channel;
     playback->audio_in_info = config->audio_in_info;
     playback->out_codec_info = config->out_codec_info;
+    playback->native_out = config->out_codec_info.sample_rate == sample_rate &&
+                           config->out_codec_info.bits_per_sample == 16 && config->out_codec_info.channel == 1;
+    playback->drained_cb = config->drained_cb;
+    playback->drained_ctx = config->drained_ctx;
+    portMUX_INITIALIZE(&playback->flush_lock);
+    portMUX_INITIALIZE(&playback->stats_lock);
     playback->started = false;
 
+    uint8_t out_bits = config->out_codec_info.bits_per_sample;
+    if ((out_bits != 16 && out_bits != 32) || config->out_codec_info.channel == 0) {
+        ESP_LOGE(TAG, "Unsupported codec format: %d bits, %d channels", out_bits, config->out_codec_info.channel);
+        goto err;
+    }
+    if (config->out_codec_info.sample_rate != sample_rate) {
+        /* Sized for the largest Opus frame, 60 ms, so a decoded frame is resampled in one pass */
+        playback->resampler = audio_resampler_create(sample_rate, config->out_codec_info.sample_rate, 0,
+                                                     sample_rate * 60 / 1000);
+        if (playback->resampler == NULL) {
+            ESP_LOGE(TAG, "Failed to create resampler");
+            goto err;
+        }
+    }
+    if (config->catch_up_speed_pct > 100) {
+        playback->stretch = audio_stretch_create(sample_rate);
+        if (playback->stretch == NULL || audio_stretch_set_speed(playback->stretch, config->catch_up_speed_pct) != ESP_OK) {
+            ESP_LOGE(TAG, "Unsupported catch-up speed: %d%%", config->catch_up_speed_pct);
+            goto err;
+        }
+        audio_stretch_set_speed(playback->stretch, 100);
+        playback->catch_up_target_ms = config->catch_up_target_ms;
+        playback->catch_up_speed_pct = config->catch_up_speed_pct;
+        if (config->audio_in_info.codec == AUDIO_PLAYBACK_CODEC_OPUS) {
+            /* Packets fit in a block */
+            playback->block_ms = config->audio_in_info.frame_duration_ms;
+        } else {
+            playback->block_ms = AUDIO_PLAYBACK_FIFO_BLOCK_SIZE * 1000 / (sample_rate * sizeof(int16_t));
+        }
+    }
+    ESP_LOGI(TAG, "Decoded %d Hz mono to codec %" PRIu32 " Hz, %d bits, %d channels%s", sample_rate,
+             (uint32_t)config->out_codec_info.sample_rate, out_bits, config->out_codec_info.channel,
+             playback->native_out ? " (native, no conversion)" : "");
+
     esp_gmf_err_t err = audio_pool_setup();
     if (err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to setup shared pool: %x", err);
@@ -379,7 +934,7 @@ audio_playback_handle_t audio_playback_init(const audio_playback_config_t *confi
         goto err;
     }
 
-    esp_gmf_err_t fifo_err = esp_gmf_db_new_fifo(AUDIO_PLAYBACK_FIFO_BLOCK_COUNT, 1, &playback->fifo);
+    esp_gmf_err_t fifo_err = esp_gmf_db_new_fifo(AUDIO_PLAYBACK_FIFO_BLOCK_COUNT, AUDIO_PLAYBACK_FIFO_BLOCK_SIZE, &playback->fifo);
     if (fifo_err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to create ESP-GMF fifo: %x", fifo_err);
         goto err;
@@ -429,6 +984,20 @@ esp_err_t audio_playback_deinit(audio_playback_handle_t *handle)
 
     ESP_LOGI(TAG, "Deinitializing audio playback");
     audio_playback_t *playback = (audio_playback_t *)handle;
+    playback->stopping = true;
+    if (playback->mixer && playback->drained_cb) {
+        audio_mixer_notify_drained(playback->mixer, playback->speech_channel, NULL, NULL);
+    }
+
+    if (playback->supervisor) {
+        xTaskNotifyGive(playback->supervisor);
+        xSemaphoreTake(playback->supervisor_exited, portMAX_DELAY);
+        playback->supervisor = NULL;
+    }
+    if (playback->supervisor_exited) {
+        vSemaphoreDelete(playback->supervisor_exited);
+        playback->supervisor_exited = NULL;
+    }
 
     if (playback->asp_handle) {
         esp_audio_simple_player_destroy(playback->asp_handle);
@@ -450,6 +1019,15 @@ esp_err_t audio_playback_deinit(audio_playback_handle_t *handle)
         playback->fifo = NULL;
     }
 
+    for (int i = 0; i < AUDIO_PLAYBACK_MAX_CLIPS; i++) {
+        free(playback->clips[i].pcm);
+    }
+    audio_resampler_destroy(playback->resampler);
+    audio_stretch_destroy(playback->stretch);
+    free(playback->stretch_buf);
+    free(playback->resample_buf);
+    free(playback->convert_buf);
+    free(playback->packet_buf);
     free(playback);
 
     ESP_LOGI(TAG, "Audio playback deinitialized");
@@ -470,6 +1048,19 @@ esp_err_t audio_playback_start(audio_playback_handle_t *handle)
         return ESP_OK;
     }
 
+    if (playback->supervisor_exited == NULL) {
+        playback->supervisor_exited = xSemaphoreCreateBinary();
+        if (playback->supervisor_exited == NULL) {
+            ESP_LOGE(TAG, "Failed to create pipeline supervisor semaphore");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (playback->supervisor == NULL
+        && xTaskCreate(playback_supervisor_task, "audio_playback_supervisor", 1024 * 4, playback, 6, &playback->supervisor) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create pipeline supervisor task");
+        return ESP_FAIL;
+    }
+
     playback->task_handle = pipeline_task_bind_run(playback->pipeline_handle);
     if (playback->task_handle == NULL) {
         ESP_LOGE(TAG, "Failed to start pipeline task");
@@ -482,36 +1073,164 @@ esp_err_t audio_playback_start(audio_playback_handle_t *handle)
     return ESP_OK;
 }
 
-esp_err_t audio_playback_write(audio_playback_handle_t *handle, const uint8_t *data, size_t len)
+esp_err_t audio_playback_get_stats(audio_playback_handle_t *handle, audio_playback_stats_t *stats)
 {
-    if (handle == NULL || data == NULL || len == 0) {
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_playback_t *playback = (audio_playback_t *)handle;
+    portENTER_CRITICAL(&playback->stats_lock);
+    *stats = playback->stats;
+    uint64_t shed = playback->stretch_in > playback->stretch_out ? playback->stretch_in - playback->stretch_out : 0;
+    portEXIT_CRITICAL(&playback->stats_lock);
+    stats->catch_up_shed_ms = (uint32_t)(shed * 1000 / playback->audio_in_info.sample_rate);
+    return ESP_OK;
+}
+
+esp_err_t audio_playback_acquire_write(audio_playback_handle_t *handle, uint8_t **buf, size_t *buf_len, TickType_t timeout)
+{
+    if (handle == NULL || buf == NULL || buf_len == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
     audio_playback_t *playback = (audio_playback_t *)handle;
 
     if (!playback->started) {
-        // ESP_LOGE(TAG, "Playback not started");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (playback->write_acquired) {
+        ESP_LOGE(TAG, "Previous block not released");
         return ESP_ERR_INVALID_STATE;
     }
 
-    esp_gmf_data_bus_block_t blk = {0};
-
-    esp_gmf_err_io_t err = esp_gmf_db_acquire_write(playback->fifo, &blk, len, pdMS_TO_TICKS(100));
+    playback->write_blk = (esp_gmf_data_bus_block_t) {0};
+    esp_gmf_err_io_t err = esp_gmf_db_acquire_write(playback->fifo, &playback->write_blk, AUDIO_PLAYBACK_FIFO_BLOCK_SIZE, timeout);
     if (err != ESP_GMF_IO_OK) {
         ESP_LOGW(TAG, "Failed to acquire write to ESP-GMF fifo: %x", err);
+        if (playback->write_more) {
+            /* Abandon the packet in progress, the reader drops its first blocks */
+            playback->write_seq++;
+            playback->write_more = false;
+        }
         return ESP_ERR_TIMEOUT;
     }
 
-    size_t copy_size = len < blk.buf_length ? len : blk.buf_length;
-    memcpy(blk.buf, data, copy_size);
-    blk.valid_size = copy_size;
+    playback->write_acquired = true;
+    *buf = playback->write_blk.buf;
+    *buf_len = playback->write_blk.buf_length;
+    return ESP_OK;
+}
+
+static esp_err_t playback_release_block(audio_playback_t *playback, size_t len, bool more, bool eos, TickType_t timeout)
+{
+    if (!playback->write_acquired || len > playback->write_blk.buf_length) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    playback->spans[playback->span_wr++ % AUDIO_PLAYBACK_FIFO_BLOCK_COUNT] = (audio_playback_span_t) {
+        .seq = playback->write_seq,
+        .more = more,
+        .eos = eos,
+    };
+    if (!more) {
+        playback->write_seq++;
+    }
+    playback->write_more = more;
+    playback->write_acquired = false;
 
-    err = esp_gmf_db_release_write(playback->fifo, &blk, pdMS_TO_TICKS(50));
+    playback->write_blk.valid_size = len;
+    esp_gmf_err_io_t err = esp_gmf_db_release_write(playback->fifo, &playback->write_blk, timeout);
     if (err != ESP_GMF_IO_OK) {
         ESP_LOGW(TAG, "Failed to release write to ESP-GMF fifo: %x", err);
         return ESP_ERR_TIMEOUT;
     }
+    return ESP_OK;
+}
+
+esp_err_t audio_playback_release_write(audio_playback_handle_t *handle, size_t len, bool more, TickType_t timeout)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return playback_release_block((audio_playback_t *)handle, len, more, false, timeout);
+}
+
+esp_err_t audio_playback_write_eos(audio_playback_handle_t *handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_playback_t *playback = (audio_playback_t *)handle;
+    uint8_t *buf = NULL;
+    size_t buf_len = 0;
+
+    if (playback->write_more) {
+        ESP_LOGW(TAG, "End of stream inside a packet, packet dropped");
+        playback->write_seq++;
+        playback->write_more = false;
+    }
+
+    esp_err_t err = audio_playback_acquire_write(handle, &buf, &buf_len, pdMS_TO_TICKS(500));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue end of stream: %x", err);
+        return err;
+    }
+    return playback_release_block(playback, 0, false, true, pdMS_TO_TICKS(50));
+}
+
+esp_err_t audio_playback_flush(audio_playback_handle_t *handle, uint16_t fade_ms)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_playback_t *playback = (audio_playback_t *)handle;
+    uint32_t fade_frames = (uint32_t)playback->out_codec_info.sample_rate * fade_ms / 1000;
+
+    portENTER_CRITICAL(&playback->flush_lock);
+    playback->flush_wr = playback->span_wr;
+    playback->flush_us = esp_timer_get_time();
+    playback->fade_frames = fade_frames;
+    playback->fade_request = true;
+    playback->flushing = true;
+    portEXIT_CRITICAL(&playback->flush_lock);
+    if (playback->mixer && playback->drained_cb) {
+        /* A stream that ended before the flush is not reported either */
+        audio_mixer_notify_drained(playback->mixer, playback->speech_channel, NULL, NULL);
+    }
+
+    ESP_LOGD(TAG, "Flushing playback, %d ms fade", fade_ms);
+    return ESP_OK;
+}
+
+esp_err_t audio_playback_write(audio_playback_handle_t *handle, const uint8_t *data, size_t len)
+{
+    if (handle == NULL || data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t offset = 0;
+    while (offset < len) {
+        uint8_t *buf = NULL;
+        size_t buf_len = 0;
+
+        esp_err_t err = audio_playback_acquire_write(handle, &buf, &buf_len, pdMS_TO_TICKS(100));
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        size_t copy_size = len - offset < buf_len ? len - offset : buf_len;
+        memcpy(buf, data + offset, copy_size);
+        offset += copy_size;
+
+        err = audio_playback_release_write(handle, copy_size, offset < len, pdMS_TO_TICKS(50));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
 
     ESP_LOGD(TAG, "Sent %d bytes to ESP-GMF speaker data buffer", len);
     return ESP_OK;
@@ -532,6 +1251,16 @@ esp_err_t audio_playback_remaining_bytes(audio_playback_handle_t *handle, size_t
     return ESP_OK;
 }
 
+static audio_playback_clip_t *playback_find_clip(audio_playback_t *playback, const uint8_t *data)
+{
+    for (int i = 0; i < AUDIO_PLAYBACK_MAX_CLIPS; i++) {
+        if (playback->clips[i].src == data && playback->clips[i].pcm) {
+            return &playback->clips[i];
+        }
+    }
+    return NULL;
+}
+
 esp_err_t play_media(audio_playback_handle_t *handle, const char *media_url, const uint8_t *data, size_t len, bool sync)
 {
     if (handle == NULL || media_url == NULL) {
@@ -539,9 +1268,26 @@ esp_err_t play_media(audio_playback_handle_t *handle, const char *media_url, con
     }
 
     audio_playback_t *playback = (audio_playback_t *)handle;
+    playback->media_request_us = esp_timer_get_time();
+
+    audio_playback_clip_t *clip = playback_find_clip(playback, data);
+    if (clip && playback->mixer && !playback->capture) {
+        ESP_LOGI(TAG, "Playing cached media: %s", media_url);
+        esp_err_t err = audio_mixer_play_buffer(playback->mixer, playback->media_channel, clip->pcm, clip->len);
+        if (err == ESP_OK) {
+            playback_log_media_output_started(playback, "cache");
+        }
+        if (err == ESP_OK && sync) {
+            size_t bytes_per_ms = playback->out_codec_info.sample_rate / 1000 * playback->out_codec_info.channel
+                                  * (playback->out_codec_info.bits_per_sample / 8);
+            vTaskDelay(pdMS_TO_TICKS(clip->len / bytes_per_ms));
+        }
+        return err;
+    }
 
     playback->asp_embed_data = data;
     playback->asp_embed_data_len = len;
+    playback->media_output_started = false;
 
     ESP_LOGI(TAG, "Playing media: %s", media_url);
     esp_err_t err = ESP_OK;
@@ -570,3 +1316,48 @@ esp_err_t audio_playback_play_media_async(audio_playback_handle_t *handle, const
 {
     return play_media(handle, media_url, data, len, false);
 }
+
+esp_err_t audio_playback_cache_media(audio_playback_handle_t *handle, const char *media_url, const uint8_t *data, size_t len)
+{
+    if (handle == NULL || media_url == NULL || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_playback_t *playback = (audio_playback_t *)handle;
+    if (playback_find_clip(playback, data)) {
+        return ESP_OK;
+    }
+
+    audio_playback_clip_t *clip = NULL;
+    for (int i = 0; i < AUDIO_PLAYBACK_MAX_CLIPS && clip == NULL; i++) {
+        if (playback->clips[i].src == NULL) {
+            clip = &playback->clips[i];
+        }
+    }
+    if (clip == NULL) {
+        ESP_LOGE(TAG, "Media cache full");
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    playback->capture = clip;
+    playback->capture_size = 0;
+    esp_err_t err = play_media(handle, media_url, data, len, true);
+    playback->capture = NULL;
+
+    if (err != ESP_OK || clip->len == 0) {
+        ESP_LOGE(TAG, "Failed to decode %s for the cache", media_url);
+        free(clip->pcm);
+        *clip = (audio_playback_clip_t) {0};
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+
+    /* Trim the growth slack */
+    uint8_t *pcm = heap_caps_realloc(clip->pcm, clip->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pcm) {
+        clip->pcm = pcm;
+    }
+    clip->src = data;
+    ESP_LOGI(TAG, "Cached %s: %zu bytes decoded in %" PRId64 " ms", media_url, clip->len, (esp_timer_get_time() - start_us) / 1000);
+    return ESP_OK;
+}
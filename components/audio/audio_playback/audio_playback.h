@@ -13,18 +13,63 @@
 
 #include "esp_err.h"
 #include "esp_codec_dev.h"
+#include "freertos/FreeRTOS.h"
+#include "audio_mixer.h"
 
 typedef void* audio_playback_handle_t;
 
+typedef enum {
+    AUDIO_PLAYBACK_CODEC_OPUS,
+    AUDIO_PLAYBACK_CODEC_PCM,      /* 16-bit mono, played without a decoder */
+} audio_playback_codec_t;
+
+/**
+ * @brief Format of the packets written for playback
+ *
+ * @param frame_duration_ms Opus frame duration: 10, 20, 40 or 60 ms (unused for PCM)
+ * @param sample_rate Sample rate in Hz: 8000, 16000 or 24000, converted to the codec device rate
+ * @param codec Codec of the packets
+ */
 typedef struct {
     uint16_t frame_duration_ms;
     uint16_t sample_rate;
+    audio_playback_codec_t codec;
 } audio_playback_audio_info_t;
 
+/**
+ * @brief Called from the playback pipeline task once the stream ended with audio_playback_write_eos()
+ *        has been written to the codec device
+ */
+typedef void (*audio_playback_drained_cb_t)(void *ctx);
+
+/**
+ * @brief Playback configuration
+ *
+ * With a mixer, the decoded stream and the media player are written to its speech_channel and
+ * media_channel instead of out_dev_handle, so the mixer task is the only writer to the codec.
+ * The mixer must be configured with out_codec_info as its format.
+ *
+ * The decoded stream, 16-bit mono at audio_in_info.sample_rate, is converted to out_codec_info (16 or
+ * 32-bit, any channel count and rate) in the pipeline output. When out_codec_info is that native format
+ * the samples go to the codec untouched.
+ *
+ * With catch_up_speed_pct, the decoded stream is played faster, with its pitch kept, while it is more than
+ * catch_up_target_ms behind its schedule, the time since its first block less the audio played since, and
+ * audio is queued to play. This sheds the latency a network stall leaves behind, without dropping any
+ * audio. A stream sent faster than real time keeps the FIFO full but never falls behind, so it plays at
+ * its own speed.
+ */
 typedef struct {
     audio_playback_audio_info_t audio_in_info;
     esp_codec_dev_sample_info_t out_codec_info;
     esp_codec_dev_handle_t out_dev_handle;
+    audio_playback_drained_cb_t drained_cb;     /* Optional */
+    void *drained_ctx;
+    audio_mixer_handle_t mixer;                 /* Optional */
+    uint8_t speech_channel;
+    uint8_t media_channel;
+    uint16_t catch_up_target_ms;
+    uint16_t catch_up_speed_pct;                /* Up to 200, 0 to disable catching up */
 } audio_playback_config_t;
 
 audio_playback_handle_t audio_playback_init(const audio_playback_config_t *config);
@@ -33,10 +78,102 @@ esp_err_t audio_playback_deinit(audio_playback_handle_t *handle);
 
 esp_err_t audio_playback_start(audio_playback_handle_t *handle);
 
+/**
+ * @brief Queue one encoded packet for playback
+ *
+ * The packet is copied into the playback FIFO. Packets larger than a FIFO block span several blocks.
+ *
+ * @param handle The audio playback handle
+ * @param data The packet
+ * @param len The length of the packet
+ * @return ESP_OK on success, otherwise an error code
+ */
 esp_err_t audio_playback_write(audio_playback_handle_t *handle, const uint8_t *data, size_t len);
 
+/**
+ * @brief Borrow a free playback FIFO block to write a packet into
+ *
+ * Lets a receiver build packets directly in playback memory. The block is handed to the decoder
+ * by reference once released. Only one block can be borrowed at a time.
+ *
+ * @param handle The audio playback handle
+ * @param buf Set to the block buffer
+ * @param buf_len Set to the block capacity
+ * @param timeout Time to wait for a free block
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if no block was free, otherwise an error code
+ */
+esp_err_t audio_playback_acquire_write(audio_playback_handle_t *handle, uint8_t **buf, size_t *buf_len, TickType_t timeout);
+
+/**
+ * @brief Queue the block borrowed with audio_playback_acquire_write()
+ *
+ * A packet larger than one block is written as consecutive blocks, all but the last released with
+ * `more` set. If acquiring a continuation block fails, the partial packet is dropped.
+ *
+ * @param handle The audio playback handle
+ * @param len Bytes written to the block
+ * @param more True if the packet continues in the next block
+ * @param timeout Time to wait to queue the block
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_playback_release_write(audio_playback_handle_t *handle, size_t len, bool more, TickType_t timeout);
+
+/**
+ * @brief Mark the end of the current stream
+ *
+ * The marker is queued behind the packets already written. The drained callback is called once
+ * the last sample before it has been written to the codec device: by the pipeline task when the
+ * decoder reaches it, or by the mixer task when the mixer has played its speech channel out.
+ * A packet left incomplete by audio_playback_release_write() is dropped.
+ *
+ * @param handle The audio playback handle
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_playback_write_eos(audio_playback_handle_t *handle);
+
+/**
+ * @brief Drop all queued audio and fade out what is playing
+ *
+ * Packets written before the call are discarded, and the output of the packet being decoded is
+ * faded out over fade_ms then muted. With a mixer, audio already in its channel buffer still
+ * plays. Audio written after the call plays normally, end of stream markers written before it are
+ * dropped without calling the drained callback. Returns immediately.
+ *
+ * @param handle The audio playback handle
+ * @param fade_ms Fade out duration, 0 to cut immediately
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_playback_flush(audio_playback_handle_t *handle, uint16_t fade_ms);
+
 esp_err_t audio_playback_remaining_bytes(audio_playback_handle_t *handle, size_t *remaining_bytes);
 
+/**
+ * @brief Pipeline supervisor and catch-up counters
+ *
+ * When the playback pipeline fails, for instance on a corrupt packet, its element is reset and the pipeline
+ * run again. The packet being decoded is dropped, the packets queued in the FIFO are kept.
+ *
+ * @param restarts Times the pipeline was restarted after an error
+ * @param last_recovery_us Time from the error to the pipeline running again, for the latest restart
+ * @param max_recovery_us Longest recovery time seen
+ * @param catch_up_shed_ms Latency shed by playing faster, see audio_playback_config_t
+ */
+typedef struct {
+    uint32_t restarts;
+    uint32_t last_recovery_us;
+    uint32_t max_recovery_us;
+    uint32_t catch_up_shed_ms;
+} audio_playback_stats_t;
+
+/**
+ * @brief Get the pipeline supervisor and catch-up counters
+ *
+ * @param handle The audio playback handle
+ * @param stats Set to the current counters
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_playback_get_stats(audio_playback_handle_t *handle, audio_playback_stats_t *stats);
+
 /**
  * @brief Play media data using ESP-GMF audio simple player
  *
@@ -64,4 +201,20 @@ esp_err_t audio_playback_play_media_sync(audio_playback_handle_t *handle, const
  */
 esp_err_t audio_playback_play_media_async(audio_playback_handle_t *handle, const char *media_url, const uint8_t *data, size_t len);
 
+/**
+ * @brief Decode embedded media once and keep the samples for later plays
+ *
+ * The media is decoded with the simple player into PSRAM, in the format it would be written to the
+ * codec device. Later plays of the same data (same pointer) through audio_playback_play_media_sync()
+ * or audio_playback_play_media_async() hand the samples to the mixer media channel instead of
+ * decoding again. Without a mixer, plays still decode. Blocks for the decode.
+ *
+ * @param handle The audio playback handle
+ * @param media_url The media URL (embed:// schema)
+ * @param data The media data
+ * @param len The length of the media data
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the cache is full, otherwise an error code
+ */
+esp_err_t audio_playback_cache_media(audio_playback_handle_t *handle, const char *media_url, const uint8_t *data, size_t len);
+
 #endif /* __AUDIO_PLAYBACK_H__ */
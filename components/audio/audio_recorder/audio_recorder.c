@@ -6,8 +6,13 @@
 
 #include "esp_audio_enc.h"
 #include "esp_opus_enc.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <esp_check.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 
 #include <esp_gmf_pool.h>
 #include <esp_gmf_pipeline.h>
@@ -16,6 +21,9 @@
 #include <esp_afe_config.h>
 #include <esp_gmf_afe.h>
 #include <esp_gmf_afe_manager.h>
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+#include <esp_mn_speech_commands.h>
+#endif
 
 #include <esp_gmf_audio_enc.h>
 #include <esp_gmf_rate_cvt.h>
@@ -23,6 +31,7 @@
 #include <esp_gmf_bit_cvt.h>
 
 #include <esp_gmf_fifo.h>
+#include <freertos/semphr.h>
 
 #include <audio_common.h>
 #include <audio_recorder.h>
@@ -30,18 +39,151 @@
 static const char *TAG = "audio_recorder";
 
 #define AUDIO_RECORDER_FIFO_BLOCK_COUNT 8
+#define AUDIO_RECORDER_AFE_SAMPLE_RATE 16000
+
+/* Complexity governor: every window, step down when the average encode time uses more than
+ * HIGH_PCT of the frame duration (two steps above CRITICAL_PCT), step up below LOW_PCT */
+#define AUDIO_RECORDER_GOVERNOR_WINDOW_MS    2000
+#define AUDIO_RECORDER_GOVERNOR_LOW_PCT      35
+#define AUDIO_RECORDER_GOVERNOR_HIGH_PCT     70
+#define AUDIO_RECORDER_GOVERNOR_CRITICAL_PCT 90
+#define AUDIO_RECORDER_OPUS_MAX_COMPLEXITY   10
+
+/* DTX look-back: packets dropped during silence are kept to be sent ahead of the speech at the VAD onset */
+#define AUDIO_RECORDER_LOOKBACK_SLOTS     AUDIO_RECORDER_FIFO_BLOCK_COUNT
+#define AUDIO_RECORDER_LOOKBACK_SLOT_SIZE 1280
+
+/* Ring between the AFE and encoder pipelines of the split topology, each slot holds one AFE output chunk */
+#define AUDIO_RECORDER_RING_SLOTS     4
+#define AUDIO_RECORDER_RING_SLOT_SIZE 2048
+
+#ifndef CONFIG_AUDIO_RECORDER_ENCODER_CORE
+#define CONFIG_AUDIO_RECORDER_ENCODER_CORE 0
+#endif
+
+/*
+ * Single producer, single consumer block ring. Only the AFE pipeline task advances wr and only the
+ * encoder pipeline task advances rd, so the indices alone order the slots. The semaphores are only
+ * taken to sleep on a full or empty ring, and given after each publish so a sleeping side wakes up.
+ * While gated the ring stays empty and the encoder pipeline sleeps on it indefinitely, so stopping that
+ * pipeline first aborts the ring, which wakes the reader and fails its waits. The writer is left alone,
+ * the AFE pipeline keeps running.
+ */
+typedef struct {
+    uint8_t *buf;
+    uint16_t len[AUDIO_RECORDER_RING_SLOTS];
+    int64_t read_us[AUDIO_RECORDER_RING_SLOTS];     /* Microphone read that completed the slot */
+    atomic_uint wr;
+    atomic_uint rd;
+    size_t rd_offset;                               /* Bytes of the slot at rd already consumed */
+    SemaphoreHandle_t filled;
+    SemaphoreHandle_t space;
+    volatile bool abort;
+} recorder_ring_t;
 
 typedef struct {
     esp_gmf_pipeline_handle_t pipeline_handle;
     esp_codec_dev_handle_t in_dev_handle;
     esp_gmf_task_handle_t task_handle;
+    esp_gmf_afe_manager_handle_t afe_manager;
+    audio_recorder_afe_profile_t afe_profile;  /* AUDIO_RECORDER_AFE_PROFILE_MAX until one is set */
+    /* Split topology: aud_enc runs in a pipeline of its own, fed through the ring */
+    bool split;
+    esp_gmf_pipeline_handle_t enc_pipeline_handle;
+    esp_gmf_task_handle_t enc_task_handle;
+    recorder_ring_t ring;
+    int64_t frame_read_us;                 /* Read time of the last samples handed to the encoder */
     esp_gmf_fifo_handle_t fifo_handle;
+    esp_gmf_data_bus_block_t write_blk;    /* FIFO block lent to the encoder */
+    esp_gmf_data_bus_block_t read_blk;     /* FIFO block lent to the reader */
+    bool read_acquired;
+    /* Packet descriptors, written alongside each FIFO block in the same order */
+    audio_recorder_packet_t packets[AUDIO_RECORDER_FIFO_BLOCK_COUNT];
+    uint32_t packet_wr;
+    uint32_t packet_rd;
+    uint32_t next_seq;
+    int64_t last_read_us;                  /* When the latest microphone read returned */
+    audio_recorder_codec_t codec;
     uint16_t sample_rate;
     uint8_t frame_duration_ms;
+    bool dtx;
+    uint16_t dtx_keepalive_ms;
+    volatile bool vad_speech;              /* AFE VAD state */
+    int64_t last_keepalive_us;
+    /* DTX look-back, only touched by the encoder task */
+    uint8_t *lookback_buf;
+    uint16_t lookback_len[AUDIO_RECORDER_LOOKBACK_SLOTS];
+    int64_t lookback_capture_us[AUDIO_RECORDER_LOOKBACK_SLOTS];
+    uint8_t lookback_slots;
+    uint8_t lookback_count;
+    uint32_t lookback_wr;
+    /* Encoder timing and complexity governor */
+    int64_t encode_start_us;               /* When the encoder got its output block */
+    uint8_t complexity;                    /* Complexity the encoder is configured with */
+    uint8_t complexity_max;
+    bool complexity_auto;
+    uint32_t governor_frames;              /* Frames into the current governor window */
+    bool reconfiguring;
+    bool idle_gating;
+    volatile bool idle;                    /* AFE output is dropped before the encoder */
+    audio_recorder_encoder_stats_t encoder_stats;
+    portMUX_TYPE stats_lock;
+    /* Voice commands, loaded into MultiNet by the AFE task */
+    const audio_recorder_command_t *commands;
+    size_t command_count;
+    volatile bool commands_changed;
+    volatile int command_id;
     audio_recorder_event_cb_t event_cb;
     void *cb_user_data;
 } audio_recorder_t;
 
+static void recorder_apply_complexity(audio_recorder_t *recorder);
+
+typedef struct {
+    const char *name;
+    bool wakenet;
+    bool vad;
+    bool agc;
+    bool aec;
+} recorder_afe_profile_t;
+
+static const recorder_afe_profile_t s_afe_profiles[AUDIO_RECORDER_AFE_PROFILE_MAX] = {
+    [AUDIO_RECORDER_AFE_PROFILE_IDLE_WAKE] = { .name = "idle-wake", .wakenet = true },
+    [AUDIO_RECORDER_AFE_PROFILE_LISTENING] = { .name = "listening", .vad = true, .agc = true },
+    [AUDIO_RECORDER_AFE_PROFILE_FULL_DUPLEX] = { .name = "full-duplex", .vad = true, .agc = true, .aec = true },
+};
+
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+/* Replace the MultiNet phrases, from the AFE task which also runs the detection */
+static void recorder_load_commands(audio_recorder_t *recorder)
+{
+    recorder->commands_changed = false;
+    esp_mn_commands_clear();
+    for (size_t i = 0; i < recorder->command_count; i++) {
+        if (esp_mn_commands_add(recorder->commands[i].id, recorder->commands[i].phrase) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to add command \"%s\"", recorder->commands[i].phrase);
+        }
+    }
+    if (esp_mn_commands_update() != NULL) {
+        ESP_LOGW(TAG, "Some commands were not understood by MultiNet");
+    }
+    ESP_LOGI(TAG, "Loaded %zu voice commands", recorder->command_count);
+}
+
+/* Listen for commands after the wake word, the AFE reports a command or the end of the window */
+static void recorder_begin_commands(audio_recorder_t *recorder, esp_gmf_obj_handle_t afe)
+{
+    if (recorder->commands_changed) {
+        recorder_load_commands(recorder);
+    }
+    if (recorder->command_count == 0) {
+        return;
+    }
+    esp_gmf_afe_vcmd_detection_cancel(afe);
+    esp_gmf_afe_vcmd_detection_begin(afe);
+}
+#endif
+
 static void esp_gmf_afe_event_cb(esp_gmf_obj_handle_t obj, esp_gmf_afe_evt_t *event, void *user_data)
 {
     audio_recorder_event_t recorder_event = AUDIO_RECORDER_EVENT_MAX;
@@ -66,34 +208,225 @@ static void esp_gmf_afe_event_cb(esp_gmf_obj_handle_t obj, esp_gmf_afe_evt_t *ev
         recorder_event = AUDIO_RECORDER_EVENT_VAD_END;
         // ESP_LOGI(TAG, "VAD_END");
         break;
+    case ESP_GMF_AFE_EVT_VCMD_DECT_TIMEOUT:
+        recorder_event = AUDIO_RECORDER_EVENT_COMMAND_TIMEOUT;
+        ESP_LOGD(TAG, "Voice command window closed");
+        break;
     default:
+        if (event->type >= 0) {
+            /* Command identifiers are reported as the event type */
+            esp_gmf_afe_vcmd_info_t *info = event->event_data;
+            recorder_event = AUDIO_RECORDER_EVENT_COMMAND;
+            if (recorder) {
+                recorder->command_id = event->type;
+            }
+            ESP_LOGI(TAG, "Voice command %d: \"%s\" (%.2f)", event->type, info ? info->str : "", info ? info->prob : 0.0f);
+            break;
+        }
         ESP_LOGW(TAG, "Unknown event: %d", event->type);
         break;
     }
 
-    if (recorder && recorder->event_cb) {
+    if (recorder == NULL) {
+        return;
+    }
+
+    if (recorder_event == AUDIO_RECORDER_EVENT_VAD_START) {
+        recorder->vad_speech = true;
+    } else if (recorder_event == AUDIO_RECORDER_EVENT_VAD_END || recorder_event == AUDIO_RECORDER_EVENT_WAKEUP_END) {
+        recorder->vad_speech = false;
+    }
+
+    if (recorder_event == AUDIO_RECORDER_EVENT_WAKEUP_START) {
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+        recorder_begin_commands(recorder, obj);
+#endif
+        if (recorder->idle) {
+            /* The next AFE chunk already reaches the encoder */
+            recorder->idle = false;
+            ESP_LOGI(TAG, "Encoder resumed on wakeup");
+        }
+    }
+
+    if (recorder->event_cb) {
         recorder->event_cb(((audio_recorder_handle_t) recorder), recorder_event, recorder->cb_user_data);
     }
 }
 
-static esp_gmf_err_io_t recorder_outport_acquire_write(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
+/* Keep a packet dropped by DTX, overwriting the oldest once the look-back is full */
+static void recorder_lookback_push(audio_recorder_t *recorder, const esp_gmf_data_bus_block_t *blk, int64_t capture_us)
 {
-    return ESP_GMF_ERR_OK;
+    if (recorder->lookback_slots == 0 || blk->valid_size > AUDIO_RECORDER_LOOKBACK_SLOT_SIZE) {
+        return;
+    }
+    size_t slot = recorder->lookback_wr++ % recorder->lookback_slots;
+    memcpy(recorder->lookback_buf + slot * AUDIO_RECORDER_LOOKBACK_SLOT_SIZE, blk->buf, blk->valid_size);
+    recorder->lookback_len[slot] = blk->valid_size;
+    recorder->lookback_capture_us[slot] = capture_us;
+    if (recorder->lookback_count < recorder->lookback_slots) {
+        recorder->lookback_count++;
+    }
 }
 
-static esp_gmf_err_io_t recorder_outport_release_write(void *handle, esp_gmf_data_bus_block_t *blk, int block_ticks)
+/* At the VAD onset, emit the kept packets, oldest first, each in a FIFO block of its own */
+static esp_gmf_err_io_t recorder_lookback_flush(audio_recorder_t *recorder, int block_ticks)
+{
+    while (recorder->lookback_count > 0) {
+        size_t slot = (recorder->lookback_wr - recorder->lookback_count) % recorder->lookback_slots;
+        esp_gmf_data_bus_block_t blk = {0};
+        int ret = esp_gmf_fifo_acquire_write(recorder->fifo_handle, &blk, recorder->lookback_len[slot], block_ticks);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "%s|%d, Fifo acquire write failed, ret: %d", __func__, __LINE__, ret);
+            return ESP_GMF_IO_FAIL;
+        }
+        memcpy(blk.buf, recorder->lookback_buf + slot * AUDIO_RECORDER_LOOKBACK_SLOT_SIZE, recorder->lookback_len[slot]);
+        blk.valid_size = recorder->lookback_len[slot];
+
+        audio_recorder_packet_t *packet = &recorder->packets[recorder->packet_wr++ % AUDIO_RECORDER_FIFO_BLOCK_COUNT];
+        packet->seq = recorder->next_seq++;
+        packet->duration_ms = recorder->frame_duration_ms;
+        packet->capture_time_us = recorder->lookback_capture_us[slot];
+        packet->dtx = false;
+        recorder->lookback_count--;
+
+        if (esp_gmf_fifo_release_write(recorder->fifo_handle, &blk, block_ticks) != ESP_GMF_ERR_OK) {
+            ESP_LOGE(TAG, "Fifo release write failed");
+        }
+    }
+    return ESP_GMF_IO_OK;
+}
+
+/* The out port is a block port: the encoder writes each packet straight into a FIFO block */
+static esp_gmf_err_io_t recorder_outport_acquire_write(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
 {
     audio_recorder_t *recorder = (audio_recorder_t *)handle;
-    esp_gmf_data_bus_block_t _blk = {0};
-    int ret = esp_gmf_fifo_acquire_write(recorder->fifo_handle, &_blk, blk->valid_size, block_ticks);
+    if (recorder->vad_speech && recorder->lookback_count > 0 && recorder_lookback_flush(recorder, block_ticks) != ESP_GMF_IO_OK) {
+        return ESP_GMF_IO_FAIL;
+    }
+
+    recorder->write_blk = (esp_gmf_data_bus_block_t) {0};
+    int ret = esp_gmf_fifo_acquire_write(recorder->fifo_handle, &recorder->write_blk, wanted_size, block_ticks);
     if (ret < 0) {
         ESP_LOGE(TAG, "%s|%d, Fifo acquire write failed, ret: %d", __func__, __LINE__, ret);
-        return ESP_FAIL;
+        return ESP_GMF_IO_FAIL;
+    }
+
+    blk->buf = recorder->write_blk.buf;
+    blk->buf_length = recorder->write_blk.buf_length;
+    blk->valid_size = 0;
+    /* The encoder takes its output block once its input is ready, so the time to the release is the encode time */
+    recorder->encode_start_us = esp_timer_get_time();
+    return ESP_GMF_IO_OK;
+}
+
+/*
+ * Discontinuous transmission: while the AFE reports no speech, packets are dropped (emitted as empty
+ * blocks, which take no sequence number) except for one keepalive every dtx_keepalive_ms. The keepalive
+ * is the packet's TOC byte alone, an Opus packet with a zero length frame that decoders treat as DTX.
+ * The AFE already holds VAD_END back for CONFIG_AUDIO_VAD_HANGOVER_MS, so word tails are not cut, and
+ * the dropped packets since the last keepalive go to the look-back, so onsets that precede VAD_START
+ * are sent too.
+ */
+static bool recorder_dtx_filter(audio_recorder_t *recorder, esp_gmf_data_bus_block_t *blk, int64_t capture_us)
+{
+    if (!recorder->dtx || recorder->vad_speech || blk->valid_size == 0) {
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now - recorder->last_keepalive_us >= (int64_t)recorder->dtx_keepalive_ms * 1000) {
+        recorder->last_keepalive_us = now;
+        /* The keepalive marks the stream position, older packets would now arrive out of order */
+        recorder->lookback_count = 0;
+        blk->buf[0] &= 0xFC;    /* Frame count code 0: one frame */
+        blk->valid_size = 1;
+        return true;
+    }
+    recorder_lookback_push(recorder, blk, capture_us);
+    blk->valid_size = 0;
+    return false;
+}
+
+/*
+ * Opus complexity governor. The encode time is averaged over about 16 frames and compared with the frame
+ * duration once per window: complexity is stepped down when encoding approaches the budget and back up,
+ * to the configured complexity, when there is headroom. aud_enc can only be reconfigured while closed,
+ * which restarts its pipeline, so the governor only runs in the split topology: there the encoder pipeline
+ * restarts on its own while the AFE keeps filling the ring.
+ */
+static void recorder_encoder_governor(audio_recorder_t *recorder, uint32_t encode_us)
+{
+    audio_recorder_encoder_stats_t *stats = &recorder->encoder_stats;
+
+    portENTER_CRITICAL(&recorder->stats_lock);
+    stats->frames++;
+    stats->last_us = encode_us;
+    if (encode_us > stats->max_us) {
+        stats->max_us = encode_us;
+    }
+    if (stats->frames == 1) {
+        stats->avg_us = encode_us;
+    } else {
+        stats->avg_us = (uint32_t)((int32_t)stats->avg_us + ((int32_t)encode_us - (int32_t)stats->avg_us) / 16);
+    }
+    stats->utilization_pct = stats->avg_us * 100 / stats->budget_us;
+    uint16_t utilization_pct = stats->utilization_pct;
+    portEXIT_CRITICAL(&recorder->stats_lock);
+
+    if (!recorder->complexity_auto
+        || ++recorder->governor_frames < AUDIO_RECORDER_GOVERNOR_WINDOW_MS / recorder->frame_duration_ms) {
+        return;
+    }
+    recorder->governor_frames = 0;
+
+    int target = stats->complexity_target;
+    if (utilization_pct >= AUDIO_RECORDER_GOVERNOR_CRITICAL_PCT) {
+        target -= 2;
+    } else if (utilization_pct >= AUDIO_RECORDER_GOVERNOR_HIGH_PCT) {
+        target -= 1;
+    } else if (utilization_pct <= AUDIO_RECORDER_GOVERNOR_LOW_PCT) {
+        target += 1;
+    }
+    target = target < 0 ? 0 : target;
+    target = target > recorder->complexity_max ? recorder->complexity_max : target;
+
+    if (target != stats->complexity_target) {
+        ESP_LOGI(TAG, "Encode time %" PRIu32 " us, %u%% of the frame: complexity %u -> %d",
+                 stats->avg_us, utilization_pct, stats->complexity_target, target);
+        stats->complexity_target = target;
+    }
+    recorder_apply_complexity(recorder);
+}
+
+static esp_gmf_err_io_t recorder_outport_release_write(void *handle, esp_gmf_data_bus_block_t *blk, int block_ticks)
+{
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+
+    if (recorder->codec == AUDIO_RECORDER_CODEC_OPUS) {
+        recorder_encoder_governor(recorder, (uint32_t)(esp_timer_get_time() - recorder->encode_start_us));
+    }
+
+    if (recorder->idle) {
+        /* PCM chunks, and the Opus frame in flight when the recorder went idle */
+        blk->valid_size = 0;
+        recorder->lookback_count = 0;
+    }
+    /* The encoder has just consumed the most recent microphone read, so that read ends the packet */
+    int64_t read_us = recorder->split ? recorder->frame_read_us : recorder->last_read_us;
+    bool keepalive = recorder_dtx_filter(recorder, blk, read_us - (int64_t)recorder->frame_duration_ms * 1000);
+    recorder->write_blk.valid_size = blk->valid_size;
+
+    audio_recorder_packet_t *packet = &recorder->packets[recorder->packet_wr++ % AUDIO_RECORDER_FIFO_BLOCK_COUNT];
+    packet->seq = blk->valid_size > 0 ? recorder->next_seq++ : recorder->next_seq;
+    if (recorder->codec == AUDIO_RECORDER_CODEC_PCM) {
+        packet->duration_ms = blk->valid_size * 1000 / (recorder->sample_rate * sizeof(int16_t));
+    } else {
+        packet->duration_ms = blk->valid_size > 0 ? recorder->frame_duration_ms : 0;
     }
-    memcpy(_blk.buf, blk->buf, blk->valid_size);
+    packet->capture_time_us = read_us - (int64_t)packet->duration_ms * 1000;
+    packet->dtx = keepalive;
 
-    _blk.valid_size = blk->valid_size;
-    ret = esp_gmf_fifo_release_write(recorder->fifo_handle, &_blk, block_ticks);
+    int ret = esp_gmf_fifo_release_write(recorder->fifo_handle, &recorder->write_blk, block_ticks);
     if (ret != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Fifo release write failed");
     }
@@ -105,6 +438,7 @@ static esp_gmf_err_io_t recorder_inport_acquire_read(void *handle, esp_gmf_data_
     audio_recorder_t *recorder = (audio_recorder_t *)handle;
 
     esp_codec_dev_read(recorder->in_dev_handle, blk->buf, wanted_size);
+    recorder->last_read_us = esp_timer_get_time();
     blk->valid_size = wanted_size;
 
     return ESP_GMF_IO_OK;
@@ -115,22 +449,147 @@ static esp_gmf_err_io_t recorder_inport_release_read(void *handle, esp_gmf_data_
     return ESP_GMF_IO_OK;
 }
 
+/* Out port of the AFE pipeline in the split topology: the AFE output is written straight into a ring slot */
+static esp_gmf_err_io_t recorder_ring_acquire_write(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
+{
+    recorder_ring_t *ring = &((audio_recorder_t *)handle)->ring;
 
-static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_handle, audio_recorder_handle_t recorder_handle)
+    if (wanted_size > AUDIO_RECORDER_RING_SLOT_SIZE) {
+        ESP_LOGE(TAG, "AFE chunk of %d bytes does not fit a ring slot", wanted_size);
+        return ESP_GMF_IO_FAIL;
+    }
+
+    unsigned wr = atomic_load_explicit(&ring->wr, memory_order_relaxed);
+    while (wr - atomic_load_explicit(&ring->rd, memory_order_acquire) == AUDIO_RECORDER_RING_SLOTS) {
+        if (xSemaphoreTake(ring->space, block_ticks) != pdTRUE) {
+            return ESP_GMF_IO_TIMEOUT;
+        }
+    }
+
+    blk->buf = ring->buf + (wr % AUDIO_RECORDER_RING_SLOTS) * AUDIO_RECORDER_RING_SLOT_SIZE;
+    blk->buf_length = AUDIO_RECORDER_RING_SLOT_SIZE;
+    blk->valid_size = 0;
+    return ESP_GMF_IO_OK;
+}
+
+static esp_gmf_err_io_t recorder_ring_release_write(void *handle, esp_gmf_data_bus_block_t *blk, int block_ticks)
 {
-    esp_gmf_err_t err = ESP_GMF_ERR_OK;
-    esp_gmf_element_handle_t ele = NULL;
-    audio_recorder_t *recorder = (audio_recorder_t *)recorder_handle;
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    recorder_ring_t *ring = &recorder->ring;
+
+    /* While idle the chunk is not published, the encoder pipeline sleeps on the empty ring */
+    if (blk->valid_size == 0 || recorder->idle) {
+        return ESP_GMF_IO_OK;
+    }
+
+    unsigned wr = atomic_load_explicit(&ring->wr, memory_order_relaxed);
+    ring->len[wr % AUDIO_RECORDER_RING_SLOTS] = blk->valid_size;
+    ring->read_us[wr % AUDIO_RECORDER_RING_SLOTS] = recorder->last_read_us;
+    atomic_store_explicit(&ring->wr, wr + 1, memory_order_release);
+    xSemaphoreGive(ring->filled);
+    return ESP_GMF_IO_OK;
+}
+
+/* In port of the encoder pipeline: copies whole encoder frames out of the ring, across slot boundaries */
+static esp_gmf_err_io_t recorder_ring_acquire_read(void *handle, esp_gmf_data_bus_block_t *blk, int wanted_size, int block_ticks)
+{
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    recorder_ring_t *ring = &recorder->ring;
+    int filled = 0;
+
+    while (filled < wanted_size) {
+        unsigned rd = atomic_load_explicit(&ring->rd, memory_order_relaxed);
+        if (atomic_load_explicit(&ring->wr, memory_order_acquire) == rd) {
+            if (ring->abort) {
+                return ESP_GMF_IO_ABORT;
+            }
+            if (xSemaphoreTake(ring->filled, block_ticks) != pdTRUE) {
+                return ESP_GMF_IO_TIMEOUT;
+            }
+            continue;
+        }
+
+        size_t slot = rd % AUDIO_RECORDER_RING_SLOTS;
+        size_t n = ring->len[slot] - ring->rd_offset;
+        if (n > (size_t)(wanted_size - filled)) {
+            n = wanted_size - filled;
+        }
+        memcpy(blk->buf + filled, ring->buf + slot * AUDIO_RECORDER_RING_SLOT_SIZE + ring->rd_offset, n);
+        filled += n;
+        ring->rd_offset += n;
+        recorder->frame_read_us = ring->read_us[slot];
+
+        if (ring->rd_offset == ring->len[slot]) {
+            ring->rd_offset = 0;
+            atomic_store_explicit(&ring->rd, rd + 1, memory_order_release);
+            xSemaphoreGive(ring->space);
+        }
+    }
+
+    blk->valid_size = wanted_size;
+    return ESP_GMF_IO_OK;
+}
+
+static esp_err_t recorder_ring_init(recorder_ring_t *ring)
+{
+    ring->buf = heap_caps_malloc(AUDIO_RECORDER_RING_SLOTS * AUDIO_RECORDER_RING_SLOT_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ring->filled = xSemaphoreCreateBinary();
+    ring->space = xSemaphoreCreateBinary();
+    if (ring->buf == NULL || ring->filled == NULL || ring->space == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_init(&ring->wr, 0);
+    atomic_init(&ring->rd, 0);
+    return ESP_OK;
+}
+
+/* Wake the reader if it sleeps on the empty ring, and fail its waits until recorder_ring_resume() */
+static void recorder_ring_abort(recorder_ring_t *ring)
+{
+    if (ring->filled == NULL) {
+        return;
+    }
+    ring->abort = true;
+    xSemaphoreGive(ring->filled);
+}
+
+static void recorder_ring_resume(recorder_ring_t *ring)
+{
+    if (ring->filled == NULL) {
+        return;
+    }
+    ring->abort = false;
+}
+
+static void recorder_ring_deinit(recorder_ring_t *ring)
+{
+    free(ring->buf);
+    if (ring->filled) {
+        vSemaphoreDelete(ring->filled);
+    }
+    if (ring->space) {
+        vSemaphoreDelete(ring->space);
+    }
+    *ring = (recorder_ring_t) {0};
+}
 
-    err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_enc", &ele);
+
+static esp_gmf_err_t recorder_setup_encoder(esp_gmf_pipeline_handle_t pipeline_handle, audio_recorder_t *recorder)
+{
+    esp_gmf_element_handle_t ele = NULL;
+    esp_gmf_err_t err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_enc", &ele);
     if (err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to get audio enc element: %x", err);
         return err;
     }
 
     esp_opus_enc_frame_duration_t frame_duration = ESP_OPUS_ENC_FRAME_DURATION_ARG;
-    if (recorder->frame_duration_ms == 20) {
+    if (recorder->frame_duration_ms == 10) {
+        frame_duration = ESP_OPUS_ENC_FRAME_DURATION_10_MS;
+    } else if (recorder->frame_duration_ms == 20) {
         frame_duration = ESP_OPUS_ENC_FRAME_DURATION_20_MS;
+    } else if (recorder->frame_duration_ms == 40) {
+        frame_duration = ESP_OPUS_ENC_FRAME_DURATION_40_MS;
     } else if (recorder->frame_duration_ms == 60) {
         frame_duration = ESP_OPUS_ENC_FRAME_DURATION_60_MS;
     } else {
@@ -143,6 +602,8 @@ static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_
     opus_enc_cfg.sample_rate = recorder->sample_rate;
     opus_enc_cfg.channel = 1;
     opus_enc_cfg.bits_per_sample = 16;
+    opus_enc_cfg.enable_dtx = recorder->dtx;
+    opus_enc_cfg.complexity = recorder->complexity;
 
     esp_audio_enc_config_t enc_config = {
         .type = ESP_AUDIO_TYPE_OPUS,
@@ -155,6 +616,102 @@ static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_
         return err;
     }
 
+    return ESP_GMF_ERR_OK;
+}
+
+/* The pipeline holding aud_enc */
+static esp_gmf_pipeline_handle_t recorder_encoder_pipeline(audio_recorder_t *recorder)
+{
+    return recorder->split ? recorder->enc_pipeline_handle : recorder->pipeline_handle;
+}
+
+/* Tell the first element of a pipeline the format of its input */
+static void pipeline_report_input_info(audio_recorder_t *recorder, esp_gmf_pipeline_handle_t pipeline_handle)
+{
+    esp_gmf_info_sound_t in_info = {
+        .sample_rates = pipeline_handle == recorder->pipeline_handle ? AUDIO_RECORDER_AFE_SAMPLE_RATE : recorder->sample_rate,
+        .bits = 16,
+        .channels = 1,
+    };
+    esp_gmf_pipeline_report_info(pipeline_handle, ESP_GMF_INFO_SOUND, &in_info, sizeof(in_info));
+}
+
+static void recorder_reconfigure_task(void *arg)
+{
+    audio_recorder_t *recorder = (audio_recorder_t *)arg;
+    esp_gmf_pipeline_handle_t pipeline_handle = recorder_encoder_pipeline(recorder);
+    uint8_t previous = recorder->complexity;
+
+    /* The encoder pipeline may be asleep on an empty ring, gated */
+    recorder_ring_abort(&recorder->ring);
+    esp_gmf_err_t err = esp_gmf_pipeline_stop(pipeline_handle);
+    recorder_ring_resume(&recorder->ring);
+    if (err == ESP_GMF_ERR_OK) {
+        esp_gmf_pipeline_reset(pipeline_handle);
+        recorder->complexity = recorder->encoder_stats.complexity_target;
+        err = recorder_setup_encoder(pipeline_handle, recorder);
+        if (err != ESP_GMF_ERR_OK) {
+            /* Keep the encoder as it was and stop adapting */
+            recorder->complexity = previous;
+            recorder->complexity_auto = false;
+            recorder_setup_encoder(pipeline_handle, recorder);
+        }
+        pipeline_report_input_info(recorder, pipeline_handle);
+        err = esp_gmf_pipeline_run(pipeline_handle);
+    }
+    if (err != ESP_GMF_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to reconfigure encoder: %x", err);
+    } else {
+        ESP_LOGI(TAG, "Encoder complexity %u -> %u", previous, recorder->complexity);
+    }
+
+    portENTER_CRITICAL(&recorder->stats_lock);
+    recorder->encoder_stats.complexity = recorder->complexity;
+    recorder->encoder_stats.reconfigs++;
+    portEXIT_CRITICAL(&recorder->stats_lock);
+    recorder->governor_frames = 0;
+    recorder->reconfiguring = false;
+    vTaskDelete(NULL);
+}
+
+/* Restart the pipeline with the complexity chosen by the governor, from a task of its own since the
+ * callers run in the pipeline and AFE tasks */
+static void recorder_apply_complexity(audio_recorder_t *recorder)
+{
+    if (!recorder->complexity_auto || recorder->reconfiguring || recorder->task_handle == NULL
+        || recorder->encoder_stats.complexity_target == recorder->complexity) {
+        return;
+    }
+
+    recorder->reconfiguring = true;
+    if (xTaskCreate(recorder_reconfigure_task, "audio_rec_reconfig", 1024 * 4, recorder, 6, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create encoder reconfigure task");
+        recorder->reconfiguring = false;
+    }
+}
+
+static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_handle, audio_recorder_handle_t recorder_handle)
+{
+    esp_gmf_err_t err = ESP_GMF_ERR_OK;
+    esp_gmf_element_handle_t ele = NULL;
+    audio_recorder_t *recorder = (audio_recorder_t *)recorder_handle;
+
+    if (recorder->sample_rate != AUDIO_RECORDER_AFE_SAMPLE_RATE) {
+        err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "aud_rate_cvt", &ele);
+        if (err != ESP_GMF_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to get rate cvt element: %x", err);
+            return err;
+        }
+        esp_gmf_rate_cvt_set_dest_rate(ele, recorder->sample_rate);
+    }
+
+    if (recorder->codec == AUDIO_RECORDER_CODEC_OPUS) {
+        err = recorder_setup_encoder(recorder_encoder_pipeline(recorder), recorder);
+        if (err != ESP_GMF_ERR_OK) {
+            return err;
+        }
+    }
+
     err = esp_gmf_pipeline_get_el_by_name(pipeline_handle, "ai_afe", &ele);
     if (err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to get ai afe element: %x", err);
@@ -166,26 +723,24 @@ static esp_gmf_err_t pipeline_setup_elements(esp_gmf_pipeline_handle_t pipeline_
         return err;
     }
 
-    esp_gmf_info_sound_t in_info = {
-        .sample_rates = 16000,
-        .bits = 16,
-        .channels = 1,
-    };
-    esp_gmf_pipeline_report_info(pipeline_handle, ESP_GMF_INFO_SOUND, &in_info, sizeof(in_info));
+    pipeline_report_input_info(recorder, pipeline_handle);
+    if (recorder->split) {
+        pipeline_report_input_info(recorder, recorder->enc_pipeline_handle);
+    }
 
     return ESP_GMF_ERR_OK;
 }
 
-static esp_gmf_task_handle_t pipeline_task_bind_run(esp_gmf_pipeline_handle_t pipeline_handle)
+static esp_gmf_task_handle_t pipeline_task_bind_run(esp_gmf_pipeline_handle_t pipeline_handle, const char *name, int core)
 {
     esp_gmf_err_t err = ESP_GMF_ERR_OK;
     esp_gmf_task_handle_t task_handle = NULL;
 
     esp_gmf_task_cfg_t task_cfg =  DEFAULT_ESP_GMF_TASK_CONFIG();
-    task_cfg.name = "audio_rec_pipeline";
+    task_cfg.name = name;
     task_cfg.thread.stack_in_ext = true;
     task_cfg.thread.stack = 32 * 1024;
-    task_cfg.thread.core = 1;
+    task_cfg.thread.core = core;
 
     err = esp_gmf_task_init(&task_cfg, &task_handle);
     if (err != ESP_GMF_ERR_OK) {
@@ -222,25 +777,15 @@ err:
     return NULL;
 }
 
-static esp_gmf_err_t pipeline_setup_ports(esp_gmf_pipeline_handle_t pipeline_handle, const char *input_name, const char *output_name, audio_recorder_handle_t recorder_handle)
+static esp_gmf_err_t pipeline_setup_ports(esp_gmf_pipeline_handle_t pipeline_handle, const char *input_name, esp_gmf_port_handle_t in_port,
+                                          const char *output_name, esp_gmf_port_handle_t out_port)
 {
-    esp_gmf_err_t err = ESP_GMF_ERR_OK;
-    esp_gmf_port_handle_t out_port = NEW_ESP_GMF_PORT_OUT_BYTE(
-        recorder_outport_acquire_write,
-        recorder_outport_release_write,
-        NULL, recorder_handle, 2048, portMAX_DELAY);
-
-    esp_gmf_err_t ret = esp_gmf_pipeline_reg_el_port(pipeline_handle, output_name, ESP_GMF_IO_DIR_WRITER, out_port);
-    if (ret != ESP_GMF_ERR_OK) {
-        ESP_LOGE(TAG, "Failed to register output port: %x", ret);
-        return ret;
+    esp_gmf_err_t err = esp_gmf_pipeline_reg_el_port(pipeline_handle, output_name, ESP_GMF_IO_DIR_WRITER, out_port);
+    if (err != ESP_GMF_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to register output port: %x", err);
+        return err;
     }
 
-    esp_gmf_port_handle_t in_port = NEW_ESP_GMF_PORT_IN_BYTE(
-        recorder_inport_acquire_read,
-        recorder_inport_release_read,
-        NULL, recorder_handle, 2048, portMAX_DELAY);
-
     err = esp_gmf_pipeline_reg_el_port(pipeline_handle, input_name, ESP_GMF_IO_DIR_READER, in_port);
     if (err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to register input port: %x", err);
@@ -250,24 +795,67 @@ static esp_gmf_err_t pipeline_setup_ports(esp_gmf_pipeline_handle_t pipeline_han
     return ESP_GMF_ERR_OK;
 }
 
+/*
+ * Builds ai_afe -> [aud_rate_cvt] -> [aud_enc] as one pipeline, or in the split topology, ai_afe ->
+ * [aud_rate_cvt] into the ring and a second pipeline of aud_enc alone reading from it.
+ */
 esp_gmf_pipeline_handle_t pipeline_init(esp_gmf_pool_handle_t pool, audio_recorder_handle_t recorder_handle)
 {
+    audio_recorder_t *recorder = (audio_recorder_t *)recorder_handle;
     esp_gmf_pipeline_handle_t pipeline_handle = NULL;
-    const char *el_names[] = {
-        "ai_afe",
-        "aud_enc",
-    };
-    size_t num_el = sizeof(el_names) / sizeof(el_names[0]);
+    const char *el_names[3];
+    size_t num_el = 0;
+
+    el_names[num_el++] = "ai_afe";
+    if (recorder->sample_rate != AUDIO_RECORDER_AFE_SAMPLE_RATE) {
+        el_names[num_el++] = "aud_rate_cvt";
+    }
+    if (recorder->codec == AUDIO_RECORDER_CODEC_OPUS && !recorder->split) {
+        el_names[num_el++] = "aud_enc";
+    }
     esp_gmf_err_t err = esp_gmf_pool_new_pipeline(pool,NULL, el_names, num_el, NULL, &pipeline_handle);
 
-    err = pipeline_setup_ports(pipeline_handle, el_names[0], el_names[num_el - 1], recorder_handle);
+    /* The out port is a block port: the last element writes straight into a FIFO block or ring slot */
+    esp_gmf_port_handle_t out_port = NULL;
+    if (recorder->split) {
+        out_port = NEW_ESP_GMF_PORT_OUT_BLOCK(recorder_ring_acquire_write, recorder_ring_release_write,
+                                              NULL, recorder_handle, AUDIO_RECORDER_RING_SLOT_SIZE, portMAX_DELAY);
+    } else {
+        out_port = NEW_ESP_GMF_PORT_OUT_BLOCK(recorder_outport_acquire_write, recorder_outport_release_write,
+                                              NULL, recorder_handle, 2048, portMAX_DELAY);
+    }
+    esp_gmf_port_handle_t in_port = NEW_ESP_GMF_PORT_IN_BYTE(recorder_inport_acquire_read, recorder_inport_release_read,
+                                                             NULL, recorder_handle, 2048, portMAX_DELAY);
+    err = pipeline_setup_ports(pipeline_handle, el_names[0], in_port, el_names[num_el - 1], out_port);
     if (err != ESP_GMF_ERR_OK) {
         ESP_LOGE(TAG, "Failed to setup ports: %x", err);
         goto err;
     }
+
+    if (recorder->split) {
+        const char *enc_names[] = {"aud_enc"};
+        err = esp_gmf_pool_new_pipeline(pool, NULL, enc_names, 1, NULL, &recorder->enc_pipeline_handle);
+        if (err != ESP_GMF_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to create encoder pipeline: %x", err);
+            goto err;
+        }
+        out_port = NEW_ESP_GMF_PORT_OUT_BLOCK(recorder_outport_acquire_write, recorder_outport_release_write,
+                                              NULL, recorder_handle, 2048, portMAX_DELAY);
+        in_port = NEW_ESP_GMF_PORT_IN_BYTE(recorder_ring_acquire_read, recorder_inport_release_read,
+                                           NULL, recorder_handle, 2048, portMAX_DELAY);
+        err = pipeline_setup_ports(recorder->enc_pipeline_handle, enc_names[0], in_port, enc_names[0], out_port);
+        if (err != ESP_GMF_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to setup encoder ports: %x", err);
+            goto err;
+        }
+    }
     return pipeline_handle;
 
 err:
+    if (recorder->enc_pipeline_handle) {
+        esp_gmf_pipeline_destroy(recorder->enc_pipeline_handle);
+        recorder->enc_pipeline_handle = NULL;
+    }
     if (pipeline_handle) {
         esp_gmf_pipeline_destroy(pipeline_handle);
     }
@@ -287,10 +875,50 @@ audio_recorder_handle_t audio_recorder_init(const audio_recorder_config_t *confi
         goto err;
     }
 
+    if (config->sample_rate != 8000 && config->sample_rate != 16000 && config->sample_rate != 24000) {
+        ESP_LOGE(TAG, "Unsupported sample rate: %d", config->sample_rate);
+        goto err;
+    }
+
     // Store codec device handle
     recorder->in_dev_handle = config->in_dev_handle;
+    recorder->codec = config->codec;
     recorder->sample_rate = config->sample_rate;
     recorder->frame_duration_ms = config->frame_duration_ms;
+    /* The keepalive is an Opus TOC byte, PCM has no DTX */
+    recorder->dtx = config->dtx && config->codec == AUDIO_RECORDER_CODEC_OPUS;
+    recorder->dtx_keepalive_ms = config->dtx_keepalive_ms;
+    if (recorder->dtx && config->dtx_lookback_ms > 0 && config->frame_duration_ms > 0) {
+        size_t slots = (config->dtx_lookback_ms + config->frame_duration_ms - 1) / config->frame_duration_ms;
+        recorder->lookback_slots = slots > AUDIO_RECORDER_LOOKBACK_SLOTS ? AUDIO_RECORDER_LOOKBACK_SLOTS : slots;
+        recorder->lookback_buf = heap_caps_malloc(recorder->lookback_slots * AUDIO_RECORDER_LOOKBACK_SLOT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (recorder->lookback_buf == NULL) {
+            recorder->lookback_buf = malloc(recorder->lookback_slots * AUDIO_RECORDER_LOOKBACK_SLOT_SIZE);
+        }
+        if (recorder->lookback_buf == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate the DTX look-back");
+            goto err;
+        }
+    }
+    recorder->complexity = config->complexity > AUDIO_RECORDER_OPUS_MAX_COMPLEXITY ? AUDIO_RECORDER_OPUS_MAX_COMPLEXITY : config->complexity;
+    recorder->complexity_max = recorder->complexity;
+    recorder->idle_gating = config->idle_gating;
+    recorder->idle = config->idle_gating;
+    /* Only worth a second task when there is an encoder to move off the AFE core, or to gate */
+#if CONFIG_AUDIO_RECORDER_SPLIT_PIPELINE
+    recorder->split = config->codec == AUDIO_RECORDER_CODEC_OPUS;
+#else
+    recorder->split = config->codec == AUDIO_RECORDER_CODEC_OPUS && config->idle_gating;
+#endif
+    /* Restarting a single pipeline would also stop the AFE and lose audio mid-session */
+    recorder->complexity_auto = config->complexity_auto && recorder->split;
+    if (config->complexity_auto && config->codec == AUDIO_RECORDER_CODEC_OPUS && !recorder->split) {
+        ESP_LOGW(TAG, "Complexity governor needs the split topology, keeping complexity %u", recorder->complexity);
+    }
+    recorder->encoder_stats.budget_us = (uint32_t)config->frame_duration_ms * 1000;
+    recorder->encoder_stats.complexity = recorder->complexity;
+    recorder->encoder_stats.complexity_target = recorder->complexity;
+    portMUX_INITIALIZE(&recorder->stats_lock);
 
     esp_gmf_err_t err = audio_pool_setup();
     if (err != ESP_GMF_ERR_OK) {
@@ -308,6 +936,13 @@ audio_recorder_handle_t audio_recorder_init(const audio_recorder_config_t *confi
         ESP_LOGE(TAG, "Failed to register AFE to shared pool");
         goto err;
     }
+    recorder->afe_manager = gmf_afe_manager;
+    recorder->afe_profile = AUDIO_RECORDER_AFE_PROFILE_MAX;
+
+    if (recorder->split && recorder_ring_init(&recorder->ring) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate the encoder ring");
+        goto err;
+    }
 
     esp_gmf_pipeline_handle_t pipeline_handle = pipeline_init(pool_handle, (audio_recorder_handle_t)recorder);
     if (pipeline_handle == NULL) {
@@ -347,11 +982,22 @@ esp_err_t audio_recorder_deinit(audio_recorder_handle_t handle)
     ESP_LOGI(TAG, "Deinitializing audio recorder");
     audio_recorder_t *recorder = (audio_recorder_t *)handle;
 
+    recorder_ring_abort(&recorder->ring);
     if (recorder->task_handle) {
         esp_gmf_task_deinit(recorder->task_handle);
         recorder->task_handle = NULL;
     }
 
+    if (recorder->enc_task_handle) {
+        esp_gmf_task_deinit(recorder->enc_task_handle);
+        recorder->enc_task_handle = NULL;
+    }
+
+    if (recorder->enc_pipeline_handle) {
+        esp_gmf_pipeline_destroy(recorder->enc_pipeline_handle);
+        recorder->enc_pipeline_handle = NULL;
+    }
+
     if (recorder->pipeline_handle) {
         esp_gmf_pipeline_destroy(recorder->pipeline_handle);
         recorder->pipeline_handle = NULL;
@@ -362,6 +1008,14 @@ esp_err_t audio_recorder_deinit(audio_recorder_handle_t handle)
         recorder->fifo_handle = NULL;
     }
 
+    recorder_ring_deinit(&recorder->ring);
+
+    if (recorder->afe_manager) {
+        audio_pool_release_afe();
+        recorder->afe_manager = NULL;
+    }
+
+    free(recorder->lookback_buf);
     free(recorder);
 
     ESP_LOGI(TAG, "Audio recorder deinitialized");
@@ -375,34 +1029,108 @@ esp_err_t audio_recorder_start(audio_recorder_handle_t handle)
     }
 
     audio_recorder_t *recorder = (audio_recorder_t *)handle;
-    recorder->task_handle = pipeline_task_bind_run(recorder->pipeline_handle);
+    if (recorder->split) {
+        recorder->enc_task_handle = pipeline_task_bind_run(recorder->enc_pipeline_handle, "audio_rec_encoder",
+                                                           CONFIG_AUDIO_RECORDER_ENCODER_CORE);
+    }
+    recorder->task_handle = pipeline_task_bind_run(recorder->pipeline_handle, "audio_rec_pipeline", 1);
 
     return ESP_OK;
 }
 
-esp_err_t audio_recorder_read(audio_recorder_handle_t handle, uint8_t *data, size_t len, size_t *read_len)
+esp_err_t audio_recorder_acquire_read(audio_recorder_handle_t handle, audio_recorder_packet_t *packet, TickType_t timeout)
 {
-    if (handle == NULL || data == NULL || len == 0) {
+    if (handle == NULL || packet == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    esp_err_t err = ESP_OK;
-
     audio_recorder_t *recorder = (audio_recorder_t *)handle;
-    esp_gmf_data_bus_block_t blk;
+    if (recorder->read_acquired) {
+        ESP_LOGE(TAG, "Previous packet not released");
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    err = esp_gmf_fifo_acquire_read(recorder->fifo_handle, &blk, len, portMAX_DELAY);
+    recorder->read_blk = (esp_gmf_data_bus_block_t) {0};
+    int err = esp_gmf_fifo_acquire_read(recorder->fifo_handle, &recorder->read_blk, 0, timeout);
     if (err != ESP_GMF_IO_OK) {
-        *read_len = 0;
+        *packet = (audio_recorder_packet_t) {0};
+        return err == ESP_GMF_IO_TIMEOUT ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    }
+
+    recorder->read_acquired = true;
+    *packet = recorder->packets[recorder->packet_rd++ % AUDIO_RECORDER_FIFO_BLOCK_COUNT];
+    packet->data = recorder->read_blk.buf;
+    packet->len = recorder->read_blk.valid_size;
+    return ESP_OK;
+}
+
+esp_err_t audio_recorder_release_read(audio_recorder_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    if (!recorder->read_acquired) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    recorder->read_acquired = false;
+    esp_gmf_fifo_release_read(recorder->fifo_handle, &recorder->read_blk, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t audio_recorder_read(audio_recorder_handle_t handle, uint8_t *data, size_t len, size_t *read_len)
+{
+    if (handle == NULL || data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_packet_t packet;
+
+    *read_len = 0;
+    esp_err_t err = audio_recorder_acquire_read(handle, &packet, portMAX_DELAY);
+    if (err != ESP_OK) {
         return err;
     }
 
-    size_t copy_len = (blk.valid_size < len) ? blk.valid_size : len;
-    memcpy(data, blk.buf, copy_len);
+    size_t copy_len = (packet.len < len) ? packet.len : len;
+    memcpy(data, packet.data, copy_len);
     *read_len = copy_len;
 
-    esp_gmf_fifo_release_read(recorder->fifo_handle, &blk, portMAX_DELAY);
+    return audio_recorder_release_read(handle);
+}
 
+esp_err_t audio_recorder_get_encoder_stats(audio_recorder_handle_t handle, audio_recorder_encoder_stats_t *stats)
+{
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    if (recorder->codec != AUDIO_RECORDER_CODEC_OPUS) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    portENTER_CRITICAL(&recorder->stats_lock);
+    *stats = recorder->encoder_stats;
+    portEXIT_CRITICAL(&recorder->stats_lock);
+    stats->idle = recorder->idle;
+    return ESP_OK;
+}
+
+esp_err_t audio_recorder_set_idle(audio_recorder_handle_t handle, bool idle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    if (!recorder->idle_gating || recorder->idle == idle) {
+        return ESP_OK;
+    }
+    recorder->idle = idle;
+    ESP_LOGI(TAG, "Encoder %s", idle ? "gated while idle" : "resumed");
     return ESP_OK;
 }
 
@@ -475,3 +1203,92 @@ esp_err_t audio_recorder_trigger_sleep(audio_recorder_handle_t handle)
     ESP_LOGD(TAG, "AFE sleep triggered");
     return ESP_OK;
 }
+
+esp_err_t audio_recorder_set_commands(audio_recorder_handle_t handle, const audio_recorder_command_t *commands, size_t count)
+{
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+    if (handle == NULL || (commands == NULL && count > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    recorder->commands = commands;
+    recorder->command_count = count;
+    recorder->commands_changed = true;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t audio_recorder_get_command(audio_recorder_handle_t handle, int *id)
+{
+    if (handle == NULL || id == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    *id = recorder->command_id;
+    return ESP_OK;
+}
+
+const char *audio_recorder_afe_profile_name(audio_recorder_afe_profile_t profile)
+{
+    if (profile >= AUDIO_RECORDER_AFE_PROFILE_MAX) {
+        return "all";
+    }
+    return s_afe_profiles[profile].name;
+}
+
+static esp_err_t recorder_afe_enable(audio_recorder_t *recorder, esp_gmf_afe_feature_t feature, const char *name, bool enable)
+{
+    esp_gmf_err_t err = esp_gmf_afe_manager_enable_features(recorder->afe_manager, feature, enable);
+    if (err != ESP_GMF_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to %s AFE %s: %x", enable ? "enable" : "disable", name, err);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t audio_recorder_set_afe_profile(audio_recorder_handle_t handle, audio_recorder_afe_profile_t profile)
+{
+    if (handle == NULL || profile >= AUDIO_RECORDER_AFE_PROFILE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    if (recorder->afe_manager == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (recorder->afe_profile == profile) {
+        return ESP_OK;
+    }
+
+    /* Only the features the AFE was created with can be switched, see pool_setup_afe() */
+    const recorder_afe_profile_t *p = &s_afe_profiles[profile];
+    esp_err_t err = recorder_afe_enable(recorder, ESP_AFE_FEATURE_WAKENET, "wakenet", p->wakenet);
+    if (err == ESP_OK) {
+        err = recorder_afe_enable(recorder, ESP_AFE_FEATURE_VAD, "VAD", p->vad);
+    }
+    if (err == ESP_OK) {
+        err = recorder_afe_enable(recorder, ESP_AFE_FEATURE_AGC, "AGC", p->agc);
+    }
+#if CONFIG_ENABLE_AEC
+    if (err == ESP_OK) {
+        err = recorder_afe_enable(recorder, ESP_AFE_FEATURE_AEC, "AEC", p->aec);
+    }
+#endif
+    if (err != ESP_OK) {
+        /* Partly applied, make the next call apply every feature again */
+        recorder->afe_profile = AUDIO_RECORDER_AFE_PROFILE_MAX;
+        return err;
+    }
+
+    if (!p->vad) {
+        /* No VAD_END will come, the DTX state must not stay stuck on speech */
+        recorder->vad_speech = false;
+    }
+    ESP_LOGI(TAG, "AFE profile %s -> %s", audio_recorder_afe_profile_name(recorder->afe_profile), p->name);
+    recorder->afe_profile = profile;
+    return ESP_OK;
+}
@@ -8,7 +8,10 @@
 #define __AUDIO_RECORDER_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
 
 #include <esp_codec_dev.h>
 
@@ -18,21 +21,50 @@ extern "C" {
 
 typedef void *audio_recorder_handle_t;
 
+typedef enum {
+    AUDIO_RECORDER_CODEC_OPUS,
+    AUDIO_RECORDER_CODEC_PCM,      /* 16-bit mono, no encoder: for links where bandwidth is cheaper than CPU */
+} audio_recorder_codec_t;
+
 /**
  * @brief Audio recorder configuration
  *
  * @param format Channel configuration for AFE
  * @param in_dev_handle Handle to the input device
- * @param sample_rate Sample rate in Hz
- * @param frame_duration_ms Frame duration in milliseconds(for OPUS encoding only)
+ * @param codec Codec of the produced packets
+ * @param sample_rate Sample rate in Hz: 8000, 16000 or 24000. The AFE runs at 16000, other rates are resampled.
+ * @param frame_duration_ms Frame duration in milliseconds: 10, 20, 40 or 60 (for OPUS encoding only, PCM
+ *        packets hold one AFE chunk)
+ * @param dtx Discontinuous transmission: while the AFE VAD reports no speech, only emit a one byte
+ *            Opus DTX packet every dtx_keepalive_ms, and enable DTX in the encoder (OPUS only)
+ * @param dtx_keepalive_ms Interval between DTX keepalive packets
+ * @param dtx_lookback_ms Audio dropped by DTX that is kept and sent ahead of the speech when the VAD reports
+ *        its start, since the VAD only fires some way into the first word. Rounded up to whole frames, at most
+ *        8 frames. 0 disables it.
+ * @param complexity Opus encoder complexity, 0 to 10 (OPUS only)
+ * @param complexity_auto Let the recorder lower the complexity when encoding takes too much of the frame
+ *        duration, and raise it back up to `complexity` when there is headroom. Only in the split topology
+ *        (idle_gating or CONFIG_AUDIO_RECORDER_SPLIT_PIPELINE), where the encoder pipeline restarts on its own
+ *        mid-session; ignored otherwise. See audio_recorder_get_encoder_stats().
+ * @param idle_gating Stop encoding while the recorder is idle (see audio_recorder_set_idle()): the AFE keeps
+ *        detecting the wake word but its output is dropped before the encoder, and no packets are produced.
+ *        With Opus this runs the encoder in its own pipeline task, as CONFIG_AUDIO_RECORDER_SPLIT_PIPELINE does.
+ *        The recorder starts idle.
  *
- * @note: All of the channels should be 16-bit, and the sample rate should be 16000.
+ * @note: All of the input channels should be 16-bit, and the input sample rate should be 16000.
  */
 typedef struct {
     const char *format;
     esp_codec_dev_handle_t in_dev_handle;
+    audio_recorder_codec_t codec;
     uint16_t sample_rate;
     uint8_t frame_duration_ms;
+    bool dtx;
+    uint16_t dtx_keepalive_ms;
+    uint16_t dtx_lookback_ms;
+    uint8_t complexity;
+    bool complexity_auto;
+    bool idle_gating;
 } audio_recorder_config_t;
 
 typedef enum {
@@ -40,9 +72,87 @@ typedef enum {
     AUDIO_RECORDER_EVENT_WAKEUP_END,
     AUDIO_RECORDER_EVENT_VAD_START,
     AUDIO_RECORDER_EVENT_VAD_END,
+    AUDIO_RECORDER_EVENT_COMMAND,           /* A voice command was recognized, see audio_recorder_get_command() */
+    AUDIO_RECORDER_EVENT_COMMAND_TIMEOUT,   /* The voice command window after the wake word closed without one */
     AUDIO_RECORDER_EVENT_MAX,
 } audio_recorder_event_t;
 
+/**
+ * @brief A voice command phrase
+ *
+ * @param id Identifier reported by audio_recorder_get_command(), shared by the phrases of one command
+ * @param phrase Phrase as spoken, such as "volume up"
+ */
+typedef struct {
+    int id;
+    const char *phrase;
+} audio_recorder_command_t;
+
+/**
+ * @brief One encoded packet produced by the recorder
+ *
+ * @param data Packet payload, owned by the recorder until audio_recorder_release_read()
+ * @param len Payload length (0 if the encoder produced nothing)
+ * @param seq Sequence number, incremented for every non-empty packet; a gap means packets were skipped
+ * @param duration_ms Audio duration of the packet
+ * @param capture_time_us Estimated esp_timer time at which the first sample of the packet was captured,
+ *        taken from the esp_codec_dev_read() that completed the packet minus the packet duration.
+ *        Buffering inside the AFE is not accounted for.
+ * @param dtx The packet is a DTX keepalive (TOC byte only) sent in place of non-speech audio
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    uint32_t seq;
+    uint16_t duration_ms;
+    int64_t capture_time_us;
+    bool dtx;
+} audio_recorder_packet_t;
+
+/**
+ * @brief Opus encoder timing, measured around each frame encoded by the pipeline
+ *
+ * @param frames Frames encoded
+ * @param last_us Encode time of the latest frame
+ * @param avg_us Moving average of the encode time over about 16 frames
+ * @param max_us Longest encode time seen
+ * @param budget_us Frame duration, the time available to encode a frame
+ * @param utilization_pct avg_us as a percentage of budget_us
+ * @param complexity Complexity the encoder runs with
+ * @param complexity_target Complexity chosen by the governor, applied by restarting the encoder pipeline
+ * @param reconfigs Times the encoder was reconfigured by the governor
+ * @param idle The encoder is gated, see audio_recorder_set_idle()
+ */
+typedef struct {
+    uint32_t frames;
+    uint32_t last_us;
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t budget_us;
+    uint16_t utilization_pct;
+    uint8_t complexity;
+    uint8_t complexity_target;
+    uint32_t reconfigs;
+    bool idle;
+} audio_recorder_encoder_stats_t;
+
+/**
+ * @brief AFE processing profiles
+ *
+ * The AFE is created with every feature it may need, a profile only enables the ones a device state uses.
+ * AEC is only available when built with CONFIG_ENABLE_AEC. Until a profile is set, all features run.
+ *
+ * - IDLE_WAKE: wake word detection alone, waiting for the wake word
+ * - LISTENING: VAD and AGC, for the user speaking to the agent. The wake word is not detected.
+ * - FULL_DUPLEX: VAD, AGC and AEC, for listening while the agent speaks (barge-in)
+ */
+typedef enum {
+    AUDIO_RECORDER_AFE_PROFILE_IDLE_WAKE,
+    AUDIO_RECORDER_AFE_PROFILE_LISTENING,
+    AUDIO_RECORDER_AFE_PROFILE_FULL_DUPLEX,
+    AUDIO_RECORDER_AFE_PROFILE_MAX,
+} audio_recorder_afe_profile_t;
+
 typedef void (*audio_recorder_event_cb_t)(audio_recorder_handle_t handle, audio_recorder_event_t event, void *user_data);
 
 /* @brief Initialize the audio recorder
@@ -65,8 +175,46 @@ audio_recorder_handle_t audio_recorder_init(const audio_recorder_config_t *confi
  */
 esp_err_t audio_recorder_start(audio_recorder_handle_t handle);
 
+/* @brief Read one encoded packet into a caller buffer
+ *
+ * Copies the packet out of the recorder FIFO. Prefer audio_recorder_acquire_read() to avoid the copy.
+ *
+ * @param handle The handle to the audio recorder
+ * @param data Buffer for the packet
+ * @param len Size of the buffer, a longer packet is truncated
+ * @param read_len Length of the packet copied
+ * @return ESP_OK on success, otherwise an error code
+ */
 esp_err_t audio_recorder_read(audio_recorder_handle_t handle, uint8_t *data, size_t len, size_t *read_len);
 
+/* @brief Borrow the next encoded packet without copying it
+ *
+ * The packet stays in the recorder FIFO, where the encoder wrote it, until audio_recorder_release_read()
+ * is called. Only one packet can be borrowed at a time, and the encoder stalls once the FIFO is full,
+ * so release it as soon as it has been consumed.
+ *
+ * @param handle The handle to the audio recorder
+ * @param packet Set to the packet descriptor
+ * @param timeout Time to wait for a packet
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if no packet was ready, otherwise an error code
+ */
+esp_err_t audio_recorder_acquire_read(audio_recorder_handle_t handle, audio_recorder_packet_t *packet, TickType_t timeout);
+
+/* @brief Return the packet borrowed with audio_recorder_acquire_read() to the recorder
+ *
+ * @param handle The handle to the audio recorder
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no packet is borrowed
+ */
+esp_err_t audio_recorder_release_read(audio_recorder_handle_t handle);
+
+/* @brief Get the Opus encoder timing and complexity
+ *
+ * @param handle The handle to the audio recorder
+ * @param stats Set to the current statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the recorder does not encode Opus
+ */
+esp_err_t audio_recorder_get_encoder_stats(audio_recorder_handle_t handle, audio_recorder_encoder_stats_t *stats);
+
 esp_err_t audio_recorder_deinit(audio_recorder_handle_t handle);
 
 esp_err_t audio_recorder_add_event_cb(audio_recorder_handle_t handle, audio_recorder_event_cb_t cb, void *user_data);
@@ -75,6 +223,54 @@ esp_err_t audio_recorder_stay_awake(audio_recorder_handle_t handle, bool awake);
 
 esp_err_t audio_recorder_trigger_sleep(audio_recorder_handle_t handle);
 
+/**
+ * @brief Gate the encoder while nobody listens
+ *
+ * While idle, the AFE output is dropped before the encoder and no packets are produced. A wake word
+ * leaves the idle state on its own, from the AFE task, so the first frame after it is encoded.
+ * Does nothing unless the recorder was created with idle_gating.
+ *
+ * @param handle The handle to the audio recorder
+ * @param idle Gate the encoder
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_recorder_set_idle(audio_recorder_handle_t handle, bool idle);
+
+/**
+ * @brief Enable the AFE features of a profile and disable the others
+ *
+ * Takes effect on the next AFE chunk, without restarting the pipeline.
+ *
+ * @param handle The handle to the audio recorder
+ * @param profile The profile
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t audio_recorder_set_afe_profile(audio_recorder_handle_t handle, audio_recorder_afe_profile_t profile);
+
+/**
+ * @brief Set the voice commands recognized after the wake word
+ *
+ * The phrases are loaded into MultiNet by the AFE task at the next wake word, which then starts a
+ * window of CONFIG_AUDIO_RECORDER_COMMAND_TIMEOUT_MS ending with AUDIO_RECORDER_EVENT_COMMAND or
+ * AUDIO_RECORDER_EVENT_COMMAND_TIMEOUT. Requires CONFIG_AUDIO_RECORDER_COMMANDS.
+ *
+ * @param handle The handle to the audio recorder
+ * @param commands The commands, kept by the caller while the recorder runs
+ * @param count Number of commands
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without CONFIG_AUDIO_RECORDER_COMMANDS
+ */
+esp_err_t audio_recorder_set_commands(audio_recorder_handle_t handle, const audio_recorder_command_t *commands, size_t count);
+
+/**
+ * @brief Identifier of the last command recognized, valid from AUDIO_RECORDER_EVENT_COMMAND
+ */
+esp_err_t audio_recorder_get_command(audio_recorder_handle_t handle, int *id);
+
+/**
+ * @brief Name of an AFE profile, such as "idle-wake"
+ */
+const char *audio_recorder_afe_profile_name(audio_recorder_afe_profile_t profile);
+
 #ifdef __cplusplus
 }
 #endif
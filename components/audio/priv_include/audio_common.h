@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdbool.h>
 #include <esp_err.h>
 #include <esp_gmf_pool.h>
 
@@ -29,9 +30,24 @@ esp_gmf_pool_handle_t audio_pool_get(void);
 
 /**
  * This function registers AFE (Audio Front End) elements to the shared pool.
- * It sets up the AFE manager and registers the ai_afe element.
+ * It sets up the AFE manager and registers the ai_afe element the first time, and hands the same
+ * manager out again afterwards. Only one user can hold it at a time, and always with the same format.
+ * Give it back with audio_pool_release_afe().
  *
  * @param input_format The input format string for AFE configuration
- * @return AFE manager handle on success, NULL on failure
+ * @return AFE manager handle on success, NULL on failure, when in use or registered with another format
  */
 void* audio_pool_register_afe(const char *input_format);
+
+/**
+ * This function gives back the AFE manager taken with audio_pool_register_afe().
+ * The manager and its ai_afe element stay in the pool for the next user.
+ */
+void audio_pool_release_afe(void);
+
+/**
+ * This function tells whether the AFE manager is held by a recorder.
+ *
+ * @return true while a user holds the AFE manager
+ */
+bool audio_pool_afe_in_use(void);
@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief Sample format conversion kernels
+ *
+ * Channel fan-out and extraction, bit depth conversion, rational resampling and time-stretching of PCM.
+ * The kernels only depend on the C library, so they also build for the linux target. On the ESP32-S3 the
+ * fan-out, bit depth conversion and resampler filter run on the PIE vector unit, for buffers that start
+ * on a 16-byte boundary.
+ *
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Copy 16-bit mono samples to every channel of 16-bit interleaved frames
+ *
+ * @param[in] in Mono samples
+ * @param[out] out Interleaved frames, samples * channels entries
+ * @param[in] samples Number of input samples
+ * @param[in] channels Output channels
+ */
+void audio_convert_s16_mono_to_s16(const int16_t *in, int16_t *out, size_t samples, uint8_t channels);
+
+/**
+ * @brief Copy 16-bit mono samples to every channel of 32-bit interleaved frames
+ *
+ * The samples are left aligned, as the codec expects for 32-bit slots.
+ *
+ * @param[in] in Mono samples
+ * @param[out] out Interleaved frames, samples * channels entries
+ * @param[in] samples Number of input samples
+ * @param[in] channels Output channels
+ */
+void audio_convert_s16_mono_to_s32(const int16_t *in, int32_t *out, size_t samples, uint8_t channels);
+
+/**
+ * @brief Convert 16-bit mono samples to the layout of a codec
+ *
+ * Dispatches to the kernel for bits and channels. With 16 bits and one channel this is a copy,
+ * callers that can should skip the conversion instead.
+ *
+ * @param[in] in Mono samples
+ * @param[out] out Converted frames, audio_convert_s16_mono_size(samples, bits, channels) bytes
+ * @param[in] samples Number of input samples
+ * @param[in] bits Output bits per sample, 16 or 32
+ * @param[in] channels Output channels
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED for other formats
+ */
+esp_err_t audio_convert_s16_mono_to(const int16_t *in, void *out, size_t samples, uint8_t bits, uint8_t channels);
+
+/**
+ * @brief Size in bytes of samples converted with audio_convert_s16_mono_to()
+ */
+static inline size_t audio_convert_s16_mono_size(size_t samples, uint8_t bits, uint8_t channels)
+{
+    return samples * channels * (bits / 8);
+}
+
+/**
+ * @brief Convert 32-bit samples to 16-bit, rounding and saturating
+ *
+ * in and out may be the same buffer.
+ */
+void audio_convert_s32_to_s16(const int32_t *in, int16_t *out, size_t samples);
+
+/**
+ * @brief Convert 16-bit samples to left aligned 32-bit samples
+ */
+void audio_convert_s16_to_s32(const int16_t *in, int32_t *out, size_t samples);
+
+/**
+ * @brief Extract one channel of 16-bit interleaved frames
+ *
+ * @param[in] in Interleaved frames
+ * @param[out] out Samples of the channel, frames entries
+ * @param[in] frames Number of frames
+ * @param[in] channels Channels per frame
+ * @param[in] channel Channel to extract
+ */
+void audio_convert_extract_s16(const int16_t *in, int16_t *out, size_t frames, uint8_t channels, uint8_t channel);
+
+/**
+ * @brief Extract one channel of 32-bit interleaved frames as 16-bit samples, rounding and saturating
+ */
+void audio_convert_extract_s32_to_s16(const int32_t *in, int16_t *out, size_t frames, uint8_t channels, uint8_t channel);
+
+typedef struct audio_resampler *audio_resampler_handle_t;
+
+/**
+ * @brief Create a polyphase resampler for 16-bit mono samples
+ *
+ * The rates are reduced to an up / down ratio L / M, and a windowed sinc low pass filter of
+ * L * taps_per_phase taps, cut off at the lower Nyquist frequency, is split into L phases.
+ * Each output sample then costs taps_per_phase multiply-accumulates, whatever the ratio. All the memory is
+ * allocated here, audio_resampler_process() never allocates.
+ *
+ * @param[in] in_rate Input sample rate
+ * @param[in] out_rate Output sample rate, different from in_rate
+ * @param[in] taps_per_phase Filter taps per phase, 0 for the default of 16. A multiple of 8 runs on the PIE
+ * @param[in] max_block Input samples processed in one pass, 0 for the default of 1024. Larger inputs are
+ *            processed in several passes, so set it to the usual block size of the stream.
+ * @return The resampler, NULL if the ratio is not supported (L above 320) or out of memory
+ */
+audio_resampler_handle_t audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint16_t taps_per_phase, size_t max_block);
+
+/**
+ * @brief Largest number of output samples for in_samples input samples
+ */
+size_t audio_resampler_max_output(audio_resampler_handle_t resampler, size_t in_samples);
+
+/**
+ * @brief Resample a block of samples
+ *
+ * The filter history is kept between calls, so a stream can be processed in blocks of any size.
+ *
+ * @param[in] resampler The resampler
+ * @param[in] in Input samples
+ * @param[in] in_samples Number of input samples
+ * @param[out] out Output samples, at least audio_resampler_max_output(in_samples) entries
+ * @return Number of output samples
+ */
+size_t audio_resampler_process(audio_resampler_handle_t resampler, const int16_t *in, size_t in_samples, int16_t *out);
+
+/**
+ * @brief Clear the filter history, for the start of a new stream
+ */
+void audio_resampler_reset(audio_resampler_handle_t resampler);
+
+void audio_resampler_destroy(audio_resampler_handle_t resampler);
+
+typedef struct audio_stretch *audio_stretch_handle_t;
+
+/**
+ * @brief Create a WSOLA time-stretcher for 16-bit mono samples
+ *
+ * Plays audio faster with its pitch kept, by cross-fading 10 ms hops taken at the point of best
+ * waveform similarity within 5 ms of their nominal position. At normal speed the samples are passed
+ * through untouched. While faster, about 25 ms of input is held back.
+ *
+ * @param[in] sample_rate Sample rate in Hz
+ * @return The stretcher, NULL on error
+ */
+audio_stretch_handle_t audio_stretch_create(uint32_t sample_rate);
+
+/**
+ * @brief Set the playback speed of the following audio_stretch_process() calls
+ *
+ * @param[in] stretch The stretcher
+ * @param[in] speed_pct Speed in percent, 100 for normal speed up to 200
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for other speeds
+ */
+esp_err_t audio_stretch_set_speed(audio_stretch_handle_t stretch, uint16_t speed_pct);
+
+/**
+ * @brief Largest number of output samples of audio_stretch_process() or audio_stretch_flush() for
+ *        in_samples input samples
+ */
+size_t audio_stretch_max_output(audio_stretch_handle_t stretch, size_t in_samples);
+
+/**
+ * @brief Time-stretch a block of samples
+ *
+ * When the speed is set back to 100, the input held back is played out by the next call.
+ *
+ * @param[in] stretch The stretcher
+ * @param[in] in Input samples
+ * @param[in] in_samples Number of input samples
+ * @param[out] out Output samples, at least audio_stretch_max_output(in_samples) entries, not overlapping in
+ * @return Number of output samples
+ */
+size_t audio_stretch_process(audio_stretch_handle_t stretch, const int16_t *in, size_t in_samples, int16_t *out);
+
+/**
+ * @brief Play out the input held back, at the end of a stream
+ *
+ * @param[in] stretch The stretcher
+ * @param[out] out Output samples, at least audio_stretch_max_output(0) entries
+ * @return Number of output samples
+ */
+size_t audio_stretch_flush(audio_stretch_handle_t stretch, int16_t *out);
+
+/**
+ * @brief Drop the input held back, for the start of a new stream
+ */
+void audio_stretch_reset(audio_stretch_handle_t stretch);
+
+void audio_stretch_destroy(audio_stretch_handle_t stretch);
+
+/**
+ * @brief Run the conversion kernel benchmarks
+ *
+ * Each kernel processes a block of 960 samples (60 ms at 16 kHz) per iteration. Results are
+ * printed to stdout as one JSON object per line:
+ *
+ *     {"suite":"audio_convert","bench":"resample.24000_16000","impl":"scalar","iterations":2000,"samples":960,
+ *      "samples_per_us":21.43,"ns_per_sample":46.66}
+ *
+ * samples counts the input samples of one iteration. impl is "scalar" for the C kernels, which every
+ * target reports, and "pie" for the ESP32-S3 vector kernels, reported as well on that target for the
+ * kernels that have one. Requires CONFIG_AUDIO_CONVERT_BENCH.
+ *
+ * @param[in] iterations Iterations per benchmark, 0 for CONFIG_AUDIO_CONVERT_BENCH_ITERATIONS
+ * @param[in] filter Only run benchmarks whose name contains this string (NULL for all)
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if benchmarks are disabled, error code otherwise
+ */
+esp_err_t audio_convert_bench_run(uint32_t iterations, const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "audio_convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The ESP32-S3 runs the kernels on its PIE vector unit, other targets and linux only have the scalar ones */
+#if CONFIG_IDF_TARGET_ESP32S3
+#define AUDIO_CONVERT_PIE 1
+#else
+#define AUDIO_CONVERT_PIE 0
+#endif
+
+/* Scalar kernels, for the part of a buffer the PIE kernels leave and for the benchmarks */
+void audio_convert_s16_mono_to_s16_scalar(const int16_t *in, int16_t *out, size_t samples, uint8_t channels);
+void audio_convert_s16_mono_to_s32_scalar(const int16_t *in, int32_t *out, size_t samples, uint8_t channels);
+void audio_convert_s32_to_s16_scalar(const int32_t *in, int16_t *out, size_t samples);
+void audio_convert_s16_to_s32_scalar(const int16_t *in, int32_t *out, size_t samples);
+
+/* Run the resampler dot products on the PIE when it can, or in C, for the benchmarks */
+void audio_resampler_set_simd(audio_resampler_handle_t resampler, bool enable);
+
+#if AUDIO_CONVERT_PIE
+/*
+ * PIE kernels. They convert the largest multiple of 8 samples when in and out are 16-byte aligned, and
+ * nothing otherwise, and return the number of input samples converted.
+ */
+size_t audio_convert_pie_mono_to_s16_2ch(const int16_t *in, int16_t *out, size_t samples);
+size_t audio_convert_pie_mono_to_s32_2ch(const int16_t *in, int32_t *out, size_t samples);
+size_t audio_convert_pie_s16_to_s32(const int16_t *in, int32_t *out, size_t samples);
+size_t audio_convert_pie_s32_to_s16(const int32_t *in, int16_t *out, size_t samples);
+
+/*
+ * Dot product of blocks * 8 samples, without rounding or shifting. h must be 16-byte aligned, x may
+ * start anywhere but the 16 bytes following its last sample must be readable.
+ */
+int32_t audio_convert_pie_dot_s16(const int16_t *h, const int16_t *x, size_t blocks);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,451 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+
+#include "audio_convert.h"
+#include "audio_convert_priv.h"
+
+static const char *TAG = "audio_convert";
+
+#define RESAMPLER_DEFAULT_TAPS  16
+#define RESAMPLER_DEFAULT_BLOCK 1024
+#define RESAMPLER_MAX_UP        320
+#define RESAMPLER_BLACKMAN_A0   0.42
+#define RESAMPLER_BLACKMAN_A1   0.5
+#define RESAMPLER_BLACKMAN_A2   0.08
+
+/*
+ * The kernels are written for the compiler: plain loops over restrict pointers, unrolled by four where
+ * the loop carries no dependency, so that the Xtensa and host compilers keep the samples in registers
+ * and issue the loads back to back. On the ESP32-S3 the fan-out, bit depth and resampler kernels run on
+ * the PIE vector unit (audio_convert_pie.c) for the 16-byte aligned part of the buffers, and these loops
+ * finish the rest; elsewhere they do all of it.
+ */
+
+static inline int16_t convert_sat_s32_to_s16(int32_t sample)
+{
+    /* Round to nearest, without overflowing INT32_MAX */
+    int32_t rounded = (sample >> 16) + ((sample >> 15) & 1);
+    if (rounded > INT16_MAX) {
+        return INT16_MAX;
+    }
+    return (int16_t)rounded;
+}
+
+static inline int32_t convert_s16_to_s32(int16_t sample)
+{
+    /* A multiply rather than a shift, shifting negative values left is undefined */
+    return (int32_t)sample * 65536;
+}
+
+void audio_convert_s16_mono_to_s16_scalar(const int16_t *restrict in, int16_t *restrict out, size_t samples, uint8_t channels)
+{
+    if (channels == 1) {
+        memcpy(out, in, samples * sizeof(int16_t));
+        return;
+    }
+    if (channels == 2) {
+        size_t i = 0;
+        for (; i + 4 <= samples; i += 4) {
+            int16_t s0 = in[i];
+            int16_t s1 = in[i + 1];
+            int16_t s2 = in[i + 2];
+            int16_t s3 = in[i + 3];
+            out[2 * i] = s0;
+            out[2 * i + 1] = s0;
+            out[2 * i + 2] = s1;
+            out[2 * i + 3] = s1;
+            out[2 * i + 4] = s2;
+            out[2 * i + 5] = s2;
+            out[2 * i + 6] = s3;
+            out[2 * i + 7] = s3;
+        }
+        for (; i < samples; i++) {
+            out[2 * i] = in[i];
+            out[2 * i + 1] = in[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            *out++ = in[i];
+        }
+    }
+}
+
+void audio_convert_s16_mono_to_s32_scalar(const int16_t *restrict in, int32_t *restrict out, size_t samples, uint8_t channels)
+{
+    if (channels == 1) {
+        audio_convert_s16_to_s32_scalar(in, out, samples);
+        return;
+    }
+    if (channels == 2) {
+        size_t i = 0;
+        for (; i + 4 <= samples; i += 4) {
+            int32_t s0 = convert_s16_to_s32(in[i]);
+            int32_t s1 = convert_s16_to_s32(in[i + 1]);
+            int32_t s2 = convert_s16_to_s32(in[i + 2]);
+            int32_t s3 = convert_s16_to_s32(in[i + 3]);
+            out[2 * i] = s0;
+            out[2 * i + 1] = s0;
+            out[2 * i + 2] = s1;
+            out[2 * i + 3] = s1;
+            out[2 * i + 4] = s2;
+            out[2 * i + 5] = s2;
+            out[2 * i + 6] = s3;
+            out[2 * i + 7] = s3;
+        }
+        for (; i < samples; i++) {
+            int32_t s = convert_s16_to_s32(in[i]);
+            out[2 * i] = s;
+            out[2 * i + 1] = s;
+        }
+        return;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        int32_t s = convert_s16_to_s32(in[i]);
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            *out++ = s;
+        }
+    }
+}
+
+void audio_convert_s16_mono_to_s16(const int16_t *in, int16_t *out, size_t samples, uint8_t channels)
+{
+    size_t done = 0;
+#if AUDIO_CONVERT_PIE
+    if (channels == 2) {
+        done = audio_convert_pie_mono_to_s16_2ch(in, out, samples);
+    }
+#endif
+    audio_convert_s16_mono_to_s16_scalar(in + done, out + done * channels, samples - done, channels);
+}
+
+void audio_convert_s16_mono_to_s32(const int16_t *in, int32_t *out, size_t samples, uint8_t channels)
+{
+    size_t done = 0;
+#if AUDIO_CONVERT_PIE
+    if (channels == 1) {
+        done = audio_convert_pie_s16_to_s32(in, out, samples);
+    } else if (channels == 2) {
+        done = audio_convert_pie_mono_to_s32_2ch(in, out, samples);
+    }
+#endif
+    audio_convert_s16_mono_to_s32_scalar(in + done, out + done * channels, samples - done, channels);
+}
+
+esp_err_t audio_convert_s16_mono_to(const int16_t *in, void *out, size_t samples, uint8_t bits, uint8_t channels)
+{
+    if (channels == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    switch (bits) {
+    case 16:
+        audio_convert_s16_mono_to_s16(in, out, samples, channels);
+        return ESP_OK;
+    case 32:
+        audio_convert_s16_mono_to_s32(in, out, samples, channels);
+        return ESP_OK;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+void audio_convert_s32_to_s16_scalar(const int32_t *in, int16_t *out, size_t samples)
+{
+    /* Not restrict: converting in place is allowed, the output never runs ahead of the input */
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int16_t s0 = convert_sat_s32_to_s16(in[i]);
+        int16_t s1 = convert_sat_s32_to_s16(in[i + 1]);
+        int16_t s2 = convert_sat_s32_to_s16(in[i + 2]);
+        int16_t s3 = convert_sat_s32_to_s16(in[i + 3]);
+        out[i] = s0;
+        out[i + 1] = s1;
+        out[i + 2] = s2;
+        out[i + 3] = s3;
+    }
+    for (; i < samples; i++) {
+        out[i] = convert_sat_s32_to_s16(in[i]);
+    }
+}
+
+void audio_convert_s16_to_s32_scalar(const int16_t *restrict in, int32_t *restrict out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        out[i] = convert_s16_to_s32(in[i]);
+        out[i + 1] = convert_s16_to_s32(in[i + 1]);
+        out[i + 2] = convert_s16_to_s32(in[i + 2]);
+        out[i + 3] = convert_s16_to_s32(in[i + 3]);
+    }
+    for (; i < samples; i++) {
+        out[i] = convert_s16_to_s32(in[i]);
+    }
+}
+
+void audio_convert_s32_to_s16(const int32_t *in, int16_t *out, size_t samples)
+{
+    size_t done = 0;
+#if AUDIO_CONVERT_PIE
+    done = audio_convert_pie_s32_to_s16(in, out, samples);
+#endif
+    audio_convert_s32_to_s16_scalar(in + done, out + done, samples - done);
+}
+
+void audio_convert_s16_to_s32(const int16_t *in, int32_t *out, size_t samples)
+{
+    size_t done = 0;
+#if AUDIO_CONVERT_PIE
+    done = audio_convert_pie_s16_to_s32(in, out, samples);
+#endif
+    audio_convert_s16_to_s32_scalar(in + done, out + done, samples - done);
+}
+
+void audio_convert_extract_s16(const int16_t *restrict in, int16_t *restrict out, size_t frames, uint8_t channels, uint8_t channel)
+{
+    in += channel;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        out[i] = in[0];
+        out[i + 1] = in[channels];
+        out[i + 2] = in[2 * channels];
+        out[i + 3] = in[3 * channels];
+        in += 4 * channels;
+    }
+    for (; i < frames; i++) {
+        out[i] = *in;
+        in += channels;
+    }
+}
+
+void audio_convert_extract_s32_to_s16(const int32_t *restrict in, int16_t *restrict out, size_t frames, uint8_t channels, uint8_t channel)
+{
+    in += channel;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        out[i] = convert_sat_s32_to_s16(in[0]);
+        out[i + 1] = convert_sat_s32_to_s16(in[channels]);
+        out[i + 2] = convert_sat_s32_to_s16(in[2 * channels]);
+        out[i + 3] = convert_sat_s32_to_s16(in[3 * channels]);
+        in += 4 * channels;
+    }
+    for (; i < frames; i++) {
+        out[i] = convert_sat_s32_to_s16(*in);
+        in += channels;
+    }
+}
+
+/*
+ * Polyphase resampler
+ *
+ * Conceptually the input is upsampled by L (zero stuffing), low pass filtered and decimated by M.
+ * Output sample n sits at upsampled position n * M, that is after input sample k = n * M / L at phase
+ * p = n * M % L, and only the taps h[p + t * L] meet non zero samples:
+ *
+ *     y[n] = sum(t = 0 .. T - 1) h[p + t * L] * x[k - t]
+ *
+ * The coefficients are stored phase by phase and in reverse, so each output is the dot product of T
+ * consecutive coefficients with the T input samples ending at x[k], both read forwards. The input of a
+ * call is appended to the last T - 1 samples of the previous one in work, which is sized at creation for
+ * max_block samples; longer inputs are processed max_block samples at a time.
+ */
+struct audio_resampler {
+    uint16_t up;
+    uint16_t down;
+    uint16_t taps;
+    uint16_t phase;
+    size_t index;
+    size_t max_block;
+    bool simd;                              /* Dot products on the PIE, taps is a multiple of 8 */
+    int16_t *coeffs;                        /* 16-byte aligned, in coeffs_mem */
+    int16_t *work;                          /* 16-byte aligned, in work_mem */
+    void *coeffs_mem;
+    void *work_mem;
+};
+
+/* The PIE loads ignore the low address bits, so the buffers they read start on a 16-byte boundary */
+static void *resampler_alloc_aligned(size_t size, void **mem)
+{
+    *mem = calloc(1, size + 15);
+    if (*mem == NULL) {
+        return NULL;
+    }
+    return (void *)(((uintptr_t)*mem + 15) & ~(uintptr_t)15);
+}
+
+static uint32_t resampler_gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void resampler_build_filter(struct audio_resampler *rs)
+{
+    size_t len = (size_t)rs->up * rs->taps;
+    double cutoff = 0.5 / (rs->up > rs->down ? rs->up : rs->down);
+    double center = (len - 1) / 2.0;
+
+    for (size_t i = 0; i < len; i++) {
+        double x = i - center;
+        double sinc = x == 0 ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+        double window = RESAMPLER_BLACKMAN_A0 - RESAMPLER_BLACKMAN_A1 * cos(2 * M_PI * i / (len - 1)) +
+                        RESAMPLER_BLACKMAN_A2 * cos(4 * M_PI * i / (len - 1));
+        /* Gain of L makes up for the zero stuffing, each tap then stays within [-1, 1] */
+        double h = rs->up * 2 * cutoff * sinc * window;
+        long q = lround(h * 32768.0);
+        if (q > INT16_MAX) {
+            q = INT16_MAX;
+        } else if (q < INT16_MIN) {
+            q = INT16_MIN;
+        }
+        rs->coeffs[(i % rs->up) * rs->taps + rs->taps - 1 - i / rs->up] = (int16_t)q;
+    }
+}
+
+audio_resampler_handle_t audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint16_t taps_per_phase, size_t max_block)
+{
+    if (in_rate == 0 || out_rate == 0 || in_rate == out_rate) {
+        ESP_LOGE(TAG, "Invalid resampler rates %u -> %u", (unsigned)in_rate, (unsigned)out_rate);
+        return NULL;
+    }
+    uint32_t gcd = resampler_gcd(in_rate, out_rate);
+    uint32_t up = out_rate / gcd;
+    uint32_t down = in_rate / gcd;
+    if (up > RESAMPLER_MAX_UP || down > UINT16_MAX) {
+        ESP_LOGE(TAG, "Resampling ratio %u/%u is not supported", (unsigned)up, (unsigned)down);
+        return NULL;
+    }
+
+    struct audio_resampler *rs = calloc(1, sizeof(struct audio_resampler));
+    if (rs == NULL) {
+        return NULL;
+    }
+    rs->up = up;
+    rs->down = down;
+    rs->taps = taps_per_phase ? taps_per_phase : RESAMPLER_DEFAULT_TAPS;
+    rs->max_block = max_block ? max_block : RESAMPLER_DEFAULT_BLOCK;
+    rs->simd = AUDIO_CONVERT_PIE && rs->taps % 8 == 0;
+    rs->coeffs = resampler_alloc_aligned((size_t)rs->up * rs->taps * sizeof(int16_t), &rs->coeffs_mem);
+    /* The history, a block, and the 16 bytes the PIE may load past the last window */
+    rs->work = resampler_alloc_aligned((rs->taps - 1 + rs->max_block + 8) * sizeof(int16_t), &rs->work_mem);
+    if (rs->coeffs == NULL || rs->work == NULL) {
+        audio_resampler_destroy(rs);
+        return NULL;
+    }
+    resampler_build_filter(rs);
+    audio_resampler_reset(rs);
+    ESP_LOGI(TAG, "Resampler %u -> %u Hz, L=%u M=%u, %u taps per phase%s",
+             (unsigned)in_rate, (unsigned)out_rate, rs->up, rs->down, rs->taps, rs->simd ? " on the PIE" : "");
+    return rs;
+}
+
+size_t audio_resampler_max_output(audio_resampler_handle_t rs, size_t in_samples)
+{
+    return ((size_t)in_samples * rs->up + rs->down - 1) / rs->down + 1;
+}
+
+void audio_resampler_reset(audio_resampler_handle_t rs)
+{
+    memset(rs->work, 0, (rs->taps - 1) * sizeof(int16_t));
+    rs->index = rs->taps - 1;
+    rs->phase = 0;
+}
+
+void audio_resampler_set_simd(audio_resampler_handle_t rs, bool enable)
+{
+    rs->simd = enable && AUDIO_CONVERT_PIE && rs->taps % 8 == 0;
+}
+
+static inline int32_t resampler_dot(const int16_t *restrict h, const int16_t *restrict x, uint16_t taps)
+{
+    /*
+     * The taps of a phase add up to about one in absolute value, so the Q15 products of full scale
+     * samples stay well below 2^31 and a 32-bit accumulator is enough.
+     */
+    int32_t acc = 0;
+    uint16_t t = 0;
+    for (; t + 4 <= taps; t += 4) {
+        acc += (int32_t)h[t] * x[t];
+        acc += (int32_t)h[t + 1] * x[t + 1];
+        acc += (int32_t)h[t + 2] * x[t + 2];
+        acc += (int32_t)h[t + 3] * x[t + 3];
+    }
+    for (; t < taps; t++) {
+        acc += (int32_t)h[t] * x[t];
+    }
+    return acc;
+}
+
+static size_t resampler_process_block(struct audio_resampler *rs, const int16_t *in, size_t in_samples, int16_t *out)
+{
+    size_t history = rs->taps - 1;
+    size_t total = history + in_samples;
+    memcpy(rs->work + history, in, in_samples * sizeof(int16_t));
+
+    const int16_t *work = rs->work;
+    size_t index = rs->index;
+    uint32_t phase = rs->phase;
+    size_t produced = 0;
+    while (index < total) {
+        const int16_t *h = rs->coeffs + (size_t)phase * rs->taps;
+        /* Oldest sample of the window ending at x[k] */
+        const int16_t *x = work + index - history;
+        int32_t acc;
+#if AUDIO_CONVERT_PIE
+        if (rs->simd) {
+            acc = audio_convert_pie_dot_s16(h, x, rs->taps / 8);
+        } else
+#endif
+        {
+            acc = resampler_dot(h, x, rs->taps);
+        }
+        acc = (acc + (1 << 14)) >> 15;
+        out[produced++] = acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : (int16_t)acc;
+
+        phase += rs->down;
+        index += phase / rs->up;
+        phase %= rs->up;
+    }
+
+    /* Keep the last T - 1 samples as the history of the next call */
+    memmove(rs->work, rs->work + in_samples, history * sizeof(int16_t));
+    rs->index = index - in_samples;
+    rs->phase = phase;
+    return produced;
+}
+
+size_t audio_resampler_process(audio_resampler_handle_t rs, const int16_t *in, size_t in_samples, int16_t *out)
+{
+    size_t produced = 0;
+    while (in_samples > 0) {
+        size_t n = in_samples > rs->max_block ? rs->max_block : in_samples;
+        produced += resampler_process_block(rs, in, n, out + produced);
+        in += n;
+        in_samples -= n;
+    }
+    return produced;
+}
+
+void audio_resampler_destroy(audio_resampler_handle_t rs)
+{
+    if (rs == NULL) {
+        return;
+    }
+    free(rs->coeffs_mem);
+    free(rs->work_mem);
+    free(rs);
+}
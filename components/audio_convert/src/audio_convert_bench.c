@@ -0,0 +1,255 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "audio_convert.h"
+#include "audio_convert_priv.h"
+
+static const char *TAG = "audio_convert_bench";
+
+#if CONFIG_AUDIO_CONVERT_BENCH
+
+#define BENCH_BLOCK_SAMPLES 960
+#define BENCH_MAX_CHANNELS  4
+#define BENCH_TONE_HZ       1000.0
+#define BENCH_TONE_RATE     16000.0
+
+typedef struct {
+    uint32_t iterations;
+    const char *filter;
+    bool scalar;                /* Time the scalar kernels rather than the ones the pipelines call */
+    int16_t *mono;
+    int32_t *wide;
+    void *out;
+} bench_ctx_t;
+
+typedef void (*bench_kernel_t)(bench_ctx_t *ctx, const void *arg);
+
+typedef struct {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    audio_resampler_handle_t resampler;
+} bench_resample_arg_t;
+
+typedef struct {
+    uint16_t speed_pct;
+    audio_stretch_handle_t stretch;
+} bench_stretch_arg_t;
+
+static bool bench_selected(const bench_ctx_t *ctx, const char *name)
+{
+    return ctx->filter == NULL || ctx->filter[0] == '\0' || strstr(name, ctx->filter) != NULL;
+}
+
+static void bench_report(const char *name, const char *impl, uint32_t iterations, size_t samples, int64_t elapsed_us)
+{
+    if (elapsed_us <= 0) {
+        elapsed_us = 1;
+    }
+    double total = (double)samples * iterations;
+    printf("{\"suite\":\"audio_convert\",\"bench\":\"%s\",\"impl\":\"%s\",\"iterations\":%" PRIu32 ",\"samples\":%zu,"
+           "\"samples_per_us\":%.2f,\"ns_per_sample\":%.2f}\n",
+           name, impl, iterations, samples, total / elapsed_us, elapsed_us * 1000.0 / total);
+}
+
+static void bench_run(bench_ctx_t *ctx, const char *name, bench_kernel_t kernel, const void *arg)
+{
+    if (!bench_selected(ctx, name)) {
+        return;
+    }
+    /* Warm the caches and the resampler history */
+    kernel(ctx, arg);
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+        kernel(ctx, arg);
+    }
+    bench_report(name, ctx->scalar ? "scalar" : "pie", ctx->iterations, BENCH_BLOCK_SAMPLES, esp_timer_get_time() - start);
+}
+
+static void bench_mono_to_s16(bench_ctx_t *ctx, const void *arg)
+{
+    if (ctx->scalar) {
+        audio_convert_s16_mono_to_s16_scalar(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES, *(const uint8_t *)arg);
+    } else {
+        audio_convert_s16_mono_to_s16(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES, *(const uint8_t *)arg);
+    }
+}
+
+static void bench_mono_to_s32(bench_ctx_t *ctx, const void *arg)
+{
+    if (ctx->scalar) {
+        audio_convert_s16_mono_to_s32_scalar(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES, *(const uint8_t *)arg);
+    } else {
+        audio_convert_s16_mono_to_s32(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES, *(const uint8_t *)arg);
+    }
+}
+
+static void bench_s32_to_s16(bench_ctx_t *ctx, const void *arg)
+{
+    if (ctx->scalar) {
+        audio_convert_s32_to_s16_scalar(ctx->wide, ctx->out, BENCH_BLOCK_SAMPLES);
+    } else {
+        audio_convert_s32_to_s16(ctx->wide, ctx->out, BENCH_BLOCK_SAMPLES);
+    }
+}
+
+static void bench_s16_to_s32(bench_ctx_t *ctx, const void *arg)
+{
+    if (ctx->scalar) {
+        audio_convert_s16_to_s32_scalar(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES);
+    } else {
+        audio_convert_s16_to_s32(ctx->mono, ctx->out, BENCH_BLOCK_SAMPLES);
+    }
+}
+
+static void bench_extract_s16(bench_ctx_t *ctx, const void *arg)
+{
+    /* The wide buffer read as 16-bit 4 channel frames, the layout of the microphone AFE input */
+    audio_convert_extract_s16((const int16_t *)ctx->wide, ctx->out, BENCH_BLOCK_SAMPLES / BENCH_MAX_CHANNELS * 2,
+                              BENCH_MAX_CHANNELS, 0);
+}
+
+static void bench_extract_s32(bench_ctx_t *ctx, const void *arg)
+{
+    audio_convert_extract_s32_to_s16(ctx->wide, ctx->out, BENCH_BLOCK_SAMPLES / 2, 2, 0);
+}
+
+static void bench_resample(bench_ctx_t *ctx, const void *arg)
+{
+    const bench_resample_arg_t *rs = arg;
+    audio_resampler_process(rs->resampler, ctx->mono, BENCH_BLOCK_SAMPLES, ctx->out);
+}
+
+static void bench_stretch(bench_ctx_t *ctx, const void *arg)
+{
+    const bench_stretch_arg_t *st = arg;
+    audio_stretch_process(st->stretch, ctx->mono, BENCH_BLOCK_SAMPLES, ctx->out);
+}
+
+/* The kernels with a PIE version, timed once per implementation */
+static esp_err_t bench_run_simd_kernels(bench_ctx_t *ctx)
+{
+    static const uint8_t channels[] = {1, 2};
+    static const uint32_t rates[][2] = {
+        {8000, 16000}, {16000, 8000}, {24000, 16000}, {16000, 24000}, {48000, 16000}, {22050, 16000},
+    };
+    char name[48];
+    esp_err_t ret = ESP_OK;
+
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        snprintf(name, sizeof(name), "mono_to_s16.%uch", channels[i]);
+        bench_run(ctx, name, bench_mono_to_s16, &channels[i]);
+        snprintf(name, sizeof(name), "mono_to_s32.%uch", channels[i]);
+        bench_run(ctx, name, bench_mono_to_s32, &channels[i]);
+    }
+    bench_run(ctx, "s32_to_s16", bench_s32_to_s16, NULL);
+    bench_run(ctx, "s16_to_s32", bench_s16_to_s32, NULL);
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        bench_resample_arg_t arg = {
+            .in_rate = rates[i][0],
+            .out_rate = rates[i][1],
+        };
+        snprintf(name, sizeof(name), "resample.%" PRIu32 "_%" PRIu32, arg.in_rate, arg.out_rate);
+        if (!bench_selected(ctx, name)) {
+            continue;
+        }
+        arg.resampler = audio_resampler_create(arg.in_rate, arg.out_rate, 0, BENCH_BLOCK_SAMPLES);
+        if (arg.resampler == NULL) {
+            ret = ESP_FAIL;
+            continue;
+        }
+        audio_resampler_set_simd(arg.resampler, !ctx->scalar);
+        /* The output buffer holds 4 * BENCH_BLOCK_SAMPLES 32-bit entries, far more than any ratio here needs */
+        bench_run(ctx, name, bench_resample, &arg);
+        audio_resampler_destroy(arg.resampler);
+    }
+    return ret;
+}
+
+esp_err_t audio_convert_bench_run(uint32_t iterations, const char *filter)
+{
+    static const uint16_t speeds[] = {115, 150};
+    char name[48];
+    esp_err_t ret = ESP_OK;
+
+    /* 16-byte aligned, so that the PIE kernels take the whole block */
+    bench_ctx_t ctx = {
+        .iterations = iterations ? iterations : CONFIG_AUDIO_CONVERT_BENCH_ITERATIONS,
+        .filter = filter,
+        .scalar = true,
+        .mono = aligned_alloc(16, BENCH_BLOCK_SAMPLES * sizeof(int16_t)),
+        .wide = aligned_alloc(16, BENCH_BLOCK_SAMPLES * sizeof(int32_t)),
+        .out = aligned_alloc(16, BENCH_BLOCK_SAMPLES * BENCH_MAX_CHANNELS * sizeof(int32_t)),
+    };
+    if (ctx.mono == NULL || ctx.wide == NULL || ctx.out == NULL) {
+        ESP_LOGE(TAG, "No memory for the benchmark buffers");
+        ret = ESP_ERR_NO_MEM;
+        goto end;
+    }
+    for (int i = 0; i < BENCH_BLOCK_SAMPLES; i++) {
+        ctx.mono[i] = (int16_t)(16000 * sin(2 * M_PI * BENCH_TONE_HZ * i / BENCH_TONE_RATE));
+        ctx.wide[i] = (int32_t)ctx.mono[i] * 65536;
+    }
+
+    if (bench_run_simd_kernels(&ctx) != ESP_OK) {
+        ret = ESP_FAIL;
+    }
+#if AUDIO_CONVERT_PIE
+    ctx.scalar = false;
+    if (bench_run_simd_kernels(&ctx) != ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    ctx.scalar = true;
+#endif
+
+    bench_run(&ctx, "extract_s16.4ch", bench_extract_s16, NULL);
+    bench_run(&ctx, "extract_s32_to_s16.2ch", bench_extract_s32, NULL);
+
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        bench_stretch_arg_t arg = {
+            .speed_pct = speeds[i],
+        };
+        snprintf(name, sizeof(name), "stretch.%u", arg.speed_pct);
+        if (!bench_selected(&ctx, name)) {
+            continue;
+        }
+        arg.stretch = audio_stretch_create((uint32_t)BENCH_TONE_RATE);
+        if (arg.stretch == NULL) {
+            ret = ESP_FAIL;
+            continue;
+        }
+        /* At most 1760 samples out of a block at 16 kHz, the output buffer is large enough */
+        audio_stretch_set_speed(arg.stretch, arg.speed_pct);
+        bench_run(&ctx, name, bench_stretch, &arg);
+        audio_stretch_destroy(arg.stretch);
+    }
+
+end:
+    free(ctx.mono);
+    free(ctx.wide);
+    free(ctx.out);
+    return ret;
+}
+
+#else /* CONFIG_AUDIO_CONVERT_BENCH */
+
+esp_err_t audio_convert_bench_run(uint32_t iterations, const char *filter)
+{
+    ESP_LOGE(TAG, "Benchmarks are disabled, enable CONFIG_AUDIO_CONVERT_BENCH");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_AUDIO_CONVERT_BENCH */
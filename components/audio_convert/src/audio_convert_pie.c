@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "audio_convert_priv.h"
+
+#if AUDIO_CONVERT_PIE
+
+/*
+ * ESP32-S3 PIE kernels
+ *
+ * The 128-bit q registers hold 8 samples of 16 bits or 4 of 32. EE.VLD.128 and EE.VST.128 ignore the low
+ * four address bits, so the conversion kernels only take buffers that start on a 16-byte boundary, as the
+ * playback allocates its conversion buffers, and leave the rest to the scalar loops. The q registers are
+ * not known to the compiler, each asm block uses them from scratch.
+ */
+
+static inline bool pie_aligned(const void *a, const void *b)
+{
+    return (((uintptr_t)a | (uintptr_t)b) & 15) == 0;
+}
+
+size_t audio_convert_pie_mono_to_s16_2ch(const int16_t *in, int16_t *out, size_t samples)
+{
+    size_t blocks = samples / 8;
+    if (blocks == 0 || !pie_aligned(in, out)) {
+        return 0;
+    }
+    /* 8 samples in, zipped with a copy of themselves into 16 interleaved ones */
+    __asm__ volatile(
+        "loopnez          %[n], 1f          \n"
+        "ee.vld.128.ip    q0, %[in], 16     \n"
+        "ee.orq           q1, q0, q0        \n"
+        "ee.vzip.16       q0, q1            \n"
+        "ee.vst.128.ip    q0, %[out], 16    \n"
+        "ee.vst.128.ip    q1, %[out], 16    \n"
+        "1:                                 \n"
+        : [in] "+r"(in), [out] "+r"(out)
+        : [n] "r"(blocks)
+        : "memory");
+    return blocks * 8;
+}
+
+size_t audio_convert_pie_s16_to_s32(const int16_t *in, int32_t *out, size_t samples)
+{
+    size_t blocks = samples / 8;
+    if (blocks == 0 || !pie_aligned(in, out)) {
+        return 0;
+    }
+    /* Zipping zeros below each sample left aligns it in a 32-bit lane */
+    __asm__ volatile(
+        "loopnez          %[n], 1f          \n"
+        "ee.vld.128.ip    q0, %[in], 16     \n"
+        "ee.zero.q        q1                \n"
+        "ee.vzip.16       q1, q0            \n"
+        "ee.vst.128.ip    q1, %[out], 16    \n"
+        "ee.vst.128.ip    q0, %[out], 16    \n"
+        "1:                                 \n"
+        : [in] "+r"(in), [out] "+r"(out)
+        : [n] "r"(blocks)
+        : "memory");
+    return blocks * 8;
+}
+
+size_t audio_convert_pie_mono_to_s32_2ch(const int16_t *in, int32_t *out, size_t samples)
+{
+    size_t blocks = samples / 8;
+    if (blocks == 0 || !pie_aligned(in, out)) {
+        return 0;
+    }
+    /* As audio_convert_pie_s16_to_s32, then each 32-bit lane zipped with a copy of itself */
+    __asm__ volatile(
+        "loopnez          %[n], 1f          \n"
+        "ee.vld.128.ip    q0, %[in], 16     \n"
+        "ee.zero.q        q1                \n"
+        "ee.vzip.16       q1, q0            \n"
+        "ee.orq           q2, q1, q1        \n"
+        "ee.vzip.32       q1, q2            \n"
+        "ee.orq           q3, q0, q0        \n"
+        "ee.vzip.32       q0, q3            \n"
+        "ee.vst.128.ip    q1, %[out], 16    \n"
+        "ee.vst.128.ip    q2, %[out], 16    \n"
+        "ee.vst.128.ip    q0, %[out], 16    \n"
+        "ee.vst.128.ip    q3, %[out], 16    \n"
+        "1:                                 \n"
+        : [in] "+r"(in), [out] "+r"(out)
+        : [n] "r"(blocks)
+        : "memory");
+    return blocks * 8;
+}
+
+size_t audio_convert_pie_s32_to_s16(const int32_t *in, int16_t *out, size_t samples)
+{
+    static const int32_t round = 0x8000;
+    size_t blocks = samples / 8;
+    if (blocks == 0 || !pie_aligned(in, out)) {
+        return 0;
+    }
+    /*
+     * Adding half an LSB with saturation and keeping the upper halves rounds to nearest and saturates
+     * like convert_sat_s32_to_s16(). out may be in, it is written behind the reads.
+     */
+    __asm__ volatile(
+        "ee.vldbc.32      q7, %[round]      \n"
+        "loopnez          %[n], 1f          \n"
+        "ee.vld.128.ip    q0, %[in], 16     \n"
+        "ee.vld.128.ip    q1, %[in], 16     \n"
+        "ee.vadds.s32     q0, q0, q7        \n"
+        "ee.vadds.s32     q1, q1, q7        \n"
+        "ee.vunzip.16     q0, q1            \n"
+        "ee.vst.128.ip    q1, %[out], 16    \n"
+        "1:                                 \n"
+        : [in] "+r"(in), [out] "+r"(out)
+        : [n] "r"(blocks), [round] "r"(&round)
+        : "memory");
+    return blocks * 8;
+}
+
+int32_t audio_convert_pie_dot_s16(const int16_t *h, const int16_t *x, size_t blocks)
+{
+    int32_t acc;
+    /*
+     * x is usually unaligned: each pair of aligned loads around it is shifted by the SAR_BYTE the loads
+     * set, EE.SRC.Q.QUP keeping the second load for the next block. The sum of a resampler phase fits
+     * in 32 bits, so the low word of the 40-bit ACCX is all of it.
+     */
+    __asm__ volatile(
+        "ee.zero.accx                           \n"
+        "ee.ld.128.usar.ip  q0, %[x], 16        \n"
+        "loopnez            %[n], 1f            \n"
+        "ee.ld.128.usar.ip  q1, %[x], 16        \n"
+        "ee.vld.128.ip      q3, %[h], 16        \n"
+        "ee.src.q.qup       q2, q0, q1          \n"
+        "ee.vmulas.s16.accx q2, q3              \n"
+        "1:                                     \n"
+        "rur.accx_0         %[acc]              \n"
+        : [x] "+r"(x), [h] "+r"(h), [acc] "=r"(acc)
+        : [n] "r"(blocks)
+        : "memory");
+    return acc;
+}
+
+#endif /* AUDIO_CONVERT_PIE */
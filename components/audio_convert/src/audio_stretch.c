@@ -0,0 +1,269 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+
+#include "audio_convert.h"
+
+static const char *TAG = "audio_stretch";
+
+#define STRETCH_FRAME_MS    20
+#define STRETCH_SEARCH_MS   5
+#define STRETCH_MAX_SPEED   200
+
+/*
+ * WSOLA time-stretch
+ *
+ * The output is built hop by hop (half a frame). Each hop cross-fades the natural continuation of the
+ * previous segment, tail, into a new segment taken near the nominal input position, which advances by
+ * hop * speed for every hop played. Within +/- search of the nominal position, the segment start is the one
+ * whose waveform best matches tail, so the cross-fade joins two similar periods and the pitch is kept.
+ *
+ * At normal speed the stretcher is bypassed. It buffers a frame and the search range of input while it runs,
+ * and plays out that buffer, without a gap, when the speed comes back to normal or on audio_stretch_flush().
+ */
+struct audio_stretch {
+    uint16_t frame;
+    uint16_t hop;
+    uint16_t search;
+    uint16_t speed_pct;
+    bool active;
+    bool primed;            /* tail holds the continuation of the last segment */
+    int16_t *fade_in;       /* Q15 raised cosine, the fade out is its complement */
+    int16_t *tail;
+    int16_t *buf;
+    size_t buf_size;
+    size_t buf_len;
+    int64_t pos_q16;        /* Nominal position in buf of the next segment */
+};
+
+static inline int16_t stretch_mix(int16_t out, int16_t in, int16_t gain)
+{
+    int32_t acc = (int32_t)out * (32768 - gain) + (int32_t)in * gain + (1 << 14);
+    return (int16_t)(acc >> 15);
+}
+
+/* Similarity of tail with a segment, decimated by two: correlation squared over the segment energy */
+static float stretch_score(const int16_t *tail, const int16_t *seg, uint16_t len)
+{
+    int64_t corr = 0;
+    int64_t energy = 1;
+    for (uint16_t i = 0; i < len; i += 2) {
+        corr += (int32_t)tail[i] * seg[i];
+        energy += (int32_t)seg[i] * seg[i];
+    }
+    float c = (float)corr;
+    return (c < 0 ? -c * c : c * c) / (float)energy;
+}
+
+/* Start of the segment near pos that best continues tail, searched within [lo, hi] */
+static size_t stretch_search(struct audio_stretch *st, size_t pos, size_t lo, size_t hi)
+{
+    size_t best = pos;
+    float best_score = -INFINITY;
+
+    /* Every other offset, then the neighbours of the best one */
+    for (size_t k = lo; k <= hi; k += 2) {
+        float score = stretch_score(st->tail, st->buf + k, st->hop);
+        if (score > best_score) {
+            best_score = score;
+            best = k;
+        }
+    }
+    size_t coarse = best;
+    if (coarse > lo && stretch_score(st->tail, st->buf + coarse - 1, st->hop) > best_score) {
+        best_score = stretch_score(st->tail, st->buf + coarse - 1, st->hop);
+        best = coarse - 1;
+    }
+    if (coarse < hi && stretch_score(st->tail, st->buf + coarse + 1, st->hop) > best_score) {
+        best = coarse + 1;
+    }
+    return best;
+}
+
+/* Play one hop, cross-fading tail into the best segment, then keep the continuation of that segment */
+static void stretch_hop(struct audio_stretch *st, int16_t *out)
+{
+    size_t pos = (size_t)(st->pos_q16 >> 16);
+    size_t best = pos;
+
+    if (!st->primed) {
+        /* Continuing the input as is: the cross-fade of two identical hops is the hop */
+        memcpy(st->tail, st->buf + pos, st->hop * sizeof(int16_t));
+        st->primed = true;
+    } else if (st->speed_pct != 100) {
+        size_t lo = pos > st->search ? pos - st->search : 0;
+        best = stretch_search(st, pos, lo, pos + st->search);
+    }
+
+    const int16_t *seg = st->buf + best;
+    for (uint16_t i = 0; i < st->hop; i++) {
+        out[i] = stretch_mix(st->tail[i], seg[i], st->fade_in[i]);
+    }
+    memcpy(st->tail, seg + st->hop, st->hop * sizeof(int16_t));
+    st->pos_q16 += ((int64_t)st->hop * st->speed_pct << 16) / 100;
+}
+
+/* Drop the input no later hop can use */
+static void stretch_compact(struct audio_stretch *st)
+{
+    size_t pos = (size_t)(st->pos_q16 >> 16);
+    size_t keep_from = pos > st->search ? pos - st->search : 0;
+    if (keep_from > st->buf_len) {
+        keep_from = st->buf_len;
+    }
+    memmove(st->buf, st->buf + keep_from, (st->buf_len - keep_from) * sizeof(int16_t));
+    st->buf_len -= keep_from;
+    st->pos_q16 -= (int64_t)keep_from << 16;
+}
+
+/*
+ * Leave the stretched segments: one last hop cross-fades into the best segment, then the input that follows
+ * it plays as is. Returns the samples written to out.
+ */
+static size_t stretch_finish(struct audio_stretch *st, int16_t *out)
+{
+    size_t produced = 0;
+    size_t pos = (size_t)(st->pos_q16 >> 16);
+
+    if (!st->primed) {
+        if (pos < st->buf_len) {
+            produced = st->buf_len - pos;
+            memcpy(out, st->buf + pos, produced * sizeof(int16_t));
+        }
+    } else if (pos + st->hop <= st->buf_len) {
+        size_t lo = pos > st->search ? pos - st->search : 0;
+        size_t hi = pos + st->search;
+        if (hi + st->hop > st->buf_len) {
+            hi = st->buf_len - st->hop;
+        }
+        size_t best = stretch_search(st, pos, lo < hi ? lo : hi, hi);
+        for (uint16_t i = 0; i < st->hop; i++) {
+            out[i] = stretch_mix(st->tail[i], st->buf[best + i], st->fade_in[i]);
+        }
+        produced = st->buf_len - best;
+        memcpy(out + st->hop, st->buf + best + st->hop, (produced - st->hop) * sizeof(int16_t));
+    } else {
+        /* Less than a hop left: end on the natural continuation, the few input samples left are dropped */
+        memcpy(out, st->tail, st->hop * sizeof(int16_t));
+        produced = st->hop;
+    }
+
+    st->active = false;
+    st->primed = false;
+    st->buf_len = 0;
+    st->pos_q16 = 0;
+    return produced;
+}
+
+audio_stretch_handle_t audio_stretch_create(uint32_t sample_rate)
+{
+    if (sample_rate < 1000) {
+        ESP_LOGE(TAG, "Invalid sample rate %u", (unsigned)sample_rate);
+        return NULL;
+    }
+
+    struct audio_stretch *st = calloc(1, sizeof(struct audio_stretch));
+    if (st == NULL) {
+        return NULL;
+    }
+    st->hop = sample_rate * STRETCH_FRAME_MS / 1000 / 2;
+    st->frame = st->hop * 2;
+    st->search = sample_rate * STRETCH_SEARCH_MS / 1000;
+    st->speed_pct = 100;
+    st->fade_in = malloc(st->hop * sizeof(int16_t));
+    st->tail = malloc(st->hop * sizeof(int16_t));
+    if (st->fade_in == NULL || st->tail == NULL) {
+        audio_stretch_destroy(st);
+        return NULL;
+    }
+    for (uint16_t i = 0; i < st->hop; i++) {
+        st->fade_in[i] = (int16_t)lround(16384.0 * (1.0 - cos(M_PI * i / st->hop)));
+    }
+    ESP_LOGI(TAG, "Time-stretch at %u Hz, %u sample hops, +/- %u sample search", (unsigned)sample_rate, st->hop, st->search);
+    return st;
+}
+
+esp_err_t audio_stretch_set_speed(audio_stretch_handle_t st, uint16_t speed_pct)
+{
+    if (st == NULL || speed_pct < 100 || speed_pct > STRETCH_MAX_SPEED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    st->speed_pct = speed_pct;
+    return ESP_OK;
+}
+
+size_t audio_stretch_max_output(audio_stretch_handle_t st, size_t in_samples)
+{
+    /* Never more than the input buffered and received, plus the tail when ending on it */
+    return in_samples + st->frame * 2 + st->search * 2;
+}
+
+size_t audio_stretch_process(audio_stretch_handle_t st, const int16_t *in, size_t in_samples, int16_t *out)
+{
+    if (!st->active && st->speed_pct == 100) {
+        memmove(out, in, in_samples * sizeof(int16_t));
+        return in_samples;
+    }
+
+    size_t total = st->buf_len + in_samples;
+    if (total > st->buf_size) {
+        int16_t *buf = realloc(st->buf, total * sizeof(int16_t));
+        if (buf == NULL) {
+            ESP_LOGE(TAG, "No memory for %zu time-stretch samples", total);
+            return 0;
+        }
+        st->buf = buf;
+        st->buf_size = total;
+    }
+    memcpy(st->buf + st->buf_len, in, in_samples * sizeof(int16_t));
+    st->buf_len = total;
+
+    if (st->speed_pct == 100) {
+        return stretch_finish(st, out);
+    }
+
+    st->active = true;
+    size_t produced = 0;
+    while ((size_t)(st->pos_q16 >> 16) + st->search + st->frame <= st->buf_len) {
+        stretch_hop(st, out + produced);
+        produced += st->hop;
+    }
+    stretch_compact(st);
+    return produced;
+}
+
+size_t audio_stretch_flush(audio_stretch_handle_t st, int16_t *out)
+{
+    if (!st->active) {
+        return 0;
+    }
+    return stretch_finish(st, out);
+}
+
+void audio_stretch_reset(audio_stretch_handle_t st)
+{
+    st->active = false;
+    st->primed = false;
+    st->buf_len = 0;
+    st->pos_q16 = 0;
+}
+
+void audio_stretch_destroy(audio_stretch_handle_t st)
+{
+    if (st == NULL) {
+        return;
+    }
+    free(st->fade_in);
+    free(st->tail);
+    free(st->buf);
+    free(st);
+}
@@ -30,7 +30,14 @@ esp_err_t app_agent_start(void);
 
 esp_err_t app_agent_connect(void);
 
-esp_err_t app_agent_send_speech(uint8_t *audio_data, size_t audio_data_len);
+esp_err_t app_agent_send_speech(const uint8_t *audio_data, size_t audio_data_len);
+
+/**
+ * @brief Queue speech without waiting for room in the send queue
+ *
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the send queue is full, error code otherwise
+ */
+esp_err_t app_agent_try_send_speech(const uint8_t *audio_data, size_t audio_data_len);
 
 bool app_agent_is_active(void);
 
@@ -40,6 +47,18 @@ esp_err_t app_agent_speech_conversation_start(void);
 
 esp_err_t app_agent_speech_conversation_end(void);
 
+esp_err_t app_agent_speech_barge_in(void);
+
+/**
+ * @brief Get the audio configuration offered to the agent
+ *
+ * The audio pipelines are built from the same configuration.
+ *
+ * @param[out] upload Upload audio configuration
+ * @param[out] download Download audio configuration
+ */
+void app_agent_get_audio_config(esp_agent_audio_config_t *upload, esp_agent_audio_config_t *download);
+
 void app_agent_default_event_handler(void *arg, esp_event_base_t event_base,
                                      int32_t event_id, void *event_data);
 
@@ -15,6 +15,7 @@ typedef enum {
     MICROPHONE_STATE_START,
     MICROPHONE_STATE_PAUSE,
     MICROPHONE_STATE_STOP,
+    MICROPHONE_STATE_MUTE,      // The audio stream has been ended, packets are dropped
     MICROPHONE_STATE_MAX,
 } app_audio_microphone_state_t;
 
@@ -42,6 +43,14 @@ esp_err_t app_audio_start(void);
  */
 esp_err_t app_audio_set_playback_volume(uint8_t volume);
 
+/**
+ * @brief Get the volume of the playback device
+ *
+ * @param[out] volume The volume, 0 to 100
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t app_audio_get_playback_volume(uint8_t *volume);
+
 esp_err_t app_audio_play_speech(uint8_t *data, size_t data_len);
 
 esp_err_t app_audio_microphone_set_state(app_audio_microphone_state_t state);
@@ -52,10 +61,40 @@ esp_err_t app_audio_speaker_stop(void);
 
 esp_err_t app_audio_speaker_download_complete(void);
 
+/**
+ * @brief Stop the assistant's speech right away
+ *
+ * Drops the queued audio and fades out what is playing. Speech data received afterwards is
+ * dropped until app_audio_speaker_start().
+ *
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t app_audio_speaker_barge_in(void);
+
 esp_err_t app_audio_play_media_sync(const char *media_url, const uint8_t *data, size_t data_len);
 
 esp_err_t app_audio_play_media_async(const char *media_url, const uint8_t *data, size_t data_len);
 
+/**
+ * @brief Decode a notification sound now so that later plays skip the decoder
+ *
+ * Does nothing unless CONFIG_APP_AUDIO_CACHE_MEDIA is set.
+ *
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t app_audio_cache_media(const char *media_url, const uint8_t *data, size_t data_len);
+
 esp_err_t app_audio_trigger_sleep(void);
 
 esp_err_t app_audio_set_awake(bool awake);
+
+/**
+ * @brief Switch the AFE to the profile of a device state
+ *
+ * The time spent in each profile and the per-core CPU load over that time are accumulated, logged
+ * when the profile is left and printed by the afe-profiles console command. The load needs
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ *
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t app_audio_set_afe_profile(audio_recorder_afe_profile_t profile);
@@ -8,11 +8,19 @@
 
 #include <esp_agent.h>
 #include <esp_err.h>
+#include <audio_recorder.h>
 
 #define TOOL_NAME_SET_REMINDER "set_reminder"
 #define TOOL_NAME_GET_LOCAL_TIME "get_local_time"
 #define TOOL_NAME_SET_VOLUME "set_volume"
 
+/* Offline voice commands, served by the tool handlers below without the agent */
+typedef enum {
+    APP_COMMON_COMMAND_VOLUME_UP,
+    APP_COMMON_COMMAND_VOLUME_DOWN,
+    APP_COMMON_COMMAND_MAX,
+} app_common_command_t;
+
 esp_err_t app_common_tools_set_reminder_handler(esp_agent_handle_t handle, const char *tool_name,
                                                 esp_agent_tool_param_t params[], size_t num_params, void *user_data,
                                                 char **result);
@@ -24,3 +32,19 @@ esp_err_t app_common_tools_get_local_time_handler(esp_agent_handle_t handle, con
 esp_err_t app_common_tools_set_volume_handler(esp_agent_handle_t handle, const char *tool_name,
                                               esp_agent_tool_param_t params[], size_t num_params, void *user_data,
                                               char **result);
+
+/**
+ * @brief Phrases of the offline voice commands, for audio_recorder_set_commands()
+ *
+ * @param[out] count Number of phrases
+ * @return The phrases, identified by app_common_command_t
+ */
+const audio_recorder_command_t *app_common_tools_get_commands(size_t *count);
+
+/**
+ * @brief Serve an offline voice command with the local tool handlers
+ *
+ * @param[in] command An app_common_command_t
+ * @return ESP_OK on success, otherwise an error code
+ */
+esp_err_t app_common_tools_run_command(int command);
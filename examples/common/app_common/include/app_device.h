@@ -22,6 +22,10 @@ typedef enum {
     DEVICE_EVENT_WAKEUP,
     DEVICE_EVENT_SLEEP,
     DEVICE_EVENT_INTERRUPT,
+    DEVICE_EVENT_BARGE_IN,          // The user spoke over the assistant
+    DEVICE_EVENT_AGENT_BARGE_IN,    // The server stopped the assistant's speech
+    DEVICE_EVENT_ENDPOINT,          // The local VAD found the end of the user's speech
+    DEVICE_EVENT_COMMAND,           // An offline voice command was recognized
     DEVICE_EVENT_FACTORY_RESET,
     DEVICE_EVENT_AGENT_STATE_CHANGED,
     DEVICE_EVENT_REMINDER,
@@ -34,6 +38,7 @@ typedef enum {
 // Event data union for different event types
 typedef union {
     const char *text;           // For REMINDER, SET_USER_TEXT, SET_ASSISTANT_TEXT events
+    int command;                // For COMMAND events, an app_common_command_t
 } device_event_data_t;
 
 typedef enum {
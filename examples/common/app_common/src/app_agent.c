@@ -4,6 +4,9 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <esp_log.h>
 #include <esp_check.h>
 
@@ -13,6 +16,10 @@
 #include <setup/rainmaker.h>
 #include <board_defs.h>
 #include <esp_console.h>
+#include <agent_console.h>
+#if CONFIG_ESP_AGENT_CAPTURE
+#include <mbedtls/base64.h>
+#endif
 
 #include "app_audio.h"
 #include "app_agent.h"
@@ -20,6 +27,14 @@
 
 static const char *TAG = "app_agent";
 
+/* The Kconfig ranges allow values in between, the agent protocol only takes these */
+#define APP_AGENT_RATE_VALID(r)     ((r) == 8000 || (r) == 16000 || (r) == 24000)
+#define APP_AGENT_FRAME_VALID(ms)   ((ms) == 10 || (ms) == 20 || (ms) == 40 || (ms) == 60)
+_Static_assert(APP_AGENT_RATE_VALID(CONFIG_AUDIO_UPLOAD_SAMPLE_RATE), "AUDIO_UPLOAD_SAMPLE_RATE must be 8000, 16000 or 24000");
+_Static_assert(APP_AGENT_RATE_VALID(CONFIG_AUDIO_DOWNLOAD_SAMPLE_RATE), "AUDIO_DOWNLOAD_SAMPLE_RATE must be 8000, 16000 or 24000");
+_Static_assert(APP_AGENT_FRAME_VALID(CONFIG_AUDIO_UPLOAD_FRAME_DURATION_MS), "AUDIO_UPLOAD_FRAME_DURATION_MS must be 10, 20, 40 or 60");
+_Static_assert(APP_AGENT_FRAME_VALID(CONFIG_AUDIO_DOWNLOAD_FRAME_DURATION_MS), "AUDIO_DOWNLOAD_FRAME_DURATION_MS must be 10, 20, 40 or 60");
+
 typedef struct {
     bool initialized;
     app_agent_state_t state;
@@ -37,6 +52,28 @@ static inline void app_agent_update_state(app_agent_state_t state)
     app_device_event_enqueue(DEVICE_EVENT_AGENT_STATE_CHANGED);
 }
 
+void app_agent_get_audio_config(esp_agent_audio_config_t *upload, esp_agent_audio_config_t *download)
+{
+    *upload = (esp_agent_audio_config_t) {
+#if CONFIG_AUDIO_UPLOAD_CODEC_PCM
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_PCM,
+#else
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
+#endif
+        .sample_rate = CONFIG_AUDIO_UPLOAD_SAMPLE_RATE,
+        .frame_duration = CONFIG_AUDIO_UPLOAD_FRAME_DURATION_MS,
+    };
+    *download = (esp_agent_audio_config_t) {
+#if CONFIG_AUDIO_DOWNLOAD_CODEC_PCM
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_PCM,
+#else
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
+#endif
+        .sample_rate = CONFIG_AUDIO_DOWNLOAD_SAMPLE_RATE,
+        .frame_duration = CONFIG_AUDIO_DOWNLOAD_FRAME_DURATION_MS,
+    };
+}
+
 void app_agent_default_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
     esp_agent_message_data_t *data = (esp_agent_message_data_t *) event_data;
@@ -60,6 +97,10 @@ void app_agent_default_event_handler(void *arg, esp_event_base_t event_base, int
             ESP_LOGD(TAG, "ESP Agent Received Speech End");
             app_device_event_enqueue(DEVICE_EVENT_SPEECH_END);
             break;
+        case ESP_AGENT_EVENT_BARGE_IN:
+            ESP_LOGD(TAG, "ESP Agent Received Barge In");
+            app_device_event_enqueue(DEVICE_EVENT_AGENT_BARGE_IN);
+            break;
         case ESP_AGENT_EVENT_DATA_TYPE_TEXT:
             {
                 if (data->text.generation_stage == ESP_AGENT_MESSAGE_GENERATION_STAGE_FINAL) {
@@ -95,6 +136,10 @@ void app_agent_default_event_handler(void *arg, esp_event_base_t event_base, int
                 ESP_LOGE(TAG, "ESP Agent Audio Conversation Error");
                 /* Device state will be changed to sleep on ESP_AGENT_EVENT_DISCONNECT */
                 esp_agent_stop(g_app_agent_data.agent_handle);
+            } else if (data->error.error == ESP_AGENT_AUDIO_CONFIG_ERROR) {
+                /* The pipelines are built at boot, a different server selection can't be played or produced */
+                ESP_LOGE(TAG, "Server rejected the offered audio configuration, update the Kconfig audio settings");
+                esp_agent_stop(g_app_agent_data.agent_handle);
             }
 
             break;
@@ -107,7 +152,7 @@ void app_agent_default_event_handler(void *arg, esp_event_base_t event_base, int
     }
 }
 
-esp_err_t app_agent_send_speech(uint8_t *audio_data, size_t audio_data_len)
+esp_err_t app_agent_send_speech(const uint8_t *audio_data, size_t audio_data_len)
 {
     if (g_app_agent_data.state != APP_AGENT_STATE_STARTED) {
         return ESP_ERR_INVALID_STATE;
@@ -115,6 +160,14 @@ esp_err_t app_agent_send_speech(uint8_t *audio_data, size_t audio_data_len)
     return esp_agent_send_speech(g_app_agent_data.agent_handle, audio_data, audio_data_len, pdMS_TO_TICKS(1000));
 }
 
+esp_err_t app_agent_try_send_speech(const uint8_t *audio_data, size_t audio_data_len)
+{
+    if (g_app_agent_data.state != APP_AGENT_STATE_STARTED) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_agent_send_speech(g_app_agent_data.agent_handle, audio_data, audio_data_len, 0);
+}
+
 void app_agent_start_task(void *arg)
 {
     char *agent_id = agent_setup_get_agent_id();
@@ -179,6 +232,14 @@ esp_err_t app_agent_speech_conversation_end(void)
     return esp_agent_speech_conversation_end(g_app_agent_data.agent_handle);
 }
 
+esp_err_t app_agent_speech_barge_in(void)
+{
+    if (g_app_agent_data.state != APP_AGENT_STATE_STARTED) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_agent_speech_barge_in(g_app_agent_data.agent_handle);
+}
+
 esp_err_t app_agent_connect(void)
 {
     if (!g_app_agent_data.agent_handle) {
@@ -194,6 +255,153 @@ esp_err_t app_agent_connect(void)
     return ret;
 }
 
+#if CONFIG_ESP_AGENT_CAPTURE
+/* Print the capture as base64, tools/agent_capture/agent_capture.py extracts it from the console log */
+static esp_err_t app_agent_capture_dump(const uint8_t *log, size_t len)
+{
+    unsigned char line[80];
+    size_t line_len = 0;
+
+    printf("-----BEGIN AGENT CAPTURE-----\n");
+    for (size_t offset = 0; offset < len; offset += 57) {
+        size_t chunk = len - offset < 57 ? len - offset : 57;
+        if (mbedtls_base64_encode(line, sizeof(line), &line_len, log + offset, chunk) != 0) {
+            return ESP_FAIL;
+        }
+        printf("%.*s\n", (int)line_len, line);
+    }
+    printf("-----END AGENT CAPTURE-----\n");
+    return ESP_OK;
+}
+
+static esp_err_t app_agent_capture_handler(int argc, char **argv)
+{
+    esp_agent_handle_t handle = g_app_agent_data.agent_handle;
+    uint8_t *log = NULL;
+    size_t len = 0;
+    esp_err_t ret = ESP_OK;
+
+    if (argc < 2) {
+        goto usage;
+    }
+
+    if (strcmp(argv[1], "start") == 0) {
+        return esp_agent_capture_start(handle, argc > 2 ? strtoul(argv[2], NULL, 0) : 0);
+    } else if (strcmp(argv[1], "stop") == 0) {
+        return esp_agent_capture_stop(handle);
+    } else if (strcmp(argv[1], "dump") == 0) {
+        ESP_RETURN_ON_ERROR(esp_agent_capture_get(handle, &log, &len), TAG, "Failed to get capture");
+        ret = app_agent_capture_dump(log, len);
+    } else if (strcmp(argv[1], "replay") == 0) {
+        ESP_RETURN_ON_ERROR(esp_agent_capture_get(handle, &log, &len), TAG, "Failed to get capture");
+        ret = esp_agent_capture_replay(handle, log, len, argc > 2 ? strtoul(argv[2], NULL, 0) : 100);
+    } else {
+        goto usage;
+    }
+
+    free(log);
+    return ret;
+
+usage:
+    ESP_LOGE(TAG, "Usage: agent-capture <start [bytes] | stop | dump | replay [speed_percent]>");
+    return ESP_ERR_INVALID_ARG;
+}
+#endif /* CONFIG_ESP_AGENT_CAPTURE */
+
+#if CONFIG_ESP_AGENT_BENCH
+static esp_err_t app_agent_bench_handler(int argc, char **argv)
+{
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+    const char *filter = argc > 2 ? argv[2] : NULL;
+    return esp_agent_bench_run(iterations, filter);
+}
+#endif /* CONFIG_ESP_AGENT_BENCH */
+
+#if CONFIG_ESP_AGENT_SOAK
+static esp_agent_soak_config_t s_soak_config;
+static char s_soak_tool_name[32];
+
+static void app_agent_soak_task(void *arg)
+{
+    esp_err_t err = esp_agent_soak_run(&s_soak_config);
+    ESP_LOGI(TAG, "Soak finished: %s", esp_err_to_name(err));
+    vTaskDelete(NULL);
+}
+
+static esp_err_t app_agent_soak_handler(int argc, char **argv)
+{
+    if (argc < 2) {
+        goto usage;
+    }
+
+    if (strcmp(argv[1], "stop") == 0) {
+        esp_agent_soak_stop();
+        return ESP_OK;
+    } else if (strcmp(argv[1], "start") != 0) {
+        goto usage;
+    }
+
+    s_soak_config = (esp_agent_soak_config_t) ESP_AGENT_SOAK_DEFAULT_CONFIG();
+    s_soak_config.handle = g_app_agent_data.agent_handle;
+    if (argc > 2) {
+        s_soak_config.turns = strtoul(argv[2], NULL, 0);
+    }
+    if (argc > 3) {
+        s_soak_config.text_every = strtoul(argv[3], NULL, 0);
+    }
+    if (argc > 4) {
+        strlcpy(s_soak_tool_name, argv[4], sizeof(s_soak_tool_name));
+        s_soak_config.tool_name = s_soak_tool_name;
+    }
+
+    if (xTaskCreate(app_agent_soak_task, "app_agent_soak", 4096, NULL, 4, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+
+usage:
+    ESP_LOGE(TAG, "Usage: agent-soak <start [turns] [text_every] [tool_name] | stop>");
+    return ESP_ERR_INVALID_ARG;
+}
+#endif /* CONFIG_ESP_AGENT_SOAK */
+
+#if CONFIG_ESP_AGENT_CAPTURE || CONFIG_ESP_AGENT_BENCH || CONFIG_ESP_AGENT_SOAK
+static esp_err_t register_agent_commands(void)
+{
+    esp_console_cmd_t cmds[] = {
+#if CONFIG_ESP_AGENT_CAPTURE
+        {
+            .command = "agent-capture",
+            .help = "Capture the agent WebSocket traffic, dump it or replay it\n"
+                    "Usage: agent-capture <start [bytes] | stop | dump | replay [speed_percent]>",
+            .func = app_agent_capture_handler,
+        },
+#endif
+#if CONFIG_ESP_AGENT_BENCH
+        {
+            .command = "agent-bench",
+            .help = "Run the agent message microbenchmarks, results are printed as JSON lines\n"
+                    "Usage: agent-bench [iterations] [filter]",
+            .func = app_agent_bench_handler,
+        },
+#endif
+#if CONFIG_ESP_AGENT_SOAK
+        {
+            .command = "agent-soak",
+            .help = "Run speech, text and tool call turns against a stand-in server and report heap leak rate and fragmentation\n"
+                    "Usage: agent-soak <start [turns] [text_every] [tool_name] | stop>",
+            .func = app_agent_soak_handler,
+        },
+#endif
+    };
+
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+        ESP_RETURN_ON_ERROR(agent_console_register_command(&cmds[i]), TAG, "Failed to register console command: %s", cmds[i].command);
+    }
+    return ESP_OK;
+}
+#endif
+
 esp_err_t app_agent_init(app_agent_config_t *config)
 {
     if (g_app_agent_data.initialized) {
@@ -211,16 +419,9 @@ esp_err_t app_agent_init(app_agent_config_t *config)
     ESP_RETURN_ON_ERROR(esp_event_handler_register(AGENT_SETUP_EVENT, ESP_EVENT_ANY_ID, agent_setup_event_handler, NULL), TAG, "Failed to register agent event handler");
 
     /* Initialize esp_agent without agent_id and refresh_token */
-    esp_agent_audio_config_t upload_audio_config = {
-        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
-        .sample_rate = CONFIG_AUDIO_UPLOAD_SAMPLE_RATE,
-        .frame_duration = CONFIG_AUDIO_UPLOAD_FRAME_DURATION_MS,
-    };
-    esp_agent_audio_config_t download_audio_config = {
-        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
-        .sample_rate = CONFIG_AUDIO_DOWNLOAD_SAMPLE_RATE,
-        .frame_duration = CONFIG_AUDIO_DOWNLOAD_FRAME_DURATION_MS,
-    };
+    esp_agent_audio_config_t upload_audio_config;
+    esp_agent_audio_config_t download_audio_config;
+    app_agent_get_audio_config(&upload_audio_config, &download_audio_config);
 
     esp_agent_config_t agent_config = {
         .conversation_type = ESP_AGENT_CONVERSATION_SPEECH,
@@ -238,6 +439,10 @@ esp_err_t app_agent_init(app_agent_config_t *config)
     esp_event_handler_t handler = config->event_handler;
     ESP_RETURN_ON_ERROR(esp_agent_register_event_handler(g_app_agent_data.agent_handle, ESP_EVENT_ANY_ID, handler, NULL, &g_app_agent_data.agent_event_handler), TAG, "Failed to register agent event handler");
 
+#if CONFIG_ESP_AGENT_CAPTURE || CONFIG_ESP_AGENT_BENCH || CONFIG_ESP_AGENT_SOAK
+    ESP_RETURN_ON_ERROR(register_agent_commands(), TAG, "Failed to register agent commands");
+#endif
+
     g_app_agent_data.state = APP_AGENT_STATE_DISCONNECTED;
     g_app_agent_data.initialized = true;
     g_app_agent_data.config = *config;
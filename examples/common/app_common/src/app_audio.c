@@ -4,14 +4,23 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include <esp_check.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
 #include <driver/i2s_std.h>
 #include <nvs_flash.h>
 #include <agent_setup.h>
 #include <agent_console.h>
 #include <setup/rainmaker.h>
 #include <esp_agent.h>
+#include <audio_convert.h>
+#include <audio_pipeline_bench.h>
 
 #include <esp_board_device.h>
 #include <dev_audio_codec.h>
@@ -19,20 +28,59 @@
 #include "app_audio.h"
 #include "app_agent.h"
 #include "app_device.h"
+#include "app_common_tools.h"
 
 static const char *TAG = "app_audio";
 
+/* Time and CPU load accumulated while an AFE profile was active */
+typedef struct {
+    int64_t time_us;
+    uint32_t entries;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint64_t elapsed;                       /* Run time counter ticks */
+    uint64_t busy[portNUM_PROCESSORS];      /* Ticks not spent in the idle task of each core */
+#endif
+} audio_afe_profile_load_t;
+
 typedef struct {
     bool initialized;
     audio_recorder_handle_t recorder_handle;
+    esp_codec_dev_handle_t microphone_handle;
+    TaskHandle_t microphone_task;
+    volatile bool microphone_park;          /* The microphone task stops reading until notified, the recorder is replaced */
+    SemaphoreHandle_t microphone_parked;
     audio_playback_handle_t playback_handle;
+    audio_mixer_handle_t mixer_handle;
     esp_codec_dev_handle_t speaker_handle;
     app_audio_microphone_state_t microphone_state;
     bool speaker_active;
     bool audio_download_complete;
-    bool audio_playback_complete;
-    EventGroupHandle_t event_group;
+    volatile bool audio_playback_complete;
     uint8_t volume;
+    RingbufHandle_t preroll;
+    void *preroll_held;                     /* Pre-roll item received but not sent yet, the send queue was full */
+    size_t preroll_held_size;
+    uint32_t preroll_dropped;
+    volatile bool awake;                    /* Between the wake word and the AFE going back to sleep */
+    volatile bool preroll_stale;            /* The pre-roll holds audio from before the last wake word */
+    volatile uint32_t wakeup_ms;            /* esp_timer ms of the last wake word */
+    volatile uint32_t vad_onset_ms;         /* esp_timer ms of the first VAD start since wakeup, 0 if none */
+    volatile int64_t barge_in_us;           /* esp_timer time of the VAD start that interrupted playback */
+    volatile bool turn_speech;              /* VAD start seen since the wake word or the last response */
+    volatile bool command_window;           /* A voice command may follow the wake word, the turn is cancelled if one does */
+    /* Capture latency of the encoded packets, from the microphone read to the packet reaching the microphone task */
+    volatile bool latency_reset;
+    uint64_t latency_sum_us;
+    uint32_t latency_count;
+    uint32_t latency_max_us;
+    /* AFE profile accounting, updated by the task switching profiles */
+    audio_recorder_afe_profile_t afe_profile;
+    int64_t afe_profile_since_us;
+    audio_afe_profile_load_t afe_load[AUDIO_RECORDER_AFE_PROFILE_MAX];
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE afe_run_start;
+    configRUN_TIME_COUNTER_TYPE afe_idle_start[portNUM_PROCESSORS];
+#endif
 } app_audio_data_t;
 
 typedef struct {
@@ -45,10 +93,27 @@ app_audio_data_t g_app_audio_data;
 #define APP_AUDIO_NVS_NAMESPACE "app_audio"
 #define APP_AUDIO_NVS_KEY_VOLUME "volume"
 
-#define AUDIO_SEND_BUFFER_SIZE 1024
-#define OPUS_DUMMY_FRAME_DATA_SIZE 320 // random size for dummy audio data (all 0s)
+/* Pre-roll ring sized for Opus up to 32 kbps or 16-bit PCM, plus the per packet overhead */
+#if CONFIG_AUDIO_UPLOAD_CODEC_PCM
+#define AUDIO_PREROLL_BYTES_PER_MS (CONFIG_AUDIO_UPLOAD_SAMPLE_RATE * 2 / 1000)
+#else
+#define AUDIO_PREROLL_BYTES_PER_MS 4
+#endif
+#define AUDIO_PREROLL_ITEM_OVERHEAD (8 + sizeof(audio_preroll_item_t))
+/* Longest wait for a packet, the microphone task checks for a park request in between */
+#define AUDIO_MICROPHONE_READ_TIMEOUT_MS 100
+/* Mixer input channels: media (chimes, reminders) ducks the assistant speech */
+#define APP_AUDIO_MIXER_SPEECH 0
+#define APP_AUDIO_MIXER_MEDIA 1
+
+/* The AFE reports wakeup and VAD start after vad_min_speech_ms and its own buffering, keep the audio just before */
+#define AUDIO_PREROLL_MARGIN_MS 300
+
+typedef struct {
+    int64_t capture_time_us;
+    uint8_t data[];
+} audio_preroll_item_t;
 
-#define AUDIO_DOWNLOAD_COMPLETE_BIT (1 << 2)
 
 static const esp_codec_dev_sample_info_t g_audio_cfg = {
     .sample_rate = 16000,
@@ -135,6 +200,175 @@ static esp_err_t app_audio_set_volume_handler(int argc, char **argv)
     return app_audio_set_playback_volume(atoi(volume));
 }
 
+static esp_err_t app_audio_encoder_stats_handler(int argc, char **argv)
+{
+    audio_recorder_encoder_stats_t stats;
+    esp_err_t ret = audio_recorder_get_encoder_stats(g_app_audio_data.recorder_handle, &stats);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "No encoder statistics: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    printf("frames: %" PRIu32 "\n", stats.frames);
+    printf("encode us: last %" PRIu32 ", avg %" PRIu32 ", max %" PRIu32 " of %" PRIu32 "\n",
+           stats.last_us, stats.avg_us, stats.max_us, stats.budget_us);
+    printf("utilization: %u%%\n", stats.utilization_pct);
+    printf("complexity: %u (target %u, %" PRIu32 " reconfigs)\n", stats.complexity, stats.complexity_target, stats.reconfigs);
+    printf("state: %s\n", stats.idle ? "gated while idle" : "encoding");
+    return ESP_OK;
+}
+
+static esp_err_t app_audio_playback_stats_handler(int argc, char **argv)
+{
+    audio_playback_stats_t stats;
+    ESP_RETURN_ON_ERROR(audio_playback_get_stats(g_app_audio_data.playback_handle, &stats), TAG, "No playback statistics");
+
+    printf("pipeline restarts: %" PRIu32 "\n", stats.restarts);
+    printf("recovery us: last %" PRIu32 ", max %" PRIu32 "\n", stats.last_recovery_us, stats.max_recovery_us);
+    printf("latency shed by catching up: %" PRIu32 " ms\n", stats.catch_up_shed_ms);
+    return ESP_OK;
+}
+
+/* Capture latency and per-core load over a few seconds, to compare recorder topologies and idle gating */
+static esp_err_t app_audio_recorder_bench_handler(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    if (seconds <= 0) {
+        ESP_LOGE(TAG, "Usage: recorder-bench [seconds]");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle_start[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        idle_start[core] = ulTaskGetIdleRunTimeCounterForCore(core);
+    }
+    configRUN_TIME_COUNTER_TYPE start = portGET_RUN_TIME_COUNTER_VALUE();
+#endif
+    audio_recorder_encoder_stats_t stats_start = {0};
+    audio_recorder_encoder_stats_t stats_end = {0};
+    audio_recorder_get_encoder_stats(g_app_audio_data.recorder_handle, &stats_start);
+    g_app_audio_data.latency_reset = true;
+
+    vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+
+    uint32_t count = g_app_audio_data.latency_count;
+    audio_recorder_get_encoder_stats(g_app_audio_data.recorder_handle, &stats_end);
+#if CONFIG_AUDIO_RECORDER_SPLIT_PIPELINE || CONFIG_AUDIO_UPLOAD_IDLE_GATING
+    printf("topology: split, encoder on core %d\n", CONFIG_AUDIO_RECORDER_ENCODER_CORE);
+#else
+    printf("topology: single pipeline\n");
+#endif
+    printf("encoder: %" PRIu32 " frames encoded, %s\n", stats_end.frames - stats_start.frames,
+           stats_end.idle ? "gated while idle" : "encoding");
+    printf("capture latency: avg %" PRIu32 " us, max %" PRIu32 " us over %" PRIu32 " packets\n",
+           count ? (uint32_t)(g_app_audio_data.latency_sum_us / count) : 0, g_app_audio_data.latency_max_us, count);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE elapsed = portGET_RUN_TIME_COUNTER_VALUE() - start;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounterForCore(core) - idle_start[core];
+        printf("core %d load: %" PRIu32 "%%\n", core, elapsed ? (uint32_t)(100 - (uint64_t)idle * 100 / elapsed) : 0);
+    }
+#else
+    printf("core load: enable CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+#endif
+    return ESP_OK;
+}
+
+/* Totals of a profile, including the time since it became active when it is the current one */
+static void audio_afe_profile_sample(audio_recorder_afe_profile_t profile, audio_afe_profile_load_t *load)
+{
+    *load = g_app_audio_data.afe_load[profile];
+    if (profile != g_app_audio_data.afe_profile) {
+        return;
+    }
+    load->time_us += esp_timer_get_time() - g_app_audio_data.afe_profile_since_us;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE elapsed = portGET_RUN_TIME_COUNTER_VALUE() - g_app_audio_data.afe_run_start;
+    load->elapsed += elapsed;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounterForCore(core) - g_app_audio_data.afe_idle_start[core];
+        load->busy[core] += elapsed > idle ? elapsed - idle : 0;
+    }
+#endif
+}
+
+static void audio_afe_profile_print(audio_recorder_afe_profile_t profile, const audio_afe_profile_load_t *load)
+{
+    printf("%s: %" PRIu32 " times, %" PRId64 " ms", audio_recorder_afe_profile_name(profile), load->entries, load->time_us / 1000);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        printf(", core %d load %" PRIu32 "%%", core, load->elapsed ? (uint32_t)(load->busy[core] * 100 / load->elapsed) : 0);
+    }
+#endif
+    printf("\n");
+}
+
+static esp_err_t app_audio_afe_profiles_handler(int argc, char **argv)
+{
+    for (int profile = 0; profile < AUDIO_RECORDER_AFE_PROFILE_MAX; profile++) {
+        audio_afe_profile_load_t load;
+        audio_afe_profile_sample(profile, &load);
+        audio_afe_profile_print(profile, &load);
+    }
+#if !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    printf("core load: enable CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+#endif
+    printf("current: %s\n", audio_recorder_afe_profile_name(g_app_audio_data.afe_profile));
+    return ESP_OK;
+}
+
+static esp_err_t app_audio_convert_bench_handler(int argc, char **argv)
+{
+    uint32_t iterations = argc > 1 ? (uint32_t)atoi(argv[1]) : 0;
+    return audio_convert_bench_run(iterations, argc > 2 ? argv[2] : NULL);
+}
+
+static esp_err_t audio_init_recorder(void);
+
+/* The benchmark needs the AFE of the shared pool: the application recorder is torn down for its duration,
+ * with the microphone task parked, and built again afterwards */
+static esp_err_t app_audio_pipeline_bench_handler(int argc, char **argv)
+{
+    uint32_t seconds = argc > 1 ? (uint32_t)atoi(argv[1]) : 0;
+
+    if (g_app_audio_data.microphone_task == NULL) {
+        ESP_LOGE(TAG, "Audio not started");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (g_app_audio_data.awake || g_app_audio_data.speaker_active) {
+        ESP_LOGE(TAG, "Device busy, run the benchmark while it sleeps");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    g_app_audio_data.microphone_park = true;
+    xSemaphoreTake(g_app_audio_data.microphone_parked, portMAX_DELAY);
+    audio_recorder_afe_profile_t profile = g_app_audio_data.afe_profile;
+    audio_recorder_handle_t recorder = g_app_audio_data.recorder_handle;
+    g_app_audio_data.recorder_handle = NULL;
+    audio_recorder_deinit(recorder);
+
+    esp_err_t ret = audio_pipeline_bench_run(seconds, argc > 2 ? argv[2] : NULL);
+
+    esp_err_t err = audio_init_recorder();
+    if (err == ESP_OK) {
+        err = audio_recorder_start(g_app_audio_data.recorder_handle);
+    }
+    if (err == ESP_OK) {
+        /* The new recorder has no profile yet */
+        g_app_audio_data.afe_profile = AUDIO_RECORDER_AFE_PROFILE_MAX;
+        err = app_audio_set_afe_profile(profile);
+    }
+    if (err != ESP_OK) {
+        /* The microphone task stays parked rather than reading a broken recorder */
+        ESP_LOGE(TAG, "Failed to restore the audio recorder: %s", esp_err_to_name(err));
+        return err;
+    }
+    g_app_audio_data.microphone_park = false;
+    xTaskNotifyGive(g_app_audio_data.microphone_task);
+    return ret;
+}
+
 static esp_err_t register_audio_commands()
 {
     esp_console_cmd_t cmd = {
@@ -142,7 +376,48 @@ static esp_err_t register_audio_commands()
         .help = "Set the volume of the playback device\nUsage: set-volume <volume>",
         .func = app_audio_set_volume_handler,
     };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register set-volume");
 
+    cmd = (esp_console_cmd_t) {
+        .command = "encoder-stats",
+        .help = "Print the upload encoder timing and complexity",
+        .func = app_audio_encoder_stats_handler,
+    };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register encoder-stats");
+
+    cmd = (esp_console_cmd_t) {
+        .command = "playback-stats",
+        .help = "Print the playback pipeline restarts, recovery time and latency shed by catching up",
+        .func = app_audio_playback_stats_handler,
+    };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register playback-stats");
+
+    cmd = (esp_console_cmd_t) {
+        .command = "recorder-bench",
+        .help = "Measure capture latency and per-core load\nUsage: recorder-bench [seconds]",
+        .func = app_audio_recorder_bench_handler,
+    };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register recorder-bench");
+
+    cmd = (esp_console_cmd_t) {
+        .command = "convert-bench",
+        .help = "Measure the sample conversion kernels\nUsage: convert-bench [iterations] [filter]",
+        .func = app_audio_convert_bench_handler,
+    };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register convert-bench");
+
+    cmd = (esp_console_cmd_t) {
+        .command = "pipeline-bench",
+        .help = "Time a chirp through a recorder and a playback on file codec devices, while the device sleeps\nUsage: pipeline-bench [seconds] [filter]",
+        .func = app_audio_pipeline_bench_handler,
+    };
+    ESP_RETURN_ON_ERROR(agent_console_register_command(&cmd), TAG, "Failed to register pipeline-bench");
+
+    cmd = (esp_console_cmd_t) {
+        .command = "afe-profiles",
+        .help = "Print the time and per-core load of each AFE profile",
+        .func = app_audio_afe_profiles_handler,
+    };
     return agent_console_register_command(&cmd);
 }
 
@@ -150,9 +425,58 @@ static void audio_recorder_event_handler(audio_recorder_handle_t handle, audio_r
 {
     switch (event) {
         case AUDIO_RECORDER_EVENT_WAKEUP_START:
+            g_app_audio_data.wakeup_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            g_app_audio_data.vad_onset_ms = 0;
+            g_app_audio_data.preroll_stale = true;
+            g_app_audio_data.awake = true;
+            g_app_audio_data.turn_speech = false;
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+            g_app_audio_data.command_window = true;
+#endif
             app_device_event_enqueue(DEVICE_EVENT_WAKEUP);
             break;
+        case AUDIO_RECORDER_EVENT_VAD_START:
+            if (g_app_audio_data.vad_onset_ms == 0) {
+                g_app_audio_data.vad_onset_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            }
+            g_app_audio_data.turn_speech = true;
+#if CONFIG_APP_AUDIO_BARGE_IN
+            /* With AEC on, speech detected while the assistant talks is the user interrupting */
+            if (g_app_audio_data.speaker_active && !g_app_audio_data.audio_playback_complete) {
+                g_app_audio_data.barge_in_us = esp_timer_get_time();
+                app_device_event_enqueue(DEVICE_EVENT_BARGE_IN);
+            }
+#endif
+            break;
+        case AUDIO_RECORDER_EVENT_VAD_END:
+            if (g_app_audio_data.command_window && g_app_audio_data.turn_speech) {
+                /* Speech after the wake word ended without a command yet. Its end is left to the server, so a
+                 * command recognized at the end of the phrase still cancels the turn before the stream closes. */
+                g_app_audio_data.command_window = false;
+                break;
+            }
+#if CONFIG_APP_AUDIO_ENDPOINT
+            /* Reported after CONFIG_AUDIO_VAD_HANGOVER_MS of silence: the user has finished speaking.
+             * Speech still held in the pre-roll while the agent connects is left to the server. */
+            if (g_app_audio_data.turn_speech && g_app_audio_data.microphone_state == MICROPHONE_STATE_START &&
+                !g_app_audio_data.speaker_active && app_agent_get_state() == APP_AGENT_STATE_STARTED) {
+                g_app_audio_data.turn_speech = false;
+                app_device_event_enqueue(DEVICE_EVENT_ENDPOINT);
+            }
+#endif
+            break;
+        case AUDIO_RECORDER_EVENT_COMMAND: {
+            /* The phrase has also been streamed to the agent, the device cancels the turn */
+            device_event_data_t data = {0};
+            audio_recorder_get_command(handle, &data.command);
+            app_device_event_enqueue_with_data(DEVICE_EVENT_COMMAND, &data);
+            break;
+        }
+        case AUDIO_RECORDER_EVENT_COMMAND_TIMEOUT:
+            g_app_audio_data.command_window = false;
+            break;
         case AUDIO_RECORDER_EVENT_WAKEUP_END:
+            g_app_audio_data.awake = false;
             app_device_event_enqueue(DEVICE_EVENT_SLEEP);
             break;
         default:
@@ -160,43 +484,262 @@ static void audio_recorder_event_handler(audio_recorder_handle_t handle, audio_r
     }
 }
 
+/*
+ * Pre-roll: from the wake word until the agent can accept speech, encoded packets are kept in a ring (in
+ * PSRAM when available) holding the last CONFIG_APP_AUDIO_PREROLL_MS of audio. Then the packets from the
+ * VAD onset onward are drained a few at a time, as the send queue has room, while live packets keep
+ * queueing behind them, so speech started right after the wake word is not lost and the recorder is
+ * never starved of reads. The ring is only touched by the microphone task.
+ */
+static void audio_preroll_release_held(void)
+{
+    if (g_app_audio_data.preroll_held) {
+        vRingbufferReturnItem(g_app_audio_data.preroll, g_app_audio_data.preroll_held);
+        g_app_audio_data.preroll_held = NULL;
+    }
+}
+
+static void audio_preroll_push(const audio_recorder_packet_t *packet)
+{
+    RingbufHandle_t rb = g_app_audio_data.preroll;
+    audio_preroll_item_t *item = NULL;
+    size_t item_size = 0;
+
+    if (rb == NULL || packet->len == 0) {
+        return;
+    }
+
+    /* Drop the oldest packets to make room, the held one first since the ring only frees in order */
+    while (xRingbufferSendAcquire(rb, (void **)&item, sizeof(*item) + packet->len, 0) != pdTRUE) {
+        void *oldest = g_app_audio_data.preroll_held;
+        g_app_audio_data.preroll_held = NULL;
+        if (oldest == NULL) {
+            oldest = xRingbufferReceive(rb, &item_size, 0);
+        }
+        if (oldest == NULL) {
+            return;
+        }
+        vRingbufferReturnItem(rb, oldest);
+        g_app_audio_data.preroll_dropped++;
+    }
+
+    item->capture_time_us = packet->capture_time_us;
+    memcpy(item->data, packet->data, packet->len);
+    xRingbufferSendComplete(rb, item);
+}
+
+static void audio_preroll_reset(void)
+{
+    size_t item_size = 0;
+    void *item = NULL;
+
+    if (g_app_audio_data.preroll == NULL) {
+        return;
+    }
+    audio_preroll_release_held();
+    while ((item = xRingbufferReceive(g_app_audio_data.preroll, &item_size, 0)) != NULL) {
+        vRingbufferReturnItem(g_app_audio_data.preroll, item);
+    }
+}
+
+/* Capture time of the first packet worth sending */
+static int64_t audio_preroll_start_us(void)
+{
+    /* From the first VAD onset after the wake word, or from the wake word itself when the VAD has not
+     * fired yet, within the pre-roll window */
+    uint32_t onset_ms = g_app_audio_data.vad_onset_ms ? g_app_audio_data.vad_onset_ms : g_app_audio_data.wakeup_ms;
+    int64_t start_us = ((int64_t)onset_ms - AUDIO_PREROLL_MARGIN_MS) * 1000;
+    int64_t window_start_us = esp_timer_get_time() - CONFIG_APP_AUDIO_PREROLL_MS * 1000LL;
+    return window_start_us > start_us ? window_start_us : start_us;
+}
+
+/*
+ * Send pre-roll packets captured from start_us onward until the ring is empty or the send queue is full.
+ * Returns ESP_OK once the ring is empty, ESP_ERR_TIMEOUT when packets are left for the next call.
+ */
+static esp_err_t audio_preroll_drain(int64_t start_us, uint32_t *sent)
+{
+    RingbufHandle_t rb = g_app_audio_data.preroll;
+    audio_preroll_item_t *item = NULL;
+
+    if (rb == NULL) {
+        return ESP_OK;
+    }
+
+    while (true) {
+        if (g_app_audio_data.preroll_held == NULL) {
+            g_app_audio_data.preroll_held = xRingbufferReceive(rb, &g_app_audio_data.preroll_held_size, 0);
+            if (g_app_audio_data.preroll_held == NULL) {
+                return ESP_OK;
+            }
+        }
+        item = g_app_audio_data.preroll_held;
+        if (item->capture_time_us >= start_us) {
+            esp_err_t err = app_agent_try_send_speech(item->data, g_app_audio_data.preroll_held_size - sizeof(*item));
+            if (err == ESP_ERR_TIMEOUT) {
+                return ESP_ERR_TIMEOUT;
+            }
+            if (err != ESP_OK) {
+                audio_preroll_reset();
+                return err;
+            }
+            (*sent)++;
+        }
+        audio_preroll_release_held();
+    }
+}
+
+static void audio_latency_update(const audio_recorder_packet_t *packet)
+{
+    if (g_app_audio_data.latency_reset) {
+        g_app_audio_data.latency_reset = false;
+        g_app_audio_data.latency_sum_us = 0;
+        g_app_audio_data.latency_count = 0;
+        g_app_audio_data.latency_max_us = 0;
+    }
+    if (packet->len == 0 || packet->dtx) {
+        return;
+    }
+
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - packet->capture_time_us);
+    g_app_audio_data.latency_sum_us += latency_us;
+    g_app_audio_data.latency_count++;
+    if (latency_us > g_app_audio_data.latency_max_us) {
+        g_app_audio_data.latency_max_us = latency_us;
+    }
+}
+
 static void audio_microphone_task(void *arg)
 {
-    uint8_t *audio_data = (uint8_t *) malloc(AUDIO_SEND_BUFFER_SIZE);
-    assert(audio_data);
-    size_t audio_data_len = 0;
-    uint8_t *dummy_audio_data = (uint8_t *) calloc(OPUS_DUMMY_FRAME_DATA_SIZE, 1);
+    audio_recorder_packet_t packet;
+    int64_t last_keepalive_us = 0;
+    app_audio_microphone_state_t prev_state = MICROPHONE_STATE_MAX;
+    bool preroll_pending = false;
+    bool preroll_draining = false;
+    int64_t preroll_start_us = 0;
+    uint32_t preroll_sent = 0;
 
     ESP_LOGI(TAG, "Audio microphone task started");
     while (true) {
-        audio_recorder_read(g_app_audio_data.recorder_handle, audio_data, AUDIO_SEND_BUFFER_SIZE, &audio_data_len);
+        if (g_app_audio_data.microphone_park) {
+            /* Hold no packet while the recorder is replaced */
+            audio_preroll_reset();
+            preroll_pending = false;
+            preroll_draining = false;
+            xSemaphoreGive(g_app_audio_data.microphone_parked);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        /* Borrow the encoded packet from the recorder, the agent makes the only copy when queueing it */
+        if (audio_recorder_acquire_read(g_app_audio_data.recorder_handle, &packet, pdMS_TO_TICKS(AUDIO_MICROPHONE_READ_TIMEOUT_MS)) != ESP_OK) {
+            continue;
+        }
+        ESP_LOGV(TAG, "Packet %" PRIu32 ": %zu bytes, %u ms, captured %" PRId64 " us ago", packet.seq, packet.len,
+                 packet.duration_ms, esp_timer_get_time() - packet.capture_time_us);
+        audio_latency_update(&packet);
+
+        app_audio_microphone_state_t state = g_app_audio_data.microphone_state;
+        /* A new wake word, the device going to sleep, or the response starting before the pre-roll was sent */
+        if (g_app_audio_data.preroll_stale || (state == MICROPHONE_STATE_STOP && prev_state != MICROPHONE_STATE_STOP) ||
+            (preroll_draining && state != MICROPHONE_STATE_START)) {
+            g_app_audio_data.preroll_stale = false;
+            audio_preroll_reset();
+            preroll_pending = false;
+            preroll_draining = false;
+        }
+        prev_state = state;
 
         esp_err_t err = ESP_OK;
-        switch (g_app_audio_data.microphone_state) {
+        switch (state) {
             case MICROPHONE_STATE_START:
-                err = app_agent_send_speech(audio_data, audio_data_len);
+                if (!preroll_draining && app_agent_get_state() != APP_AGENT_STATE_STARTED) {
+                    /* Still connecting. A voice command does not hold the uplink, it cancels the turn. */
+                    audio_preroll_push(&packet);
+                    preroll_pending = true;
+                    break;
+                }
+                if (preroll_pending && g_app_audio_data.preroll) {
+                    if (!preroll_draining) {
+                        preroll_draining = true;
+                        preroll_start_us = audio_preroll_start_us();
+                        preroll_sent = 0;
+                        g_app_audio_data.preroll_dropped = 0;
+                    }
+                    /* Live packets queue behind the pre-roll until it has drained, so the audio stays in order */
+                    audio_preroll_push(&packet);
+                    err = audio_preroll_drain(preroll_start_us, &preroll_sent);
+                    if (err == ESP_ERR_TIMEOUT) {
+                        err = ESP_OK;
+                        break;
+                    }
+                    preroll_pending = false;
+                    preroll_draining = false;
+                    ESP_LOGI(TAG, "Sent %" PRIu32 " pre-roll packets", preroll_sent);
+                    if (g_app_audio_data.preroll_dropped) {
+                        ESP_LOGW(TAG, "Pre-roll full while draining, %" PRIu32 " packets dropped", g_app_audio_data.preroll_dropped);
+                    }
+                    break;
+                }
+                if (packet.len > 0) {
+                    err = app_agent_send_speech(packet.data, packet.len);
+                }
                 break;
             case MICROPHONE_STATE_PAUSE:
-                err = app_agent_send_speech(dummy_audio_data, OPUS_DUMMY_FRAME_DATA_SIZE);
+                if (packet.len > 0 && esp_timer_get_time() - last_keepalive_us >= CONFIG_AUDIO_UPLOAD_DTX_KEEPALIVE_MS * 1000LL) {
+                    last_keepalive_us = esp_timer_get_time();
+#if CONFIG_AUDIO_UPLOAD_CODEC_PCM
+                    /* Keep the stream alive with a few ms of silence */
+                    static const uint8_t silence[64] = {0};
+                    err = app_agent_send_speech(silence, sizeof(silence));
+#else
+                    /* Keep the stream alive with the packet's TOC byte alone, an Opus DTX packet */
+                    uint8_t toc = packet.data[0] & 0xFC;
+                    err = app_agent_send_speech(&toc, 1);
+#endif
+                }
                 break;
             case MICROPHONE_STATE_STOP:
-                vTaskDelay(pdMS_TO_TICKS(10));
-                continue; // While loop
+                /* After a wake word while the agent connects, keep the audio. Nothing is kept while asleep. */
+                if (g_app_audio_data.awake) {
+                    audio_preroll_push(&packet);
+                    preroll_pending = true;
+                }
+                break;
+            case MICROPHONE_STATE_MUTE:
+                /* The audio stream has ended, nothing is sent until the next turn starts another */
+                break;
             default:
                 break;
         }
+        audio_recorder_release_read(g_app_audio_data.recorder_handle);
 
-        if (err != ESP_OK) {
+        if (err == ESP_ERR_TIMEOUT) {
+            /* The connection is slow rather than gone, that is left to the agent to detect */
+            ESP_LOGW(TAG, "Send queue full, packet %" PRIu32 " dropped", packet.seq);
+        } else if (err != ESP_OK) {
             ESP_LOGW(TAG, "Failed to send speech data: %s", esp_err_to_name(err));
             app_device_event_enqueue(DEVICE_EVENT_SLEEP);
         }
     }
 
-    free(audio_data);
-    free(dummy_audio_data);
     vTaskDelete(NULL);
 }
 
+static esp_err_t audio_preroll_init(void)
+{
+#if CONFIG_APP_AUDIO_PREROLL_MS > 0
+    size_t packets = CONFIG_APP_AUDIO_PREROLL_MS / CONFIG_AUDIO_UPLOAD_FRAME_DURATION_MS + 1;
+    size_t size = CONFIG_APP_AUDIO_PREROLL_MS * AUDIO_PREROLL_BYTES_PER_MS + packets * AUDIO_PREROLL_ITEM_OVERHEAD;
+
+    g_app_audio_data.preroll = xRingbufferCreateWithCaps(size, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (g_app_audio_data.preroll == NULL) {
+        g_app_audio_data.preroll = xRingbufferCreate(size, RINGBUF_TYPE_NOSPLIT);
+    }
+    ESP_RETURN_ON_FALSE(g_app_audio_data.preroll, ESP_ERR_NO_MEM, TAG, "Failed to allocate %zu byte pre-roll ring", size);
+#endif
+    return ESP_OK;
+}
+
 static esp_err_t audio_init_micrphone()
 {
     dev_audio_codec_handles_t *codec_handles = NULL;
@@ -205,12 +748,35 @@ static esp_err_t audio_init_micrphone()
 
     ESP_RETURN_ON_ERROR(esp_codec_dev_open(microphone_handle, (esp_codec_dev_sample_info_t *)&g_audio_cfg), TAG, "Failed to open microphone");
     ESP_RETURN_ON_ERROR(esp_codec_dev_set_in_gain(microphone_handle, 30.0f), TAG, "Failed to set microphone gain");
+    g_app_audio_data.microphone_handle = microphone_handle;
+
+    return audio_init_recorder();
+}
+
+static esp_err_t audio_init_recorder(void)
+{
+    esp_agent_audio_config_t upload;
+    esp_agent_audio_config_t download;
+    app_agent_get_audio_config(&upload, &download);
 
     audio_recorder_config_t config = {
         .format = "RMNM",
-        .in_dev_handle = microphone_handle,
-        .sample_rate = CONFIG_AUDIO_UPLOAD_SAMPLE_RATE,
-        .frame_duration_ms = CONFIG_AUDIO_UPLOAD_FRAME_DURATION_MS,
+        .in_dev_handle = g_app_audio_data.microphone_handle,
+        .codec = upload.format == ESP_AGENT_CONVERSATION_AUDIO_FORMAT_PCM ? AUDIO_RECORDER_CODEC_PCM : AUDIO_RECORDER_CODEC_OPUS,
+        .sample_rate = upload.sample_rate,
+        .frame_duration_ms = upload.frame_duration,
+#if CONFIG_AUDIO_UPLOAD_DTX
+        .dtx = true,
+        .dtx_lookback_ms = CONFIG_AUDIO_UPLOAD_DTX_LOOKBACK_MS,
+#endif
+        .dtx_keepalive_ms = CONFIG_AUDIO_UPLOAD_DTX_KEEPALIVE_MS,
+        .complexity = CONFIG_AUDIO_UPLOAD_OPUS_COMPLEXITY,
+#if CONFIG_AUDIO_UPLOAD_OPUS_COMPLEXITY_AUTO
+        .complexity_auto = true,
+#endif
+#if CONFIG_AUDIO_UPLOAD_IDLE_GATING
+        .idle_gating = true,
+#endif
     };
 
     g_app_audio_data.recorder_handle = audio_recorder_init(&config);
@@ -219,6 +785,11 @@ static esp_err_t audio_init_micrphone()
     }
 
     audio_recorder_add_event_cb(g_app_audio_data.recorder_handle, audio_recorder_event_handler, NULL);
+#if CONFIG_AUDIO_RECORDER_COMMANDS
+    size_t command_count = 0;
+    const audio_recorder_command_t *commands = app_common_tools_get_commands(&command_count);
+    ESP_RETURN_ON_ERROR(audio_recorder_set_commands(g_app_audio_data.recorder_handle, commands, command_count), TAG, "Failed to set voice commands");
+#endif
 
     return ESP_OK;
 }
@@ -243,6 +814,18 @@ static esp_err_t audio_calibrate_volume_curve(esp_codec_dev_handle_t speaker_han
     return ESP_FAIL;
 }
 
+/* Runs in the playback pipeline task, or the mixer task, when the speech stream has been played out */
+static void audio_speaker_drained_cb(void *ctx)
+{
+    if (g_app_audio_data.audio_playback_complete) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Speaker playback complete");
+    g_app_audio_data.audio_playback_complete = true;
+    app_device_event_enqueue(DEVICE_EVENT_SPEECH_PLAYBACK_COMPLETE);
+}
+
 static esp_err_t audio_init_speaker()
 {
     dev_audio_codec_handles_t *codec_handles = NULL;
@@ -252,11 +835,20 @@ static esp_err_t audio_init_speaker()
     esp_codec_dev_handle_t speaker_handle = codec_handles->codec_dev;
     g_app_audio_data.speaker_handle = speaker_handle;
 
+    esp_agent_audio_config_t upload;
+    esp_agent_audio_config_t download;
+    app_agent_get_audio_config(&upload, &download);
+
+#if CONFIG_APP_AUDIO_SPEAKER_NATIVE_FORMAT
+    /* The decoded speech format, playback then skips every conversion */
     esp_codec_dev_sample_info_t fs = {
-        .sample_rate = 16000,
-        .channel = 2,
-        .bits_per_sample = 32,
+        .sample_rate = download.sample_rate,
+        .channel = 1,
+        .bits_per_sample = 16,
     };
+#else
+    esp_codec_dev_sample_info_t fs = g_audio_cfg;
+#endif
 
     ESP_RETURN_ON_ERROR(esp_codec_dev_open(speaker_handle, &fs), TAG, "Failed to open speaker");
     uint8_t volume = 0;
@@ -272,13 +864,42 @@ static esp_err_t audio_init_speaker()
     ESP_RETURN_ON_ERROR(esp_codec_dev_set_out_vol(speaker_handle, volume), TAG, "Failed to set speaker volume");
     g_app_audio_data.volume = volume;
 
+    audio_mixer_config_t mixer_config = {
+        .out_dev_handle = speaker_handle,
+        .out_info = fs,
+        .channel_count = 2,
+        .channels = {
+            [APP_AUDIO_MIXER_SPEECH] = { .gain_db = 0 },
+            [APP_AUDIO_MIXER_MEDIA] = { .gain_db = 0, .ducks_others = true },
+        },
+        .buffer_ms = 40,
+        .duck_db = CONFIG_APP_AUDIO_DUCK_DB,
+        .duck_attack_ms = 20,
+        .duck_release_ms = 300,
+        .task_core = 1,
+        .task_prio = 7,
+    };
+    g_app_audio_data.mixer_handle = audio_mixer_init(&mixer_config);
+    if (g_app_audio_data.mixer_handle == NULL) {
+        return ESP_FAIL;
+    }
+
     audio_playback_config_t config = {
         .audio_in_info = {
-            .sample_rate = CONFIG_AUDIO_DOWNLOAD_SAMPLE_RATE,
-            .frame_duration_ms = CONFIG_AUDIO_DOWNLOAD_FRAME_DURATION_MS,
+            .sample_rate = download.sample_rate,
+            .frame_duration_ms = download.frame_duration,
+            .codec = download.format == ESP_AGENT_CONVERSATION_AUDIO_FORMAT_PCM ? AUDIO_PLAYBACK_CODEC_PCM : AUDIO_PLAYBACK_CODEC_OPUS,
         },
-        .out_codec_info = g_audio_cfg,
+        .out_codec_info = fs,
         .out_dev_handle = speaker_handle,
+        .drained_cb = audio_speaker_drained_cb,
+        .mixer = g_app_audio_data.mixer_handle,
+        .speech_channel = APP_AUDIO_MIXER_SPEECH,
+        .media_channel = APP_AUDIO_MIXER_MEDIA,
+#if CONFIG_APP_AUDIO_CATCH_UP
+        .catch_up_target_ms = CONFIG_APP_AUDIO_CATCH_UP_TARGET_MS,
+        .catch_up_speed_pct = CONFIG_APP_AUDIO_CATCH_UP_SPEED_PCT,
+#endif
     };
 
     g_app_audio_data.playback_handle = audio_playback_init(&config);
@@ -289,29 +910,6 @@ static esp_err_t audio_init_speaker()
     return ESP_OK;
 }
 
-void download_complete_task(void *arg)
-{
-    while (true) {
-        /* Wait for the download complete bit to be set */
-        /* This will be set by the `app_audio_speaker_download_complete` function */
-        xEventGroupWaitBits(g_app_audio_data.event_group, AUDIO_DOWNLOAD_COMPLETE_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
-
-        size_t remaining_bytes = 0;
-        do {
-            audio_playback_remaining_bytes(g_app_audio_data.playback_handle, &remaining_bytes);
-            vTaskDelay(pdMS_TO_TICKS(10));
-        } while (remaining_bytes > 0);
-
-        vTaskDelay(pdMS_TO_TICKS(100));
-
-        ESP_LOGI(TAG, "Speaker playback complete");
-        g_app_audio_data.audio_playback_complete = true;
-        app_device_event_enqueue(DEVICE_EVENT_SPEECH_PLAYBACK_COMPLETE);
-    }
-
-    vTaskDelete(NULL);
-}
-
 static esp_err_t app_audio_get_volume_cb(uint8_t *volume)
 {
     if (!g_app_audio_data.initialized) {
@@ -321,6 +919,11 @@ static esp_err_t app_audio_get_volume_cb(uint8_t *volume)
     return ESP_OK;
 }
 
+esp_err_t app_audio_get_playback_volume(uint8_t *volume)
+{
+    return app_audio_get_volume_cb(volume);
+}
+
 static esp_err_t app_audio_set_volume_cb(uint8_t volume)
 {
     return app_audio_set_playback_volume(volume);
@@ -333,6 +936,10 @@ esp_err_t app_audio_init(void)
         return ESP_OK;
     }
 
+    /* The AFE runs every feature until app_audio_start() selects the idle profile */
+    g_app_audio_data.afe_profile = AUDIO_RECORDER_AFE_PROFILE_MAX;
+
+    ESP_RETURN_ON_ERROR(audio_preroll_init(), TAG, "Failed to initialize pre-roll");
     ESP_RETURN_ON_ERROR(audio_init_micrphone(), TAG, "Failed to initialize microphone");
     ESP_RETURN_ON_ERROR(audio_init_speaker(), TAG, "Failed to initialize speaker");
     ESP_RETURN_ON_ERROR(register_audio_commands(), TAG, "Failed to register audio commands");
@@ -340,7 +947,6 @@ esp_err_t app_audio_init(void)
     /* Register volume callbacks with RainMaker */
     ESP_RETURN_ON_ERROR(setup_rainmaker_register_volume_callbacks(app_audio_get_volume_cb, app_audio_set_volume_cb), TAG, "Failed to register volume callbacks");
 
-    g_app_audio_data.event_group = xEventGroupCreate();
     g_app_audio_data.initialized = true;
 
     return ESP_OK;
@@ -352,11 +958,13 @@ esp_err_t app_audio_start(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    xTaskCreate(audio_microphone_task, "audio_microphone_task", 1024 * 4, NULL, 8, NULL);
-    xTaskCreate(download_complete_task, "download_complete_task", 1024 * 4, NULL, 8, NULL);
+    g_app_audio_data.microphone_parked = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(g_app_audio_data.microphone_parked, ESP_ERR_NO_MEM, TAG, "Failed to create the microphone semaphore");
+    xTaskCreate(audio_microphone_task, "audio_microphone_task", 1024 * 4, NULL, 8, &g_app_audio_data.microphone_task);
 
     ESP_RETURN_ON_ERROR(audio_recorder_start(g_app_audio_data.recorder_handle), TAG, "Failed to start audio recorder");
     ESP_RETURN_ON_ERROR(audio_playback_start(g_app_audio_data.playback_handle), TAG, "Failed to start audio playback");
+    ESP_RETURN_ON_ERROR(app_audio_set_afe_profile(AUDIO_RECORDER_AFE_PROFILE_IDLE_WAKE), TAG, "Failed to set the idle AFE profile");
 
     return ESP_OK;
 }
@@ -406,6 +1014,11 @@ esp_err_t app_audio_microphone_set_state(app_audio_microphone_state_t state)
             break;
         case MICROPHONE_STATE_STOP:
             ESP_LOGI(TAG, "Stopping microphone");
+            /* Asleep, the next wake word opens a new command window */
+            g_app_audio_data.command_window = false;
+            break;
+        case MICROPHONE_STATE_MUTE:
+            ESP_LOGI(TAG, "Muting microphone, end of speech");
             break;
         default:
             break;
@@ -421,7 +1034,13 @@ esp_err_t app_audio_speaker_start(void)
     ESP_LOGI(TAG, "Starting speaker");
     g_app_audio_data.speaker_active = true;
     g_app_audio_data.audio_playback_complete = false;
+    /* The next turn starts with the user speaking over or after the response */
+    g_app_audio_data.turn_speech = false;
 
+#if CONFIG_APP_AUDIO_BARGE_IN
+    /* Keep VAD running over playback */
+    audio_recorder_stay_awake(g_app_audio_data.recorder_handle, true);
+#endif
     return ESP_OK;
 }
 
@@ -429,15 +1048,78 @@ esp_err_t app_audio_speaker_stop(void)
 {
     ESP_LOGI(TAG, "Stopping speaker");
     g_app_audio_data.speaker_active = false;
+#if CONFIG_APP_AUDIO_BARGE_IN
+    audio_recorder_stay_awake(g_app_audio_data.recorder_handle, false);
+#endif
     return ESP_OK;
 }
 
+esp_err_t app_audio_speaker_barge_in(void)
+{
+    /* Drop the rest of the response, including packets still arriving */
+    g_app_audio_data.speaker_active = false;
+    g_app_audio_data.audio_playback_complete = true;
+
+    if (g_app_audio_data.barge_in_us) {
+        ESP_LOGI(TAG, "Barge-in: flushing playback %" PRId64 " ms after VAD start",
+                 (esp_timer_get_time() - g_app_audio_data.barge_in_us) / 1000);
+        g_app_audio_data.barge_in_us = 0;
+    } else {
+        ESP_LOGI(TAG, "Barge-in: flushing playback");
+    }
+    return audio_playback_flush(g_app_audio_data.playback_handle, CONFIG_APP_AUDIO_BARGE_IN_FADE_MS);
+}
+
 esp_err_t app_audio_speaker_download_complete(void)
 {
     ESP_LOGI(TAG, "Speaker download complete");
 
-    xEventGroupSetBits(g_app_audio_data.event_group, AUDIO_DOWNLOAD_COMPLETE_BIT);
+    /* Completion is reported by audio_speaker_drained_cb once this marker has been played out */
+    esp_err_t err = audio_playback_write_eos(g_app_audio_data.playback_handle);
+    if (err != ESP_OK) {
+        /* Don't leave the device stuck speaking */
+        audio_speaker_drained_cb(NULL);
+    }
+    return err;
+}
+
+esp_err_t app_audio_set_afe_profile(audio_recorder_afe_profile_t profile)
+{
+    audio_recorder_afe_profile_t prev = g_app_audio_data.afe_profile;
+    if (profile == prev) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(audio_recorder_set_afe_profile(g_app_audio_data.recorder_handle, profile), TAG, "Failed to set AFE profile");
+    /* Nobody listens in the idle profile, the encoder can stop until the wake word */
+    audio_recorder_set_idle(g_app_audio_data.recorder_handle, profile == AUDIO_RECORDER_AFE_PROFILE_IDLE_WAKE);
+
+    if (prev < AUDIO_RECORDER_AFE_PROFILE_MAX) {
+        audio_afe_profile_load_t load;
+        audio_afe_profile_sample(prev, &load);
+        int64_t period_ms = (load.time_us - g_app_audio_data.afe_load[prev].time_us) / 1000;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        uint64_t elapsed = (load.elapsed - g_app_audio_data.afe_load[prev].elapsed) * portNUM_PROCESSORS;
+        uint64_t busy = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            busy += load.busy[core] - g_app_audio_data.afe_load[prev].busy[core];
+        }
+        ESP_LOGI(TAG, "AFE profile %s ran %" PRId64 " ms, CPU load %" PRIu32 "%%", audio_recorder_afe_profile_name(prev),
+                 period_ms, elapsed ? (uint32_t)(busy * 100 / elapsed) : 0);
+#else
+        ESP_LOGI(TAG, "AFE profile %s ran %" PRId64 " ms", audio_recorder_afe_profile_name(prev), period_ms);
+#endif
+        g_app_audio_data.afe_load[prev] = load;
+    }
 
+    g_app_audio_data.afe_profile = profile;
+    g_app_audio_data.afe_profile_since_us = esp_timer_get_time();
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    g_app_audio_data.afe_run_start = portGET_RUN_TIME_COUNTER_VALUE();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        g_app_audio_data.afe_idle_start[core] = ulTaskGetIdleRunTimeCounterForCore(core);
+    }
+#endif
+    g_app_audio_data.afe_load[profile].entries++;
     return ESP_OK;
 }
 
@@ -461,3 +1143,15 @@ esp_err_t app_audio_play_media_async(const char *media_url, const uint8_t *data,
 {
     return audio_playback_play_media_async(g_app_audio_data.playback_handle, media_url, data, data_len);
 }
+
+esp_err_t app_audio_cache_media(const char *media_url, const uint8_t *data, size_t data_len)
+{
+#if CONFIG_APP_AUDIO_CACHE_MEDIA
+    if (!g_app_audio_data.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return audio_playback_cache_media(g_app_audio_data.playback_handle, media_url, data, data_len);
+#else
+    return ESP_OK;
+#endif
+}
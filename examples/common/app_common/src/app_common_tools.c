@@ -17,6 +17,16 @@
 
 static const char *TAG = "app_common_tools";
 
+#define APP_COMMON_COMMAND_VOLUME_STEP 10
+
+/* English phrases, for the MultiNet models that take text */
+static const audio_recorder_command_t s_commands[] = {
+    { APP_COMMON_COMMAND_VOLUME_UP, "volume up" },
+    { APP_COMMON_COMMAND_VOLUME_UP, "turn up the volume" },
+    { APP_COMMON_COMMAND_VOLUME_DOWN, "volume down" },
+    { APP_COMMON_COMMAND_VOLUME_DOWN, "turn down the volume" },
+};
+
 static void reminder_timer_callback(void *arg)
 {
     char *task = (char *)arg;
@@ -157,3 +167,38 @@ esp_err_t app_common_tools_set_volume_handler(esp_agent_handle_t handle, const c
     }
     return err;
 }
+
+const audio_recorder_command_t *app_common_tools_get_commands(size_t *count)
+{
+    *count = sizeof(s_commands) / sizeof(s_commands[0]);
+    return s_commands;
+}
+
+esp_err_t app_common_tools_run_command(int command)
+{
+    esp_err_t err = ESP_OK;
+    char *result = NULL;
+
+    switch (command) {
+        case APP_COMMON_COMMAND_VOLUME_UP:
+        case APP_COMMON_COMMAND_VOLUME_DOWN: {
+            uint8_t current = 0;
+            ESP_RETURN_ON_ERROR(app_audio_get_playback_volume(&current), TAG, "Failed to get volume");
+            int volume = current + (command == APP_COMMON_COMMAND_VOLUME_UP ? APP_COMMON_COMMAND_VOLUME_STEP : -APP_COMMON_COMMAND_VOLUME_STEP);
+            esp_agent_tool_param_t param = {
+                .name = "volume",
+                .type = ESP_AGENT_PARAM_TYPE_INT,
+                .value.i = volume < 0 ? 0 : volume > 100 ? 100 : volume,
+            };
+            err = app_common_tools_set_volume_handler(NULL, TOOL_NAME_SET_VOLUME, &param, 1, NULL, &result);
+            break;
+        }
+        default:
+            ESP_LOGW(TAG, "Unknown voice command: %d", command);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_LOGI(TAG, "Voice command %d served locally%s%s", command, result ? ": " : "", result ? result : "");
+    free(result);
+    return err;
+}
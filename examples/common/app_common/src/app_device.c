@@ -11,6 +11,7 @@
 #include "app_agent.h"
 #include "app_audio.h"
 #include "app_device.h"
+#include "app_common_tools.h"
 #include "app_capacitive_touch.h"
 #include "app_touch_press.h"
 #include "board_defs.h"
@@ -34,6 +35,7 @@ typedef enum {
     DEVICE_ACTION_MICROPHONE_START,
     DEVICE_ACTION_MICROPHONE_PAUSE,
     DEVICE_ACTION_MICROPHONE_STOP,
+    DEVICE_ACTION_MICROPHONE_MUTE,
     DEVICE_ACTION_SPEAKER_START,
     DEVICE_ACTION_SPEAKER_STOP,
     DEVICE_ACTION_SLEEP_TIMER_START,
@@ -54,6 +56,7 @@ typedef struct {
     bool init_done;
     bool wakeup;
     bool wakeup_start_pending;
+    bool stream_ended;          /* The endpointer ended the audio stream of the current turn */
     esp_timer_handle_t sleep_timer;
     bool reminder_active;
     esp_timer_handle_t reminder_complete_timer;
@@ -159,6 +162,11 @@ static void device_perform_action(device_action_t action)
             device_update_led(false);
             break;
 
+        case DEVICE_ACTION_MICROPHONE_MUTE:
+            app_audio_microphone_set_state(MICROPHONE_STATE_MUTE);
+            device_update_led(false);
+            break;
+
         case DEVICE_ACTION_SPEAKER_START:
             app_audio_speaker_start();
             break;
@@ -204,9 +212,14 @@ void device_process_event(app_device_event_t event, void *data)
                 break;
             }
 
-            device_perform_action(DEVICE_ACTION_MICROPHONE_PAUSE);
+            /* No keepalives once the stream has been ended */
+            device_perform_action(g_device_data.stream_ended ? DEVICE_ACTION_MICROPHONE_MUTE : DEVICE_ACTION_MICROPHONE_PAUSE);
             device_perform_action(DEVICE_ACTION_SPEAKER_START);
             device_perform_action(DEVICE_ACTION_SLEEP_TIMER_STOP);
+#if CONFIG_APP_AUDIO_BARGE_IN
+            /* Listen over the playback, with AEC */
+            app_audio_set_afe_profile(AUDIO_RECORDER_AFE_PROFILE_FULL_DUPLEX);
+#endif
 
             g_device_data.state = DEVICE_STATE_SPEAKING;
             break;
@@ -231,6 +244,9 @@ void device_process_event(app_device_event_t event, void *data)
                 break;
             }
 
+            /* Awake from here on, also while the agent connects: the pre-roll needs the VAD onset */
+            app_audio_set_afe_profile(AUDIO_RECORDER_AFE_PROFILE_LISTENING);
+
             if (!app_agent_is_active()) {
                 g_device_data.wakeup_start_pending = true;
                 app_agent_connect();
@@ -240,7 +256,11 @@ void device_process_event(app_device_event_t event, void *data)
             if (g_device_data.state == DEVICE_STATE_IDLE){
                 app_audio_play_media_async("embed://audio/0_wakeup.mp3", wakeup_mp3_start, wakeup_mp3_end - wakeup_mp3_start);
                 app_agent_speech_conversation_start();
+            } else if (g_device_data.stream_ended) {
+                /* The last turn's stream was ended on the device, the next one needs a new stream */
+                app_agent_speech_conversation_start();
             }
+            g_device_data.stream_ended = false;
 
             device_perform_action(DEVICE_ACTION_SPEAKER_STOP);
             device_perform_action(DEVICE_ACTION_MICROPHONE_START);
@@ -258,7 +278,11 @@ void device_process_event(app_device_event_t event, void *data)
             device_perform_action(DEVICE_ACTION_MICROPHONE_STOP);
             device_perform_action(DEVICE_ACTION_SLEEP_TIMER_STOP);
 
-            app_agent_speech_conversation_end();
+            if (!g_device_data.stream_ended) {
+                app_agent_speech_conversation_end();
+            }
+            g_device_data.stream_ended = false;
+            app_audio_set_afe_profile(AUDIO_RECORDER_AFE_PROFILE_IDLE_WAKE);
 
             device_notify_state_changed(APP_DEVICE_SYSTEM_STATE_SLEEP);
             g_device_data.state = DEVICE_STATE_IDLE;
@@ -276,6 +300,57 @@ void device_process_event(app_device_event_t event, void *data)
             }
             break;
 
+        case DEVICE_EVENT_BARGE_IN:
+        case DEVICE_EVENT_AGENT_BARGE_IN:
+            if (g_device_data.state != DEVICE_STATE_SPEAKING) {
+                break;
+            }
+
+            app_audio_speaker_barge_in();
+            if (event == DEVICE_EVENT_BARGE_IN) {
+                app_agent_speech_barge_in();
+            }
+
+            /* Wakeup event will take care of stopping speaker and turning on microphone*/
+            g_device_data.state = DEVICE_STATE_LISTENING;
+            app_device_event_enqueue(DEVICE_EVENT_WAKEUP);
+            break;
+
+        case DEVICE_EVENT_ENDPOINT:
+            if (g_device_data.state != DEVICE_STATE_LISTENING || g_device_data.stream_ended) {
+                break;
+            }
+
+            /* End the turn now instead of waiting for the server's VAD, and stop sending trailing silence.
+             * The sleep timer keeps running in case no response comes. */
+            ESP_LOGI(TAG, "End of speech detected locally, ending the audio stream");
+            device_perform_action(DEVICE_ACTION_MICROPHONE_MUTE);
+            app_agent_speech_conversation_end();
+            g_device_data.stream_ended = true;
+            break;
+
+        case DEVICE_EVENT_COMMAND:
+            /* Also while the agent is still connecting after the wake word, or already answering */
+            if (!has_data || (g_device_data.state == DEVICE_STATE_IDLE && !g_device_data.wakeup_start_pending)) {
+                break;
+            }
+
+            /* Served on the device. The phrase was streamed to the agent too: close the stream, stop the
+             * response to it and drop what arrives of it. Nothing was sent while still connecting. */
+            if (!g_device_data.wakeup_start_pending && !g_device_data.stream_ended) {
+                app_agent_speech_conversation_end();
+                g_device_data.stream_ended = true;
+            }
+            if (!g_device_data.wakeup_start_pending) {
+                app_agent_speech_barge_in();
+                app_audio_speaker_barge_in();
+            }
+            app_common_tools_run_command(event_data.command);
+            g_device_data.wakeup_start_pending = false;
+            app_device_event_enqueue(DEVICE_EVENT_SLEEP);
+            app_audio_trigger_sleep();
+            break;
+
         case DEVICE_EVENT_FACTORY_RESET:
             device_set_text(APP_DEVICE_TEXT_TYPE_SYSTEM, "Release to factory reset");
             break;
@@ -418,6 +493,14 @@ esp_err_t app_device_init(app_device_config_t *config)
     // Initialize reminder state
     g_device_data.reminder_active = false;
 
+    /* Decode the chimes now rather than at the wake word */
+    if (app_audio_cache_media("embed://audio/0_wakeup.mp3", wakeup_mp3_start, wakeup_mp3_end - wakeup_mp3_start) != ESP_OK) {
+        ESP_LOGW(TAG, "Wakeup chime not cached");
+    }
+    if (app_audio_cache_media("embed://audio/0_reminder.mp3", finish_reminder_mp3_start, finish_reminder_mp3_end - finish_reminder_mp3_start) != ESP_OK) {
+        ESP_LOGW(TAG, "Reminder chime not cached");
+    }
+
     g_device_data.init_done = true;
     device_update_led(false);
 
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Compare two runs of the agent microbenchmarks, the sample conversion benchmarks or the
+audio pipeline benchmark.
+
+Each input is a console log or a file holding the JSON lines printed by
+`agent-bench`, `convert-bench` or `pipeline-bench` (or the host apps with the benchmark enabled). Other lines
+are ignored, so the raw serial output can be passed as is.
+
+Results are matched by bench name and, for the conversion benchmarks, by implementation (scalar or
+pie), which share the bench names.
+
+Exits with status 1 if any metric regressed by more than --threshold percent.
+"""
+
+import argparse
+import json
+import sys
+
+METRICS = ('ns_per_msg', 'allocs_per_msg', 'peak_heap_bytes', 'ns_per_sample', 'capture_us', 'end_to_end_us')
+
+
+def load(path):
+    results = {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            start = line.find('{"suite"')
+            if start < 0:
+                continue
+            try:
+                entry = json.loads(line[start:])
+            except json.JSONDecodeError:
+                continue
+            if 'bench' in entry:
+                results[(entry['bench'], entry.get('impl', ''))] = entry
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('baseline')
+    parser.add_argument('candidate')
+    parser.add_argument('--threshold', type=float, default=5.0, help='regression threshold in percent (default: 5)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    candidate = load(args.candidate)
+    if not baseline or not candidate:
+        sys.exit('No benchmark results found')
+
+    regressions = 0
+    print('%-40s %-8s %-20s %12s %12s %8s' % ('bench', 'impl', 'metric', 'baseline', 'candidate', 'delta'))
+    for key in sorted(set(baseline) & set(candidate)):
+        name, impl = key
+        for metric in METRICS:
+            old = baseline[key].get(metric)
+            new = candidate[key].get(metric)
+            if old is None or new is None:
+                continue
+            delta = (new - old) * 100.0 / old if old else (0.0 if new == old else float('inf'))
+            flag = ''
+            if delta > args.threshold:
+                flag = '  REGRESSION'
+                regressions += 1
+            print('%-40s %-8s %-20s %12.2f %12.2f %+7.1f%%%s' % (name, impl, metric, old, new, delta, flag))
+
+    for key in sorted(set(baseline) ^ set(candidate)):
+        print('%-40s %-8s only in %s' % (key[0], key[1], 'baseline' if key in baseline else 'candidate'))
+
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Extract and inspect agent WebSocket captures.
+
+  extract  Pull the capture printed by `agent-capture dump` out of a console log
+  show     Print the records of a capture file, with inter-frame timing
+  stats    Summarize a capture: frame counts, sizes and gaps per direction
+  frames   Write the speech frames of a capture to a frame file for the soak harness
+
+The capture format is described in components/agent/include/esp_agent_capture.h.
+"""
+
+import argparse
+import base64
+import struct
+import sys
+
+MAGIC = 0x50434145
+HEADER = struct.Struct('<IHHII')
+RECORD = struct.Struct('<IIBBBB')
+
+DIRECTIONS = {0: 'rx', 1: 'tx', 2: 'event'}
+OPCODES = {0: 'cont', 1: 'text', 2: 'binary', 8: 'close', 9: 'ping', 10: 'pong'}
+
+BEGIN = '-----BEGIN AGENT CAPTURE-----'
+END = '-----END AGENT CAPTURE-----'
+
+
+def parse(data):
+    magic, version, header_size, records, dropped = HEADER.unpack_from(data)
+    if magic != MAGIC or version != 1:
+        sys.exit('Not an agent capture (magic %#x, version %d)' % (magic, version))
+    offset = header_size
+    out = []
+    for _ in range(records):
+        timestamp_us, length, direction, op_code, flags, _ = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        out.append((timestamp_us, direction, op_code, flags, data[offset:offset + length]))
+        offset += length
+    return dropped, out
+
+
+def cmd_extract(args):
+    captures = []
+    current = None
+    with open(args.log, errors='replace') as f:
+        for line in f:
+            line = line.strip()
+            if line.endswith(BEGIN):
+                current = []
+            elif line.endswith(END) and current is not None:
+                captures.append(base64.b64decode(''.join(current)))
+                current = None
+            elif current is not None:
+                current.append(line.split()[-1] if line else '')
+    if not captures:
+        sys.exit('No capture found in %s' % args.log)
+    with open(args.output, 'wb') as f:
+        f.write(captures[args.index])
+    print('Wrote %d bytes to %s (%d captures found)' % (len(captures[args.index]), args.output, len(captures)))
+
+
+def cmd_show(args):
+    with open(args.capture, 'rb') as f:
+        dropped, records = parse(f.read())
+    previous = None
+    for timestamp_us, direction, op_code, flags, payload in records:
+        gap_ms = 0 if previous is None else ((timestamp_us - previous) & 0xFFFFFFFF) / 1000
+        previous = timestamp_us
+        if direction == 2:
+            desc = 'event %d' % op_code
+        else:
+            desc = '%-6s %6d B%s%s' % (OPCODES.get(op_code, op_code), len(payload),
+                                       '' if flags & 1 else ' (partial)', ' ERROR' if flags & 2 else '')
+        text = ''
+        if op_code == 1 and direction != 2:
+            text = payload[:args.width].decode(errors='replace')
+        print('%10.3f ms  +%8.3f  %-5s %s  %s' % (timestamp_us / 1000, gap_ms, DIRECTIONS.get(direction, direction), desc, text))
+    if dropped:
+        print('%d records dropped (buffer overrun)' % dropped)
+
+
+def cmd_stats(args):
+    with open(args.capture, 'rb') as f:
+        dropped, records = parse(f.read())
+    for direction in (0, 1):
+        frames = [r for r in records if r[1] == direction]
+        if not frames:
+            continue
+        sizes = [len(r[4]) for r in frames]
+        gaps = [((b[0] - a[0]) & 0xFFFFFFFF) / 1000 for a, b in zip(frames, frames[1:])]
+        print('%s: %d frames, %d bytes, max frame %d B' % (DIRECTIONS[direction], len(frames), sum(sizes), max(sizes)))
+        if gaps:
+            gaps.sort()
+            print('    gap ms: median %.1f, p95 %.1f, max %.1f' % (gaps[len(gaps) // 2], gaps[int(len(gaps) * 0.95)], gaps[-1]))
+    print('dropped: %d' % dropped)
+
+
+def cmd_frames(args):
+    with open(args.capture, 'rb') as f:
+        _, records = parse(f.read())
+    direction = 0 if args.direction == 'rx' else 1
+    frames = []
+    current = None
+    for _, rec_direction, op_code, flags, payload in records:
+        if rec_direction != direction:
+            continue
+        if op_code == 2:
+            current = bytearray(payload)
+        elif op_code == 0 and current is not None:
+            current += payload
+        else:
+            continue
+        if flags & 1:
+            frames.append(bytes(current))
+            current = None
+    if not frames:
+        sys.exit('No %s speech frames in %s' % (args.direction, args.capture))
+    # Each frame is stored as a 16-bit little endian length followed by the frame
+    with open(args.output, 'wb') as f:
+        for frame in frames:
+            f.write(struct.pack('<H', len(frame)) + frame)
+    print('Wrote %d frames to %s' % (len(frames), args.output))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('extract', help='extract a capture from a console log')
+    p.add_argument('log')
+    p.add_argument('-o', '--output', default='capture.bin')
+    p.add_argument('-i', '--index', type=int, default=-1, help='capture to extract if the log has several (default: last)')
+    p.set_defaults(func=cmd_extract)
+
+    p = sub.add_parser('show', help='print the records of a capture')
+    p.add_argument('capture')
+    p.add_argument('-w', '--width', type=int, default=80, help='characters of text payload to print')
+    p.set_defaults(func=cmd_show)
+
+    p = sub.add_parser('stats', help='summarize a capture')
+    p.add_argument('capture')
+    p.set_defaults(func=cmd_stats)
+
+    p = sub.add_parser('frames', help='write the speech frames of a capture to a soak frame file')
+    p.add_argument('capture')
+    p.add_argument('-o', '--output', default='frames.bin')
+    p.add_argument('-d', '--direction', choices=('tx', 'rx'), default='tx',
+                   help='uploaded (tx, default) or downloaded (rx) speech')
+    p.set_defaults(func=cmd_frames)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()
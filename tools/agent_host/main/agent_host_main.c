@@ -0,0 +1,300 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <esp_agent.h>
+
+static const char *TAG = "agent_host";
+
+#define AGENT_HOST_STARTED_BIT      BIT0
+#define AGENT_HOST_TURN_DONE_BIT    BIT1
+#define AGENT_HOST_DISCONNECTED_BIT BIT2
+
+#define AGENT_HOST_START_TIMEOUT_MS 5000
+
+typedef struct {
+    EventGroupHandle_t event_group;
+    uint32_t disconnects;
+    uint32_t tool_calls;
+    uint32_t text_messages;
+} agent_host_ctx_t;
+
+static agent_host_ctx_t s_ctx;
+
+static esp_err_t echo_tool_handler(esp_agent_handle_t handle, const char *tool_name, esp_agent_tool_param_t params[], size_t num_params, void *user_data, char **result)
+{
+    const char *text = "";
+    for (size_t i = 0; i < num_params; i++) {
+        if (strcmp(params[i].name, "text") == 0 && params[i].type == ESP_AGENT_PARAM_TYPE_STRING) {
+            text = params[i].value.s;
+        }
+    }
+
+    s_ctx.tool_calls++;
+    *result = strdup(text);
+    return *result ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static void agent_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    esp_agent_message_data_t *data = (esp_agent_message_data_t *)event_data;
+
+    switch (event_id) {
+        case ESP_AGENT_EVENT_START:
+            ESP_LOGI(TAG, "Conversation started: %s", data->start.conversation_id);
+            xEventGroupSetBits(s_ctx.event_group, AGENT_HOST_STARTED_BIT);
+            break;
+        case ESP_AGENT_EVENT_DISCONNECTED:
+            s_ctx.disconnects++;
+            xEventGroupClearBits(s_ctx.event_group, AGENT_HOST_STARTED_BIT);
+            xEventGroupSetBits(s_ctx.event_group, AGENT_HOST_DISCONNECTED_BIT);
+            break;
+        case ESP_AGENT_EVENT_DATA_TYPE_TEXT:
+            s_ctx.text_messages++;
+            if (data->text.generation_stage == ESP_AGENT_MESSAGE_GENERATION_STAGE_FINAL) {
+                ESP_LOGI(TAG, "Assistant: %s", data->text.text);
+            }
+            break;
+        case ESP_AGENT_EVENT_USAGE:
+            ESP_LOGD(TAG, "Turn: %" PRIu32 " ms, %" PRIu32 " tool calls", data->usage.duration_ms, data->usage.tool_calls);
+            xEventGroupSetBits(s_ctx.event_group, AGENT_HOST_TURN_DONE_BIT);
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_err_t agent_host_connect(esp_agent_handle_t handle)
+{
+    xEventGroupClearBits(s_ctx.event_group, AGENT_HOST_STARTED_BIT | AGENT_HOST_DISCONNECTED_BIT);
+
+    esp_err_t err = esp_agent_start(handle, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(s_ctx.event_group, AGENT_HOST_STARTED_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(AGENT_HOST_START_TIMEOUT_MS));
+    return (bits & AGENT_HOST_STARTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static int agent_host_replay(esp_agent_handle_t handle, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *log = malloc(len > 0 ? len : 1);
+    if (log == NULL || fread(log, 1, len, f) != (size_t)len) {
+        ESP_LOGE(TAG, "Failed to read %s", path);
+        fclose(f);
+        free(log);
+        return 1;
+    }
+    fclose(f);
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = esp_agent_capture_replay(handle, log, len, CONFIG_AGENT_HOST_REPLAY_SPEED);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    free(log);
+
+    /* Let the message task and the event loop drain */
+    vTaskDelay(pdMS_TO_TICKS(500));
+
+    printf("replay: %s in %" PRId64 " us\n", esp_err_to_name(err), elapsed_us);
+    printf("local tool calls: %" PRIu32 ", text messages: %" PRIu32 "\n", s_ctx.tool_calls, s_ctx.text_messages);
+    return err == ESP_OK ? 0 : 1;
+}
+
+#if CONFIG_AGENT_HOST_SOAK
+/* Frames are stored as a 16-bit little endian length followed by the frame, the file is read in a loop */
+static esp_err_t soak_read_frame(void *user_data, uint8_t *buf, size_t buf_size, size_t *len)
+{
+    FILE *f = (FILE *)user_data;
+    uint8_t hdr[2];
+
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        rewind(f);
+        if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    size_t frame_len = hdr[0] | (hdr[1] << 8);
+    if (frame_len == 0 || frame_len > buf_size || fread(buf, 1, frame_len, f) != frame_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *len = frame_len;
+    return ESP_OK;
+}
+
+static int agent_host_soak(esp_agent_handle_t handle)
+{
+    esp_agent_soak_config_t config = ESP_AGENT_SOAK_DEFAULT_CONFIG();
+    FILE *f = NULL;
+
+    config.handle = handle;
+    config.turns = CONFIG_AGENT_HOST_SOAK_TURNS;
+    config.frame_interval_ms = CONFIG_AGENT_HOST_SOAK_FRAME_INTERVAL_MS;
+    config.tool_every = CONFIG_AGENT_HOST_TOOL_EVERY;
+    config.tool_name = "echo";
+    config.turn_timeout_ms = CONFIG_AGENT_HOST_TURN_TIMEOUT_MS;
+
+    if (strlen(CONFIG_AGENT_HOST_SOAK_AUDIO_FILE) > 0) {
+        f = fopen(CONFIG_AGENT_HOST_SOAK_AUDIO_FILE, "rb");
+        if (f == NULL) {
+            ESP_LOGE(TAG, "Failed to open %s", CONFIG_AGENT_HOST_SOAK_AUDIO_FILE);
+            return 1;
+        }
+        config.read_frame = soak_read_frame;
+        config.user_data = f;
+    }
+
+    esp_err_t err = esp_agent_soak_run(&config);
+    if (f) {
+        fclose(f);
+    }
+    return err == ESP_OK ? 0 : 1;
+}
+#endif /* CONFIG_AGENT_HOST_SOAK */
+
+void app_main(void)
+{
+    uint32_t turns_ok = 0;
+    uint32_t turns_failed = 0;
+    uint32_t reconnects = 0;
+    int64_t latency_total_us = 0;
+    int64_t latency_min_us = INT64_MAX;
+    int64_t latency_max_us = 0;
+    char message[64];
+
+#if CONFIG_AGENT_HOST_BENCH
+    exit(esp_agent_bench_run(0, NULL) == ESP_OK ? 0 : 1);
+#endif
+
+    s_ctx.event_group = xEventGroupCreate();
+
+#if CONFIG_AGENT_HOST_SOAK
+    esp_agent_audio_config_t audio_config = {
+        .format = ESP_AGENT_CONVERSATION_AUDIO_FORMAT_OPUS,
+        .sample_rate = 16000,
+        .frame_duration = 60,
+    };
+#endif
+
+    esp_agent_config_t config = {
+        .agent_id = "stub_agent",
+        .refresh_token = "stub_refresh_token",
+#if CONFIG_AGENT_HOST_SOAK
+        .conversation_type = ESP_AGENT_CONVERSATION_SPEECH,
+        .upload_audio_config = &audio_config,
+        .download_audio_config = &audio_config,
+#else
+        .conversation_type = ESP_AGENT_CONVERSATION_TEXT,
+#endif
+    };
+
+    esp_agent_handle_t handle = esp_agent_init(&config);
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Failed to initialize agent");
+        exit(1);
+    }
+
+    esp_agent_register_event_handler(handle, ESP_EVENT_ANY_ID, agent_event_handler, NULL, NULL);
+    esp_agent_register_local_tool(handle, "echo", echo_tool_handler, NULL);
+
+    if (strlen(CONFIG_AGENT_HOST_REPLAY_FILE) > 0) {
+        int status = agent_host_replay(handle, CONFIG_AGENT_HOST_REPLAY_FILE);
+        esp_agent_deinit(handle);
+        exit(status);
+    }
+
+#if CONFIG_AGENT_HOST_SOAK
+    int status = agent_host_soak(handle);
+    esp_agent_deinit(handle);
+    exit(status);
+#endif
+
+    if (agent_host_connect(handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to connect to %s, is the stub server running?", CONFIG_ESP_AGENT_API_ENDPOINT);
+        esp_agent_deinit(handle);
+        exit(1);
+    }
+
+    for (int turn = 1; turn <= CONFIG_AGENT_HOST_TURNS; turn++) {
+        if (!(xEventGroupGetBits(s_ctx.event_group) & AGENT_HOST_STARTED_BIT)) {
+            reconnects++;
+            if (agent_host_connect(handle) != ESP_OK) {
+                ESP_LOGW(TAG, "Reconnect failed");
+                turns_failed++;
+                continue;
+            }
+        }
+
+        if (CONFIG_AGENT_HOST_TOOL_EVERY > 0 && turn % CONFIG_AGENT_HOST_TOOL_EVERY == 0) {
+            snprintf(message, sizeof(message), "tool:echo {\"text\": \"turn %d\"}", turn);
+        } else {
+            snprintf(message, sizeof(message), "turn %d", turn);
+        }
+
+        xEventGroupClearBits(s_ctx.event_group, AGENT_HOST_TURN_DONE_BIT);
+        int64_t start_us = esp_timer_get_time();
+        if (esp_agent_send_text(handle, message, pdMS_TO_TICKS(100)) != ESP_OK) {
+            turns_failed++;
+            continue;
+        }
+
+        EventBits_t bits = xEventGroupWaitBits(s_ctx.event_group, AGENT_HOST_TURN_DONE_BIT | AGENT_HOST_DISCONNECTED_BIT,
+                                               pdFALSE, pdFALSE, pdMS_TO_TICKS(CONFIG_AGENT_HOST_TURN_TIMEOUT_MS));
+        if (!(bits & AGENT_HOST_TURN_DONE_BIT)) {
+            ESP_LOGW(TAG, "Turn %d %s", turn, (bits & AGENT_HOST_DISCONNECTED_BIT) ? "interrupted by disconnect" : "timed out");
+            turns_failed++;
+            if (!(bits & AGENT_HOST_DISCONNECTED_BIT)) {
+                esp_agent_stop(handle);
+                xEventGroupClearBits(s_ctx.event_group, AGENT_HOST_STARTED_BIT);
+            }
+            continue;
+        }
+
+        int64_t latency_us = esp_timer_get_time() - start_us;
+        latency_total_us += latency_us;
+        latency_min_us = latency_us < latency_min_us ? latency_us : latency_min_us;
+        latency_max_us = latency_us > latency_max_us ? latency_us : latency_max_us;
+        turns_ok++;
+    }
+
+    esp_agent_usage_stats_t usage = {0};
+    esp_agent_get_usage_stats(handle, &usage);
+
+    printf("turns: %" PRIu32 " ok, %" PRIu32 " failed\n", turns_ok, turns_failed);
+    if (turns_ok) {
+        printf("turn latency: min %" PRId64 " us, avg %" PRId64 " us, max %" PRId64 " us\n",
+               latency_min_us, latency_total_us / turns_ok, latency_max_us);
+    }
+    printf("local tool calls: %" PRIu32 ", text messages: %" PRIu32 "\n", s_ctx.tool_calls, s_ctx.text_messages);
+    printf("disconnects: %" PRIu32 ", reconnects: %" PRIu32 "\n", s_ctx.disconnects, reconnects);
+    printf("server usage: %" PRIu32 " transactions, %" PRIu64 " input tokens, %" PRIu64 " output tokens\n",
+           usage.transactions, usage.input_tokens, usage.output_tokens);
+
+    esp_agent_deinit(handle);
+    exit(turns_failed ? 1 : 0);
+}
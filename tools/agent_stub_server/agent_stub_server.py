@@ -0,0 +1,365 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Local stand-in for the ESP Private Agents API.
+
+Serves the token endpoint and the agent WebSocket on localhost, so that
+components/agent can be exercised without the cloud (for example from the
+linux target host app in tools/agent_host). Only the Python standard library
+is used.
+
+The protocol subset implemented here is:
+  - POST /user/auth/tokens              -> {"access_token": ...}
+  - GET  /user/agents/<id>/ws?token=... -> WebSocket
+      handshake          -> handshake_ack
+      user (text)        -> [tool_request] -> assistant (speculative, final)
+      tool_response      -> continues the pending turn
+      audio_stream_start/binary/audio_stream_end
+                         -> user transcript, audio echoed back between
+                            audio_stream_start and audio_stream_end
+    Every turn also emits usage_info, tool_call_info/tool_result_info (when a
+    tool was used) and transaction_end.
+
+A text message starting with "tool:<name> <json>" makes the server call that
+local tool on the device, e.g. "tool:echo {\"text\": \"hi\"}".
+
+Fault injection (all deterministic for a given --seed):
+  --delay-ms / --jitter-ms   delay before every server message
+  --fragment BYTES           split text messages into continuation frames
+  --disconnect-after N       drop the TCP connection after N server messages
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import logging
+import random
+import struct
+import time
+import uuid
+
+WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+OP_CONT = 0x0
+OP_TEXT = 0x1
+OP_BINARY = 0x2
+OP_CLOSE = 0x8
+OP_PING = 0x9
+OP_PONG = 0xA
+
+log = logging.getLogger('agent_stub')
+
+
+class ConnectionDropped(Exception):
+    pass
+
+
+class WebSocket:
+    def __init__(self, reader, writer, args, rng):
+        self.reader = reader
+        self.writer = writer
+        self.args = args
+        self.rng = rng
+        self.sent_messages = 0
+
+    async def read_frame(self):
+        """Return (opcode, payload) of the next complete message."""
+        message_opcode = None
+        payload = bytearray()
+        while True:
+            header = await self.reader.readexactly(2)
+            fin = header[0] & 0x80
+            opcode = header[0] & 0x0F
+            masked = header[1] & 0x80
+            length = header[1] & 0x7F
+            if length == 126:
+                length = struct.unpack('!H', await self.reader.readexactly(2))[0]
+            elif length == 127:
+                length = struct.unpack('!Q', await self.reader.readexactly(8))[0]
+            mask = await self.reader.readexactly(4) if masked else None
+            data = bytearray(await self.reader.readexactly(length))
+            if mask:
+                for i in range(length):
+                    data[i] ^= mask[i % 4]
+
+            if opcode == OP_PING:
+                await self._write_frame(OP_PONG, bytes(data))
+                continue
+            if opcode in (OP_CLOSE, OP_PONG):
+                return opcode, bytes(data)
+
+            if opcode != OP_CONT:
+                message_opcode = opcode
+            payload += data
+            if fin:
+                return message_opcode, bytes(payload)
+
+    async def _write_frame(self, opcode, payload, fin=True):
+        header = bytearray([(0x80 if fin else 0) | opcode])
+        length = len(payload)
+        if length < 126:
+            header.append(length)
+        elif length < 0x10000:
+            header.append(126)
+            header += struct.pack('!H', length)
+        else:
+            header.append(127)
+            header += struct.pack('!Q', length)
+        self.writer.write(bytes(header) + payload)
+        await self.writer.drain()
+
+    async def _inject_faults(self):
+        delay_ms = self.args.delay_ms
+        if self.args.jitter_ms:
+            delay_ms += self.rng.randint(0, self.args.jitter_ms)
+        if delay_ms:
+            await asyncio.sleep(delay_ms / 1000)
+        if self.args.disconnect_after and self.sent_messages >= self.args.disconnect_after:
+            log.info('Dropping connection after %d messages', self.sent_messages)
+            self.writer.transport.abort()
+            raise ConnectionDropped()
+        self.sent_messages += 1
+
+    async def send_json(self, message):
+        await self._inject_faults()
+        payload = json.dumps(message, separators=(',', ':')).encode()
+        log.debug('-> %s', payload.decode())
+        step = self.args.fragment
+        if not step or step >= len(payload):
+            await self._write_frame(OP_TEXT, payload)
+            return
+        for offset in range(0, len(payload), step):
+            opcode = OP_TEXT if offset == 0 else OP_CONT
+            await self._write_frame(opcode, payload[offset:offset + step], fin=offset + step >= len(payload))
+
+    async def send_binary(self, payload):
+        await self._inject_faults()
+        await self._write_frame(OP_BINARY, payload)
+
+    async def close(self):
+        try:
+            await self._write_frame(OP_CLOSE, struct.pack('!H', 1000))
+        except (ConnectionError, RuntimeError):
+            pass
+
+
+class AgentSession:
+    def __init__(self, ws, args):
+        self.ws = ws
+        self.args = args
+        self.conversation_id = None
+        self.pending_turn = None
+        self.audio_frames = []
+
+    async def send_usage(self, prompt):
+        await self.ws.send_json({
+            'type': 'usage_info',
+            'content_type': 'json',
+            'content': {'input_tokens': len(prompt.split()) + 16, 'output_tokens': 8},
+        })
+
+    async def finish_turn(self, reply):
+        await self.ws.send_json({
+            'type': 'assistant',
+            'content_type': 'text',
+            'content': reply[:len(reply) // 2],
+            'metadata': {'role': 'assistant', 'generation_stage': 'speculative'},
+        })
+        await self.ws.send_json({
+            'type': 'assistant',
+            'content_type': 'text',
+            'content': reply,
+            'metadata': {'role': 'assistant', 'generation_stage': 'final'},
+        })
+        await self.ws.send_json({'type': 'transaction_end', 'content_type': 'json', 'content': {}})
+
+    async def on_handshake(self, content):
+        self.conversation_id = content.get('conversationId') or str(uuid.uuid4())
+        await self.ws.send_json({
+            'type': 'handshake_ack',
+            'content_type': 'json',
+            'content': {'conversationId': self.conversation_id},
+        })
+
+    async def on_user_text(self, text):
+        await self.send_usage(text)
+        if not text.startswith('tool:'):
+            await self.finish_turn('You said: ' + text)
+            return
+
+        name, _, raw_input = text[len('tool:'):].partition(' ')
+        try:
+            tool_input = json.loads(raw_input) if raw_input.strip() else {}
+        except json.JSONDecodeError:
+            tool_input = {}
+        request_id = str(uuid.uuid4())
+        self.pending_turn = {'request_id': request_id, 'name': name, 'start': time.monotonic()}
+        await self.ws.send_json({
+            'type': 'tool_call_info',
+            'content_type': 'json',
+            'content': {'tool_call_id': request_id, 'tool_name': name},
+        })
+        await self.ws.send_json({
+            'type': 'tool_request',
+            'content_type': 'json',
+            'content': {'request_id': request_id, 'tool_name': name, 'input': tool_input},
+        })
+
+    async def on_tool_response(self, content):
+        turn = self.pending_turn
+        if not turn or content.get('request_id') != turn['request_id']:
+            log.warning('Unexpected tool response: %s', content)
+            return
+        self.pending_turn = None
+        duration_ms = int((time.monotonic() - turn['start']) * 1000)
+        await self.ws.send_json({
+            'type': 'tool_result_info',
+            'content_type': 'json',
+            'content': {'tool_call_id': turn['request_id'], 'duration_ms': duration_ms},
+        })
+        result = content.get('result', {})
+        await self.finish_turn('Tool %s returned %s: %s' % (turn['name'], result.get('status'), result.get('result', '')))
+
+    async def on_audio_stream_end(self):
+        frames, self.audio_frames = self.audio_frames, []
+        total = sum(len(frame) for frame in frames)
+        transcript = '(%d audio frames, %d bytes)' % (len(frames), total)
+        await self.ws.send_json({
+            'type': 'user',
+            'content_type': 'text',
+            'content': transcript,
+            'metadata': {'role': 'user'},
+        })
+        await self.send_usage(transcript)
+        await self.ws.send_json({'type': 'audio_stream_start', 'content_type': 'json', 'content': {}})
+        for frame in frames:
+            await self.ws.send_binary(frame)
+        await self.ws.send_json({'type': 'audio_stream_end', 'content_type': 'json', 'content': {}})
+        await self.finish_turn('Echoed ' + transcript)
+
+    async def dispatch(self, message):
+        msg_type = message.get('type')
+        content = message.get('content')
+        if msg_type == 'handshake':
+            await self.on_handshake(content or {})
+        elif msg_type == 'user' and isinstance(content, str):
+            await self.on_user_text(content)
+        elif msg_type == 'tool_response':
+            await self.on_tool_response(content or {})
+        elif msg_type == 'audio_stream_start':
+            self.audio_frames = []
+        elif msg_type == 'audio_stream_end':
+            await self.on_audio_stream_end()
+        else:
+            log.warning('Unhandled message type: %s', msg_type)
+
+    async def run(self):
+        while True:
+            opcode, payload = await self.ws.read_frame()
+            if opcode == OP_CLOSE:
+                await self.ws.close()
+                return
+            if opcode == OP_BINARY:
+                self.audio_frames.append(payload)
+                continue
+            if opcode != OP_TEXT:
+                continue
+            log.debug('<- %s', payload.decode(errors='replace'))
+            try:
+                message = json.loads(payload)
+            except json.JSONDecodeError:
+                log.warning('Invalid JSON from device')
+                continue
+            await self.dispatch(message)
+
+
+async def read_http_request(reader):
+    request_line = (await reader.readline()).decode().strip()
+    headers = {}
+    while True:
+        line = (await reader.readline()).decode().strip()
+        if not line:
+            break
+        key, _, value = line.partition(':')
+        headers[key.strip().lower()] = value.strip()
+    body = b''
+    if 'content-length' in headers:
+        body = await reader.readexactly(int(headers['content-length']))
+    method, path, _ = request_line.split(' ', 2)
+    return method, path, headers, body
+
+
+def http_response(writer, status, body=b'', content_type='application/json'):
+    reason = {200: 'OK', 400: 'Bad Request', 404: 'Not Found'}.get(status, 'Error')
+    writer.write(('HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n'
+                  % (status, reason, content_type, len(body))).encode() + body)
+
+
+async def handle_client(reader, writer, args, counter):
+    counter['connections'] += 1
+    rng = random.Random(args.seed + counter['connections'])
+    peer = writer.get_extra_info('peername')
+    try:
+        method, path, headers, body = await read_http_request(reader)
+        log.info('%s %s from %s', method, path.split('?')[0], peer)
+
+        if method == 'POST' and path == '/user/auth/tokens':
+            try:
+                json.loads(body or b'{}')['refresh_token']
+            except (KeyError, json.JSONDecodeError):
+                http_response(writer, 400)
+            else:
+                http_response(writer, 200, json.dumps({'access_token': 'stub-access-token'}).encode())
+            await writer.drain()
+            return
+
+        if not (method == 'GET' and path.startswith('/user/agents/') and headers.get('upgrade', '').lower() == 'websocket'):
+            http_response(writer, 404)
+            await writer.drain()
+            return
+
+        accept = base64.b64encode(hashlib.sha1((headers['sec-websocket-key'] + WS_GUID).encode()).digest()).decode()
+        writer.write(('HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+                      'Sec-WebSocket-Accept: %s\r\n\r\n' % accept).encode())
+        await writer.drain()
+
+        await AgentSession(WebSocket(reader, writer, args, rng), args).run()
+    except (asyncio.IncompleteReadError, ConnectionError, ConnectionDropped):
+        pass
+    finally:
+        log.info('Connection from %s closed', peer)
+        writer.close()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=8765)
+    parser.add_argument('--delay-ms', type=int, default=0, help='delay before each server message')
+    parser.add_argument('--jitter-ms', type=int, default=0, help='random extra delay before each server message')
+    parser.add_argument('--fragment', type=int, default=0, help='split text messages into frames of this many bytes')
+    parser.add_argument('--disconnect-after', type=int, default=0, help='drop the connection after this many server messages')
+    parser.add_argument('--seed', type=int, default=0, help='seed for the jitter generator')
+    parser.add_argument('-v', '--verbose', action='store_true', help='log every message')
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO, format='%(asctime)s %(message)s')
+
+    counter = {'connections': 0}
+    server = await asyncio.start_server(lambda r, w: handle_client(r, w, args, counter), args.host, args.port)
+    log.info('Agent stub server listening on %s:%d', args.host, args.port)
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == '__main__':
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
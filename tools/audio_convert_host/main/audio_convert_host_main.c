@@ -0,0 +1,149 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <audio_convert.h>
+
+static const char *TAG = "audio_convert_host";
+
+#define HOST_STRETCH_BLOCK_SAMPLES 960
+
+static uint32_t host_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void host_put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* Read a 16-bit mono PCM WAV file, returns the samples and their rate */
+static int16_t *host_read_wav(const char *path, size_t *samples, uint32_t *sample_rate)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return NULL;
+    }
+
+    uint8_t hdr[12];
+    uint8_t chunk[8];
+    uint8_t fmt[16] = {0};
+    int16_t *pcm = NULL;
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path);
+        goto end;
+    }
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        uint32_t len = host_le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && len >= sizeof(fmt)) {
+            if (fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt)) {
+                break;
+            }
+            fseek(f, (len - sizeof(fmt) + 1) & ~1u, SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            /* fmt precedes data in a valid file */
+            if (fmt[0] != 1 || fmt[2] != 1 || fmt[14] != 16) {
+                ESP_LOGE(TAG, "%s is not 16-bit mono PCM", path);
+                goto end;
+            }
+            pcm = malloc(len + 1);
+            if (pcm == NULL) {
+                goto end;
+            }
+            *samples = fread(pcm, 1, len, f) / sizeof(int16_t);
+            *sample_rate = host_le32(fmt + 4);
+            goto end;
+        } else {
+            fseek(f, (len + 1) & ~1u, SEEK_CUR);
+        }
+    }
+    ESP_LOGE(TAG, "No audio in %s", path);
+
+end:
+    fclose(f);
+    return pcm;
+}
+
+static bool host_write_wav(const char *path, const int16_t *pcm, size_t samples, uint32_t sample_rate)
+{
+    uint8_t hdr[44] = "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x01\0\0\0\0\0\0\0\0\0\x02\0\x10\0data";
+    uint32_t len = samples * sizeof(int16_t);
+    host_put_le32(hdr + 4, 36 + len);
+    host_put_le32(hdr + 24, sample_rate);
+    host_put_le32(hdr + 28, sample_rate * sizeof(int16_t));
+    host_put_le32(hdr + 40, len);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot create %s", path);
+        return false;
+    }
+    bool ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr) && fwrite(pcm, 1, len, f) == len;
+    fclose(f);
+    return ok;
+}
+
+/* Play a WAV file through the time-stretcher, in blocks as the playback does, and write the result */
+static esp_err_t host_stretch(const char *in_path, const char *out_path, uint16_t speed_pct)
+{
+    size_t samples = 0;
+    uint32_t rate = 0;
+    int16_t *in = host_read_wav(in_path, &samples, &rate);
+    if (in == NULL) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    audio_stretch_handle_t stretch = audio_stretch_create(rate);
+    int16_t *out = NULL;
+    if (stretch == NULL || audio_stretch_set_speed(stretch, speed_pct) != ESP_OK) {
+        ESP_LOGE(TAG, "Unsupported speed %u%%", speed_pct);
+        goto end;
+    }
+    out = malloc(audio_stretch_max_output(stretch, samples) * sizeof(int16_t));
+    if (out == NULL) {
+        goto end;
+    }
+
+    size_t produced = 0;
+    for (size_t pos = 0; pos < samples; pos += HOST_STRETCH_BLOCK_SAMPLES) {
+        size_t n = samples - pos < HOST_STRETCH_BLOCK_SAMPLES ? samples - pos : HOST_STRETCH_BLOCK_SAMPLES;
+        produced += audio_stretch_process(stretch, in + pos, n, out + produced);
+    }
+    produced += audio_stretch_flush(stretch, out + produced);
+
+    if (host_write_wav(out_path, out, produced, rate)) {
+        printf("%s: %.3f s at %" PRIu32 " Hz, %u%% -> %s: %.3f s\n", in_path, (double)samples / rate, rate,
+               speed_pct, out_path, (double)produced / rate);
+        ret = ESP_OK;
+    }
+
+end:
+    audio_stretch_destroy(stretch);
+    free(out);
+    free(in);
+    return ret;
+}
+
+void app_main(void)
+{
+    if (CONFIG_AUDIO_CONVERT_HOST_STRETCH_INPUT[0] != '\0') {
+        exit(host_stretch(CONFIG_AUDIO_CONVERT_HOST_STRETCH_INPUT, CONFIG_AUDIO_CONVERT_HOST_STRETCH_OUTPUT,
+                          CONFIG_AUDIO_CONVERT_HOST_STRETCH_SPEED) == ESP_OK ? 0 : 1);
+    }
+    exit(audio_convert_bench_run(CONFIG_AUDIO_CONVERT_HOST_ITERATIONS, CONFIG_AUDIO_CONVERT_HOST_FILTER) == ESP_OK ? 0 : 1);
+}